@@ -16,6 +16,12 @@
 #include "edict.h"
 #include "timedeventmgr.h"
 
+class CServerNetworkProperty;
+
+// See parallelthink.h
+extern bool g_bParallelThinkActive;
+bool ParallelThink_DeferStateChanged( CServerNetworkProperty *pProp );
+
 //
 // Lightweight base class for networkable data on the server.
 //
@@ -184,6 +190,10 @@ inline void CServerNetworkProperty::NetworkStateForceUpdate()
 
 inline void CServerNetworkProperty::NetworkStateChanged()
 { 
+	// Parallel thinks can't touch the shared edict change info
+	if ( g_bParallelThinkActive && ParallelThink_DeferStateChanged( this ) )
+		return;
+
 	// If we're using the timer, then ignore this call.
 	if ( m_TimerEvent.IsRegistered() )
 	{
@@ -200,6 +210,10 @@ inline void CServerNetworkProperty::NetworkStateChanged()
 
 inline void CServerNetworkProperty::NetworkStateChanged( unsigned short varOffset )
 { 
+	// Parallel thinks can't touch the shared edict change info
+	if ( g_bParallelThinkActive && ParallelThink_DeferStateChanged( this ) )
+		return;
+
 	// If we're using the timer, then ignore this call.
 	if ( m_TimerEvent.IsRegistered() )
 	{
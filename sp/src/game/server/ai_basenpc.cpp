@@ -252,6 +252,7 @@ CAI_Manager g_AI_Manager;
 CAI_Manager::CAI_Manager()
 {
 	m_AIs.EnsureCapacity( MAX_AIS );
+	m_nChangeSerial = 0;
 }
 
 //-------------------------------------
@@ -275,6 +276,7 @@ int CAI_Manager::NumAIs()
 void CAI_Manager::AddAI( CAI_BaseNPC *pAI )
 {
 	m_AIs.AddToTail( pAI );
+	m_nChangeSerial++;
 }
 
 //-------------------------------------
@@ -284,7 +286,10 @@ void CAI_Manager::RemoveAI( CAI_BaseNPC *pAI )
 	int i = m_AIs.Find( pAI );
 
 	if ( i != -1 )
+	{
 		m_AIs.FastRemove( i );
+		m_nChangeSerial++;
+	}
 }
 
 
@@ -344,6 +349,7 @@ CPostFrameNavigationHook *PostFrameNavigationSystem( void )
 bool CPostFrameNavigationHook::Init( void )
 {
 	m_Functors.Purge();
+	m_RouteQueries.Purge();
 	m_bGameFrameRunning = false;
 	return true;
 }
@@ -360,6 +366,32 @@ static void ProcessNavigationQueries( CFunctor **pData, unsigned int nCount )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Route jobs pull queries off the shared list until it runs out
+//-----------------------------------------------------------------------------
+void CPostFrameNavigationHook::ProcessRouteQueries( void )
+{
+	int i;
+	while ( ( i = m_iNextRouteQuery++ ) < m_RouteQueries.Count() )
+	{
+		m_RouteQueries[i]->RunQueuedRoute();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: 
+//-----------------------------------------------------------------------------
+void CPostFrameNavigationHook::WaitForRouteQueries( void )
+{
+	for ( int i = 0; i < m_RouteJobs.Count(); i++ )
+	{
+		m_RouteJobs[i]->WaitForFinishAndRelease();
+	}
+
+	m_RouteJobs.RemoveAll();
+	m_RouteQueries.RemoveAll();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -372,6 +404,8 @@ void CPostFrameNavigationHook::FrameUpdatePreEntityThink( void )
 		g_pQueuedNavigationQueryJob = NULL;
 		m_Functors.Purge();
 	}
+
+	WaitForRouteQueries();
 	
 	if ( ai_post_frame_navigation.GetBool() == false )
 		return;
@@ -384,12 +418,30 @@ void CPostFrameNavigationHook::FrameUpdatePreEntityThink( void )
 //-----------------------------------------------------------------------------
 void CPostFrameNavigationHook::FrameUpdatePostEntityThink( void )
 {
-	if ( ai_post_frame_navigation.GetBool() == false )
-		return;
-
 	// The guts of the NPC will check against this to decide whether or not to queue its navigation calls
 	SetGrameFrameRunning( false );
 
+	// Split the routes between the pool threads. Queries are never left
+	// behind, even if the convar was turned off during the frame.
+	if ( m_RouteQueries.Count() )
+	{
+		m_iNextRouteQuery = 0;
+
+		int nJobs = MIN( m_RouteQueries.Count(), g_pThreadPool->NumThreads() );
+		for ( int i = 0; i < nJobs; i++ )
+		{
+			m_RouteJobs.AddToTail( ThreadExecute( this, &CPostFrameNavigationHook::ProcessRouteQueries ) );
+		}
+
+		if ( !nJobs )
+		{
+			ProcessRouteQueries();
+		}
+	}
+
+	if ( ai_post_frame_navigation.GetBool() == false )
+		return;
+
 	// Throw this off to a thread job
 	g_pQueuedNavigationQueryJob = ThreadExecute( &ProcessNavigationQueries, m_Functors.Base(), m_Functors.Count() );
 }
@@ -406,6 +458,31 @@ void CPostFrameNavigationHook::EnqueueEntityNavigationQuery( CAI_BaseNPC *pNPC,
 	pNPC->SetNavigationDeferred( true );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Queue up a route, see CAI_Pathfinder::QueueRoute()
+//-----------------------------------------------------------------------------
+void CPostFrameNavigationHook::EnqueueRouteQuery( CAI_BaseNPC *pNPC, CAI_Pathfinder *pPathfinder )
+{
+	Assert( !m_RouteJobs.Count() );
+
+	m_RouteQueries.AddToTail( pPathfinder );
+	pNPC->SetNavigationDeferred( true );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops a route that hasn't been taken yet, e.g. when the NPC is removed
+//-----------------------------------------------------------------------------
+void CPostFrameNavigationHook::CancelRouteQuery( CAI_Pathfinder *pPathfinder )
+{
+	if ( m_RouteJobs.Count() )
+	{
+		WaitForRouteQueries();
+		return;
+	}
+
+	m_RouteQueries.FindAndRemove( pPathfinder );
+}
+
 //
 //	Deferred Navigation calls go here
 //
@@ -4327,7 +4404,26 @@ bool CAI_BaseNPC::PreNPCThink()
 
 	g_StartTimeCurThink = 0;
 
-	if ( bUseThinkLimits && VCRGetMode() == VCR_Disabled )
+	if ( g_AI_ThinkScheduler.IsEnabled() && VCRGetMode() == VCR_Disabled )
+	{
+		if ( bUseThinkLimits )
+		{
+			if ( m_iFrameBlocked == gpGlobals->framecount || !g_AI_ThinkScheduler.ShouldThink( this ) )
+			{
+				DbgFrameLimitMsg( "Deferred %d (%d)\n", this, gpGlobals->framecount );
+				m_iFrameBlocked = gpGlobals->framecount;
+				SetNextThink( gpGlobals->curtime );
+				return false;
+			}
+
+			m_iFrameBlocked = -1;
+			m_nLastThinkTick = TIME_TO_TICKS( m_flLastRealThinkTime );
+		}
+
+		// Thinks outside the budget are still measured, they use it up
+		g_StartTimeCurThink = engine->Time();
+	}
+	else if ( bUseThinkLimits && VCRGetMode() == VCR_Disabled )
 	{
 		if ( m_iFrameBlocked == gpGlobals->framecount )
 		{
@@ -4380,7 +4476,13 @@ void CAI_BaseNPC::PostNPCThink( void )
 { 
 	if ( g_StartTimeCurThink != 0.0 && VCRGetMode() == VCR_Disabled )
 	{
-		g_NpcTimeThisFrame += engine->Time() - g_StartTimeCurThink;
+		float flThinkTime = engine->Time() - g_StartTimeCurThink;
+		g_NpcTimeThisFrame += flThinkTime;
+
+		if ( g_AI_ThinkScheduler.IsEnabled() )
+		{
+			g_AI_ThinkScheduler.OnThinkDone( this, flThinkTime );
+		}
 	}
 }
 
@@ -4595,6 +4697,11 @@ void CAI_BaseNPC::NPCThink( void )
 
 				PostRun();
 
+				if ( g_AI_ThinkScheduler.IsEnabled() )
+				{
+					g_AI_ThinkScheduler.AddTimings( bRanDecision );
+				}
+
 				PerformMovement();
 
 				m_bIsMoving = IsMoving();
@@ -9113,6 +9220,9 @@ void CAI_BaseNPC::TaskFail( AI_TaskFailureCode_t code )
 	m_ScheduleState.taskFailureCode = code;
 	SetCondition(COND_TASK_FAILED);
 	Forget( bits_MEMORY_TURNING );
+
+	// A failed task isn't started again for its deferred route
+	m_bRestartingTask = false;
 }
 
 //------------------------------------------------------------------------------
@@ -11026,6 +11136,9 @@ void CAI_BaseNPC::ReportOverThinkLimit( float time )
 		NDebugOverlay::Text( tmp, (char*)(const char *)CFmtStr( "Slow %.1f, %s %.1f ", time, pszMax, max ), false, 1 );
 	}
 
+	if ( g_AI_ThinkScheduler.IsEnabled() )
+		g_AI_ThinkScheduler.ReportLastFrame();
+
 	if ( ai_report_task_timings_on_limit.GetBool() )
 		DumpTaskTimings();
 }
@@ -12448,6 +12561,8 @@ BEGIN_DATADESC( CAI_BaseNPC )
 	//							m_bSelected					DEBUG
 	// 							m_TimeLastShotMark			DEBUG
 	//							m_bDeferredNavigation
+	//							m_bStartingTask
+	//							m_bRestartingTask
 
 
 	// Outputs
@@ -13285,7 +13400,9 @@ bool CAI_BaseNPC::LoadedSchedules(void)
 //-----------------------------------------------------------------------------
 CAI_BaseNPC::CAI_BaseNPC(void)
  :	m_UnreachableEnts( 0, 4 ),
-    m_bDeferredNavigation( false )
+    m_bDeferredNavigation( false ),
+    m_bStartingTask( false ),
+    m_bRestartingTask( false )
 {
 	m_pMotor = NULL;
 	m_pMoveProbe = NULL;
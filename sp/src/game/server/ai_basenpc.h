@@ -26,6 +26,7 @@
 #include "ai_hull.h"
 #include "ai_utils.h"
 #include "ai_moveshoot.h"
+#include "ai_thinkscheduler.h"
 #include "entityoutput.h"
 #include "utlvector.h"
 #include "activitylist.h"
@@ -58,6 +59,7 @@ class CAI_MoveProbe;
 class CAI_LocalNavigator;
 class CAI_TacticalServices;
 class CVarBitVec;
+class CJob;
 class CAI_ScriptedSequence;
 class CSceneEntity;
 class CBaseGrenade;
@@ -519,6 +521,9 @@ public:
 	void RemoveAI( CAI_BaseNPC *pAI );
 
 	bool FindAI( CAI_BaseNPC *pAI )	{ return ( m_AIs.Find( pAI ) != m_AIs.InvalidIndex() ); }
+
+	// Changes whenever an AI is added or removed, and with it the indices
+	int	GetChangeSerial() const		{ return m_nChangeSerial; }
 	
 private:
 	enum
@@ -529,6 +534,7 @@ private:
 	typedef CUtlVector<CAI_BaseNPC *> CAIArray;
 	
 	CAIArray m_AIs;
+	int m_nChangeSerial;
 
 };
 
@@ -841,6 +847,8 @@ private:
 	int					m_iFrameBlocked;
 	bool				m_bInChoreo;
 
+	AI_ThinkScheduleInfo_t m_ThinkSchedule;
+
 	static int			gm_iNextThinkRebalanceTick;
 	static float		gm_flTimeLastSpawn;
 	static int			gm_nSpawnedThisFrame;
@@ -1927,6 +1935,8 @@ public:
 	virtual bool		IsValidShootPosition ( const Vector &vecCoverLocation, CAI_Node *pNode, CAI_Hint const *pHint );
 	virtual bool		TestShootPosition(const Vector &vecShootPos, const Vector &targetPos )	{ return WeaponLOSCondition( vecShootPos, targetPos, false ); }
 	virtual bool		IsCoverPosition( const Vector &vecThreat, const Vector &vecPosition );
+	virtual bool		IsCoverPositionCacheable( void ) { return true; } // False if IsCoverPosition() depends on more than the threat, position and class
+	virtual bool		IsShootPositionCacheable( void ) { return true; } // False if TestShootPosition() depends on more than the threat, position, class, weapon, enemy and shoot offset
 	virtual float		CoverRadius( void ) { return 1024; } // Default cover radius
 	virtual float		GetMaxTacticalLateralMovement( void ) { return MAXTACLAT_IGNORE; }
 
@@ -2340,10 +2350,13 @@ private:
 
 private:
 	bool	m_bDeferredNavigation;	// This NPCs has a navigation query that's being deferred until later in the frame
+	bool	m_bStartingTask;		// Routes asked for while starting a task may be deferred, the task is started again when the route is ready
+	bool	m_bRestartingTask;		// The current task is being started again to pick up its deferred route
 
 public:
 	void	SetNavigationDeferred( bool bState ) { m_bDeferredNavigation = bState; }
 	bool	IsNavigationDeferred( void ) { return m_bDeferredNavigation; }
+	bool	IsStartingTask( void ) { return m_bStartingTask; }
 
 	//-----------------------------------------------------
 protected:
@@ -2356,6 +2369,7 @@ private:
 
 	friend class CAI_SystemHook;
 	friend class CAI_SchedulesManager;
+	friend class CAI_ThinkScheduler;
 	
 	static bool			LoadDefaultSchedules(void);
 
@@ -3503,9 +3517,19 @@ public:
 	
 	void EnqueueEntityNavigationQuery( CAI_BaseNPC *pNPC, CFunctor *functor );
 
+	void EnqueueRouteQuery( CAI_BaseNPC *pNPC, CAI_Pathfinder *pPathfinder );
+	void CancelRouteQuery( CAI_Pathfinder *pPathfinder );
+
 private:
+	void ProcessRouteQueries( void );
+	void WaitForRouteQueries( void );
+
 	CUtlVector<CFunctor *>	m_Functors;
 	bool					m_bGameFrameRunning;
+
+	CUtlVector<CAI_Pathfinder *> m_RouteQueries;
+	CUtlVector<CJob *>		m_RouteJobs;
+	CInterlockedInt			m_iNextRouteQuery;
 };
 
 extern CPostFrameNavigationHook *PostFrameNavigationSystem( void );
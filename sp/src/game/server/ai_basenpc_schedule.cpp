@@ -23,6 +23,7 @@
 #include "ai_hint.h"
 #include "ai_memory.h"
 #include "ai_navigator.h"
+#include "ai_pathfinder.h"
 #include "ai_tacticalservices.h"
 #include "ai_moveprobe.h"
 #include "ai_squadslot.h"
@@ -112,6 +113,7 @@ void CAI_BaseNPC::ClearSchedule( const char *szReason )
 	m_IdealSchedule = SCHED_NONE;
 	m_pSchedule =  NULL;
 	ResetScheduleCurTaskIndex();
+	m_bRestartingTask = false;
 	m_InverseIgnoreConditions.SetAll();
 }
 
@@ -172,6 +174,7 @@ void CAI_BaseNPC::SetSchedule( CAI_Schedule *pNewSchedule )
 	m_pSchedule = pNewSchedule ;
 	ResetScheduleCurTaskIndex();
 	SetTaskStatus( TASKSTATUS_NEW );
+	m_bRestartingTask = false;
 	m_failSchedule = SCHED_NONE;
 	bool bCondInPVS = HasCondition( COND_IN_PVS );
 	m_Conditions.ClearAll();
@@ -252,6 +255,7 @@ void CAI_BaseNPC::NextScheduledTask ( void )
 
 	SetTaskStatus( TASKSTATUS_NEW );
 	IncScheduleCurTaskIndex();
+	m_bRestartingTask = false;
 
 	if ( FScheduleDone() )
 	{
@@ -602,6 +606,7 @@ void CAI_BaseNPC::MaintainSchedule ( void )
 
 	// Reset this at the beginning of the frame
 	Forget( bits_MEMORY_TASK_EXPENSIVE );
+	SetNavigationDeferred( false );
 
 	// UNDONE: Tune/fix this MAX_TASKS_RUN... This is just here so infinite loops are impossible
 	bool bStopProcessing = false;
@@ -714,7 +719,7 @@ void CAI_BaseNPC::MaintainSchedule ( void )
 
 		if ( GetTaskStatus() == TASKSTATUS_NEW )
 		{	
-			if ( GetScheduleCurTaskIndex() == 0 )
+			if ( GetScheduleCurTaskIndex() == 0 && !m_bRestartingTask )
 			{
 				int globalId = GetCurSchedule()->GetId();
 				int localId = GetLocalScheduleId( globalId ); // if localId == -1, then it came from a behavior
@@ -742,6 +747,10 @@ void CAI_BaseNPC::MaintainSchedule ( void )
 			AI_PROFILE_SCOPE_BEGIN_( pszTaskName );
 			AI_PROFILE_SCOPE_BEGIN(CAI_BaseNPC_StartTask);
 
+			// Routes are only deferred the first time a task starts
+			m_bStartingTask = !m_bRestartingTask;
+			m_bRestartingTask = false;
+
 #ifdef MAPBASE_VSCRIPT
 			if (m_ScriptScope.IsInitialized() && g_Hook_StartTask.CanRunInScope( m_ScriptScope ))
 			{
@@ -761,6 +770,17 @@ void CAI_BaseNPC::MaintainSchedule ( void )
 #endif
 			StartTask( pTask );
 
+			m_bStartingTask = false;
+
+			// The task's route is being built after the frame. Start the task
+			// again on the next think, the route will be waiting for it then.
+			if ( GetPathfinder()->IsQueuedRoutePending() )
+			{
+				ClearCondition( COND_TASK_FAILED );
+				SetTaskStatus( TASKSTATUS_NEW );
+				m_bRestartingTask = true;
+			}
+
 			AI_PROFILE_SCOPE_END();
 			AI_PROFILE_SCOPE_END();
 
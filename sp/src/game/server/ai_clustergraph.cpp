@@ -0,0 +1,412 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Cluster level abstraction of the AI node graph, used to plan
+//			long routes before refining them through the full graph.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "utlpriorityqueue.h"
+
+#include "ai_clustergraph.h"
+
+#include "ai_basenpc.h"
+#include "ai_node.h"
+#include "ai_network.h"
+#include "ai_link.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar ai_path_cluster_size( "ai_path_cluster_size", "768", FCVAR_NONE, "Edge length of the cells used to group nodes into route planning clusters. Applies the next time the node graph is loaded." );
+
+//-----------------------------------------------------------------------------
+
+struct AI_ClusterOpenNode_t
+{
+	AI_ClusterOpenNode_t() {}
+	AI_ClusterOpenNode_t( int id, float flCost ) { nodeID = id; cost = flCost; }
+	float	cost;
+	int		nodeID;
+};
+
+static bool ClusterOpenIsLowerPriority( const AI_ClusterOpenNode_t &node1, const AI_ClusterOpenNode_t &node2 )
+{
+	return ( node1.cost > node2.cost );
+}
+
+//-----------------------------------------------------------------------------
+// CAI_ClusterLayer
+//-----------------------------------------------------------------------------
+
+CAI_ClusterLayer::CAI_ClusterLayer( Hull_t hull, int moveTypes )
+ :	m_hull( hull ),
+	m_moveTypes( moveTypes )
+{
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Optimistic version of CAI_Pathfinder::IsLinkUsable. Ignores
+//			anything that can change at runtime so the real search can only
+//			ever be more restrictive than the cluster plan.
+//-----------------------------------------------------------------------------
+
+bool CAI_ClusterLayer::IsLinkTraversable( CAI_Link *pLink ) const
+{
+	// Jump links may be taken through HINT_JUMP_OVERRIDE regardless of capability
+	return ( ( pLink->m_iAcceptedMoveTypes[m_hull] & ( m_moveTypes | bits_CAP_MOVE_JUMP ) ) != 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+static void GetClusterCell( CAI_Node *pNode, float flClusterSize, int *pCell )
+{
+	const Vector &vecOrigin = pNode->GetOrigin();
+	for ( int i = 0; i < 3; i++ )
+	{
+		pCell[i] = (int)floorf( vecOrigin[i] / flClusterSize );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Mirrors the base cost in CAI_Navigator::MovementCost
+//-----------------------------------------------------------------------------
+
+static float ClusterLinkCost( CAI_Node *pSrcNode, CAI_Node *pDestNode, CAI_Link *pLink, Hull_t hull, int moveTypes )
+{
+	float cost = ( pSrcNode->GetPosition( hull ) - pDestNode->GetPosition( hull ) ).Length();
+
+	int moveType = pLink->m_iAcceptedMoveTypes[hull] & moveTypes;
+	if ( moveType == bits_CAP_MOVE_JUMP || moveType == bits_CAP_MOVE_CLIMB || !moveType )
+	{
+		cost *= 2.0;
+	}
+
+	return cost;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_ClusterLayer::Build( CAI_Network *pNetwork, float flClusterSize )
+{
+	BuildClusters( pNetwork, flClusterSize );
+	BuildPortals( pNetwork );
+	BuildEdges( pNetwork );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Flood fills nodes into clusters. A cluster never leaves its grid
+//			cell and is always connected, so any portal of a cluster can be
+//			reached from any of its nodes without leaving it.
+//-----------------------------------------------------------------------------
+
+void CAI_ClusterLayer::BuildClusters( CAI_Network *pNetwork, float flClusterSize )
+{
+	int nNodes = pNetwork->NumNodes();
+	CAI_Node **ppNodes = pNetwork->AccessNodes();
+
+	m_NodeCluster.SetCount( nNodes );
+	for ( int node = 0; node < nNodes; node++ )
+	{
+		m_NodeCluster[node] = -1;
+	}
+
+	CUtlVector<int> stack;
+	int nClusters = 0;
+
+	for ( int seed = 0; seed < nNodes; seed++ )
+	{
+		if ( m_NodeCluster[seed] != -1 )
+			continue;
+
+		int seedCell[3];
+		GetClusterCell( ppNodes[seed], flClusterSize, seedCell );
+
+		int cluster = nClusters++;
+		m_NodeCluster[seed] = cluster;
+		stack.AddToTail( seed );
+
+		while ( stack.Count() )
+		{
+			int nodeID = stack.Tail();
+			stack.RemoveMultipleFromTail( 1 );
+
+			CAI_Node *pNode = ppNodes[nodeID];
+			for ( int link = 0; link < pNode->NumLinks(); link++ )
+			{
+				CAI_Link *pLink = pNode->GetLinkByIndex( link );
+				if ( !IsLinkTraversable( pLink ) )
+					continue;
+
+				int destID = pLink->DestNodeID( nodeID );
+				if ( m_NodeCluster[destID] != -1 )
+					continue;
+
+				int destCell[3];
+				GetClusterCell( ppNodes[destID], flClusterSize, destCell );
+				if ( destCell[0] != seedCell[0] || destCell[1] != seedCell[1] || destCell[2] != seedCell[2] )
+					continue;
+
+				m_NodeCluster[destID] = cluster;
+				stack.AddToTail( destID );
+			}
+		}
+	}
+
+	m_ClusterPortalStart.SetCount( nClusters + 1 );
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_ClusterLayer::BuildPortals( CAI_Network *pNetwork )
+{
+	int nNodes = pNetwork->NumNodes();
+	int nClusters = NumClusters();
+	CAI_Node **ppNodes = pNetwork->AccessNodes();
+
+	m_NodePortal.SetCount( nNodes );
+	m_PortalNodes.RemoveAll();
+
+	for ( int i = 0; i <= nClusters; i++ )
+	{
+		m_ClusterPortalStart[i] = 0;
+	}
+
+	for ( int node = 0; node < nNodes; node++ )
+	{
+		m_NodePortal[node] = -1;
+
+		CAI_Node *pNode = ppNodes[node];
+		for ( int link = 0; link < pNode->NumLinks(); link++ )
+		{
+			CAI_Link *pLink = pNode->GetLinkByIndex( link );
+			if ( IsLinkTraversable( pLink ) && m_NodeCluster[pLink->DestNodeID( node )] != m_NodeCluster[node] )
+			{
+				m_NodePortal[node] = m_PortalNodes.AddToTail( node );
+				m_ClusterPortalStart[m_NodeCluster[node] + 1]++;
+				break;
+			}
+		}
+	}
+
+	// Counts to offsets
+	for ( int i = 1; i <= nClusters; i++ )
+	{
+		m_ClusterPortalStart[i] += m_ClusterPortalStart[i - 1];
+	}
+
+	CUtlVector<int> fill;
+	fill.SetCount( nClusters );
+	for ( int i = 0; i < nClusters; i++ )
+	{
+		fill[i] = m_ClusterPortalStart[i];
+	}
+
+	m_ClusterPortals.SetCount( m_PortalNodes.Count() );
+	for ( int portal = 0; portal < m_PortalNodes.Count(); portal++ )
+	{
+		int cluster = m_NodeCluster[m_PortalNodes[portal]];
+		m_ClusterPortals[fill[cluster]++] = portal;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Links every portal to the portals it can reach inside its own
+//			cluster and to the portals on the other side of its boundary links
+//-----------------------------------------------------------------------------
+
+void CAI_ClusterLayer::BuildEdges( CAI_Network *pNetwork )
+{
+	int nNodes = pNetwork->NumNodes();
+	int nPortals = NumPortals();
+	CAI_Node **ppNodes = pNetwork->AccessNodes();
+
+	CUtlVector<float> nodeCost;
+	nodeCost.SetCount( nNodes );
+	for ( int node = 0; node < nNodes; node++ )
+	{
+		nodeCost[node] = FLT_MAX;
+	}
+
+	CUtlVector<int> touched;
+	CUtlPriorityQueue<AI_ClusterOpenNode_t> openList( 0, 0, ClusterOpenIsLowerPriority );
+
+	m_PortalEdgeStart.SetCount( nPortals + 1 );
+	m_PortalEdges.RemoveAll();
+
+	for ( int portal = 0; portal < nPortals; portal++ )
+	{
+		m_PortalEdgeStart[portal] = m_PortalEdges.Count();
+
+		int startID = m_PortalNodes[portal];
+		int cluster = m_NodeCluster[startID];
+
+		// Boundary links
+		CAI_Node *pStartNode = ppNodes[startID];
+		for ( int link = 0; link < pStartNode->NumLinks(); link++ )
+		{
+			CAI_Link *pLink = pStartNode->GetLinkByIndex( link );
+			if ( !IsLinkTraversable( pLink ) )
+				continue;
+
+			int destID = pLink->DestNodeID( startID );
+			if ( m_NodeCluster[destID] == cluster )
+				continue;
+
+			Assert( m_NodePortal[destID] != -1 );
+
+			AI_ClusterEdge_t edge;
+			edge.portal = m_NodePortal[destID];
+			edge.cost = ClusterLinkCost( pStartNode, ppNodes[destID], pLink, m_hull, m_moveTypes );
+			m_PortalEdges.AddToTail( edge );
+		}
+
+		if ( NumClusterPortals( cluster ) < 2 )
+			continue;
+
+		// Shortest paths to the rest of the cluster
+		nodeCost[startID] = 0;
+		touched.AddToTail( startID );
+		openList.Insert( AI_ClusterOpenNode_t( startID, 0 ) );
+
+		while ( openList.Count() )
+		{
+			AI_ClusterOpenNode_t top = openList.ElementAtHead();
+			openList.RemoveAtHead();
+
+			if ( top.cost > nodeCost[top.nodeID] )
+				continue;
+
+			CAI_Node *pNode = ppNodes[top.nodeID];
+			for ( int link = 0; link < pNode->NumLinks(); link++ )
+			{
+				CAI_Link *pLink = pNode->GetLinkByIndex( link );
+				if ( !IsLinkTraversable( pLink ) )
+					continue;
+
+				int destID = pLink->DestNodeID( top.nodeID );
+				if ( m_NodeCluster[destID] != cluster )
+					continue;
+
+				float cost = top.cost + ClusterLinkCost( pNode, ppNodes[destID], pLink, m_hull, m_moveTypes );
+				if ( cost < nodeCost[destID] )
+				{
+					if ( nodeCost[destID] == FLT_MAX )
+						touched.AddToTail( destID );
+					nodeCost[destID] = cost;
+					openList.Insert( AI_ClusterOpenNode_t( destID, cost ) );
+				}
+			}
+		}
+
+		for ( int i = 0; i < NumClusterPortals( cluster ); i++ )
+		{
+			int destPortal = GetClusterPortal( cluster, i );
+			int destID = m_PortalNodes[destPortal];
+			if ( destPortal == portal || nodeCost[destID] == FLT_MAX )
+				continue;
+
+			AI_ClusterEdge_t edge;
+			edge.portal = destPortal;
+			edge.cost = nodeCost[destID];
+			m_PortalEdges.AddToTail( edge );
+		}
+
+		for ( int i = 0; i < touched.Count(); i++ )
+		{
+			nodeCost[touched[i]] = FLT_MAX;
+		}
+		touched.RemoveAll();
+	}
+
+	m_PortalEdgeStart[nPortals] = m_PortalEdges.Count();
+}
+
+//-----------------------------------------------------------------------------
+// CAI_ClusterGraph
+//-----------------------------------------------------------------------------
+
+CAI_ClusterGraph::CAI_ClusterGraph( CAI_Network *pNetwork )
+ :	m_pNetwork( pNetwork )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+CAI_ClusterGraph::~CAI_ClusterGraph()
+{
+	Purge();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the layer for the given hull and movement capabilities,
+//			building it if this is the first request. Returns NULL if the
+//			layer was built before nodes were added, until it's purged.
+//-----------------------------------------------------------------------------
+
+const CAI_ClusterLayer *CAI_ClusterGraph::GetLayer( Hull_t hull, int moveTypes )
+{
+	moveTypes &= AI_MOVE_TYPE_BITS;
+
+	AUTO_LOCK_FM( m_LayersMutex );
+
+	for ( int i = 0; i < m_Layers.Count(); i++ )
+	{
+		if ( m_Layers[i]->GetHull() == hull && m_Layers[i]->GetMoveTypes() == moveTypes )
+			return ( m_Layers[i]->NumNodes() == m_pNetwork->NumNodes() ) ? m_Layers[i] : NULL;
+	}
+
+	if ( !m_pNetwork->NumNodes() )
+		return NULL;
+
+	CAI_ClusterLayer *pLayer = new CAI_ClusterLayer( hull, moveTypes );
+	pLayer->Build( m_pNetwork, MAX( ai_path_cluster_size.GetFloat(), 64.0f ) );
+	m_Layers.AddToTail( pLayer );
+
+	return pLayer;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds the layers needed by the NPCs currently in the level
+//-----------------------------------------------------------------------------
+
+void CAI_ClusterGraph::Precache()
+{
+	if ( !m_pNetwork->NumNodes() )
+		return;
+
+	CFastTimer timer;
+	timer.Start();
+
+	int nLayers = m_Layers.Count();
+
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+	{
+		GetLayer( ppAIs[i]->GetHullType(), ppAIs[i]->CapabilitiesGet() );
+	}
+
+	timer.End();
+
+	for ( int i = nLayers; i < m_Layers.Count(); i++ )
+	{
+		DevMsg( 2, "AI cluster layer (%s, move 0x%x): %d clusters, %d portals\n",
+			NAI_Hull::Name( m_Layers[i]->GetHull() ), m_Layers[i]->GetMoveTypes(),
+			m_Layers[i]->NumClusters(), m_Layers[i]->NumPortals() );
+	}
+
+	if ( m_Layers.Count() > nLayers )
+	{
+		DevMsg( "Built %d AI cluster layers in %.2f ms\n", m_Layers.Count() - nLayers, timer.GetDuration().GetMillisecondsF() );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Discards all layers. Must not be called while a search is running.
+//-----------------------------------------------------------------------------
+
+void CAI_ClusterGraph::Purge()
+{
+	AUTO_LOCK_FM( m_LayersMutex );
+	m_Layers.PurgeAndDeleteElements();
+}
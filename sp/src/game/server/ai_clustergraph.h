@@ -0,0 +1,113 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Cluster level abstraction of the AI node graph, used to plan
+//			long routes before refining them through the full graph.
+//
+//=============================================================================//
+
+#ifndef AI_CLUSTERGRAPH_H
+#define AI_CLUSTERGRAPH_H
+
+#include "utlvector.h"
+#include "ai_hull.h"
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+class CAI_Network;
+class CAI_Link;
+
+//-----------------------------------------------------------------------------
+
+struct AI_ClusterEdge_t
+{
+	int		portal;		// Portal on the far end of the edge
+	float	cost;
+};
+
+//-----------------------------------------------------------------------------
+// CAI_ClusterLayer
+//
+// Purpose: Partitions the nodes usable by one hull and movement capability
+//			set into small connected clusters. Nodes with a link crossing a
+//			cluster boundary are portals. Portal to portal costs, both within
+//			a cluster and across boundary links, are computed once when the
+//			layer is built.
+//-----------------------------------------------------------------------------
+
+class CAI_ClusterLayer
+{
+public:
+	CAI_ClusterLayer( Hull_t hull, int moveTypes );
+
+	void			Build( CAI_Network *pNetwork, float flClusterSize );
+
+	Hull_t			GetHull() const					{ return m_hull; }
+	int				GetMoveTypes() const			{ return m_moveTypes; }
+
+	bool			IsLinkTraversable( CAI_Link *pLink ) const;
+
+	int				NumNodes() const				{ return m_NodeCluster.Count(); }
+	int				NumClusters() const				{ return m_ClusterPortalStart.Count() - 1; }
+	int				NumPortals() const				{ return m_PortalNodes.Count(); }
+
+	int				GetNodeCluster( int nodeID ) const	{ return m_NodeCluster[nodeID]; }
+	int				GetNodePortal( int nodeID ) const	{ return m_NodePortal[nodeID]; }
+	int				GetPortalNode( int portal ) const	{ return m_PortalNodes[portal]; }
+
+	int				NumClusterPortals( int cluster ) const			{ return m_ClusterPortalStart[cluster + 1] - m_ClusterPortalStart[cluster]; }
+	int				GetClusterPortal( int cluster, int i ) const	{ return m_ClusterPortals[m_ClusterPortalStart[cluster] + i]; }
+
+	int				NumPortalEdges( int portal ) const						{ return m_PortalEdgeStart[portal + 1] - m_PortalEdgeStart[portal]; }
+	const AI_ClusterEdge_t &GetPortalEdge( int portal, int i ) const		{ return m_PortalEdges[m_PortalEdgeStart[portal] + i]; }
+
+private:
+	void			BuildClusters( CAI_Network *pNetwork, float flClusterSize );
+	void			BuildPortals( CAI_Network *pNetwork );
+	void			BuildEdges( CAI_Network *pNetwork );
+
+	Hull_t			m_hull;
+	int				m_moveTypes;
+
+	CUtlVector<int>	m_NodeCluster;				// Cluster of each node
+	CUtlVector<int>	m_NodePortal;				// Portal index of each node, or -1
+
+	CUtlVector<int>	m_PortalNodes;				// Node of each portal
+	CUtlVector<int>	m_ClusterPortalStart;		// Index into m_ClusterPortals, one past the end per cluster
+	CUtlVector<int>	m_ClusterPortals;
+
+	CUtlVector<int>					m_PortalEdgeStart;	// Index into m_PortalEdges, one past the end per portal
+	CUtlVector<AI_ClusterEdge_t>	m_PortalEdges;
+};
+
+//-----------------------------------------------------------------------------
+// CAI_ClusterGraph
+//
+// Purpose: Holds the cluster layers of a network. Layers are built when the
+//			network is loaded or built for the NPCs present at that time, and
+//			on first use for anything else. Once built a layer is read only
+//			and may be shared between threads.
+//-----------------------------------------------------------------------------
+
+class CAI_ClusterGraph
+{
+public:
+	CAI_ClusterGraph( CAI_Network *pNetwork );
+	~CAI_ClusterGraph();
+
+	const CAI_ClusterLayer *GetLayer( Hull_t hull, int moveTypes );
+
+	void			Precache();
+	void			Purge();
+
+private:
+	CAI_Network *	m_pNetwork;
+
+	CUtlVector<CAI_ClusterLayer *> m_Layers;
+	CThreadFastMutex m_LayersMutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif // AI_CLUSTERGRAPH_H
@@ -15,6 +15,7 @@
 #include "stringregistry.h"
 #include "igamesystem.h"
 #include "ai_network.h"
+#include "ai_pathfinder.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -516,6 +517,7 @@ public:
 	{
 		g_AI_SensedObjectsManager.Term();
 		g_pAINetworkManager->DeleteAllAINetworks();
+		CAI_Pathfinder::PurgeSearchScratch();
 		g_AI_SchedulesManager.DeleteAllSchedules();
 		g_AI_SquadManager.DeleteAllSquads();
 		g_AI_SchedulesManager.DestroyStringRegistries();
@@ -355,6 +355,7 @@ END_DATADESC()
 //-----------------------------------------------------------------------------
 CAI_DynamicLink *CAI_DynamicLink::m_pAllDynamicLinks = NULL;
 bool CAI_DynamicLink::gm_bInitialized;
+int CAI_DynamicLink::gm_nLinkStateSerial;
 
 
 //------------------------------------------------------------------------------
@@ -643,6 +644,8 @@ void CAI_DynamicLink::SetLinkState(void)
 		CAI_Link* pLink = FindLink();
 		if ( pLink )
 		{
+			gm_nLinkStateSerial++;
+
 			pLink->m_pDynamicLink = this;
 			if (m_nLinkState == LINK_OFF)
 			{
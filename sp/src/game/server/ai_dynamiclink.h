@@ -39,6 +39,7 @@ public:
 	static void 				GenerateControllerLinks();
 
 	static bool					gm_bInitialized;
+	static int					gm_nLinkStateSerial;	// Bumped whenever a link is turned on or off
 
 	static CAI_DynamicLink*		GetDynamicLink(int nSrcID, int nDstID);
 
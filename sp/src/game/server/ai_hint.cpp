@@ -252,11 +252,166 @@ bool CHintCriteria::InExcludedZone( const Vector &testPosition ) const
 	return InZone( m_zoneExclude, testPosition );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Gets a box around all the include zones
+// Output : Returns false if there are no include zones
+//-----------------------------------------------------------------------------
+bool CHintCriteria::GetIncludeBounds( Vector *pMins, Vector *pMaxs ) const
+{
+	if ( !HasIncludeZones() )
+		return false;
+
+	ClearBounds( *pMins, *pMaxs );
+	for ( int i = 0; i < m_zoneInclude.Count(); i++ )
+	{
+		float flRadius = sqrt( m_zoneInclude[i].radiussqr );
+		Vector vecExtents( flRadius, flRadius, flRadius );
+		AddPointToBounds( m_zoneInclude[i].position - vecExtents, *pMins, *pMaxs );
+		AddPointToBounds( m_zoneInclude[i].position + vecExtents, *pMins, *pMaxs );
+	}
+
+	return true;
+}
+
+//==================================================
+// CAI_HintGrid
+//==================================================
+
+ConVar ai_hint_grid( "ai_hint_grid", "1", FCVAR_NONE, "Use the hint grid for hint searches bounded by a distance" );
+
+#define HINT_GRID_CELL_SIZE		512.0f
+#define HINT_GRID_MIN_HINTS		16		// Smaller lists are just scanned
+
+//-----------------------------------------------------------------------------
+
+int __cdecl CAI_HintGrid::SerialCompare( const void *pLeft, const void *pRight )
+{
+	return (*(CAI_Hint **)pLeft)->m_iHintSerial - (*(CAI_Hint **)pRight)->m_iHintSerial;
+}
+
+int __cdecl CAI_HintGrid::TypeSerialCompare( const void *pLeft, const void *pRight )
+{
+	return (*(CAI_Hint **)pLeft)->m_iHintTypeSerial - (*(CAI_Hint **)pRight)->m_iHintTypeSerial;
+}
+
+//-----------------------------------------------------------------------------
+
+CAI_HintGrid::CAI_HintGrid( bool bByType )
+ :	m_bByType( bByType ),
+	m_nHints( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_HintGrid::Insert( CAI_Hint *pHint )
+{
+	m_nHints++;
+
+	if ( pHint->m_bHintGridMobile )
+	{
+		m_Mobile.AddToTail( pHint );
+		return;
+	}
+
+	const Vector &vecOrigin = pHint->m_vecHintGridOrigin;
+	int key = CellKey( (int)floor( vecOrigin.x / HINT_GRID_CELL_SIZE ), (int)floor( vecOrigin.y / HINT_GRID_CELL_SIZE ) );
+
+	UtlHashHandle_t h = m_Cells.Find( key );
+	if ( h == m_Cells.InvalidHandle() )
+		h = m_Cells.Insert( key );
+
+	m_Cells.Element( h ).AddToTail( pHint );
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_HintGrid::Remove( CAI_Hint *pHint )
+{
+	if ( pHint->m_bHintGridMobile )
+	{
+		if ( m_Mobile.FindAndRemove( pHint ) )
+			m_nHints--;
+		return;
+	}
+
+	const Vector &vecOrigin = pHint->m_vecHintGridOrigin;
+	int key = CellKey( (int)floor( vecOrigin.x / HINT_GRID_CELL_SIZE ), (int)floor( vecOrigin.y / HINT_GRID_CELL_SIZE ) );
+
+	UtlHashHandle_t h = m_Cells.Find( key );
+	if ( h != m_Cells.InvalidHandle() && m_Cells.Element( h ).FindAndRemove( pHint ) )
+	{
+		m_nHints--;
+		if ( !m_Cells.Element( h ).Count() )
+			m_Cells.Remove( key );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_HintGrid::Purge()
+{
+	m_Cells.Purge();
+	m_Mobile.Purge();
+	m_nHints = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gets every hint bucketed in a cell the box touches, in list order.
+//			Callers still have to test the hints themselves.
+//-----------------------------------------------------------------------------
+
+void CAI_HintGrid::GetHintsInBox( const Vector &mins, const Vector &maxs, CUtlVector<CAI_Hint *> *pResult ) const
+{
+	int x0 = (int)floor( mins.x / HINT_GRID_CELL_SIZE );
+	int y0 = (int)floor( mins.y / HINT_GRID_CELL_SIZE );
+	int x1 = (int)floor( maxs.x / HINT_GRID_CELL_SIZE );
+	int y1 = (int)floor( maxs.y / HINT_GRID_CELL_SIZE );
+
+	int iFirst = pResult->Count();
+
+	// Big boxes are cheaper to test against the occupied cells
+	if ( (int64)( x1 - x0 + 1 ) * (int64)( y1 - y0 + 1 ) > m_Cells.Count() )
+	{
+		FOR_EACH_HASHTABLE( m_Cells, h )
+		{
+			int key = m_Cells.Key( h );
+			int x = (short)( key >> 16 );
+			int y = (short)( key & 0xffff );
+			if ( x >= x0 && x <= x1 && y >= y0 && y <= y1 )
+				pResult->AddVectorToTail( m_Cells.Element( h ) );
+		}
+	}
+	else
+	{
+		for ( int x = x0; x <= x1; x++ )
+		{
+			for ( int y = y0; y <= y1; y++ )
+			{
+				UtlHashHandle_t h = m_Cells.Find( CellKey( x, y ) );
+				if ( h != m_Cells.InvalidHandle() )
+					pResult->AddVectorToTail( m_Cells.Element( h ) );
+			}
+		}
+	}
+
+	pResult->AddVectorToTail( m_Mobile );
+
+	int nFound = pResult->Count() - iFirst;
+	if ( nFound > 1 )
+	{
+		qsort( pResult->Base() + iFirst, nFound, sizeof( CAI_Hint * ), ( m_bByType ) ? TypeSerialCompare : SerialCompare );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Init static variables
 //-----------------------------------------------------------------------------
 CAIHintVector CAI_HintManager::gm_AllHints;
 CUtlMap< int,  CAIHintVector >	CAI_HintManager::gm_TypedHints( 0, 0, DefLessFunc( int ) );
+CAI_HintGrid	CAI_HintManager::gm_AllHintsGrid( false );
+CUtlMap< int, CAI_HintGrid * >	CAI_HintManager::gm_TypedHintGrids( 0, 0, DefLessFunc( int ) );
+int				CAI_HintManager::gm_nNextHintSerial = 0;
 CAI_Hint*	CAI_HintManager::gm_pLastFoundHints[ CAI_HintManager::HINT_HISTORY ];
 int			CAI_HintManager::gm_nFoundHintIndex = 0;
 
@@ -321,11 +476,22 @@ int CAI_HintManager::FindAllHints( CAI_BaseNPC *pNPC, const Vector &position, co
 	bool hadNearest = hintCriteria.HasFlag( bits_HINT_NODE_NEAREST );
 	(const_cast<CHintCriteria &>(hintCriteria)).ClearFlag( bits_HINT_NODE_NEAREST );
 
+	// Only visit hints near the include zones if there are any
+	CAI_Hint * const *ppHints = CAI_HintManager::gm_AllHints.Base();
+	CUtlVector<CAI_Hint *> candidates;
+	Vector vecZoneMins, vecZoneMaxs;
+	if ( ai_hint_grid.GetBool() && c >= HINT_GRID_MIN_HINTS && gm_AllHintsGrid.Count() == c && hintCriteria.GetIncludeBounds( &vecZoneMins, &vecZoneMaxs ) )
+	{
+		gm_AllHintsGrid.GetHintsInBox( vecZoneMins, vecZoneMaxs, &candidates );
+		ppHints = candidates.Base();
+		c = candidates.Count();
+	}
+
 	//  Now loop till we find a valid hint or return to the start
 	CAI_Hint *pTestHint;
 	for ( int i = 0; i < c; ++i )
 	{
-		pTestHint = CAI_HintManager::gm_AllHints[ i ];
+		pTestHint = ppHints[ i ];
 		Assert( pTestHint );
 		if ( pTestHint->HintMatchesCriteria( pNPC, hintCriteria, position, NULL ) )
 			pResult->AddToTail( pTestHint );
@@ -388,12 +554,14 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 	bool bIgnoreHintType = true;
 
 	CUtlVector< CAIHintVector * > lists;
+	CUtlVector< CAI_HintGrid * > grids;
 	if ( singleType )
 	{
 		int slot = CAI_HintManager::gm_TypedHints.Find( hintCriteria.GetFirstHintType() );
 		if ( slot != CAI_HintManager::gm_TypedHints.InvalidIndex() )
 		{
 			lists.AddToTail( &CAI_HintManager::gm_TypedHints[ slot ] );
+			grids.AddToTail( GetTypedHintGrid( hintCriteria.GetFirstHintType() ) );
 		}
 	}
 	else
@@ -407,6 +575,7 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 				if ( slot != CAI_HintManager::gm_TypedHints.InvalidIndex() )
 				{
 					lists.AddToTail( &CAI_HintManager::gm_TypedHints[ slot ] );
+					grids.AddToTail( GetTypedHintGrid( hintCriteria.GetHintType( listType ) ) );
 				}
 			}
 		}
@@ -414,6 +583,7 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 		{
 			// Still need to check hint type in this case
 			lists.AddToTail( &CAI_HintManager::gm_AllHints );
+			grids.AddToTail( &CAI_HintManager::gm_AllHintsGrid );
 			bIgnoreHintType = false;
 		}
 	}
@@ -459,9 +629,15 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 	// Longer search, reset best distance
 	flBestDistance = MAX_TRACE_LENGTH;
 
+	// With include zones, hints outside them can be skipped using the grid
+	Vector vecZoneMins, vecZoneMaxs;
+	bool bUseGrid = ai_hint_grid.GetBool() && hintCriteria.GetIncludeBounds( &vecZoneMins, &vecZoneMaxs );
+	CUtlVector<CAI_Hint *> candidates;
+
 	for ( int listNum = 0; listNum < listCount; ++listNum )
 	{
 		CAIHintVector *list = lists[ listNum ];
+		CAI_Hint * const *ppHints = list->Base();
 		count = list->Count();
 		// -------------------------------------------
 		//  If we have no hints, bail
@@ -469,10 +645,18 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 		if ( !count )
 			continue;
 
+		if ( bUseGrid && count >= HINT_GRID_MIN_HINTS && grids[ listNum ] && grids[ listNum ]->Count() == count )
+		{
+			candidates.RemoveAll();
+			grids[ listNum ]->GetHintsInBox( vecZoneMins, vecZoneMaxs, &candidates );
+			ppHints = candidates.Base();
+			count = candidates.Count();
+		}
+
 		//  Now loop till we find a valid hint or return to the start
 		for ( i = 0 ; i < count; ++i )
 		{
-			pTestHint = list->Element( i );
+			pTestHint = ppHints[ i ];
 			Assert( pTestHint );
 
 			++visited;
@@ -624,6 +808,13 @@ void CAI_HintManager::AddHint( CAI_Hint *pHint )
 	//  Add to linked list of hints
 	// ---------------------------------
 	CAI_HintManager::gm_AllHints.AddToTail( pHint );
+
+	pHint->m_iHintSerial = gm_nNextHintSerial++;
+	pHint->m_bHintGridMobile = ( pHint->GetMoveParent() != NULL );
+	pHint->m_vecHintGridOrigin = pHint->GetAbsOrigin();
+	pHint->m_bInHintGrid = true;
+	gm_AllHintsGrid.Insert( pHint );
+
 	CAI_HintManager::AddHintByType( pHint );
 }
 
@@ -647,6 +838,12 @@ void CAI_HintManager::AddHintByType( CAI_Hint *pHint )
 		slot = CAI_HintManager::gm_TypedHints.Insert( type);
 	}
 	CAI_HintManager::gm_TypedHints[ slot ].AddToTail( pHint );
+
+	pHint->m_iHintTypeSerial = gm_nNextHintSerial++;
+	if ( pHint->m_bInHintGrid )
+	{
+		GetTypedHintGrid( type, true )->Insert( pHint );
+	}
 }
 
 void CAI_HintManager::RemoveHintByType( CAI_Hint *pHintToRemove )
@@ -656,6 +853,51 @@ void CAI_HintManager::RemoveHintByType( CAI_Hint *pHintToRemove )
 	{
 		CAI_HintManager::gm_TypedHints[ slot ].FindAndRemove( pHintToRemove );
 	}
+
+	CAI_HintGrid *pGrid = GetTypedHintGrid( pHintToRemove->HintType() );
+	if ( pGrid && pHintToRemove->m_bInHintGrid )
+	{
+		pGrid->Remove( pHintToRemove );
+	}
+}
+
+//------------------------------------------------------------------------------
+// Purpose: Rebuckets a hint that has moved or changed parent
+//------------------------------------------------------------------------------
+void CAI_HintManager::UpdateHintPosition( CAI_Hint *pHint )
+{
+	if ( !pHint->m_bInHintGrid )
+		return;
+
+	bool bMobile = ( pHint->GetMoveParent() != NULL );
+	if ( !bMobile && !pHint->m_bHintGridMobile && pHint->GetAbsOrigin() == pHint->m_vecHintGridOrigin )
+		return;
+
+	CAI_HintGrid *pGrid = GetTypedHintGrid( pHint->HintType(), true );
+
+	gm_AllHintsGrid.Remove( pHint );
+	pGrid->Remove( pHint );
+
+	pHint->m_bHintGridMobile = bMobile;
+	pHint->m_vecHintGridOrigin = pHint->GetAbsOrigin();
+
+	gm_AllHintsGrid.Insert( pHint );
+	pGrid->Insert( pHint );
+}
+
+//------------------------------------------------------------------------------
+CAI_HintGrid *CAI_HintManager::GetTypedHintGrid( int type, bool bCreate )
+{
+	int slot = gm_TypedHintGrids.Find( type );
+	if ( slot == gm_TypedHintGrids.InvalidIndex() )
+	{
+		if ( !bCreate )
+			return NULL;
+
+		slot = gm_TypedHintGrids.Insert( type, new CAI_HintGrid( true ) );
+	}
+
+	return gm_TypedHintGrids[ slot ];
 }
 
 //------------------------------------------------------------------------------
@@ -667,12 +909,95 @@ void CAI_HintManager::RemoveHint( CAI_Hint *pHintToRemove )
 	gm_AllHints.FindAndRemove( pHintToRemove );
 	RemoveHintByType( pHintToRemove );
 
+	if ( pHintToRemove->m_bInHintGrid )
+	{
+		gm_AllHintsGrid.Remove( pHintToRemove );
+		pHintToRemove->m_bInHintGrid = false;
+	}
+
 	if ( CAI_HintManager::IsInFoundHintList( pHintToRemove ) )
 	{
 		CAI_HintManager::ResetFoundHints();
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Runs the same radius bounded searches around random hints with
+//			the hint grid off and on, and reports the times and whether the
+//			results agree.
+//-----------------------------------------------------------------------------
+void CAI_HintManager::Benchmark( int nQueries, float flRadius )
+{
+	if ( !gm_AllHints.Count() )
+	{
+		Msg( "No hints to search\n" );
+		return;
+	}
+
+	CUniformRandomStream randomStream;
+	randomStream.SetSeed( 0 );
+
+	CUtlVector<Vector> positions;
+	CUtlVector<int> types;
+	for ( int i = 0; i < nQueries; i++ )
+	{
+		CAI_Hint *pHint = gm_AllHints[ randomStream.RandomInt( 0, gm_AllHints.Count() - 1 ) ];
+		positions.AddToTail( pHint->GetAbsOrigin() + Vector( randomStream.RandomFloat( -flRadius, flRadius ), randomStream.RandomFloat( -flRadius, flRadius ), 0 ) );
+		types.AddToTail( pHint->HintType() );
+	}
+
+	CUtlVector<CAI_Hint *> nearest[2];
+	CUtlVector<CAI_Hint *> found;
+	int nFound[2];
+	float flFindTime[2];
+	float flFindAllTime[2];
+
+	bool bUseGrid = ai_hint_grid.GetBool();
+	for ( int run = 0; run < 2; run++ )
+	{
+		ai_hint_grid.SetValue( run );
+
+		CFastTimer timer;
+		timer.Start();
+		for ( int i = 0; i < nQueries; i++ )
+		{
+			CHintCriteria hintCriteria;
+			hintCriteria.SetHintType( types[i] );
+			hintCriteria.SetFlag( bits_HINT_NODE_NEAREST );
+			hintCriteria.AddIncludePosition( positions[i], flRadius );
+			nearest[run].AddToTail( FindHint( positions[i], hintCriteria ) );
+		}
+		timer.End();
+		flFindTime[run] = timer.GetDuration().GetMillisecondsF();
+
+		nFound[run] = 0;
+		timer.Start();
+		for ( int i = 0; i < nQueries; i++ )
+		{
+			CHintCriteria hintCriteria;
+			hintCriteria.AddIncludePosition( positions[i], flRadius );
+			found.RemoveAll();
+			nFound[run] += FindAllHints( positions[i], hintCriteria, &found );
+		}
+		timer.End();
+		flFindAllTime[run] = timer.GetDuration().GetMillisecondsF();
+	}
+
+	ai_hint_grid.SetValue( bUseGrid );
+	ResetFoundHints();
+
+	int nMismatches = 0;
+	for ( int i = 0; i < nQueries; i++ )
+	{
+		if ( nearest[0][i] != nearest[1][i] )
+			nMismatches++;
+	}
+
+	Msg( "%d queries of radius %.0f against %d hints:\n", nQueries, flRadius, gm_AllHints.Count() );
+	Msg( "   FindHint (nearest)  scan %8.3f ms  grid %8.3f ms  %d mismatches\n", flFindTime[0], flFindTime[1], nMismatches );
+	Msg( "   FindAllHints        scan %8.3f ms  grid %8.3f ms  %d / %d hints found\n", flFindAllTime[0], flFindAllTime[1], nFound[0], nFound[1] );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *token - 
@@ -993,6 +1318,18 @@ void CAI_Hint::UpdateOnRemove( void )
 	BaseClass::UpdateOnRemove();
 }
 
+void CAI_Hint::SetParent( CBaseEntity *pNewParent, int iAttachment )
+{
+	BaseClass::SetParent( pNewParent, iAttachment );
+	CAI_HintManager::UpdateHintPosition( this );
+}
+
+void CAI_Hint::Teleport( const Vector *newPosition, const QAngle *newAngles, const Vector *newVelocity )
+{
+	BaseClass::Teleport( newPosition, newAngles, newVelocity );
+	CAI_HintManager::UpdateHintPosition( this );
+}
+
 //------------------------------------------------------------------------------
 // Purpose :  If connected to a node returns node position, otherwise
 //			  returns local hint position
@@ -1622,6 +1959,11 @@ CAI_Hint::CAI_Hint(void)
 {
 	m_flNextUseTime	= 0;
 	m_nTargetNodeID = NO_NODE;
+	m_bInHintGrid = false;
+	m_bHintGridMobile = false;
+	m_vecHintGridOrigin = vec3_origin;
+	m_iHintSerial = 0;
+	m_iHintTypeSerial = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -1739,6 +2081,17 @@ CON_COMMAND(ai_dump_hints, "")
 	CAI_HintManager::DumpHints();
 }
 
+CON_COMMAND_F( ai_hint_benchmark, "Times hint searches with and without the hint grid. Arguments: [queries] [radius]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nQueries = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 1000;
+	float flRadius = ( args.ArgC() > 2 ) ? atof( args[2] ) : 1024.0f;
+
+	CAI_HintManager::Benchmark( MAX( nQueries, 1 ), MAX( flRadius, 1.0f ) );
+}
+
 
 //-----------------------------------------------------------------------------
 //
@@ -11,6 +11,7 @@
 
 #include "ai_initutils.h"
 #include "tier1/utlmap.h"
+#include "tier1/utlhashtable.h"
 
 //Flags for FindHintNode
 #define bits_HINT_NODE_NONE						0x00000000
@@ -167,6 +168,7 @@ public:
 
 	bool		InIncludedZone( const Vector &testPosition ) const;
 	bool		InExcludedZone( const Vector &testPosition ) const;
+	bool		GetIncludeBounds( Vector *pMins, Vector *pMaxs ) const;
 
 	int			NumHintTypes() const;
 	int			GetHintType( int idx ) const;
@@ -227,6 +229,41 @@ public:
 	}
 };
 
+//-----------------------------------------------------------------------------
+// CAI_HintGrid
+//
+// Purpose: Buckets the hints of one hint list on a 2D grid so searches that
+//			are bounded by include zones only visit nearby hints. Results
+//			come back in the order of the list they mirror. Hints with a move
+//			parent aren't bucketed and are returned by every query. Hints
+//			moved other than by Teleport() need UpdateHintPosition().
+//-----------------------------------------------------------------------------
+
+class CAI_HintGrid
+{
+public:
+	CAI_HintGrid( bool bByType );
+
+	void		Insert( CAI_Hint *pHint );
+	void		Remove( CAI_Hint *pHint );
+	void		Purge();
+
+	int			Count() const		{ return m_nHints; }
+	void		GetHintsInBox( const Vector &mins, const Vector &maxs, CUtlVector<CAI_Hint *> *pResult ) const;
+
+private:
+	static int	CellKey( int x, int y )	{ return ( ( x & 0xffff ) << 16 ) | ( y & 0xffff ); }
+	static int	__cdecl SerialCompare( const void *pLeft, const void *pRight );
+	static int	__cdecl TypeSerialCompare( const void *pLeft, const void *pRight );
+
+	bool								m_bByType;
+	int									m_nHints;
+	CUtlHashtable<int, CAIHintVector>	m_Cells;
+	CAIHintVector						m_Mobile;
+};
+
+//-----------------------------------------------------------------------------
+
 class CAI_HintManager
 {
 	friend class CAI_Hint;
@@ -239,6 +276,7 @@ public:
 	static void			RemoveHint( CAI_Hint *pTestHint );
 	static void			AddHintByType( CAI_Hint *pHint );
 	static void			RemoveHintByType( CAI_Hint *pHintToRemove );
+	static void			UpdateHintPosition( CAI_Hint *pHint );
 
 	// Interface for searching the hint node list
 	static CAI_Hint		*FindHint( CAI_BaseNPC *pNPC, const Vector &position, const CHintCriteria &hintCriteria );
@@ -257,6 +295,7 @@ public:
 	static CAI_Hint		*GetNextHint( AIHintIter_t *pIter );
 
 	static void DumpHints();
+	static void Benchmark( int nQueries, float flRadius );
 
 	static void ValidateHints();
 
@@ -277,8 +316,15 @@ private:
 
 	static int			gm_nFoundHintIndex;
 	static CAI_Hint		*gm_pLastFoundHints[ HINT_HISTORY ];			// Last used hint 
+	static CAI_HintGrid	*GetTypedHintGrid( int type, bool bCreate = false );
+
 	static CAIHintVector gm_AllHints;				// A linked list of all hints
 	static CUtlMap< int,  CAIHintVector >	gm_TypedHints;
+
+	// Spatial index of the lists above
+	static CAI_HintGrid	gm_AllHintsGrid;
+	static CUtlMap< int, CAI_HintGrid * >	gm_TypedHintGrids;
+	static int			gm_nNextHintSerial;
 };
 
 //-----------------------------------------------------------------------------
@@ -365,6 +411,8 @@ private:
 	void				Spawn( void );
 	virtual void		Activate();
 	virtual void		UpdateOnRemove( void );
+	virtual void		SetParent( CBaseEntity *pNewParent, int iAttachment = -1 );
+	virtual void		Teleport( const Vector *newPosition, const QAngle *newAngles, const Vector *newVelocity );
 	int					DrawDebugTextOverlays(void);
 	virtual int			ObjectCaps( void ) { return (BaseClass::ObjectCaps() & ~FCAP_ACROSS_TRANSITION); }
 	virtual void		OnRestore();
@@ -392,8 +440,16 @@ private:
 	COutputEvent m_OnScriptEvent[8];
 #endif
 
+	// Hint grid bookkeeping (not saved, hints are re-added on restore)
+	bool				m_bInHintGrid;
+	bool				m_bHintGridMobile;		// Has a move parent, not bucketed
+	Vector				m_vecHintGridOrigin;	// Where the hint was bucketed
+	int					m_iHintSerial;			// Order in the list of all hints
+	int					m_iHintTypeSerial;		// Order in the list of its type
+
 	// The next hint in list of all hints
 	friend class CAI_HintManager;
+	friend class CAI_HintGrid;
 
 	DECLARE_DATADESC();
 #ifdef MAPBASE_VSCRIPT
@@ -141,7 +141,9 @@ bool CAI_TestHull::IsJumpLegal(const Vector &startPos, const Vector &apex, const
 //-----------------------------------------------------------------------------
 CAI_TestHull::~CAI_TestHull(void)
 {
-	CAI_TestHull::pTestHull = NULL;
+	// The network builder creates extra hulls for its worker threads
+	if ( CAI_TestHull::pTestHull == this )
+		CAI_TestHull::pTestHull = NULL;
 }
 
 //###########################################################
@@ -457,23 +457,6 @@ ConVar ai_navigator_generate_spikes_strength( "ai_navigator_generate_spikes_stre
 
 bool CAI_Navigator::SetGoal( const AI_NavGoal_t &goal, unsigned flags )
 {
-	// Queue this up if we're in the middle of a frame
-	if ( PostFrameNavigationSystem()->IsGameFrameRunning() )
-	{
-		// Send off the query for queuing
-		PostFrameNavigationSystem()->EnqueueEntityNavigationQuery( GetOuter(), CreateFunctor( this, &CAI_Navigator::SetGoal, RefToVal( goal ), flags ) );
-
-		// Complete immediately if we're waiting on that
-		// FIXME: This will probably cause a lot of subtle little nuisances...
-		if ( ( flags & AIN_NO_PATH_TASK_FAIL ) == 0 || GetOuter()->IsCurTaskContinuousMove() )
-		{
-			TaskComplete();
-		}
-
-		// For now, always succeed -- we need to deal with failures on the next frame
-		return true;
-	}
-
 	CAI_Path *pPath = GetPath();
 
 	OnNewGoal();
@@ -482,7 +465,7 @@ bool CAI_Navigator::SetGoal( const AI_NavGoal_t &goal, unsigned flags )
 	if ( flags & AIN_CLEAR_PREVIOUS_STATE )
 		ClearPath();
 
-	if ( GetOuter()->IsCurTaskContinuousMove() || ai_post_frame_navigation.GetBool() )
+	if ( GetOuter()->IsCurTaskContinuousMove() )
 		flags |= AIN_NO_PATH_TASK_FAIL;
 
 	bool result = FindPath( goal, flags );
@@ -3596,7 +3579,23 @@ bool CAI_Navigator::DoFindPathToPos(void)
 
 	pPath->ClearWaypoints();
 
-	AI_Waypoint_t *pFirstWaypoint = pPathfinder->BuildRoute( origin, actualGoalPos, pTarget, tolerance, GetNavType(), m_bLocalSucceedOnWithinTolerance );
+	// Use the route queued on the last think if it still fits. Otherwise a
+	// task that is just starting hands the route off to the post frame job,
+	// and is started again on the next think to pick it up.
+	AI_Waypoint_t *pFirstWaypoint = NULL;
+	bool bHadQueuedRoute = pPathfinder->HasQueuedRoute();
+	if ( !bHadQueuedRoute || !pPathfinder->TakeQueuedRoute( origin, actualGoalPos, pTarget, tolerance, GetNavType(), m_bLocalSucceedOnWithinTolerance, &pFirstWaypoint ) )
+	{
+		if ( !bHadQueuedRoute && GetOuter()->IsStartingTask() && PostFrameNavigationSystem()->IsGameFrameRunning() )
+		{
+			pPathfinder->QueueRoute( origin, actualGoalPos, pTarget, tolerance, GetNavType(), m_bLocalSucceedOnWithinTolerance );
+
+			// Assume success, the real result is handled when the task starts again
+			return true;
+		}
+
+		pFirstWaypoint = pPathfinder->BuildRoute( origin, actualGoalPos, pTarget, tolerance, GetNavType(), m_bLocalSucceedOnWithinTolerance );
+	}
 
 	if (!pFirstWaypoint)
 	{
@@ -16,6 +16,8 @@
 #include "ai_navigator.h"
 #include "world.h"
 #include "ai_moveprobe.h"
+#include "ai_clustergraph.h"
+#include "ai_nodevisibility.h"
 #ifdef MAPBASE_VSCRIPT
 #include "ai_hint.h"
 #endif
@@ -195,12 +197,18 @@ CAI_Network::CAI_Network()
 #ifdef AI_NODE_TREE
 	m_pNodeTree = NULL;
 #endif
+
+	m_pClusterGraph = new CAI_ClusterGraph( this );
+	m_pNodeVisibility = new CAI_NodeVisibility;
 }
 
 //-----------------------------------------------------------------------------
 
 CAI_Network::~CAI_Network()
 {
+	delete m_pClusterGraph;
+	delete m_pNodeVisibility;
+
 #ifdef AI_NODE_TREE
 	if ( m_pNodeTree )
 	{
@@ -367,7 +375,12 @@ int	CAI_Network::NearestNodeToPoint( CAI_BaseNPC *pNPC, const Vector &vecOrigin,
 
 		if ( cachedNode != NO_NODE && ( !pFilter || pFilter->IsValid( m_pAInode[cachedNode] ) ) )
 		{
-			m_NearestCache[cachePos].expiration	= gpGlobals->curtime + NEARNODE_CACHE_LIFE;
+			// Another thread may have reused the entry since it was looked up
+			AUTO_LOCK_FM( m_NearestCacheMutex );
+			if ( m_NearestCache[cachePos].node == cachedNode )
+			{
+				m_NearestCache[cachePos].expiration	= gpGlobals->curtime + NEARNODE_CACHE_LIFE;
+			}
 			return cachedNode;
 		}
 	}
@@ -476,6 +489,8 @@ int	CAI_Network::GetCachedNode(const Vector &checkPos, Hull_t nHull, int *pCache
 	if ( ai_no_node_cache.GetBool() )
 		return NOT_CACHED;
 
+	AUTO_LOCK_FM( m_NearestCacheMutex );
+
 	// Walk from newest to oldest.
 	int iNewest = m_iNearestCacheNext + 1;
 	for ( int i = 0; i < NEARNODE_CACHE_SIZE; i++ )
@@ -526,6 +541,8 @@ void CAI_Network::SetCachedNearestNode(const Vector &checkPos, int nodeID, Hull_
 	if ( ai_no_node_cache.GetBool() )
 		return;
 
+	AUTO_LOCK_FM( m_NearestCacheMutex );
+
 	m_NearestCache[m_iNearestCacheNext].vTestPosition	= checkPos;
 	m_NearestCache[m_iNearestCacheNext].node			= nodeID;
 	m_NearestCache[m_iNearestCacheNext].hull			= nHull;
@@ -614,6 +631,10 @@ CAI_Node *CAI_Network::AddNode( const Vector &origin, float yaw )
 
 	m_pAInode[m_iNumNodes] = new CAI_Node( m_iNumNodes, origin, yaw );
 
+	// The cluster layers and visibility only know about the nodes they were built with
+	m_pClusterGraph->Purge();
+	m_pNodeVisibility->Purge();
+
 #ifdef AI_NODE_TREE
 	if ( !m_pNodeTree )
 	{
@@ -678,6 +699,8 @@ CAI_Link *CAI_Network::CreateLink( int srcID, int destID, CAI_DynamicLink *pDyna
 	pSrcNode->AddLink(pLink);
 	pDestNode->AddLink(pLink);
 
+	m_pClusterGraph->Purge();
+
 	return pLink;
 }
 
@@ -25,6 +25,8 @@ struct AI_Waypoint_t;
 class CAI_BaseNPC;
 class CAI_Link;
 class CAI_DynamicLink;
+class CAI_ClusterGraph;
+class CAI_NodeVisibility;
 
 //-----------------------------------------------------------------------------
 
@@ -128,6 +130,9 @@ public:
 	
 	CAI_Node**		AccessNodes() const	{ return m_pAInode; }
 
+	CAI_ClusterGraph *GetClusterGraph()	{ return m_pClusterGraph; }
+	CAI_NodeVisibility *GetNodeVisibility()	{ return m_pNodeVisibility; }
+
 #ifdef MAPBASE_VSCRIPT
 	Vector		ScriptGetNodePosition( int nodeID ) { return GetNodePosition( HULL_HUMAN, nodeID ); }
 	Vector		ScriptGetNodePositionWithHull( int nodeID, int hull ) { return GetNodePosition( (Hull_t)hull, nodeID ); }
@@ -170,6 +175,9 @@ private:
 	int					m_iNumNodes;				// Number of nodes in this network
 	CAI_Node**			m_pAInode;					// Array of all nodes in this network
 
+	CAI_ClusterGraph *	m_pClusterGraph;			// Cluster abstraction used to plan long routes
+	CAI_NodeVisibility *m_pNodeVisibility;			// World visibility between nodes, saved with the graph
+
 	enum
 	{
 		PARTITION_NODE	= ( 1 << 0 )
@@ -177,6 +185,7 @@ private:
 
 	NearNodeCache_T		m_NearestCache[NEARNODE_CACHE_SIZE];	// Cache of nearest nodes
 	int					m_iNearestCacheNext;					// Oldest record in the cache
+	CThreadFastMutex	m_NearestCacheMutex;					// Route jobs share the cache between threads
 
 #ifdef AI_NODE_TREE
 	ISpatialPartition * m_pNodeTree;
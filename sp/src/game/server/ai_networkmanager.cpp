@@ -24,7 +24,10 @@
 #include "ai_hull.h"
 #include "ndebugoverlay.h"
 #include "ai_hint.h"
+#include "ai_clustergraph.h"
+#include "ai_nodevisibility.h"
 #include "tier0/icommandline.h"
+#include "vstdlib/jobthread.h"
 #ifdef MAPBASE
 #include "gameinterface.h"
 #endif
@@ -81,6 +84,8 @@ extern CUtlVector<MODTITLECOMMENT> *Mapbase_GetChapterMaps();
 extern CUtlVector<MODCHAPTER> *Mapbase_GetChapterList();
 #endif
 
+ConVar ai_network_build_threaded( "ai_network_build_threaded", "1", FCVAR_NONE, "Test node connections on worker threads when building the node graph. The graph is the same either way." );
+
 
 //-----------------------------------------------------------------------------
 // CAI_NetworkManager
@@ -180,6 +185,9 @@ void CAI_NetworkManager::StartRebuild( void )
 
 	g_AINetworkBuilder.Rebuild( m_pNetwork );
 
+	m_pNetwork->GetClusterGraph()->Purge();
+	m_pNetwork->GetNodeVisibility()->Purge();
+
 	// ------------------------------------------------------------
 	// Purge any dynamic links for links that don't exist any more
 	// ------------------------------------------------------------
@@ -355,6 +363,11 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 		buf.PutInt( GetEditOps()->m_pNodeIndexTable[node] );
 	}
 
+	// -------------------------------
+	// Dump node visibility
+	// -------------------------------
+	m_pNetwork->GetNodeVisibility()->Save( buf );
+
 	// -------------------------------
 	// Write the file out
 	// -------------------------------
@@ -684,6 +697,14 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 		GetEditOps()->m_pNodeIndexTable[node] = buf.GetInt();
 	}
 
+	// -------------------------------
+	// Load node visibility, graphs saved before it was added don't have it
+	// -------------------------------
+	if ( !m_pNetwork->GetNodeVisibility()->Load( buf, m_pNetwork->m_iNumNodes ) )
+	{
+		DevMsg( "AI node graph %s has no node visibility\n", szNrpFilename );
+	}
+
 	
 #if 1
 	CUtlRBTree<int> usedIds;
@@ -1168,6 +1189,10 @@ void CAI_NetworkManager::DelayedInit( void )
 	// --------------------------------------------
 	CAI_DynamicLink::InitDynamicLinks();
 	FixupHints();
+
+	// Dynamic links can add links, so wait for them before clustering
+	m_pNetwork->GetClusterGraph()->Purge();
+	m_pNetwork->GetClusterGraph()->Precache();
 	
 	GetEditOps()->OnInit();
 
@@ -2263,6 +2288,7 @@ void CAI_NetworkBuilder::EndBuild()
 {
 	m_NeighborsTable.SetSize(0);
 	m_DidSetNeighborsTable.Resize(0);
+	m_ComputedConnections.Purge();
 	CAI_TestHull::ReturnTestHull();
 }
 
@@ -2286,6 +2312,32 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 
 	BeginBuild();
 
+	enum
+	{
+		PHASE_NODE_POSITIONS,
+		PHASE_NEIGHBORS,
+		PHASE_DYNAMIC_LINKS,
+		PHASE_CONNECTIONS,
+		PHASE_LINKS,
+		PHASE_ZONES,
+		PHASE_VISIBILITY,
+
+		NUM_PHASES
+	};
+
+	static const char *pszPhaseNames[NUM_PHASES] =
+	{
+		"node positions",
+		"neighbors",
+		"dynamic link neighbors",
+		"connection tests",
+		"links",
+		"zones",
+		"node visibility",
+	};
+
+	float flPhaseTimes[NUM_PHASES] = { 0 };
+
 	CFastTimer masterTimer;
 	CFastTimer timer;
 	
@@ -2306,7 +2358,8 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	}
 	nNodes = pNetwork->NumNodes(); // InitNodePosition can create nodes
 	timer.End();
-	DevMsg( "...done initializing node positions. %f seconds\n", timer.GetDuration().GetSeconds() );
+	flPhaseTimes[PHASE_NODE_POSITIONS] = timer.GetDuration().GetSeconds();
+	DevMsg( "...done initializing node positions. %f seconds\n", flPhaseTimes[PHASE_NODE_POSITIONS] );
 
 	// ---------------------------
 	// Initialize node neighbors
@@ -2326,7 +2379,8 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 		InitNeighbors( pNetwork, ppNodes[i] );
 	}
 	timer.End();
-	DevMsg( "...done initializing node neighbors. %f seconds\n", timer.GetDuration().GetSeconds() );
+	flPhaseTimes[PHASE_NEIGHBORS] = timer.GetDuration().GetSeconds();
+	DevMsg( "...done initializing node neighbors. %f seconds\n", flPhaseTimes[PHASE_NEIGHBORS] );
 
 	// ---------------------------
 	// Force node neighbors for dynamic links
@@ -2335,7 +2389,22 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	timer.Start();
 	ForceDynamicLinkNeighbors();
 	timer.End();
-	DevMsg( "...done forcing dynamic link neighbors. %f seconds\n", timer.GetDuration().GetSeconds() );
+	flPhaseTimes[PHASE_DYNAMIC_LINKS] = timer.GetDuration().GetSeconds();
+	DevMsg( "...done forcing dynamic link neighbors. %f seconds\n", flPhaseTimes[PHASE_DYNAMIC_LINKS] );
+
+	// ---------------------------
+	// Test connections between neighbors
+	// ---------------------------
+	int nTestHulls = 1;
+	if ( ai_network_build_threaded.GetBool() )
+	{
+		DevMsg( "Testing node connections...\n" );
+		timer.Start();
+		nTestHulls = ComputeConnections( pNetwork );
+		timer.End();
+		flPhaseTimes[PHASE_CONNECTIONS] = timer.GetDuration().GetSeconds();
+		DevMsg( "...done testing node connections on %d threads. %f seconds\n", nTestHulls, flPhaseTimes[PHASE_CONNECTIONS] );
+	}
 
 	// ---------------------------
 	// Initialize accepted hulls
@@ -2352,7 +2421,8 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 		InitLinks( pNetwork, ppNodes[i] );
 	}
 	timer.End();
-	DevMsg( "...done determining links. %f seconds\n", timer.GetDuration().GetSeconds() );
+	flPhaseTimes[PHASE_LINKS] = timer.GetDuration().GetSeconds();
+	DevMsg( "...done determining links. %f seconds\n", flPhaseTimes[PHASE_LINKS] );
 
 	// ------------------------------
 	// Initialize disconnected nodes
@@ -2361,10 +2431,38 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	timer.Start();
 	InitZones( pNetwork);
 	timer.End();
+	flPhaseTimes[PHASE_ZONES] = timer.GetDuration().GetSeconds();
+	DevMsg( "...done determining zones. %f seconds\n", flPhaseTimes[PHASE_ZONES] );
+
+	// ------------------------------
+	// Initialize node visibility
+	// ------------------------------
+	DevMsg( "Computing node visibility...\n" );
+	timer.Start();
+	pNetwork->GetNodeVisibility()->Build( pNetwork );
+	timer.End();
 	masterTimer.End();
-	DevMsg( "...done determining zones. %f seconds\n", timer.GetDuration().GetSeconds() );
+	flPhaseTimes[PHASE_VISIBILITY] = timer.GetDuration().GetSeconds();
+	DevMsg( "...done computing node visibility. %f seconds\n", flPhaseTimes[PHASE_VISIBILITY] );
 	DevMsg( "...done building AI node graph, %f seconds\n", masterTimer.GetDuration().GetSeconds() );
 
+	// ------------------------------
+	// Report
+	// ------------------------------
+	int nLinks = 0;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		nLinks += ppNodes[i]->NumLinks();
+	}
+
+	float flTotal = masterTimer.GetDuration().GetSeconds();
+	DevMsg( "AI node graph build: %d nodes, %d links, %d connection test threads\n", nNodes, nLinks / 2, nTestHulls );
+	for ( i = 0; i < NUM_PHASES; i++ )
+	{
+		DevMsg( "   %-24s %9.3f s %6.1f%%\n", pszPhaseNames[i], flPhaseTimes[i], ( flTotal > 0 ) ? 100.0f * flPhaseTimes[i] / flTotal : 0.0f );
+	}
+	DevMsg( "   %-24s %9.3f s\n", "total", flTotal );
+
 	g_pAINetworkManager->FixupHints();
 
 	EndBuild();
@@ -3003,39 +3101,40 @@ static bool IsInLineForClimb( const Vector &srcPos, const Vector &srcFacing, con
 
 //-------------------------------------
 
-int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull )
+int CAI_NetworkBuilder::ComputeConnection( CAI_TestHull *pTestHull, CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull )
 {
 	int srcId = pSrcNode->m_iID;
 	int destId = pDestNode->m_iID;
 	int result = 0;
 	trace_t tr;
 	
-	// Set the size of the test hull
-	if ( m_pTestHull->GetHullType() != hull ) 
+	// Set the size of the test hull. Test hulls used on the job threads were
+	// already set up on the main thread, so none of this writes to them there.
+	if ( pTestHull->GetHullType() != hull ) 
 	{
-		m_pTestHull->SetHullType( hull );
-		m_pTestHull->SetHullSizeNormal( true );
+		pTestHull->SetHullType( hull );
+		pTestHull->SetHullSizeNormal( true );
 	}
 
-	if ( !( m_pTestHull->GetFlags() & FL_ONGROUND ) )
+	if ( !( pTestHull->GetFlags() & FL_ONGROUND ) )
 	{
 		DevWarning( 2, "OFFGROUND!\n" );
+		pTestHull->AddFlag( FL_ONGROUND );
 	}
-	m_pTestHull->AddFlag( FL_ONGROUND );
 
 	// ==============================================================
 	// FIRST CHECK IF HULL CAN EVEN FIT AT THESE NODES
 	// ==============================================================
 	// @Note (toml 02-10-03): this should be optimized, caching the results of CanFitAtNode() 
 	if ( !( pSrcNode->m_eNodeInfo & ( HullToBit( hull ) << NODE_ENT_FLAGS_SHIFT ) ) &&
-		 !m_pTestHull->GetNavigator()->CanFitAtNode(srcId,MASK_NPCWORLDSTATIC) )
+		 !pTestHull->GetNavigator()->CanFitAtNode(srcId,MASK_NPCWORLDSTATIC) )
 	{
 		DebugConnectMsg( srcId, destId, "      Cannot fit at node %d\n", srcId );
 		return 0;
 	}
 	
 	if (  !( pDestNode->m_eNodeInfo & ( HullToBit( hull ) << NODE_ENT_FLAGS_SHIFT ) ) &&
-		 !m_pTestHull->GetNavigator()->CanFitAtNode(destId,MASK_NPCWORLDSTATIC) )
+		 !pTestHull->GetNavigator()->CanFitAtNode(destId,MASK_NPCWORLDSTATIC) )
 	{
 		DebugConnectMsg( srcId, destId, "      Cannot fit at node %d\n", destId );
 		return 0;
@@ -3051,7 +3150,7 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 		// Air nodes only connect to other air nodes and nothing else
 		if (pSrcNode->m_eNodeType == NODE_AIR && pDestNode->GetType() == NODE_AIR)
 		{
-			AI_TraceHull( pSrcNode->GetOrigin(), pDestNode->GetOrigin(), NAI_Hull::Mins(hull),NAI_Hull::Maxs(hull), MASK_NPCWORLDSTATIC, m_pTestHull, COLLISION_GROUP_NONE, &tr );
+			AI_TraceHull( pSrcNode->GetOrigin(), pDestNode->GetOrigin(), NAI_Hull::Mins(hull),NAI_Hull::Maxs(hull), MASK_NPCWORLDSTATIC, pTestHull, COLLISION_GROUP_NONE, &tr );
 			if (!tr.startsolid && tr.fraction == 1.0)
 			{
 				result |= bits_CAP_MOVE_FLY;
@@ -3076,7 +3175,7 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 		{
 			AI_TraceHull( srcPos, destPos, 
 							NAI_Hull::Mins(hull),NAI_Hull::Maxs(hull), 
-							MASK_NPCWORLDSTATIC, m_pTestHull, COLLISION_GROUP_NONE, &tr );
+							MASK_NPCWORLDSTATIC, pTestHull, COLLISION_GROUP_NONE, &tr );
 			if (!tr.startsolid && tr.fraction == 1.0)
 			{
 				result |= bits_CAP_MOVE_CLIMB;
@@ -3102,7 +3201,7 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 				return 0;
 			}
 
-			AI_TraceHull( srcPos, destPos, NAI_Hull::Mins(hull),NAI_Hull::Maxs(hull), MASK_NPCWORLDSTATIC, m_pTestHull, COLLISION_GROUP_NONE, &tr );
+			AI_TraceHull( srcPos, destPos, NAI_Hull::Mins(hull),NAI_Hull::Maxs(hull), MASK_NPCWORLDSTATIC, pTestHull, COLLISION_GROUP_NONE, &tr );
 			if (!tr.startsolid && tr.fraction == 1.0)
 			{
 				result |= bits_CAP_MOVE_CLIMB;
@@ -3130,13 +3229,13 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 		Vector srcPos	 = pSrcNode->GetPosition(hull);
 		Vector destPos	 = pDestNode->GetPosition(hull);
 
-		if (!m_pTestHull->GetMoveProbe()->CheckStandPosition( srcPos, MASK_NPCWORLDSTATIC))
+		if (!pTestHull->GetMoveProbe()->CheckStandPosition( srcPos, MASK_NPCWORLDSTATIC))
 		{
 			DebugConnectMsg( srcId, destId, "      Failed to stand at %d\n", srcId );
 			fStandFailed = true;
 		}
 
-		if (!m_pTestHull->GetMoveProbe()->CheckStandPosition( destPos, MASK_NPCWORLDSTATIC))
+		if (!pTestHull->GetMoveProbe()->CheckStandPosition( destPos, MASK_NPCWORLDSTATIC))
 		{
 			DebugConnectMsg( srcId, destId, "      Failed to stand at %d\n", destId );
 			fStandFailed = true;
@@ -3147,7 +3246,7 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 
 		if ( !fStandFailed )
 		{
-			fWalkFailed = !m_pTestHull->GetMoveProbe()->TestGroundMove( srcPos, destPos, MASK_NPCWORLDSTATIC, AITGM_IGNORE_INITIAL_STAND_POS, NULL );
+			fWalkFailed = !pTestHull->GetMoveProbe()->TestGroundMove( srcPos, destPos, MASK_NPCWORLDSTATIC, AITGM_IGNORE_INITIAL_STAND_POS, NULL );
 			if ( fWalkFailed )
 				DebugConnectMsg( srcId, destId, "      Failed to walk between nodes\n" );
 		}
@@ -3173,15 +3272,18 @@ int CAI_NetworkBuilder::ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNo
 
 			// Jumps aren't bi-directional.  We can jump down further than we can jump up so
 			// we have to test for either one
-			bool canDestJump = m_pTestHull->IsJumpLegal(srcPos, destPos, destPos);
-			bool canSrcJump  = m_pTestHull->IsJumpLegal(destPos, srcPos, srcPos);
+			bool canDestJump = pTestHull->IsJumpLegal(srcPos, destPos, destPos);
+			bool canSrcJump  = pTestHull->IsJumpLegal(destPos, srcPos, srcPos);
 
 			if (canDestJump || canSrcJump) 
 			{
-				CAI_MoveProbe *pMoveProbe = m_pTestHull->GetMoveProbe();
+				CAI_MoveProbe *pMoveProbe = pTestHull->GetMoveProbe();
 
 				bool fJumpLegal = false;
-				m_pTestHull->SetGravity(1.0);
+				if ( pTestHull->GetGravity() != 1.0 )
+				{
+					pTestHull->SetGravity(1.0);
+				}
 
 				AIMoveTrace_t moveTrace;
 				pMoveProbe->MoveLimit( NAV_JUMP, srcPos,destPos, MASK_NPCWORLDSTATIC, NULL, &moveTrace);
@@ -3264,13 +3366,24 @@ void CAI_NetworkBuilder::InitLinks(CAI_Network *pNetwork, CAI_Node *pNode)
 
 			if ( !(pNode->m_eNodeInfo & bits_NODE_FALLEN) && !(pDestNode->m_eNodeInfo & bits_NODE_FALLEN) )
 			{
-				for (int hull = 0 ; hull < NUM_HULLS; hull++ )
+				if ( GetComputedConnection( pNode->m_iID, i, acceptedMotions ) )
 				{
-					DebugConnectMsg( pNode->m_iID, i, "   Testing for hull %s\n", NAI_Hull::Name( (Hull_t)hull  ) );
-					
-					acceptedMotions[hull] = ComputeConnection( pNode, pDestNode, (Hull_t)hull );
-					if ( acceptedMotions[hull] != 0 )
-						bAllFailed = false;
+					for (int hull = 0 ; hull < NUM_HULLS; hull++ )
+					{
+						if ( acceptedMotions[hull] != 0 )
+							bAllFailed = false;
+					}
+				}
+				else
+				{
+					for (int hull = 0 ; hull < NUM_HULLS; hull++ )
+					{
+						DebugConnectMsg( pNode->m_iID, i, "   Testing for hull %s\n", NAI_Hull::Name( (Hull_t)hull  ) );
+						
+						acceptedMotions[hull] = ComputeConnection( pNode, pDestNode, (Hull_t)hull );
+						if ( acceptedMotions[hull] != 0 )
+							bAllFailed = false;
+					}
 				}
 			}
 			else
@@ -3301,3 +3414,188 @@ void CAI_NetworkBuilder::InitLinks(CAI_Network *pNetwork, CAI_Node *pNode)
 }
 
 //-----------------------------------------------------------------------------
+// Purpose: Tests every connection InitLinks() is going to ask for ahead of
+//			time, on worker threads. Each worker has its own test hull.
+//			InitLinks() still decides which links to create and in what
+//			order, so the graph is the same as a serial build. Returns the
+//			number of test hulls used.
+//-----------------------------------------------------------------------------
+
+int CAI_NetworkBuilder::ComputeConnections( CAI_Network *pNetwork )
+{
+	int nNodes = pNetwork->NumNodes();
+	CAI_Node **ppNodes = pNetwork->AccessNodes();
+
+	m_ComputedConnections.SetSize( nNodes );
+	for ( int node = 0; node < nNodes; node++ )
+	{
+		m_ComputedConnections[node].RemoveAll();
+	}
+
+	// InitLinks() tests a pair from whichever node it reaches first that
+	// lists the other as a neighbor
+	for ( int node = 0; node < nNodes; node++ )
+	{
+		if ( ppNodes[node]->m_eNodeInfo & bits_NODE_FALLEN )
+			continue;
+
+		for ( int other = node + 1; other < nNodes; other++ )
+		{
+			if ( ppNodes[other]->m_eNodeInfo & bits_NODE_FALLEN )
+				continue;
+
+			bool bNeighbor = m_NeighborsTable[node].IsBitSet( other );
+			if ( bNeighbor || m_NeighborsTable[other].IsBitSet( node ) )
+			{
+				ComputedConnection_t &connection = m_ComputedConnections[node][m_ComputedConnections[node].AddToTail()];
+				connection.otherId = other;
+				connection.bFromOther = !bNeighbor;
+				connection.pass = 0;
+			}
+		}
+	}
+
+	int nTestHulls = ( g_pThreadPool ) ? g_pThreadPool->NumThreads() + 1 : 1;
+	for ( int i = 0; i < nTestHulls; i++ )
+	{
+		CAI_TestHull *pTestHull = CREATE_ENTITY( CAI_TestHull, "aitesthull" );
+		pTestHull->Spawn();
+		pTestHull->AddFlag( FL_NPC );
+		pTestHull->GetNavigator()->SetNetwork( pNetwork );
+		m_FreeTestHulls.AddToTail( pTestHull );
+	}
+
+	m_pComputeNetwork = pNetwork;
+
+	CUtlVector<int> rows;
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		// When no hull can use the first direction, InitLinks() tries again
+		// from the other node
+		if ( pass == 1 )
+		{
+			for ( int node = 0; node < nNodes; node++ )
+			{
+				int nConnections = m_ComputedConnections[node].Count();
+				for ( int i = 0; i < nConnections; i++ )
+				{
+					ComputedConnection_t &connection = m_ComputedConnections[node][i];
+					if ( connection.bFromOther || !m_NeighborsTable[connection.otherId].IsBitSet( node ) )
+						continue;
+
+					int hull;
+					for ( hull = 0; hull < NUM_HULLS; hull++ )
+					{
+						if ( connection.acceptedMotions[hull] != 0 )
+							break;
+					}
+
+					if ( hull == NUM_HULLS )
+					{
+						ComputedConnection_t &reverse = m_ComputedConnections[node][m_ComputedConnections[node].AddToTail()];
+						reverse.otherId = m_ComputedConnections[node][i].otherId;
+						reverse.bFromOther = true;
+						reverse.pass = 1;
+					}
+				}
+			}
+		}
+
+		rows.RemoveAll();
+		for ( int node = 0; node < nNodes; node++ )
+		{
+			if ( m_ComputedConnections[node].Count() && m_ComputedConnections[node].Tail().pass == pass )
+				rows.AddToTail( node );
+		}
+
+		if ( !rows.Count() )
+			continue;
+
+		m_iComputePass = pass;
+
+		for ( int hull = 0; hull < NUM_HULLS; hull++ )
+		{
+			// Resizing a hull relinks it and flags are networked, so set up
+			// everything ComputeConnection() needs here rather than on a worker
+			for ( int i = 0; i < m_FreeTestHulls.Count(); i++ )
+			{
+				m_FreeTestHulls[i]->SetHullType( (Hull_t)hull );
+				m_FreeTestHulls[i]->SetHullSizeNormal( true );
+				m_FreeTestHulls[i]->AddFlag( FL_ONGROUND );
+				m_FreeTestHulls[i]->SetGravity( 1.0 );
+			}
+
+			m_ComputeHull = (Hull_t)hull;
+			ParallelProcess( "CAI_NetworkBuilder::ComputeConnectionsForNode", rows.Base(), rows.Count(), this, &CAI_NetworkBuilder::ComputeConnectionsForNode );
+		}
+	}
+
+	m_pComputeNetwork = NULL;
+
+	Assert( m_FreeTestHulls.Count() == nTestHulls );
+	for ( int i = 0; i < m_FreeTestHulls.Count(); i++ )
+	{
+		UTIL_RemoveImmediate( m_FreeTestHulls[i] );
+	}
+	m_FreeTestHulls.RemoveAll();
+
+	return nTestHulls;
+}
+
+//-------------------------------------
+
+void CAI_NetworkBuilder::ComputeConnectionsForNode( int &nodeID )
+{
+	CAI_TestHull *pTestHull = NULL;
+	{
+		AUTO_LOCK_FM( m_FreeTestHullsMutex );
+		Assert( m_FreeTestHulls.Count() );
+		pTestHull = m_FreeTestHulls.Tail();
+		m_FreeTestHulls.RemoveMultipleFromTail( 1 );
+	}
+
+	CAI_Node *pNode = m_pComputeNetwork->GetNode( nodeID );
+	CUtlVector<ComputedConnection_t> &connections = m_ComputedConnections[nodeID];
+
+	for ( int i = 0; i < connections.Count(); i++ )
+	{
+		ComputedConnection_t &connection = connections[i];
+		if ( connection.pass != m_iComputePass )
+			continue;
+
+		CAI_Node *pOtherNode = m_pComputeNetwork->GetNode( connection.otherId );
+		if ( connection.bFromOther )
+			connection.acceptedMotions[m_ComputeHull] = ComputeConnection( pTestHull, pOtherNode, pNode, m_ComputeHull );
+		else
+			connection.acceptedMotions[m_ComputeHull] = ComputeConnection( pTestHull, pNode, pOtherNode, m_ComputeHull );
+	}
+
+	AUTO_LOCK_FM( m_FreeTestHullsMutex );
+	m_FreeTestHulls.AddToTail( pTestHull );
+}
+
+//-------------------------------------
+
+bool CAI_NetworkBuilder::GetComputedConnection( int srcId, int destId, int *pAcceptedMotions )
+{
+	int node = MIN( srcId, destId );
+	int otherId = MAX( srcId, destId );
+	bool bFromOther = ( srcId > destId );
+
+	if ( node >= m_ComputedConnections.Count() )
+		return false;
+
+	CUtlVector<ComputedConnection_t> &connections = m_ComputedConnections[node];
+	for ( int i = 0; i < connections.Count(); i++ )
+	{
+		if ( connections[i].otherId == otherId && connections[i].bFromOther == bFromOther )
+		{
+			memcpy( pAcceptedMotions, connections[i].acceptedMotions, sizeof( connections[i].acceptedMotions ) );
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
@@ -9,6 +9,7 @@
 
 #include "utlvector.h"
 #include "bitstring.h"
+#include "ai_hull.h"
 
 #if defined( _WIN32 )
 #pragma once
@@ -112,7 +113,12 @@ private:
 	
 	void			FloodFillZone( CAI_Node **ppNodes, CAI_Node *pNode, int zone );
 
-	int				ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull );
+	int				ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull )	{ return ComputeConnection( m_pTestHull, pSrcNode, pDestNode, hull ); }
+	int				ComputeConnection( CAI_TestHull *pTestHull, CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull );
+
+	int				ComputeConnections( CAI_Network *pNetwork );
+	void			ComputeConnectionsForNode( int &nodeID );
+	bool			GetComputedConnection( int srcId, int destId, int *pAcceptedMotions );
 	
 	void 			BeginBuild();
 	void			EndBuild();
@@ -120,6 +126,25 @@ private:
 	CUtlVector<CVarBitVec>	m_NeighborsTable;
 	CVarBitVec				m_DidSetNeighborsTable;
 	CAI_TestHull *			m_pTestHull;
+
+	// Connections tested ahead of InitLinks() by worker threads, stored
+	// with the lower of the two node ids
+	struct ComputedConnection_t
+	{
+		int		otherId;
+		bool	bFromOther;		// Tested from otherId to the row's node
+		int		pass;
+		int		acceptedMotions[NUM_HULLS];
+	};
+
+	CUtlVector< CUtlVector<ComputedConnection_t> > m_ComputedConnections;
+
+	// Only valid during ComputeConnections()
+	CAI_Network *				m_pComputeNetwork;
+	Hull_t						m_ComputeHull;
+	int							m_iComputePass;
+	CUtlVector<CAI_TestHull *>	m_FreeTestHulls;
+	CThreadFastMutex			m_FreeTestHullsMutex;
 };
 
 extern CAI_NetworkBuilder g_AINetworkBuilder;
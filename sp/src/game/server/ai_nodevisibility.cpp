@@ -0,0 +1,272 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Precomputed world visibility between the nodes of an AI network
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "utlbuffer.h"
+#include "vstdlib/jobthread.h"
+
+#include "ai_nodevisibility.h"
+
+#include "ai_node.h"
+#include "ai_network.h"
+#include "ai_link.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar ai_node_visibility_max_dist( "ai_node_visibility_max_dist", "2048", FCVAR_NONE, "Node pairs further apart than this are left out of the precomputed visibility. Applies the next time the node graph is built." );
+
+#define AI_NODE_VISIBILITY_TAG		MAKEID('N','V','I','S')
+#define AI_NODE_VISIBILITY_VERSION	1
+
+//-----------------------------------------------------------------------------
+
+CAI_NodeVisibility::CAI_NodeVisibility()
+ :	m_nNodes( 0 ),
+	m_pBuildNetwork( NULL ),
+	m_BuildHull( HULL_HUMAN )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_NodeVisibility::Init( int nNodes )
+{
+	Purge();
+
+	m_nNodes = nNodes;
+	m_RowStart.SetCount( nNodes + 1 );
+
+	int nWords = 0;
+	for ( int node = 0; node < nNodes; node++ )
+	{
+		m_RowStart[node] = nWords;
+		nWords += ( nNodes - node - 1 + 31 ) / 32;
+	}
+	m_RowStart[nNodes] = nWords;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_NodeVisibility::Purge()
+{
+	m_nNodes = 0;
+	m_RowStart.Purge();
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		m_Bits[hull].Purge();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Where the visibility of a node is measured from for the hull
+//-----------------------------------------------------------------------------
+
+Vector CAI_NodeVisibility::GetEyePosition( CAI_Node *pNode, Hull_t hull )
+{
+	Vector vecEye = pNode->GetPosition( hull );
+	vecEye.z += NAI_Hull::Mins( hull ).z + NAI_Hull::Height( hull ) * 0.9f;
+	return vecEye;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Computes the visibility for every hull used by a link of the
+//			network. Rows are traced in parallel.
+//-----------------------------------------------------------------------------
+
+void CAI_NodeVisibility::Build( CAI_Network *pNetwork )
+{
+	int nNodes = pNetwork->NumNodes();
+	Init( nNodes );
+
+	if ( !nNodes )
+		return;
+
+	int hullsUsed = 0;
+	for ( int node = 0; node < nNodes; node++ )
+	{
+		CAI_Node *pNode = pNetwork->GetNode( node );
+		for ( int link = 0; link < pNode->NumLinks(); link++ )
+		{
+			CAI_Link *pLink = pNode->GetLinkByIndex( link );
+			for ( int hull = 0; hull < NUM_HULLS; hull++ )
+			{
+				if ( pLink->m_iAcceptedMoveTypes[hull] )
+					hullsUsed |= ( 1 << hull );
+			}
+		}
+	}
+
+	CUtlVector<int> rows;
+	rows.SetCount( nNodes );
+	for ( int node = 0; node < nNodes; node++ )
+	{
+		rows[node] = node;
+	}
+
+	m_pBuildNetwork = pNetwork;
+
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		if ( !( hullsUsed & ( 1 << hull ) ) )
+			continue;
+
+		m_Bits[hull].SetCount( MAX( m_RowStart[nNodes], 1 ) );
+		memset( m_Bits[hull].Base(), 0, m_Bits[hull].Count() * sizeof( uint32 ) );
+
+		m_BuildHull = (Hull_t)hull;
+		ParallelProcess( "CAI_NodeVisibility::BuildRow", rows.Base(), rows.Count(), this, &CAI_NodeVisibility::BuildRow );
+	}
+
+	m_pBuildNetwork = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Traces one node against every later node. Only touches the node's
+//			own row, so rows may run on different threads.
+//-----------------------------------------------------------------------------
+
+void CAI_NodeVisibility::BuildRow( int &nodeID )
+{
+	CAI_Node *pNode = m_pBuildNetwork->GetNode( nodeID );
+	if ( pNode->GetType() == NODE_DELETED )
+		return;
+
+	float flMaxDistSqr = Square( ai_node_visibility_max_dist.GetFloat() );
+	Vector vecEye = GetEyePosition( pNode, m_BuildHull );
+	uint32 *pRow = m_Bits[m_BuildHull].Base() + m_RowStart[nodeID];
+
+	CTraceFilterWorldOnly filter;
+	trace_t tr;
+
+	for ( int testID = nodeID + 1; testID < m_nNodes; testID++ )
+	{
+		CAI_Node *pTestNode = m_pBuildNetwork->GetNode( testID );
+		if ( pTestNode->GetType() == NODE_DELETED )
+			continue;
+
+		Vector vecTestEye = GetEyePosition( pTestNode, m_BuildHull );
+		if ( ( vecTestEye - vecEye ).LengthSqr() > flMaxDistSqr )
+			continue;
+
+		UTIL_TraceLine( vecEye, vecTestEye, MASK_BLOCKLOS, &filter, &tr );
+
+		// A node inside geometry says nothing about the other one
+		if ( tr.startsolid || tr.fraction == 1.0 )
+			continue;
+
+		int bit = testID - nodeID - 1;
+		pRow[bit >> 5] |= ( 1u << ( bit & 31 ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the bits run length encoded, as (count, byte) pairs. Far
+//			apart pairs are never set, so long runs of zeros are common.
+//-----------------------------------------------------------------------------
+
+void CAI_NodeVisibility::Save( CUtlBuffer &buf ) const
+{
+	int hullsSaved = 0;
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		if ( HasHull( (Hull_t)hull ) )
+			hullsSaved |= ( 1 << hull );
+	}
+
+	buf.PutInt( AI_NODE_VISIBILITY_TAG );
+	buf.PutInt( AI_NODE_VISIBILITY_VERSION );
+	buf.PutInt( m_nNodes );
+	buf.PutInt( hullsSaved );
+
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		if ( !( hullsSaved & ( 1 << hull ) ) )
+			continue;
+
+		const byte *pBytes = (const byte *)m_Bits[hull].Base();
+		int nBytes = m_Bits[hull].Count() * sizeof( uint32 );
+
+		CUtlBuffer rle;
+		for ( int i = 0; i < nBytes; )
+		{
+			int run = 1;
+			while ( i + run < nBytes && run < 255 && pBytes[i + run] == pBytes[i] )
+			{
+				run++;
+			}
+
+			rle.PutUnsignedChar( run );
+			rle.PutUnsignedChar( pBytes[i] );
+			i += run;
+		}
+
+		buf.PutInt( nBytes );
+		buf.PutInt( rle.TellPut() );
+		buf.Put( rle.Base(), rle.TellPut() );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads what Save() wrote. Graphs saved without visibility, or for
+//			a different node count, are left without it.
+//-----------------------------------------------------------------------------
+
+bool CAI_NodeVisibility::Load( CUtlBuffer &buf, int nNodes )
+{
+	Purge();
+
+	if ( buf.GetBytesRemaining() < 4 * (int)sizeof( int ) )
+		return false;
+
+	if ( buf.GetInt() != AI_NODE_VISIBILITY_TAG || buf.GetInt() != AI_NODE_VISIBILITY_VERSION || buf.GetInt() != nNodes )
+		return false;
+
+	int hullsSaved = buf.GetInt();
+
+	Init( nNodes );
+
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		if ( !( hullsSaved & ( 1 << hull ) ) )
+			continue;
+
+		int nBytes = buf.GetInt();
+		int nEncoded = buf.GetInt();
+
+		if ( nBytes != MAX( m_RowStart[nNodes], 1 ) * (int)sizeof( uint32 ) || nEncoded < 0 || nEncoded > buf.GetBytesRemaining() )
+		{
+			DevWarning( "AI node visibility is corrupt, ignoring it\n" );
+			Purge();
+			return false;
+		}
+
+		m_Bits[hull].SetCount( nBytes / sizeof( uint32 ) );
+		byte *pBytes = (byte *)m_Bits[hull].Base();
+
+		int nDecoded = 0;
+		for ( int i = 0; i < nEncoded; i += 2 )
+		{
+			int run = buf.GetUnsignedChar();
+			byte value = buf.GetUnsignedChar();
+
+			if ( nDecoded + run > nBytes )
+				break;
+
+			memset( pBytes + nDecoded, value, run );
+			nDecoded += run;
+		}
+
+		if ( nDecoded != nBytes )
+		{
+			DevWarning( "AI node visibility is corrupt, ignoring it\n" );
+			Purge();
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,86 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Precomputed world visibility between the nodes of an AI network
+//
+//=============================================================================//
+
+#ifndef AI_NODEVISIBILITY_H
+#define AI_NODEVISIBILITY_H
+
+#include "utlvector.h"
+#include "ai_hull.h"
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+class CAI_Network;
+class CAI_Node;
+class CUtlBuffer;
+
+//-----------------------------------------------------------------------------
+// CAI_NodeVisibility
+//
+// Purpose: One bit per pair of nodes and hull, set when world geometry blocks
+//			the line between the two nodes at that hull's eye height. Only
+//			static geometry is considered, so a clear bit means "trace to
+//			find out". Pairs further apart than ai_node_visibility_max_dist
+//			are never marked. Each node stores its pairs with every later
+//			node as a row padded to a whole word, so rows can be built in
+//			parallel.
+//-----------------------------------------------------------------------------
+
+class CAI_NodeVisibility
+{
+public:
+	CAI_NodeVisibility();
+
+	void			Build( CAI_Network *pNetwork );
+	void			Purge();
+
+	void			Save( CUtlBuffer &buf ) const;
+	bool			Load( CUtlBuffer &buf, int nNodes );
+
+	bool			HasHull( Hull_t hull ) const		{ return ( m_Bits[hull].Count() != 0 ); }
+	bool			IsOccluded( Hull_t hull, int nodeID1, int nodeID2 ) const;
+
+	static Vector	GetEyePosition( CAI_Node *pNode, Hull_t hull );
+
+private:
+	void			Init( int nNodes );
+	void			BuildRow( int &nodeID );
+
+	int					m_nNodes;
+	CUtlVector<int>		m_RowStart;				// First word of each node's row
+	CUtlVector<uint32>	m_Bits[NUM_HULLS];		// Empty for hulls no link accepts
+
+	// Only valid during Build()
+	CAI_Network *		m_pBuildNetwork;
+	Hull_t				m_BuildHull;
+};
+
+//-----------------------------------------------------------------------------
+
+inline bool CAI_NodeVisibility::IsOccluded( Hull_t hull, int nodeID1, int nodeID2 ) const
+{
+	if ( nodeID1 == nodeID2 || !HasHull( hull ) )
+		return false;
+
+	// Nodes added since the table was built have no rows
+	if ( (unsigned)nodeID1 >= (unsigned)m_nNodes || (unsigned)nodeID2 >= (unsigned)m_nNodes )
+		return false;
+
+	if ( nodeID1 > nodeID2 )
+	{
+		int temp = nodeID1;
+		nodeID1 = nodeID2;
+		nodeID2 = temp;
+	}
+
+	int bit = nodeID2 - nodeID1 - 1;
+	return ( m_Bits[hull][m_RowStart[nodeID1] + ( bit >> 5 )] & ( 1u << ( bit & 31 ) ) ) != 0;
+}
+
+//-----------------------------------------------------------------------------
+
+#endif // AI_NODEVISIBILITY_H
@@ -8,6 +8,8 @@
 #include "cbase.h"
 
 #include "ndebugoverlay.h"
+#include "filesystem.h"
+#include "utlbuffer.h"
 
 #include "ai_pathfinder.h"
 
@@ -20,6 +22,7 @@
 #include "ai_moveprobe.h"
 #include "ai_dynamiclink.h"
 #include "ai_hint.h"
+#include "ai_clustergraph.h"
 #include "bitstring.h"
 
 //@todo: bad dependency!
@@ -73,6 +76,13 @@ Navigation_t MoveBitsToNavType( int fBits )
 }
 
 
+//-----------------------------------------------------------------------------
+
+CAI_Pathfinder::~CAI_Pathfinder()
+{
+	CancelQueuedRoute();
+}
+
 //-----------------------------------------------------------------------------
 
 void CAI_Pathfinder::Init( CAI_Network *pNetwork )
@@ -220,19 +230,27 @@ AI_Waypoint_t* CAI_Pathfinder::MakeRouteFromParents( int *parentArray, int endID
 
 
 //------------------------------------------------------------------------------
-// Purpose : Test if stale link is no longer stale
+// Purpose : Test if stale link is no longer stale. Route jobs run this for
+//			 several NPCs at once, so the link's stale state is only touched
+//			 under g_StaleLinkMutex. The test move itself runs unlocked.
 //------------------------------------------------------------------------------
 
+static CThreadFastMutex g_StaleLinkMutex;
+
 bool CAI_Pathfinder::IsLinkStillStale(int moveType, CAI_Link *nodeLink)
 {
 	if ( m_bIgnoreStaleLinks )
 		return false;
 
-	if ( !(nodeLink->m_LinkInfo & bits_LINK_STALE_SUGGESTED ) )
-		return false;
+	{
+		AUTO_LOCK_FM( g_StaleLinkMutex );
 
-	if ( gpGlobals->curtime < nodeLink->m_timeStaleExpires )
-		return true;
+		if ( !(nodeLink->m_LinkInfo & bits_LINK_STALE_SUGGESTED ) )
+			return false;
+
+		if ( gpGlobals->curtime < nodeLink->m_timeStaleExpires )
+			return true;
+	}
 
 	// NPC should only check one stale link per think
 	if (gpGlobals->curtime == m_flLastStaleLinkCheckTime)
@@ -245,8 +263,11 @@ bool CAI_Pathfinder::IsLinkStillStale(int moveType, CAI_Link *nodeLink)
 	}
 	
 	// Test movement, if suceeds, clear the stale bit
-	if (CheckStaleRoute(GetNetwork()->GetNode(nodeLink->m_iSrcID)->GetPosition(GetHullType()),
-		GetNetwork()->GetNode(nodeLink->m_iDestID)->GetPosition(GetHullType()), moveType))
+	bool bStillStale = !CheckStaleRoute(GetNetwork()->GetNode(nodeLink->m_iSrcID)->GetPosition(GetHullType()),
+		GetNetwork()->GetNode(nodeLink->m_iDestID)->GetPosition(GetHullType()), moveType);
+
+	AUTO_LOCK_FM( g_StaleLinkMutex );
+	if ( !bStillStale )
 	{
 		nodeLink->m_LinkInfo &= ~bits_LINK_STALE_SUGGESTED;
 		return false;
@@ -272,6 +293,238 @@ int CAI_Pathfinder::NearestNodeToPoint( const Vector &vecOrigin )
 	return GetNetwork()->NearestNodeToPoint( GetOuter(), vecOrigin );
 }
 
+//-----------------------------------------------------------------------------
+// CAI_AStarScratch
+//
+// Purpose: A* bookkeeping over a dense range of IDs (nodes or cluster
+//			portals). Reused across searches; entries are not cleared between
+//			searches, an entry is only valid if its stamp matches the current
+//			search.
+//-----------------------------------------------------------------------------
+
+struct AI_PathOpenNode_t
+{
+	AI_PathOpenNode_t() {}
+	AI_PathOpenNode_t( int id, float flF ) { nodeID = id; f = flF; }
+	float	f;
+	int		nodeID;
+};
+
+class CAI_AStarScratch
+{
+public:
+	CAI_AStarScratch()
+	 :	m_iSearch( 0 ),
+		m_OpenList( 0, 0, IsLowerPriority )
+	{
+	}
+
+	void BeginSearch( int nNodes )
+	{
+		if ( nNodes > m_Stamp.Count() )
+		{
+			m_G.SetCount( nNodes );
+			m_F.SetCount( nNodes );
+			m_Parent.SetCount( nNodes );
+			m_bOpen.SetCount( nNodes );
+			m_Stamp.SetCount( nNodes );
+			ResetStamps();
+		}
+
+		m_OpenList.RemoveAll();
+
+		if ( ++m_iSearch == 0 )
+		{
+			// Wrapped, every old stamp could now look current
+			ResetStamps();
+			m_iSearch = 1;
+		}
+	}
+
+	bool IsTouched( int nodeID ) const	{ return ( m_Stamp[nodeID] == m_iSearch ); }
+	bool IsOpen( int nodeID ) const		{ return ( IsTouched( nodeID ) && m_bOpen[nodeID] ); }
+
+	void Open( int nodeID, int parentID, float g, float f )
+	{
+		m_Stamp[nodeID]		= m_iSearch;
+		m_Parent[nodeID]	= parentID;
+		m_G[nodeID]			= g;
+		m_F[nodeID]			= f;
+		m_bOpen[nodeID]		= true;
+		m_OpenList.Insert( AI_PathOpenNode_t( nodeID, f ) );
+	}
+
+	// Returns NO_NODE once the open list is exhausted. Entries superseded by a
+	// cheaper reopen are left in the heap and skipped here.
+	int PopSmallest()
+	{
+		while ( m_OpenList.Count() )
+		{
+			AI_PathOpenNode_t top = m_OpenList.ElementAtHead();
+			m_OpenList.RemoveAtHead();
+
+			if ( m_bOpen[top.nodeID] && m_F[top.nodeID] == top.f )
+			{
+				m_bOpen[top.nodeID] = false;
+				return top.nodeID;
+			}
+		}
+		return NO_NODE;
+	}
+
+	void Purge()
+	{
+		m_G.Purge();
+		m_F.Purge();
+		m_Parent.Purge();
+		m_bOpen.Purge();
+		m_Stamp.Purge();
+		m_OpenList.Purge();
+		m_iSearch = 0;
+	}
+
+	CUtlVector<float>	m_G;
+	CUtlVector<float>	m_F;
+	CUtlVector<int>		m_Parent;
+
+private:
+	static bool IsLowerPriority( const AI_PathOpenNode_t &node1, const AI_PathOpenNode_t &node2 )
+	{
+		// Higher cost is lower priority, ties go to the lower node ID like the old linear scan
+		if ( node1.f != node2.f )
+			return ( node1.f > node2.f );
+		return ( node1.nodeID > node2.nodeID );
+	}
+
+	void ResetStamps()
+	{
+		if ( m_Stamp.Count() )
+			memset( m_Stamp.Base(), 0, m_Stamp.Count() * sizeof(unsigned) );
+	}
+
+	CUtlVector<bool>		m_bOpen;
+	CUtlVector<unsigned>	m_Stamp;
+	unsigned				m_iSearch;
+
+	CUtlPriorityQueue<AI_PathOpenNode_t> m_OpenList;
+};
+
+//-----------------------------------------------------------------------------
+// CAI_PathfindScratch
+//
+// Purpose: Everything FindBestPath needs besides the network. One instance
+//			lives on each thread that pathfinds.
+//-----------------------------------------------------------------------------
+
+class CAI_PathfindScratch
+{
+public:
+	CAI_PathfindScratch()
+	 :	m_iCorridor( 0 )
+	{
+	}
+
+	// Clusters the current node search is restricted to
+	void BeginCorridor( int nClusters )
+	{
+		if ( nClusters > m_CorridorStamp.Count() )
+		{
+			int nOld = m_CorridorStamp.Count();
+			m_CorridorStamp.SetCount( nClusters );
+			memset( m_CorridorStamp.Base() + nOld, 0, ( nClusters - nOld ) * sizeof(unsigned) );
+		}
+
+		if ( ++m_iCorridor == 0 )
+		{
+			memset( m_CorridorStamp.Base(), 0, m_CorridorStamp.Count() * sizeof(unsigned) );
+			m_iCorridor = 1;
+		}
+	}
+
+	void AddToCorridor( int cluster )			{ m_CorridorStamp[cluster] = m_iCorridor; }
+	bool IsInCorridor( int cluster ) const		{ return ( m_CorridorStamp[cluster] == m_iCorridor ); }
+
+	void Purge()
+	{
+		m_Nodes.Purge();
+		m_Portals.Purge();
+		m_CorridorStamp.Purge();
+		m_iCorridor = 0;
+	}
+
+	CAI_AStarScratch		m_Nodes;
+	CAI_AStarScratch		m_Portals;
+
+private:
+	CUtlVector<unsigned>	m_CorridorStamp;
+	unsigned				m_iCorridor;
+};
+
+static CThreadLocalPtr<CAI_PathfindScratch>	g_pPathfindScratch;
+static CUtlVector<CAI_PathfindScratch *>	g_AllPathfindScratch;
+static CThreadFastMutex						g_PathfindScratchMutex;
+
+static CAI_PathfindScratch *GetPathfindScratch()
+{
+	CAI_PathfindScratch *pScratch = g_pPathfindScratch;
+	if ( !pScratch )
+	{
+		pScratch = new CAI_PathfindScratch;
+		g_pPathfindScratch = pScratch;
+
+		AUTO_LOCK_FM( g_PathfindScratchMutex );
+		g_AllPathfindScratch.AddToTail( pScratch );
+	}
+	return pScratch;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Releases the memory held by every thread's search scratch. The
+//			scratch objects themselves stay around so the thread locals remain
+//			valid. Must not be called while a search is in flight.
+//-----------------------------------------------------------------------------
+
+void CAI_Pathfinder::PurgeSearchScratch()
+{
+	AUTO_LOCK_FM( g_PathfindScratchMutex );
+	for ( int i = 0; i < g_AllPathfindScratch.Count(); i++ )
+	{
+		g_AllPathfindScratch[i]->Purge();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Hierarchical node search
+//-----------------------------------------------------------------------------
+
+ConVar ai_path_hierarchical( "ai_path_hierarchical", "1", FCVAR_NONE, "Plan long node routes over the cluster graph and refine them inside the planned clusters" );
+ConVar ai_path_hierarchical_min_dist( "ai_path_hierarchical_min_dist", "1536", FCVAR_NONE, "Routes between nodes closer than this are searched over the whole graph" );
+
+//-----------------------------------------------------------------------------
+// Route recording for ai_pathfind_benchmark
+//-----------------------------------------------------------------------------
+
+ConVar ai_pathfind_record( "ai_pathfind_record", "0", FCVAR_CHEAT, "Record the start/end node pairs passed to FindBestPath for ai_pathfind_benchmark" );
+
+struct AI_RecordedPath_t
+{
+	short	startID;
+	short	endID;
+};
+
+static CUtlVector<AI_RecordedPath_t> g_RecordedPaths;
+static CThreadFastMutex g_RecordedPathsMutex;
+
+static void RecordPathQuery( int startID, int endID )
+{
+	AI_RecordedPath_t query;
+	query.startID = startID;
+	query.endID = endID;
+
+	AUTO_LOCK_FM( g_RecordedPathsMutex );
+	g_RecordedPaths.AddToTail( query );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Build a path between two nodes
 //-----------------------------------------------------------------------------
@@ -287,39 +540,143 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 	m_nPerfStatPB++;
 #endif
 
-	int nNodes = GetNetwork()->NumNodes();
+	if ( ai_pathfind_record.GetBool() )
+		RecordPathQuery( startID, endID );
+
+	if ( ai_path_hierarchical.GetBool() )
+	{
+		const CAI_ClusterLayer *pLayer = GetNetwork()->GetClusterGraph()->GetLayer( GetHullType(), CapabilitiesGet() );
+		if ( pLayer && FindClusterCorridor( pLayer, startID, endID ) )
+		{
+			AI_Waypoint_t *route = SearchNodePath( startID, endID, pLayer );
+			if ( route )
+				return route;
+
+			// The cluster plan knows nothing about dynamic links, locked nodes
+			// and the like, so try again over the whole graph
+		}
+	}
+
+	return SearchNodePath( startID, endID, NULL );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Plans a route over the cluster portals of pLayer and marks the
+//			clusters it passes through as the corridor for SearchNodePath.
+//			Returns false if the route is too short to be worth planning or
+//			no plan could be found.
+//-----------------------------------------------------------------------------
+
+bool CAI_Pathfinder::FindClusterCorridor( const CAI_ClusterLayer *pLayer, int startID, int endID )
+{
+	AI_PROFILE_SCOPE( CAI_Pathfinder_FindClusterCorridor );
+
+	int startCluster = pLayer->GetNodeCluster( startID );
+	int endCluster = pLayer->GetNodeCluster( endID );
+	if ( startCluster == endCluster )
+		return false;
+
+	if ( !pLayer->NumClusterPortals( startCluster ) || !pLayer->NumClusterPortals( endCluster ) )
+		return false;
+
 	CAI_Node **pAInode = GetNetwork()->AccessNodes();
+	Hull_t hull = GetHullType();
 
-	CVarBitVec	openBS(nNodes);
-	CVarBitVec	closeBS(nNodes);
+	Vector vecStart = pAInode[startID]->GetPosition( hull );
+	Vector vecEnd = pAInode[endID]->GetPosition( hull );
 
-	// ------------- INITIALIZE ------------------------
-	float* nodeG = (float *)stackalloc( nNodes * sizeof(float) );
-	float* nodeH = (float *)stackalloc( nNodes * sizeof(float) );
-	float* nodeF = (float *)stackalloc( nNodes * sizeof(float) );
-	int*   nodeP = (int *)stackalloc( nNodes * sizeof(int) );		// Node parent 
+	if ( ( vecEnd - vecStart ).LengthSqr() < Square( ai_path_hierarchical_min_dist.GetFloat() ) )
+		return false;
+
+	CAI_PathfindScratch *pScratch = GetPathfindScratch();
+	CAI_AStarScratch &portals = pScratch->m_Portals;
+
+	// One past the last portal stands in for the end node
+	int goal = pLayer->NumPortals();
+	portals.BeginSearch( goal + 1 );
 
-	for (int node=0;node<nNodes;node++)
+	for ( int i = 0; i < pLayer->NumClusterPortals( startCluster ); i++ )
 	{
-		nodeG[node] = FLT_MAX;
-		nodeP[node] = -1;
+		int portal = pLayer->GetClusterPortal( startCluster, i );
+		Vector vecPortal = pAInode[pLayer->GetPortalNode( portal )]->GetPosition( hull );
+
+		float g = ( vecPortal - vecStart ).Length();
+		portals.Open( portal, NO_NODE, g, g + ( vecEnd - vecPortal ).Length() );
 	}
 
-	nodeG[startID] = 0;
+	int current;
+	while ( ( current = portals.PopSmallest() ) != NO_NODE )
+	{
+		if ( current == goal )
+			break;
 
-	nodeH[startID] = 0.1*(pAInode[startID]->GetPosition(GetHullType())-pAInode[endID]->GetPosition(GetHullType())).Length(); // Don't want to over estimate
-	nodeF[startID] = nodeG[startID] + nodeH[startID];
+		int nodeID = pLayer->GetPortalNode( current );
+		float g = portals.m_G[current];
 
-	openBS.Set(startID);
-	closeBS.Set( startID );
+		if ( pLayer->GetNodeCluster( nodeID ) == endCluster )
+		{
+			float new_g = g + ( vecEnd - pAInode[nodeID]->GetPosition( hull ) ).Length();
+			if ( !portals.IsTouched( goal ) || new_g < portals.m_G[goal] )
+			{
+				portals.Open( goal, current, new_g, new_g );
+			}
+		}
 
-	// --------------- FIND BEST PATH ------------------
-	while (!openBS.IsAllClear()) 
+		for ( int i = 0; i < pLayer->NumPortalEdges( current ); i++ )
+		{
+			const AI_ClusterEdge_t &edge = pLayer->GetPortalEdge( current, i );
+
+			float new_g = g + edge.cost;
+			if ( !portals.IsTouched( edge.portal ) || new_g < portals.m_G[edge.portal] )
+			{
+				Vector vecPortal = pAInode[pLayer->GetPortalNode( edge.portal )]->GetPosition( hull );
+				portals.Open( edge.portal, current, new_g, new_g + ( vecEnd - vecPortal ).Length() );
+			}
+		}
+	}
+
+	if ( current != goal )
+		return false;
+
+	pScratch->BeginCorridor( pLayer->NumClusters() );
+	pScratch->AddToCorridor( startCluster );
+	pScratch->AddToCorridor( endCluster );
+
+	for ( int portal = portals.m_Parent[goal]; portal != NO_NODE; portal = portals.m_Parent[portal] )
 	{
-		int smallestID = CAI_Network::FindBSSmallest(&openBS,nodeF,nNodes);
-	
-		openBS.Clear(smallestID);
+		pScratch->AddToCorridor( pLayer->GetNodeCluster( pLayer->GetPortalNode( portal ) ) );
+	}
 
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: A* through the node graph. If pCorridorLayer is given, only nodes
+//			in the clusters marked by FindClusterCorridor are considered.
+//-----------------------------------------------------------------------------
+
+AI_Waypoint_t *CAI_Pathfinder::SearchNodePath( int startID, int endID, const CAI_ClusterLayer *pCorridorLayer )
+{
+	int nNodes = GetNetwork()->NumNodes();
+	CAI_Node **pAInode = GetNetwork()->AccessNodes();
+
+	// ------------- INITIALIZE ------------------------
+	CAI_PathfindScratch *pScratch = GetPathfindScratch();
+	CAI_AStarScratch &nodes = pScratch->m_Nodes;
+	nodes.BeginSearch( nNodes );
+
+	float *nodeG = nodes.m_G.Base();
+	int   *nodeP = nodes.m_Parent.Base();		// Node parent 
+
+	Vector vecEnd = pAInode[endID]->GetPosition(GetHullType());
+
+	float startH = 0.1*(pAInode[startID]->GetPosition(GetHullType())-vecEnd).Length(); // Don't want to over estimate
+	nodes.Open( startID, NO_NODE, 0, startH );
+
+	// --------------- FIND BEST PATH ------------------
+	int smallestID;
+	while ( ( smallestID = nodes.PopSmallest() ) != NO_NODE ) 
+	{
 		CAI_Node *pSmallestNode = pAInode[smallestID];
 		
 		if (GetOuter()->IsUnusableNode(smallestID, pSmallestNode->GetHint()))
@@ -327,7 +684,7 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 
 		if (smallestID == endID) 
 		{
-			AI_Waypoint_t* route = MakeRouteFromParents(&nodeP[0], endID);
+			AI_Waypoint_t* route = MakeRouteFromParents(nodeP, endID);
 			return route;
 		}
 
@@ -336,13 +693,16 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 		for (int link=0; link < pSmallestNode->NumLinks();link++) 
 		{
 			CAI_Link *nodeLink = pSmallestNode->GetLinkByIndex(link);
-			
+			int testID	 = nodeLink->DestNodeID(smallestID);
+
+			if ( pCorridorLayer && !pScratch->IsInCorridor( pCorridorLayer->GetNodeCluster( testID ) ) )
+				continue;
+
 			if (!IsLinkUsable(nodeLink,smallestID))
 				continue;
 
 			// FIXME: the cost function should take into account Node costs (danger, flanking, etc).
 			int moveType = nodeLink->m_iAcceptedMoveTypes[GetHullType()] & CapabilitiesGet();
-			int testID	 = nodeLink->DestNodeID(smallestID);
 
 			Vector r1 = pSmallestNode->GetPosition(GetHullType());
 			Vector r2 = pAInode[testID]->GetPosition(GetHullType());
@@ -353,15 +713,10 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 
 			float new_g  = nodeG[smallestID] + dist;
 
-			if ( !closeBS.IsBitSet(testID) || (new_g < nodeG[testID]) ) 
+			if ( !nodes.IsTouched(testID) || (new_g < nodeG[testID]) ) 
 			{
-				nodeP[testID] = smallestID;
-				nodeG[testID] = new_g;
-				nodeH[testID] = (pAInode[testID]->GetPosition(GetHullType())-pAInode[endID]->GetPosition(GetHullType())).Length();
-				nodeF[testID] = nodeG[testID] + nodeH[testID];
-
-				closeBS.Set( testID );
-				openBS.Set( testID );
+				float new_h = (r2-vecEnd).Length();
+				nodes.Open( testID, smallestID, new_g, new_g + new_h );
 			}
 		}
 	}
@@ -1466,6 +1821,94 @@ void CAI_Pathfinder::UnlockRouteNodes( AI_Waypoint_t *pPath )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Deferred routes
+//
+// A route queued during the game frame is built on the post frame navigation
+// job. The caller asks for the same route on its next think and gets the
+// result from TakeQueuedRoute() instead of building it again.
+//-----------------------------------------------------------------------------
+
+ConVar ai_route_query_tolerance( "ai_route_query_tolerance", "24", FCVAR_NONE, "How far the start or end of a deferred route may move before the route is built again" );
+
+void CAI_Pathfinder::QueueRoute( const Vector &vStart, const Vector &vEnd, CBaseEntity *pTarget, float goalTolerance, Navigation_t curNavType, bool bLocalSucceedOnWithinTolerance )
+{
+	CancelQueuedRoute();
+
+	m_RouteQuery.vStart = vStart;
+	m_RouteQuery.vEnd = vEnd;
+	m_RouteQuery.hTarget = pTarget;
+	m_RouteQuery.goalTolerance = goalTolerance;
+	m_RouteQuery.curNavType = curNavType;
+	m_RouteQuery.bLocalSucceedOnWithinTolerance = bLocalSucceedOnWithinTolerance;
+	m_RouteQuery.state = ROUTE_QUERY_PENDING;
+
+	PostFrameNavigationSystem()->EnqueueRouteQuery( GetOuter(), this );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Hands over a built route if it was asked for with the same
+//			arguments. The route is discarded either way.
+// Output : True if *ppRoute holds the result, which may be NULL if no route
+//			was found
+//-----------------------------------------------------------------------------
+
+bool CAI_Pathfinder::TakeQueuedRoute( const Vector &vStart, const Vector &vEnd, CBaseEntity *pTarget, float goalTolerance, Navigation_t curNavType, bool bLocalSucceedOnWithinTolerance, AI_Waypoint_t **ppRoute )
+{
+	if ( m_RouteQuery.state != ROUTE_QUERY_READY )
+	{
+		CancelQueuedRoute();
+		return false;
+	}
+
+	float flToleranceSqr = Square( ai_route_query_tolerance.GetFloat() );
+	bool bMatch = ( ( vStart - m_RouteQuery.vStart ).LengthSqr() <= flToleranceSqr &&
+					( vEnd - m_RouteQuery.vEnd ).LengthSqr() <= flToleranceSqr &&
+					m_RouteQuery.hTarget.Get() == pTarget &&
+					m_RouteQuery.goalTolerance == goalTolerance &&
+					m_RouteQuery.curNavType == curNavType &&
+					m_RouteQuery.bLocalSucceedOnWithinTolerance == bLocalSucceedOnWithinTolerance );
+
+	AI_Waypoint_t *pRoute = m_RouteQuery.pResult;
+	m_RouteQuery.pResult = NULL;
+	m_RouteQuery.state = ROUTE_QUERY_NONE;
+
+	if ( !bMatch )
+	{
+		DeleteAll( pRoute );
+		return false;
+	}
+
+	*ppRoute = pRoute;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds the queued route. Runs on a worker thread.
+//-----------------------------------------------------------------------------
+
+void CAI_Pathfinder::RunQueuedRoute()
+{
+	Assert( m_RouteQuery.state == ROUTE_QUERY_PENDING );
+
+	m_RouteQuery.pResult = BuildRoute( m_RouteQuery.vStart, m_RouteQuery.vEnd, m_RouteQuery.hTarget, m_RouteQuery.goalTolerance, m_RouteQuery.curNavType, m_RouteQuery.bLocalSucceedOnWithinTolerance );
+	m_RouteQuery.state = ROUTE_QUERY_READY;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_Pathfinder::CancelQueuedRoute()
+{
+	if ( m_RouteQuery.state == ROUTE_QUERY_PENDING )
+	{
+		// Waits for the job if it's running
+		PostFrameNavigationSystem()->CancelRouteQuery( this );
+	}
+
+	DeleteAll( &m_RouteQuery.pResult );
+	m_RouteQuery.state = ROUTE_QUERY_NONE;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Attempts to build a radial route around the given center position
 //			over a given arc size
@@ -2153,3 +2596,166 @@ void CAI_Pathfinder::CTriDebugOverlay::AddTriOverlayLine(const Vector &origin, c
 }
 
 //-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// Pathfinding benchmark
+//
+// Record queries while playing with ai_pathfind_record 1, write them out with
+// ai_pathfind_record_save, then replay them against the same .ain with
+// ai_pathfind_benchmark.
+//-----------------------------------------------------------------------------
+
+CON_COMMAND( ai_pathfind_record_save, "Saves the node pairs recorded by ai_pathfind_record. Arguments: <filename> [clear]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: ai_pathfind_record_save <filename> [clear]\n" );
+		return;
+	}
+
+	if ( !g_pBigAINet )
+		return;
+
+	FileHandle_t fh = filesystem->Open( args[1], "wt", "DEFAULT_WRITE_PATH" );
+	if ( !fh )
+	{
+		Warning( "Couldn't create %s!\n", args[1] );
+		return;
+	}
+
+	AUTO_LOCK_FM( g_RecordedPathsMutex );
+
+	filesystem->FPrintf( fh, "%s %d\n", STRING( gpGlobals->mapname ), g_pBigAINet->NumNodes() );
+	for ( int i = 0; i < g_RecordedPaths.Count(); i++ )
+	{
+		filesystem->FPrintf( fh, "%d %d\n", g_RecordedPaths[i].startID, g_RecordedPaths[i].endID );
+	}
+	filesystem->Close( fh );
+
+	Msg( "Saved %d path queries to %s\n", g_RecordedPaths.Count(), args[1] );
+
+	if ( args.ArgC() > 2 && atoi( args[2] ) )
+	{
+		g_RecordedPaths.RemoveAll();
+	}
+}
+
+CON_COMMAND( ai_pathfind_benchmark, "Replays recorded node pairs through FindBestPath. Arguments: <filename> [iterations] [npc name]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: ai_pathfind_benchmark <filename> [iterations] [npc name]\n" );
+		return;
+	}
+
+	if ( !g_pBigAINet || !g_pBigAINet->NumNodes() )
+	{
+		Warning( "ai_pathfind_benchmark: no node graph loaded\n" );
+		return;
+	}
+
+	int nIterations = ( args.ArgC() > 2 ) ? MAX( atoi( args[2] ), 1 ) : 1;
+
+	// Routes are built from the point of view of an NPC, so we need one to hang the search off
+	CAI_BaseNPC *pNPC = NULL;
+	if ( args.ArgC() > 3 )
+	{
+		CBaseEntity *pEntity = gEntList.FindEntityByName( NULL, args[3] );
+		pNPC = pEntity ? pEntity->MyNPCPointer() : NULL;
+	}
+	else if ( g_AI_Manager.NumAIs() )
+	{
+		pNPC = g_AI_Manager.AccessAIs()[0];
+	}
+
+	if ( !pNPC || !pNPC->GetPathfinder() )
+	{
+		Warning( "ai_pathfind_benchmark: need an NPC to route with\n" );
+		return;
+	}
+
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	if ( !filesystem->ReadFile( args[1], "MOD", buf ) )
+	{
+		Warning( "Couldn't read %s!\n", args[1] );
+		return;
+	}
+
+	char szLine[256];
+	buf.GetLine( szLine, sizeof( szLine ) );
+
+	char szMapName[128];
+	int nRecordedNodes = 0;
+	if ( sscanf( szLine, "%127s %d", szMapName, &nRecordedNodes ) != 2 || nRecordedNodes != g_pBigAINet->NumNodes() )
+	{
+		Warning( "ai_pathfind_benchmark: %s was not recorded against the current node graph\n", args[1] );
+		return;
+	}
+
+	CUtlVector<AI_RecordedPath_t> queries;
+	while ( buf.IsValid() )
+	{
+		buf.GetLine( szLine, sizeof( szLine ) );
+
+		int startID, endID;
+		if ( sscanf( szLine, "%d %d", &startID, &endID ) != 2 )
+			continue;
+
+		if ( startID < 0 || startID >= nRecordedNodes || endID < 0 || endID >= nRecordedNodes )
+			continue;
+
+		AI_RecordedPath_t query;
+		query.startID = startID;
+		query.endID = endID;
+		queries.AddToTail( query );
+	}
+
+	if ( !queries.Count() )
+	{
+		Warning( "ai_pathfind_benchmark: %s has no queries\n", args[1] );
+		return;
+	}
+
+	// Don't record ourselves
+	bool bWasRecording = ai_pathfind_record.GetBool();
+	ai_pathfind_record.SetValue( 0 );
+
+	CAI_Pathfinder *pPathfinder = pNPC->GetPathfinder();
+	int nFound = 0;
+	float flTotalMs = 0;
+	float flWorstMs = 0;
+	CFastTimer timer;
+
+	for ( int iteration = 0; iteration < nIterations; iteration++ )
+	{
+		for ( int i = 0; i < queries.Count(); i++ )
+		{
+			timer.Start();
+			AI_Waypoint_t *pRoute = pPathfinder->FindBestPath( queries[i].startID, queries[i].endID );
+			timer.End();
+
+			float flMs = timer.GetDuration().GetMillisecondsF();
+			flTotalMs += flMs;
+			flWorstMs = MAX( flWorstMs, flMs );
+
+			if ( pRoute )
+			{
+				nFound++;
+				DeleteAll( pRoute );
+			}
+		}
+	}
+
+	ai_pathfind_record.SetValue( bWasRecording );
+
+	int nTotal = queries.Count() * nIterations;
+	Msg( "ai_pathfind_benchmark: %d queries (%d nodes) with %s\n", nTotal, nRecordedNodes, pNPC->GetDebugName() );
+	Msg( "    routes found: %d\n", nFound );
+	Msg( "    total: %.3f ms, average: %.4f ms, worst: %.4f ms\n", flTotalMs, flTotalMs / nTotal, flWorstMs );
+}
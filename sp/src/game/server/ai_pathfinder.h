@@ -20,6 +20,7 @@ struct OverlayLine_t;
 struct AI_Waypoint_t;
 class CAI_Link;
 class CAI_Network;
+class CAI_ClusterLayer;
 class CAI_Node;
 
 
@@ -38,6 +39,34 @@ enum RouteBuildFlags_e
 	bits_BUILD_GET_CLOSE	=			0x00000100, // the route will be built even if it can't reach the destination
 };
 
+//-----------------------------------------------------------------------------
+// A BuildRoute() call handed off to the post frame navigation job
+
+enum AI_RouteQueryState_t
+{
+	ROUTE_QUERY_NONE,
+	ROUTE_QUERY_PENDING,	// Queued this frame, waiting for the job
+	ROUTE_QUERY_READY,		// Built, waiting to be taken on the next think
+};
+
+struct AI_RouteQuery_t
+{
+	AI_RouteQuery_t()
+	 :	state( ROUTE_QUERY_NONE ),
+		pResult( NULL )
+	{
+	}
+
+	AI_RouteQueryState_t	state;
+	Vector					vStart;
+	Vector					vEnd;
+	EHANDLE					hTarget;
+	float					goalTolerance;
+	Navigation_t			curNavType;
+	bool					bLocalSucceedOnWithinTolerance;
+	AI_Waypoint_t *			pResult;
+};
+
 //-----------------------------------------------------------------------------
 // CAI_Pathfinder
 //
@@ -55,6 +84,8 @@ public:
 	{
 	}
 
+	~CAI_Pathfinder();
+
 	void Init( CAI_Network *pNetwork );
 	
 	//---------------------------------
@@ -74,6 +105,15 @@ public:
 	AI_Waypoint_t *BuildRoute( const Vector &vStart, const Vector &vEnd, CBaseEntity *pTarget, float goalTolerance, Navigation_t curNavType = NAV_NONE, bool bLocalSucceedOnWithinTolerance = false );
 	void UnlockRouteNodes( AI_Waypoint_t * );
 
+	// Deferred routes, see CPostFrameNavigationHook
+	void QueueRoute( const Vector &vStart, const Vector &vEnd, CBaseEntity *pTarget, float goalTolerance, Navigation_t curNavType, bool bLocalSucceedOnWithinTolerance );
+	bool TakeQueuedRoute( const Vector &vStart, const Vector &vEnd, CBaseEntity *pTarget, float goalTolerance, Navigation_t curNavType, bool bLocalSucceedOnWithinTolerance, AI_Waypoint_t **ppRoute );
+	void RunQueuedRoute();
+	void CancelQueuedRoute();
+
+	bool HasQueuedRoute() const			{ return ( m_RouteQuery.state != ROUTE_QUERY_NONE ); }
+	bool IsQueuedRoutePending() const	{ return ( m_RouteQuery.state == ROUTE_QUERY_PENDING ); }
+
 	// --------------------------------
 
 	void SetIgnoreBadLinks()		{ m_bIgnoreStaleLinks = true; } // lasts only for the next pathfind
@@ -101,6 +141,10 @@ public:
 	
 	void DrawDebugGeometryOverlays( int m_debugOverlays );
 
+	// --------------------------------
+
+	static void PurgeSearchScratch();
+
 protected:
 	virtual bool	CanUseLocalNavigation() { return true; }
 
@@ -116,6 +160,9 @@ private:
 
 	//---------------------------------
 	
+	bool			FindClusterCorridor( const CAI_ClusterLayer *pLayer, int startID, int endID );
+	AI_Waypoint_t*	SearchNodePath( int startID, int endID, const CAI_ClusterLayer *pCorridorLayer );
+
 	AI_Waypoint_t*	MakeRouteFromParents(int *parentArray, int endID);
 	AI_Waypoint_t*	CreateNodeWaypoint( Hull_t hullType, int nodeID, int nodeFlags = 0 );
 	
@@ -188,6 +235,8 @@ private:
 	float m_flLastStaleLinkCheckTime;	// Last time I check for a stale link
 	bool m_bIgnoreStaleLinks;
 
+	AI_RouteQuery_t m_RouteQuery;
+
 	//---------------------------------
 	
 	CAI_Network *GetNetwork()				{ return m_pNetwork; }
@@ -13,6 +13,7 @@
 #include "team.h"
 #include "ai_basenpc.h"
 #include "saverestore_utlvector.h"
+#include "querycache.h"
 
 #ifdef PORTAL
 	#include "portal_util_shared.h"
@@ -38,6 +39,18 @@ const float AI_MISC_SEARCH_TIME  = 0.45;
 //-----------------------------------------------------------------------------
 
 CAI_SensedObjectsManager g_AI_SensedObjectsManager;
+CAI_NPCGrid g_AI_NPCGrid;
+
+ConVar ai_npc_grid( "ai_npc_grid", "1", FCVAR_NONE, "Use a spatial grid to find the NPCs an NPC could see" );
+
+#define AI_NPC_GRID_CELL_SIZE	1024.0f
+#define AI_NPC_GRID_SLOP		128.0f		// Allows for NPCs moving after the grid was built
+#define AI_NPC_GRID_MIN_NPCS	24			// Fewer NPCs are just scanned
+
+ConVar ai_senses_los_cache( "ai_senses_los_cache", "1", FCVAR_NONE, "Resolve sight traces through the query cache, which retraces them on worker threads before entities think" );
+ConVar ai_senses_los_cache_interval( "ai_senses_los_cache_interval", "0.2", FCVAR_NONE, "How old a cached sight result may be before it is traced again" );
+
+extern ConVar ai_LOS_mode;
 
 //-----------------------------------------------------------------------------
 
@@ -167,7 +180,25 @@ bool CAI_Senses::ShouldSeeEntity( CBaseEntity *pSightEnt )
 
 bool CAI_Senses::CanSeeEntity( CBaseEntity *pSightEnt )
 {
-	return ( GetOuter()->FInViewCone( pSightEnt ) && GetOuter()->FVisible( pSightEnt ) );
+	if ( !ai_senses_los_cache.GetBool() || ai_LOS_mode.GetBool() )
+	{
+		return ( GetOuter()->FInViewCone( pSightEnt ) && GetOuter()->FVisible( pSightEnt ) );
+	}
+
+	float flInterval = ai_senses_los_cache_interval.GetFloat();
+
+	if ( !GetOuter()->FInViewCone( pSightEnt ) )
+	{
+		// Have the trace ready in case it turns into view
+		if ( !( pSightEnt->GetFlags() & FL_NOTARGET ) )
+		{
+			PrefetchEntityVisibility( GetOuter(), pSightEnt, COLLISION_GROUP_NONE, MASK_BLOCKLOS_AND_NPCS, flInterval );
+		}
+		return false;
+	}
+
+	CQueryCacheVisibilityScope cacheScope( flInterval );
+	return GetOuter()->FVisible( pSightEnt );
 }
 
 #ifdef PORTAL
@@ -496,14 +527,37 @@ int CAI_Senses::LookForNPCs( int iDistance )
 			BeginGather();
 
 			CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
-			
-			for ( i = 0; i < g_AI_Manager.NumAIs(); i++ )
+
+			if ( g_AI_NPCGrid.ShouldUse() )
 			{
-				if ( ppAIs[i] != GetOuter() && ( ppAIs[i]->ShouldNotDistanceCull() || origin.DistToSqr(ppAIs[i]->GetAbsOrigin()) < distSq ) )
+				CUtlVector<int> candidates;
+				g_AI_NPCGrid.GetNPCsInRadius( origin, iDistance, &candidates );
+
+				for ( int j = 0; j < candidates.Count(); j++ )
 				{
-					if ( Look( ppAIs[i] ) )
+					i = candidates[j];
+					if ( i >= g_AI_Manager.NumAIs() )
+						break;
+
+					if ( ppAIs[i] != GetOuter() && ( ppAIs[i]->ShouldNotDistanceCull() || origin.DistToSqr(ppAIs[i]->GetAbsOrigin()) < distSq ) )
 					{
-						nSeen++;
+						if ( Look( ppAIs[i] ) )
+						{
+							nSeen++;
+						}
+					}
+				}
+			}
+			else
+			{
+				for ( i = 0; i < g_AI_Manager.NumAIs(); i++ )
+				{
+					if ( ppAIs[i] != GetOuter() && ( ppAIs[i]->ShouldNotDistanceCull() || origin.DistToSqr(ppAIs[i]->GetAbsOrigin()) < distSq ) )
+					{
+						if ( Look( ppAIs[i] ) )
+						{
+							nSeen++;
+						}
 					}
 				}
 			}
@@ -810,3 +864,136 @@ END_SCRIPTDESC();
 #endif
 
 //=============================================================================
+
+//=============================================================================
+//
+// CAI_NPCGrid
+//
+//=============================================================================
+
+CAI_NPCGrid::CAI_NPCGrid()
+ :	m_iBuildTick( -1 ),
+	m_iBuildSerial( -1 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+bool CAI_NPCGrid::ShouldUse()
+{
+	return ( ai_npc_grid.GetBool() && g_AI_Manager.NumAIs() >= AI_NPC_GRID_MIN_NPCS );
+}
+
+//-----------------------------------------------------------------------------
+
+int __cdecl CAI_NPCGrid::EntryCompare( const void *pLeft, const void *pRight )
+{
+	const Entry_t *pLeftEntry = (const Entry_t *)pLeft;
+	const Entry_t *pRightEntry = (const Entry_t *)pRight;
+
+	if ( pLeftEntry->key != pRightEntry->key )
+		return ( pLeftEntry->key < pRightEntry->key ) ? -1 : 1;
+
+	return pLeftEntry->index - pRightEntry->index;
+}
+
+//-----------------------------------------------------------------------------
+
+static int __cdecl IndexCompare( const int *pLeft, const int *pRight )
+{
+	return *pLeft - *pRight;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_NPCGrid::Update()
+{
+	if ( m_iBuildTick == gpGlobals->tickcount && m_iBuildSerial == g_AI_Manager.GetChangeSerial() )
+		return;
+
+	AI_PROFILE_SCOPE( CAI_NPCGrid_Update );
+
+	m_iBuildTick = gpGlobals->tickcount;
+	m_iBuildSerial = g_AI_Manager.GetChangeSerial();
+
+	m_Entries.RemoveAll();
+	m_AlwaysIncluded.RemoveAll();
+
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+	{
+		if ( ppAIs[i]->ShouldNotDistanceCull() )
+		{
+			m_AlwaysIncluded.AddToTail( i );
+			continue;
+		}
+
+		const Vector &vecOrigin = ppAIs[i]->GetAbsOrigin();
+
+		Entry_t &entry = m_Entries[m_Entries.AddToTail()];
+		entry.key = CellKey( (int)floor( vecOrigin.x / AI_NPC_GRID_CELL_SIZE ), (int)floor( vecOrigin.y / AI_NPC_GRID_CELL_SIZE ) );
+		entry.index = i;
+	}
+
+	if ( m_Entries.Count() > 1 )
+		qsort( m_Entries.Base(), m_Entries.Count(), sizeof( Entry_t ), EntryCompare );
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_NPCGrid::GetNPCsInRadius( const Vector &vecOrigin, float flRadius, CUtlVector<int> *pResult )
+{
+	Update();
+
+	pResult->RemoveAll();
+
+	float flExtent = flRadius + AI_NPC_GRID_SLOP;
+	int x0 = (int)floor( ( vecOrigin.x - flExtent ) / AI_NPC_GRID_CELL_SIZE );
+	int y0 = (int)floor( ( vecOrigin.y - flExtent ) / AI_NPC_GRID_CELL_SIZE );
+	int x1 = (int)floor( ( vecOrigin.x + flExtent ) / AI_NPC_GRID_CELL_SIZE );
+	int y1 = (int)floor( ( vecOrigin.y + flExtent ) / AI_NPC_GRID_CELL_SIZE );
+
+	if ( (int64)( x1 - x0 + 1 ) * (int64)( y1 - y0 + 1 ) > m_Entries.Count() )
+	{
+		// Cheaper to test every entry than to visit every cell
+		for ( int i = 0; i < m_Entries.Count(); i++ )
+		{
+			int x = (short)( m_Entries[i].key >> 16 );
+			int y = (short)( m_Entries[i].key & 0xffff );
+			if ( x >= x0 && x <= x1 && y >= y0 && y <= y1 )
+				pResult->AddToTail( m_Entries[i].index );
+		}
+	}
+	else
+	{
+		for ( int x = x0; x <= x1; x++ )
+		{
+			for ( int y = y0; y <= y1; y++ )
+			{
+				int key = CellKey( x, y );
+
+				// Find the first entry of the cell
+				int low = 0;
+				int high = m_Entries.Count();
+				while ( low < high )
+				{
+					int mid = ( low + high ) / 2;
+					if ( m_Entries[mid].key < key )
+						low = mid + 1;
+					else
+						high = mid;
+				}
+
+				for ( int i = low; i < m_Entries.Count() && m_Entries[i].key == key; i++ )
+				{
+					pResult->AddToTail( m_Entries[i].index );
+				}
+			}
+		}
+	}
+
+	pResult->AddVectorToTail( m_AlwaysIncluded );
+
+	// Look in the same order as a scan of g_AI_Manager would
+	pResult->Sort( IndexCompare );
+}
@@ -174,6 +174,47 @@ private:
 extern CAI_SensedObjectsManager g_AI_SensedObjectsManager;
 
 //-----------------------------------------------------------------------------
+// class CAI_NPCGrid
+//
+// Purpose: Buckets the NPCs in g_AI_Manager on a 2D grid so looking for
+//			NPCs doesn't have to visit every NPC. Rebuilt on first use each
+//			tick, or when an NPC is added or removed. Callers still test the
+//			real distance, since NPCs that think later in the tick move.
+//-----------------------------------------------------------------------------
+
+class CAI_NPCGrid
+{
+public:
+	CAI_NPCGrid();
+
+	bool	ShouldUse();
+
+	// Fills pResult with the g_AI_Manager indices of the NPCs that may be
+	// within flRadius of vecOrigin, in increasing order. NPCs that are never
+	// distance culled are always included.
+	void	GetNPCsInRadius( const Vector &vecOrigin, float flRadius, CUtlVector<int> *pResult );
+
+private:
+	void	Update();
+
+	static int	CellKey( int x, int y )	{ return ( ( x & 0xffff ) << 16 ) | ( y & 0xffff ); }
+	static int	__cdecl EntryCompare( const void *pLeft, const void *pRight );
+
+	struct Entry_t
+	{
+		int	key;
+		int	index;
+	};
+
+	CUtlVector<Entry_t>	m_Entries;			// Sorted by cell
+	CUtlVector<int>		m_AlwaysIncluded;
+	int					m_iBuildTick;
+	int					m_iBuildSerial;
+};
+
+extern CAI_NPCGrid g_AI_NPCGrid;
+
+//-----------------------------------------------------------------------------
 
 
 
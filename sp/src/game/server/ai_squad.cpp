@@ -186,6 +186,7 @@ BEGIN_SIMPLE_DATADESC( CAI_Squad )
  	DEFINE_FIELD( m_nSquadSoundPriority,		FIELD_INTEGER ),
 	DEFINE_FIELD( m_hSquadInflictor,			FIELD_EHANDLE ),
 	DEFINE_AUTO_ARRAY( m_SquadData,				FIELD_INTEGER ),
+	//							m_TacticalCache		(not saved)
  	//							m_pLastFoundEnemyInfo  (think transient)
 
 #ifdef PER_ENEMY_SQUADSLOTS
@@ -9,6 +9,7 @@
 
 #include "ai_memory.h"
 #include "ai_squadslot.h"
+#include "ai_tacticalservices.h"
 #include "bitstring.h"
 
 class CAI_Squad;
@@ -138,6 +139,8 @@ public:
 	void					SetSquadInflictor( CBaseEntity *pInflictor );
 	bool					IsSquadInflictor( CBaseEntity *pInflictor );
 
+	CAI_TacticalCache *		GetTacticalCache()					{ return &m_TacticalCache; }
+
 	static bool				IsSilentMember( const CAI_BaseNPC *pNPC );
 
 	template <typename T>
@@ -220,6 +223,8 @@ private:
 
 	int												m_SquadData[MAX_SQUAD_DATA_SLOTS];
 
+	CAI_TacticalCache								m_TacticalCache;
+
 #ifdef PER_ENEMY_SQUADSLOTS
 
 	AISquadEnemyInfo_t *FindEnemyInfo( CBaseEntity *pEnemy );
@@ -16,6 +16,9 @@
 #include "ai_navigator.h"
 #include "ai_networkmanager.h"
 #include "ai_hint.h"
+#include "ai_squad.h"
+#include "ai_dynamiclink.h"
+#include "ai_nodevisibility.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -23,6 +26,16 @@
 ConVar ai_find_lateral_cover( "ai_find_lateral_cover", "1" );
 ConVar ai_find_lateral_los( "ai_find_lateral_los", "1" );
 
+ConVar ai_tactical_cache( "ai_tactical_cache", "1", FCVAR_NONE, "Share cover and shoot position traces between NPCs searching from the same threat" );
+ConVar ai_tactical_cache_grid( "ai_tactical_cache_grid", "32", FCVAR_NONE, "Threat eye positions within the same cell of this size share cached traces" );
+ConVar ai_tactical_cache_lifetime( "ai_tactical_cache_lifetime", "1.0", FCVAR_NONE, "Seconds before cached cover and shoot position traces are run again" );
+
+ConVar ai_node_visibility( "ai_node_visibility", "1", FCVAR_NONE, "Skip shoot position traces the precomputed node visibility already rules out" );
+ConVar ai_node_visibility_snap( "ai_node_visibility_snap", "32", FCVAR_NONE, "How close a threat's eyes must be to a node's for the node's visibility to stand in for the threat's" );
+
+static int g_nTacticalCacheHits;
+static int g_nTacticalCacheMisses;
+
 #ifdef _DEBUG
 ConVar ai_debug_cover( "ai_debug_cover", "0" );
 int g_AIDebugFindCoverNode = -1;
@@ -57,11 +70,147 @@ BEGIN_SIMPLE_DATADESC(CAI_TacticalServices)
 	//						m_pNetwork	(not saved)
 	//						m_pPathfinder	(not saved)
 	DEFINE_FIELD( m_bAllowFindLateralLos, FIELD_BOOLEAN ),
+	//						m_TacticalCache	(not saved)
 
 END_DATADESC();
 
+//-----------------------------------------------------------------------------
+// CAI_TacticalCache
+//-----------------------------------------------------------------------------
+
+CAI_TacticalCache::CAI_TacticalCache()
+{
+	Purge();
+}
+
+//-------------------------------------
+
+bool CAI_TacticalCache::Threat_t::IsValid() const
+{
+	return ( timeCreated >= 0 &&
+			 gpGlobals->curtime - timeCreated < ai_tactical_cache_lifetime.GetFloat() &&
+			 linkSerial == CAI_DynamicLink::gm_nLinkStateSerial );
+}
+
+//-------------------------------------
+
+CAI_TacticalCache::Threat_t *CAI_TacticalCache::FindThreat( const Vector &vThreatEyePos, const AI_TacticalViewer_t &viewer, bool bCreate )
+{
+	float flGridSize = MAX( ai_tactical_cache_grid.GetFloat(), 1.0f );
+
+	int cell[3];
+	for ( int i = 0; i < 3; i++ )
+	{
+		cell[i] = (int)floorf( vThreatEyePos[i] / flGridSize );
+	}
+
+	Threat_t *pOldest = &m_Threats[0];
+	for ( int i = 0; i < MAX_THREATS; i++ )
+	{
+		Threat_t *pThreat = &m_Threats[i];
+		if ( !pThreat->IsValid() )
+		{
+			if ( pOldest->IsValid() )
+				pOldest = pThreat;
+			continue;
+		}
+
+		if ( pThreat->cell[0] == cell[0] && pThreat->cell[1] == cell[1] && pThreat->cell[2] == cell[2] &&
+			 pThreat->viewer.iClassname == viewer.iClassname && 
+			 pThreat->viewer.iWeapon == viewer.iWeapon && 
+			 pThreat->viewer.hull == viewer.hull &&
+			 pThreat->viewer.hThreat == viewer.hThreat &&
+			 pThreat->viewer.vShootOffset == viewer.vShootOffset )
+		{
+			return pThreat;
+		}
+
+		if ( pOldest->IsValid() && pThreat->timeCreated < pOldest->timeCreated )
+			pOldest = pThreat;
+	}
+
+	if ( !bCreate )
+		return NULL;
+
+	// The threat moved, or a new one showed up
+	pOldest->cell[0] = cell[0];
+	pOldest->cell[1] = cell[1];
+	pOldest->cell[2] = cell[2];
+	pOldest->viewer = viewer;
+	pOldest->timeCreated = gpGlobals->curtime;
+	pOldest->linkSerial = CAI_DynamicLink::gm_nLinkStateSerial;
+	pOldest->results.RemoveAll();
+
+	return pOldest;
+}
+
+//-------------------------------------
+
+static int TacticalCacheKey( AI_TacticalTest_t test, int nodeID, float flEyeHeight )
+{
+	int eyeHeight = clamp( (int)flEyeHeight, 0, 0x7fff );
+	return ( nodeID << 16 ) | ( test << 15 ) | eyeHeight;
+}
+
+//-------------------------------------
+
+int CAI_TacticalCache::Lookup( const Vector &vThreatEyePos, const AI_TacticalViewer_t &viewer, AI_TacticalTest_t test, int nodeID, float flEyeHeight )
+{
+	Threat_t *pThreat = FindThreat( vThreatEyePos, viewer, false );
+	if ( pThreat )
+	{
+		UtlHashHandle_t h = pThreat->results.Find( TacticalCacheKey( test, nodeID, flEyeHeight ) );
+		if ( h != pThreat->results.InvalidHandle() )
+		{
+			g_nTacticalCacheHits++;
+			return pThreat->results.Element( h );
+		}
+	}
+
+	g_nTacticalCacheMisses++;
+	return -1;
+}
+
+//-------------------------------------
+
+void CAI_TacticalCache::Store( const Vector &vThreatEyePos, const AI_TacticalViewer_t &viewer, AI_TacticalTest_t test, int nodeID, float flEyeHeight, bool bResult )
+{
+	Threat_t *pThreat = FindThreat( vThreatEyePos, viewer, true );
+	pThreat->results.Insert( TacticalCacheKey( test, nodeID, flEyeHeight ), bResult );
+}
+
 //-------------------------------------
 
+void CAI_TacticalCache::Purge()
+{
+	for ( int i = 0; i < MAX_THREATS; i++ )
+	{
+		m_Threats[i].timeCreated = -1;
+		m_Threats[i].results.Purge();
+	}
+}
+
+//-------------------------------------
+
+CON_COMMAND( ai_tactical_cache_report, "Prints how many cover and shoot position traces were answered by the tactical cache" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nTotal = g_nTacticalCacheHits + g_nTacticalCacheMisses;
+	Msg( "Tactical cache: %d hits, %d misses (%.1f%% of traces saved)\n", g_nTacticalCacheHits, g_nTacticalCacheMisses, 
+		( nTotal ) ? 100.0f * g_nTacticalCacheHits / nTotal : 0.0f );
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "clear" ) )
+	{
+		g_nTacticalCacheHits = g_nTacticalCacheMisses = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// CAI_TacticalServices
+//-----------------------------------------------------------------------------
+
 void CAI_TacticalServices::Init( CAI_Network *pNetwork )
 {
 	Assert( pNetwork );
@@ -404,7 +553,7 @@ int CAI_TacticalServices::FindCoverNode(const Vector &vNearPos, const Vector &vT
 			if ( GetOuter()->IsValidCover( nodeOrigin, pNode->GetHint() ) )
 			{
 				// Check if this location will block the threat's line of sight to me
-				if (GetOuter()->IsCoverPosition(vThreatEyePos, vEyePos))
+				if ( IsCoverNode( pNode, vThreatEyePos, vEyePos ) )
 				{
 					// --------------------------------------------------------
 					// Don't let anyone else use this node for a while
@@ -534,6 +683,12 @@ int CAI_TacticalServices::FindLosNode(const Vector &vThreatPos, const Vector &vT
 	wasVisited.Set( iMyNode );
 	list.Insert( AI_NearNode_t(iMyNode, 0) );
 
+	// Nodes the precomputed visibility says can't see the threat are only
+	// tested once no other node can shoot. The table looks from stand-in eye
+	// positions, so they still get the real test before being ruled out.
+	int iThreatNode = GetVisibilityNode( vThreatEyePos );
+	CUtlVectorFixedGrowable<int, 32> occludedNodes;
+
 	static int nSearchRandomizer = 0;		// tries to ensure the links are searched in a different order each time;
 
 	while ( list.Count() )
@@ -600,7 +755,16 @@ int CAI_TacticalServices::FindLosNode(const Vector &vThreatPos, const Vector &vT
 					CAI_Node *pNode = GetNetwork()->GetNode(nodeIndex);
 					if ( GetOuter()->IsValidShootPosition( nodeOrigin, pNode, pNode->GetHint() ) )
 					{
-						if (GetOuter()->TestShootPosition(nodeOrigin,vThreatEyePos))
+						if ( iThreatNode != NO_NODE && GetNetwork()->GetNodeVisibility()->IsOccluded( GetHullType(), nodeIndex, iThreatNode ) )
+						{
+							occludedNodes.AddToTail( nodeIndex );
+
+							if ( ShouldDebugLos( nodeIndex ) )
+							{
+								NDebugOverlay::Text( nodeOrigin, CFmtStr( "%d:occluded", nodeIndex), false, 1 );
+							}
+						}
+						else if ( IsShootNode( pNode, vThreatEyePos ) )
 						{
 							// Note when this node was used, so we don't try 
 							// to use it again right away.
@@ -677,10 +841,135 @@ int CAI_TacticalServices::FindLosNode(const Vector &vThreatPos, const Vector &vT
 			}
 		}
 	}
+
+	// Nothing the table calls visible can shoot, try the rest in search order
+	for ( int i = 0; i < occludedNodes.Count(); i++ )
+	{
+		int nodeIndex = occludedNodes[i];
+		CAI_Node *pNode = GetNetwork()->GetNode( nodeIndex );
+		if ( IsShootNode( pNode, vThreatEyePos ) )
+		{
+			pNode->Lock( flBlockTime );
+
+			if ( ShouldDebugLos( nodeIndex ) )
+			{
+				NDebugOverlay::Text( pNode->GetPosition( GetHullType() ), CFmtStr( "%d:los!", nodeIndex), false, 1 );
+			}
+
+			nSearchRandomizer = nodeIndex;
+			return nodeIndex;
+		}
+	}
+
 	// We failed.  No range attack node node was found
 	return NO_NODE;
 }
 
+//-------------------------------------
+// Purpose: Cached versions of the traces run by FindCoverNode and FindLosNode
+//-------------------------------------
+
+CAI_TacticalCache *CAI_TacticalServices::GetTacticalCache()
+{
+	if ( GetOuter()->GetSquad() )
+		return GetOuter()->GetSquad()->GetTacticalCache();
+	return &m_TacticalCache;
+}
+
+//-------------------------------------
+// Purpose: Returns the node whose precomputed visibility can be used for
+//			something looking from the given eye position, if any
+//-------------------------------------
+
+int CAI_TacticalServices::GetVisibilityNode( const Vector &vEyePos )
+{
+	if ( !ai_node_visibility.GetBool() || !GetNetwork()->GetNodeVisibility()->HasHull( GetHullType() ) )
+		return NO_NODE;
+
+	int iNode = GetNetwork()->NearestNodeToPoint( GetOuter(), vEyePos, false );
+	if ( iNode == NO_NODE )
+		return NO_NODE;
+
+	Vector vNodeEyePos = CAI_NodeVisibility::GetEyePosition( GetNetwork()->GetNode( iNode ), GetHullType() );
+	if ( ( vNodeEyePos - vEyePos ).LengthSqr() > Square( ai_node_visibility_snap.GetFloat() ) )
+		return NO_NODE;
+
+	return iNode;
+}
+
+//-------------------------------------
+
+void CAI_TacticalServices::GetTacticalViewer( const Vector &vThreatEyePos, AI_TacticalViewer_t *pViewer )
+{
+	pViewer->iClassname = GetOuter()->m_iClassname;
+	pViewer->iWeapon = NULL_STRING;
+	pViewer->hull = GetHullType();
+
+	// The tests ignore the enemy when looking from its eyes, so results
+	// from squad members fighting different enemies can't be shared
+	CBaseEntity *pEnemy = GetEnemy();
+	if ( pEnemy && ( vThreatEyePos - pEnemy->EyePosition() ).LengthSqr() < 0.1f )
+		pViewer->hThreat = pEnemy;
+	else
+		pViewer->hThreat = NULL;
+
+	pViewer->vShootOffset = vec3_origin;
+}
+
+//-------------------------------------
+
+bool CAI_TacticalServices::IsCoverNode( CAI_Node *pNode, const Vector &vThreatEyePos, const Vector &vEyePos )
+{
+	if ( !ai_tactical_cache.GetBool() || !GetOuter()->IsCoverPositionCacheable() )
+		return GetOuter()->IsCoverPosition( vThreatEyePos, vEyePos );
+
+	AI_TacticalViewer_t viewer;
+	GetTacticalViewer( vThreatEyePos, &viewer );
+
+	float flEyeHeight = vEyePos.z - pNode->GetPosition( GetHullType() ).z;
+
+	CAI_TacticalCache *pCache = GetTacticalCache();
+	int result = pCache->Lookup( vThreatEyePos, viewer, AI_TACTICAL_TEST_COVER, pNode->GetId(), flEyeHeight );
+	if ( result == -1 )
+	{
+		result = GetOuter()->IsCoverPosition( vThreatEyePos, vEyePos );
+		pCache->Store( vThreatEyePos, viewer, AI_TACTICAL_TEST_COVER, pNode->GetId(), flEyeHeight, ( result != 0 ) );
+	}
+
+	return ( result != 0 );
+}
+
+//-------------------------------------
+
+bool CAI_TacticalServices::IsShootNode( CAI_Node *pNode, const Vector &vThreatEyePos )
+{
+	const Vector &vecNodeOrigin = pNode->GetPosition( GetHullType() );
+
+	if ( !ai_tactical_cache.GetBool() || !GetOuter()->IsShootPositionCacheable() )
+		return GetOuter()->TestShootPosition( vecNodeOrigin, vThreatEyePos );
+
+	CBaseCombatWeapon *pWeapon = GetOuter()->GetActiveWeapon();
+
+	AI_TacticalViewer_t viewer;
+	GetTacticalViewer( vThreatEyePos, &viewer );
+	viewer.iWeapon = ( pWeapon ) ? pWeapon->m_iClassname : NULL_STRING;
+
+	// The weapon traces from the asker's own barrel offset, which changes
+	// with posture, and always lets the shot through the asker's enemy
+	viewer.hThreat = GetEnemy();
+	viewer.vShootOffset = GetOuter()->Weapon_ShootPosition() - GetOuter()->GetAbsOrigin();
+
+	CAI_TacticalCache *pCache = GetTacticalCache();
+	int result = pCache->Lookup( vThreatEyePos, viewer, AI_TACTICAL_TEST_SHOOT, pNode->GetId(), 0 );
+	if ( result == -1 )
+	{
+		result = GetOuter()->TestShootPosition( vecNodeOrigin, vThreatEyePos );
+		pCache->Store( vThreatEyePos, viewer, AI_TACTICAL_TEST_SHOOT, pNode->GetId(), 0, ( result != 0 ) );
+	}
+
+	return ( result != 0 );
+}
+
 //-------------------------------------
 // Checks lateral LOS
 //-------------------------------------
@@ -6,12 +6,14 @@
 #define AI_TACTICALSERVICES_H
 
 #include "ai_component.h"
+#include "utlhashtable.h"
 
 #if defined( _WIN32 )
 #pragma once
 #endif
 
 class CAI_Network;
+class CAI_Node;
 class CAI_Pathfinder;
 
 
@@ -23,6 +25,66 @@ enum FlankType_t
 };
 
 
+//-----------------------------------------------------------------------------
+// CAI_TacticalCache
+//
+// Purpose: Remembers the cover and shoot position traces run by the tactical
+//			node searches. Results are kept per threat eye position, snapped
+//			to a grid, and per kind of NPC doing the test. Squad members
+//			share one cache, so a squad taking cover from the same threat
+//			only traces each node once. NPCs whose tests depend on more
+//			than that opt out through CAI_BaseNPC::IsCoverPositionCacheable()
+//			and CAI_BaseNPC::IsShootPositionCacheable().
+//-----------------------------------------------------------------------------
+
+enum AI_TacticalTest_t
+{
+	AI_TACTICAL_TEST_COVER,
+	AI_TACTICAL_TEST_SHOOT,
+};
+
+struct AI_TacticalViewer_t
+{
+	string_t		iClassname;
+	string_t		iWeapon;
+	int				hull;
+	EHANDLE			hThreat;		// The enemy, if the threat eye position is its eyes. The tests ignore it.
+	Vector			vShootOffset;	// Weapon_ShootPosition() relative to the origin, for shoot tests
+};
+
+class CAI_TacticalCache
+{
+public:
+	CAI_TacticalCache();
+
+	// Returns -1 if the result isn't known
+	int				Lookup( const Vector &vThreatEyePos, const AI_TacticalViewer_t &viewer, AI_TacticalTest_t test, int nodeID, float flEyeHeight );
+	void			Store( const Vector &vThreatEyePos, const AI_TacticalViewer_t &viewer, AI_TacticalTest_t test, int nodeID, float flEyeHeight, bool bResult );
+
+	void			Purge();
+
+private:
+	struct Threat_t
+	{
+		bool		IsValid() const;
+
+		int			cell[3];
+		AI_TacticalViewer_t viewer;
+		float		timeCreated;
+		int			linkSerial;
+		CUtlHashtable<int, bool> results;
+	};
+
+	enum
+	{
+		MAX_THREATS = 4
+	};
+
+	Threat_t *		FindThreat( const Vector &vThreatEyePos, const AI_TacticalViewer_t &viewer, bool bCreate );
+
+	Threat_t		m_Threats[MAX_THREATS];
+};
+
 //-----------------------------------------------------------------------------
 
 class CAI_TacticalServices : public CAI_Component
@@ -58,6 +120,12 @@ private:
 	int				FindCoverNode( const Vector &vThreatPos, const Vector &vThreatEyePos, float flMinDist, float flMaxDist );
 	int				FindCoverNode( const Vector &vNearPos, const Vector &vThreatPos, const Vector &vThreatEyePos, float flMinDist, float flMaxDist );
 	int				FindLosNode( const Vector &vThreatPos, const Vector &vThreatEyePos, float flMinThreatDist, float flMaxThreatDist, float flBlockTime, FlankType_t eFlankType, const Vector &vThreatFacing, float flFlankParam );
+
+	bool			IsCoverNode( CAI_Node *pNode, const Vector &vThreatEyePos, const Vector &vEyePos );
+	bool			IsShootNode( CAI_Node *pNode, const Vector &vThreatEyePos );
+	int				GetVisibilityNode( const Vector &vEyePos );
+	void			GetTacticalViewer( const Vector &vThreatEyePos, AI_TacticalViewer_t *pViewer );
+	CAI_TacticalCache *GetTacticalCache();
 	
 	Vector			GetNodePos( int );
 
@@ -72,6 +140,8 @@ private:
 
 	bool	m_bAllowFindLateralLos;	// Allows us to turn Lateral LOS checking on/off. 
 
+	CAI_TacticalCache m_TacticalCache;	// Used when not in a squad
+
 	DECLARE_SIMPLE_DATADESC();
 };
 
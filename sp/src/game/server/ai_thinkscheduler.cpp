@@ -0,0 +1,279 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per frame time budget for NPC thinks
+//
+//=============================================================================//
+
+#include "cbase.h"
+
+#include "ai_thinkscheduler.h"
+
+#include "ai_basenpc.h"
+#include "ai_utils.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar ai_think_scheduler( "ai_think_scheduler", "1", FCVAR_NONE, "Rank NPC thinks by relevance and run them within ai_think_budget each frame" );
+ConVar ai_think_budget( "ai_think_budget", "10", FCVAR_NONE, "Milliseconds per frame for NPC thinks, scaled by host_timescale" );
+ConVar ai_think_max_defer( "ai_think_max_defer", "0.25", FCVAR_NONE, "NPCs that have not thought for this many seconds think regardless of the budget" );
+ConVar ai_think_priority_dist( "ai_think_priority_dist", "2048", FCVAR_NONE, "NPCs further than this from the player get no priority for distance" );
+ConVar ai_think_priority_wait( "ai_think_priority_wait", "20", FCVAR_NONE, "Priority gained per second an NPC has waited to think" );
+ConVar ai_think_scheduler_report( "ai_think_scheduler_report", "0", FCVAR_NONE, "Print the think scheduler's stats every frame" );
+
+extern CFastTimer g_AIRunTimer;
+extern CFastTimer g_AIPostRunTimer;
+
+#define AI_THINK_COST_BLEND 0.2f	// Weight of the latest think in the running average
+
+CAI_ThinkScheduler g_AI_ThinkScheduler;
+
+//-----------------------------------------------------------------------------
+
+CAI_ThinkScheduler::CAI_ThinkScheduler()
+ :	m_iFrame( -1 ),
+	m_bHavePlayer( false )
+{
+	memset( &m_Frame, 0, sizeof( m_Frame ) );
+	memset( &m_LastFrame, 0, sizeof( m_LastFrame ) );
+}
+
+//-----------------------------------------------------------------------------
+
+bool CAI_ThinkScheduler::IsEnabled() const
+{
+	return ai_think_scheduler.GetBool();
+}
+
+//-----------------------------------------------------------------------------
+
+int __cdecl CAI_ThinkScheduler::PriorityCompare( CAI_BaseNPC * const *ppLeft, CAI_BaseNPC * const *ppRight )
+{
+	float flLeft = (*ppLeft)->m_ThinkSchedule.flPriority;
+	float flRight = (*ppRight)->m_ThinkSchedule.flPriority;
+
+	if ( flLeft != flRight )
+		return ( flLeft > flRight ) ? -1 : 1;
+
+	// Keep the order stable from frame to frame
+	return (*ppLeft)->entindex() - (*ppRight)->entindex();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Relevance of an NPC's think to the player
+//-----------------------------------------------------------------------------
+
+float CAI_ThinkScheduler::ComputePriority( CAI_BaseNPC *pNPC, float flWaited )
+{
+	float flPriority = 1.0;
+
+	if ( pNPC->GetState() == NPC_STATE_COMBAT )
+		flPriority += 3.0;
+	else if ( pNPC->GetState() == NPC_STATE_ALERT )
+		flPriority += 1.0;
+
+	if ( pNPC->GetEnemy() )
+		flPriority += 1.0;
+
+	if ( m_bHavePlayer )
+	{
+		Vector vecToNPC = pNPC->EyePosition() - m_vecPlayerEye;
+		float flDist = VectorNormalize( vecToNPC );
+		float flMaxDist = MAX( ai_think_priority_dist.GetFloat(), 1.0f );
+
+		flPriority += 4.0 * ( 1.0 - MIN( flDist / flMaxDist, 1.0f ) );
+
+		if ( pNPC->HasCondition( COND_IN_PVS ) )
+		{
+			flPriority += 1.0;
+			if ( m_vecPlayerForward.Dot( vecToNPC ) > 0.5 )
+				flPriority += 2.0;
+		}
+	}
+
+	if ( pNPC->GetEfficiency() == AIE_DORMANT || pNPC->GetSleepState() != AISS_AWAKE )
+		flPriority *= 0.5;
+
+	// So waiting NPCs eventually outrank everything else
+	flPriority += flWaited * ai_think_priority_wait.GetFloat();
+
+	return flPriority;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Ranks the NPCs due to think this frame and admits them in order
+//			until their estimated cost fills the budget
+//-----------------------------------------------------------------------------
+
+void CAI_ThinkScheduler::BeginFrame( CAI_BaseNPC *pThinking )
+{
+	if ( m_iFrame != -1 && ai_think_scheduler_report.GetBool() && ( m_Frame.nRun || m_Frame.nDeferred ) )
+	{
+		Report( m_Frame );
+	}
+
+	m_LastFrame = m_Frame;
+	memset( &m_Frame, 0, sizeof( m_Frame ) );
+	m_iFrame = gpGlobals->framecount;
+
+	static const ConVar *pHostTimescale = cvar->FindVar( "host_timescale" );
+	float flTimescale = ( pHostTimescale ) ? MAX( pHostTimescale->GetFloat(), 1.0f ) : 1.0f;
+	m_Frame.flBudget = ai_think_budget.GetFloat() * 0.001 * flTimescale;
+
+	CBasePlayer *pPlayer = AI_GetSinglePlayer();
+	m_bHavePlayer = ( pPlayer != NULL );
+	if ( pPlayer )
+	{
+		pPlayer->EyePositionAndVectors( &m_vecPlayerEye, &m_vecPlayerForward, NULL, NULL );
+	}
+
+	// Thinks that ignore the budget still use it up
+	float flReserved = 0;
+
+	m_Ranked.RemoveAll();
+
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+	{
+		CAI_BaseNPC *pNPC = ppAIs[i];
+
+		// The engine clears the think tick of the NPC being run
+		int iNextThinkTick = pNPC->GetNextThinkTick();
+		if ( pNPC != pThinking && ( iNextThinkTick == TICK_NEVER_THINK || iNextThinkTick > gpGlobals->tickcount ) )
+			continue;
+
+		AI_ThinkScheduleInfo_t &info = pNPC->m_ThinkSchedule;
+		info.iRankedFrame = m_iFrame;
+		info.bAdmitted = true;
+
+		if ( pNPC->m_bInChoreo )
+		{
+			flReserved += info.flCostEstimate;
+			continue;
+		}
+
+		info.flPriority = ComputePriority( pNPC, gpGlobals->curtime - pNPC->m_flLastRealThinkTime );
+		m_Ranked.AddToTail( pNPC );
+	}
+
+	m_Ranked.Sort( PriorityCompare );
+
+	float flEstimate = flReserved;
+	for ( int i = 0; i < m_Ranked.Count(); i++ )
+	{
+		AI_ThinkScheduleInfo_t &info = m_Ranked[i]->m_ThinkSchedule;
+
+		// The most relevant NPC always gets to think
+		flEstimate += info.flCostEstimate;
+		info.bAdmitted = ( i == 0 || flEstimate <= m_Frame.flBudget );
+		if ( info.bAdmitted )
+			m_Frame.nAdmitted++;
+	}
+
+	m_Frame.nRanked = m_Ranked.Count();
+	m_Ranked.RemoveAll();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called before an NPC that is subject to the budget thinks. If this
+//			returns false the think is pushed to the next tick.
+//-----------------------------------------------------------------------------
+
+bool CAI_ThinkScheduler::ShouldThink( CAI_BaseNPC *pNPC )
+{
+	if ( gpGlobals->framecount != m_iFrame )
+	{
+		BeginFrame( pNPC );
+	}
+
+	AI_ThinkScheduleInfo_t &info = pNPC->m_ThinkSchedule;
+
+	bool bThink;
+	if ( info.iRankedFrame != m_iFrame )
+	{
+		// Became due after the frame was ranked
+		bThink = ( m_Frame.flSpent + info.flCostEstimate <= m_Frame.flBudget );
+	}
+	else
+	{
+		// Estimates can be wrong, the measured time has the final say
+		bThink = ( info.bAdmitted && m_Frame.flSpent < m_Frame.flBudget );
+	}
+
+	if ( !bThink && gpGlobals->curtime - pNPC->m_flLastRealThinkTime > ai_think_max_defer.GetFloat() )
+	{
+		bThink = true;
+		m_Frame.nForced++;
+	}
+
+	if ( bThink )
+		m_Frame.nRun++;
+	else
+		m_Frame.nDeferred++;
+
+	return bThink;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_ThinkScheduler::OnThinkDone( CAI_BaseNPC *pNPC, float flThinkTime )
+{
+	if ( gpGlobals->framecount != m_iFrame )
+	{
+		BeginFrame( NULL );
+	}
+
+	AI_ThinkScheduleInfo_t &info = pNPC->m_ThinkSchedule;
+	if ( info.flCostEstimate == 0 )
+		info.flCostEstimate = flThinkTime;
+	else
+		info.flCostEstimate += ( flThinkTime - info.flCostEstimate ) * AI_THINK_COST_BLEND;
+
+	m_Frame.flSpent += flThinkTime;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects the crude frame timings of an NPC think
+//-----------------------------------------------------------------------------
+
+void CAI_ThinkScheduler::AddTimings( bool bRanDecision )
+{
+	if ( bRanDecision )
+	{
+		m_Frame.nDecisions++;
+		m_Frame.flRunTime += g_AIRunTimer.GetDuration().GetMillisecondsF();
+	}
+	m_Frame.flPostRunTime += g_AIPostRunTimer.GetDuration().GetMillisecondsF();
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_ThinkScheduler::Report( const FrameStats_t &stats )
+{
+	Msg( "AI think frame: %d due, %d admitted, %d run (%d forced), %d deferred, %d decisions; %.2fms of %.2fms (run %.2fms, post-run %.2fms)\n",
+		stats.nRanked, stats.nAdmitted, stats.nRun, stats.nForced, stats.nDeferred, stats.nDecisions,
+		stats.flSpent * 1000.0, stats.flBudget * 1000.0, stats.flRunTime, stats.flPostRunTime );
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_ThinkScheduler::ReportLastFrame()
+{
+	Report( m_LastFrame );
+}
+
+//-----------------------------------------------------------------------------
+
+CON_COMMAND( ai_think_scheduler_stats, "Print the think scheduler's stats for the last complete frame" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( !g_AI_ThinkScheduler.IsEnabled() )
+	{
+		Msg( "ai_think_scheduler is off\n" );
+		return;
+	}
+
+	g_AI_ThinkScheduler.ReportLastFrame();
+}
@@ -0,0 +1,99 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Per frame time budget for NPC thinks
+//
+//=============================================================================//
+
+#ifndef AI_THINKSCHEDULER_H
+#define AI_THINKSCHEDULER_H
+
+#include "utlvector.h"
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+class CAI_BaseNPC;
+
+//-----------------------------------------------------------------------------
+// Per NPC scheduling state, kept by the NPC
+//-----------------------------------------------------------------------------
+
+struct AI_ThinkScheduleInfo_t
+{
+	AI_ThinkScheduleInfo_t()
+	 :	flCostEstimate( 0 ),
+		flPriority( 0 ),
+		iRankedFrame( -1 ),
+		bAdmitted( false )
+	{
+	}
+
+	float	flCostEstimate;		// Running average of the think time, in seconds
+	float	flPriority;
+	int		iRankedFrame;		// Frame the NPC was last ranked in
+	bool	bAdmitted;			// Fits in the budget of iRankedFrame
+};
+
+//-----------------------------------------------------------------------------
+// CAI_ThinkScheduler
+//
+// Purpose: Replaces the fixed per frame think limit in CAI_BaseNPC. On the
+//			first NPC think of a frame, every NPC due to think that frame is
+//			ranked by relevance and admitted in that order until their
+//			estimated cost fills the budget. Others are pushed to the next
+//			tick. The time an NPC has waited raises its priority, and
+//			ai_think_max_defer forces a think regardless of the budget, so
+//			low priority NPCs are slowed down but never starved.
+//-----------------------------------------------------------------------------
+
+class CAI_ThinkScheduler
+{
+public:
+	CAI_ThinkScheduler();
+
+	bool			IsEnabled() const;
+
+	bool			ShouldThink( CAI_BaseNPC *pNPC );
+	void			AddTimings( bool bRanDecision );
+	void			OnThinkDone( CAI_BaseNPC *pNPC, float flThinkTime );
+
+	void			ReportLastFrame();
+
+private:
+	struct FrameStats_t
+	{
+		int			nRanked;
+		int			nAdmitted;
+		int			nRun;
+		int			nForced;			// Ran over the budget to avoid starving
+		int			nDeferred;
+		int			nDecisions;
+		float		flBudget;			// Seconds
+		float		flSpent;			// Seconds
+		float		flRunTime;			// g_AIRunTimer summed over the frame, in ms
+		float		flPostRunTime;		// g_AIPostRunTimer summed over the frame, in ms
+	};
+
+	void			BeginFrame( CAI_BaseNPC *pThinking );
+	float			ComputePriority( CAI_BaseNPC *pNPC, float flWaited );
+	void			Report( const FrameStats_t &stats );
+
+	static int __cdecl PriorityCompare( CAI_BaseNPC * const *ppLeft, CAI_BaseNPC * const *ppRight );
+
+	int				m_iFrame;
+	FrameStats_t	m_Frame;
+	FrameStats_t	m_LastFrame;
+
+	bool			m_bHavePlayer;
+	Vector			m_vecPlayerEye;
+	Vector			m_vecPlayerForward;
+
+	CUtlVector<CAI_BaseNPC *> m_Ranked;
+};
+
+extern CAI_ThinkScheduler g_AI_ThinkScheduler;
+
+//-----------------------------------------------------------------------------
+
+#endif // AI_THINKSCHEDULER_H
@@ -62,6 +62,10 @@
 #include "env_debughistory.h"
 #include "tier1/utlstring.h"
 #include "utlhashtable.h"
+#include "querycache.h"
+#include "triggerbroadphase.h"
+#include "entityioprofiler.h"
+#include "entityiolog.h"
 #ifdef MAPBASE
 #include "mapbase/matchers.h"
 #include "mapbase/datadesc_mod.h"
@@ -380,6 +384,9 @@ CBaseEntity::CBaseEntity( bool bServerOnly )
 
 	m_bAlternateSorting = false;
 	m_CollisionGroup = COLLISION_GROUP_NONE;
+	m_nEntListOrder = 0;
+	m_iszIndexedClassname = m_iszIndexedName = NULL_STRING;
+	m_pPrevByClass = m_pNextByClass = m_pPrevByName = m_pNextByName = NULL;
 	m_iParentAttachment = 0;
 	CollisionProp()->Init( this );
 	NetworkProp()->Init( this );
@@ -644,7 +651,13 @@ CBaseEntity *CBaseEntity::GetFollowedEntity()
 
 void CBaseEntity::SetClassname( const char *className )
 {
-	m_iClassname = AllocPooledString( className );
+	SetClassname( AllocPooledString( className ) );
+}
+
+void CBaseEntity::SetClassname( string_t iszClassName )
+{
+	m_iClassname = iszClassName;
+	gEntList.NotifyEntityClassnameChanged( this );
 }
 
 void CBaseEntity::SetModelIndex( int index )
@@ -3278,7 +3291,10 @@ void CBaseEntity::PhysicsTouchTriggers( const Vector *pPrevAbsOrigin )
 		SetCheckUntouch( true );
 		if ( isSolidCheckTriggers )
 		{
-			engine->SolidMoved( pEdict, CollisionProp(), pPrevAbsOrigin, sm_bAccurateTriggerBboxChecks );
+			if ( !TriggerBroadphase_SolidMoved( this, pPrevAbsOrigin, sm_bAccurateTriggerBboxChecks ) )
+			{
+				engine->SolidMoved( pEdict, CollisionProp(), pPrevAbsOrigin, sm_bAccurateTriggerBboxChecks );
+			}
 		}
 		if ( isTriggerCheckSolids )
 		{
@@ -3478,6 +3494,12 @@ bool CBaseEntity::FVisible( CBaseEntity *pEntity, int traceMask, CBaseEntity **p
 			traceMask &= ~CONTENTS_BLOCKLOS;
 		}
 
+		// Senses may accept a recent answer from the query cache
+		if ( g_flQueryCacheVisibilityInterval > 0 && !IsPlayer() )
+		{
+			return IsEntityVisibleFromEntity( this, pEntity, COLLISION_GROUP_NONE, traceMask, g_flQueryCacheVisibilityInterval, ppBlocker );
+		}
+
 		// Use the custom LOS trace filter
 		CTraceFilterLOS traceFilter( this, COLLISION_GROUP_NONE, pEntity );
 		UTIL_TraceLine( vecLookerOrigin, vecTargetOrigin, traceMask, &traceFilter, &tr );
@@ -3748,6 +3770,19 @@ FORCEINLINE bool NamesMatch( const char *pszQuery, string_t nameToMatch )
 #endif
 }
 
+void CBaseEntity::SetName( string_t newName )
+{
+	m_iName = newName;
+	gEntList.NotifyEntityNameChanged( this );
+}
+
+#ifdef MAPBASE_VSCRIPT
+void CBaseEntity::SetNameAsCStr( const char *newName )
+{
+	SetName( AllocPooledString(newName) );
+}
+#endif
+
 bool CBaseEntity::NameMatchesComplex( const char *pszNameOrWildcard )
 {
 	if ( !Q_stricmp( "!player", pszNameOrWildcard) )
@@ -3922,6 +3957,10 @@ int CBaseEntity::Restore( IRestore &restore )
 	// loops through the data description list, restoring each data desc block in order
 	int status = RestoreDataDescBlock( restore, GetDataDescMap() );
 
+	// The names were read directly
+	gEntList.NotifyEntityClassnameChanged( this );
+	gEntList.NotifyEntityNameChanged( this );
+
 	// ---------------------------------------------------------------
 	// HACKHACK: We don't know the space of these vectors until now
 	// if they are worldspace, fix them up.
@@ -4601,6 +4640,45 @@ void CBaseEntity::OnEntityEvent( EntityEvent_t event, void *pEventData )
 
 ConVar ent_messages_draw( "ent_messages_draw", "0", FCVAR_CHEAT, "Visualizes all entity input/output activity." );
 
+//-----------------------------------------------------------------------------
+// Input dispatch tables
+//
+// Purpose: Maps input names to their descriptions for each datamap, including
+//			the inputs of its base maps. Built the first time a class receives
+//			an input, so AcceptInput doesn't compare against every field.
+//-----------------------------------------------------------------------------
+typedef CUtlHashtable< const char *, const typedescription_t *, CaselessStringHashFunctor, CaselessStringEqualFunctor > CInputDispatchTable;
+
+static CUtlHashtable< datamap_t *, CInputDispatchTable *, PointerHashFunctor, PointerEqualFunctor > sg_InputDispatchTables;
+
+static const typedescription_t *FindInputDesc( datamap_t *pRootMap, const char *szInputName )
+{
+	UtlHashHandle_t hTable = sg_InputDispatchTables.Find( pRootMap );
+	if ( hTable == sg_InputDispatchTables.InvalidHandle() )
+	{
+		CInputDispatchTable *pTable = new CInputDispatchTable;
+
+		// Derived classes first, so the most derived input of a name wins as it always has
+		for ( datamap_t *dmap = pRootMap; dmap != NULL; dmap = dmap->baseMap )
+		{
+			for ( int i = 0; i < dmap->dataNumFields; i++ )
+			{
+				const typedescription_t *pField = &dmap->dataDesc[i];
+				if ( ( pField->flags & FTYPEDESC_INPUT ) && pField->externalName && !pTable->HasElement( pField->externalName ) )
+				{
+					pTable->Insert( pField->externalName, pField );
+				}
+			}
+		}
+
+		hTable = sg_InputDispatchTables.Insert( pRootMap, pTable );
+	}
+
+	CInputDispatchTable *pTable = sg_InputDispatchTables[hTable];
+	UtlHashHandle_t hInput = pTable->Find( szInputName );
+	return ( hInput != pTable->InvalidHandle() ) ? pTable->Element( hInput ) : NULL;
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: calls the appropriate message mapped function in the entity according
@@ -4624,139 +4702,126 @@ bool CBaseEntity::AcceptInput( const char *szInputName, CBaseEntity *pActivator,
 		NDebugOverlay::Box( GetAbsOrigin(), Vector(-4, -4, -4), Vector(4, 4, 4), 0, 255, 0, 0, 3 );
 	}
 
-	// loop through the data description list, restoring each data desc block
-	for ( datamap_t *dmap = GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
+	// find the input in the class's dispatch table
+	const typedescription_t *pDesc = FindInputDesc( GetDataDescMap(), szInputName );
+	if ( pDesc )
 	{
-		// search through all the actions in the data description, looking for a match
-		for ( int i = 0; i < dmap->dataNumFields; i++ )
+		CEntityIOProfileScope ioProfile( IOPROFILE_INPUT, this, pDesc );
+
+		// mapper debug message, only formatted if someone is reading
+		EntityIOLog_Input( this, pCaller, szInputName, Value );
+
+		if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
 		{
-			if ( dmap->dataDesc[i].flags & FTYPEDESC_INPUT )
-			{
-				if ( !Q_stricmp(dmap->dataDesc[i].externalName, szInputName) )
-				{
-					// found a match
+			DrawInputOverlay(szInputName,pCaller,Value);
+		}
 
-					// mapper debug message
+		// convert the value if necessary
+		if ( Value.FieldType() != pDesc->fieldType )
+		{
+			if ( !(Value.FieldType() == FIELD_VOID && pDesc->fieldType == FIELD_STRING) ) // allow empty strings
+			{
 #ifdef MAPBASE
-					CGMsg( 2, CON_GROUP_IO_SYSTEM, "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, pCaller ? STRING(pCaller->m_iName.Get()) : "<NULL>", GetDebugName(), szInputName, Value.String() );
-#else
-					DevMsg( 2, "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, pCaller ? STRING(pCaller->m_iName.Get()) : "<NULL>", GetDebugName(), szInputName, Value.String() );
-#endif
-					ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+				// Activator, etc. support for EHANDLE convert
+				if ( !Value.Convert( (fieldtype_t)pDesc->fieldType, this, pActivator, pCaller ) )
+				{
+					bool bBadConversion = true;
 
-					if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
+					// Attempt to convert to string and back.
+					// Almost all field types support being converted to a string, and many support being parsed from a string too.
+					// Convert() handles the common pairs directly, so this only catches the odd ones out (entities to numbers, etc.)
+					fieldtype_t originalfield = Value.FieldType();
+					if (Value.Convert(FIELD_STRING))
 					{
-						DrawInputOverlay(szInputName,pCaller,Value);
+						bBadConversion = !(Value.Convert((fieldtype_t)pDesc->fieldType, this, pActivator, pCaller));
+						if (!bBadConversion)
+						{
+							// Actual support should be added for each field, but if it works, it works.
+							// Warning against it only matters if you're a programmer and want to add support for each field.
+							// Only send a warning in dev mode.
+							DevWarning("!! Had to convert to string and back\n"
+										"!! Source Field Type: %i, Target Field Type: %i\n",
+									originalfield, pDesc->fieldType);
+						}
 					}
 
-					// convert the value if necessary
-					if ( Value.FieldType() != dmap->dataDesc[i].fieldType )
+					if (bBadConversion)
 					{
-						if ( !(Value.FieldType() == FIELD_VOID && dmap->dataDesc[i].fieldType == FIELD_STRING) ) // allow empty strings
-						{
-#ifdef MAPBASE
-							// Activator, etc. support for EHANDLE convert
-							if ( !Value.Convert( (fieldtype_t)dmap->dataDesc[i].fieldType, this, pActivator, pCaller ) )
-							{
-								bool bBadConversion = true;
-
-								// Attempt to convert to string and back.
-								// Almost all field types support being converted to a string, and many support being parsed from a string too.
-								fieldtype_t originalfield = Value.FieldType();
-								if (Value.Convert(FIELD_STRING))
-								{
-									bBadConversion = !(Value.Convert((fieldtype_t)dmap->dataDesc[i].fieldType, this, pActivator, pCaller));
-									if (!bBadConversion)
-									{
-										// Actual support should be added for each field, but if it works, it works.
-										// Warning against it only matters if you're a programmer and want to add support for each field.
-										// Only send a warning in dev mode.
-										DevWarning("!! Had to convert to string and back\n"
-													"!! Source Field Type: %i, Target Field Type: %i\n",
-												originalfield, dmap->dataDesc[i].fieldType);
-									}
-								}
-
-								if (bBadConversion)
-								{
-									Warning( "!! ERROR: bad input/output link:\n!! Unable to convert value \"%s\" from %s (%s) to field type %i\n!! Target Entity: %s (%s), Input: %s\n", 
-										Value.GetDebug(),
-										( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
-										( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>",
-										dmap->dataDesc[i].fieldType,
-										STRING(m_iClassname), GetDebugName(), szInputName );
-									return false;
-								}
-							}
+						Warning( "!! ERROR: bad input/output link:\n!! Unable to convert value \"%s\" from %s (%s) to field type %i\n!! Target Entity: %s (%s), Input: %s\n", 
+							Value.GetDebug(),
+							( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
+							( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>",
+							pDesc->fieldType,
+							STRING(m_iClassname), GetDebugName(), szInputName );
+						return false;
+					}
+				}
 #else
-							if ( !Value.Convert( (fieldtype_t)dmap->dataDesc[i].fieldType ) )
-							{
-								// bad conversion
-								Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
-									STRING(m_iClassname), GetDebugName(), szInputName, 
-									( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
-									( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>" );
-								return false;
-							}
+				if ( !Value.Convert( (fieldtype_t)pDesc->fieldType ) )
+				{
+					// bad conversion
+					Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
+						STRING(m_iClassname), GetDebugName(), szInputName, 
+						( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
+						( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>" );
+					return false;
+				}
 #endif
-						}
-					}
-
-					// call the input handler, or if there is none just set the value
-					inputfunc_t pfnInput = dmap->dataDesc[i].inputFunc;
+			}
+		}
 
-					if ( pfnInput )
-					{ 
-						// Package the data into a struct for passing to the input handler.
-						inputdata_t data;
-						data.pActivator = pActivator;
-						data.pCaller = pCaller;
-						data.value = Value;
-						data.nOutputID = outputID;
+		// call the input handler, or if there is none just set the value
+		inputfunc_t pfnInput = pDesc->inputFunc;
 
+		if ( pfnInput )
+		{ 
+			// Package the data into a struct for passing to the input handler.
+			inputdata_t data;
+			data.pActivator = pActivator;
+			data.pCaller = pCaller;
+			data.value = Value;
+			data.nOutputID = outputID;
 
-						// Now, see if there's a function named Input<Name of Input> in this entity's script file. 
-						// If so, execute it and let it decide whether to allow the default behavior to also execute.
-						bool bCallInputFunc = true; // Always assume default behavior (do call the input function)
 
-						if ( m_ScriptScope.IsInitialized() )
-						{
-							ScriptVariant_t functionReturn;
-							if ( ScriptInputHook( szInputName, pActivator, pCaller, Value, functionReturn ) )
-							{
-								bCallInputFunc = functionReturn.m_bool;
-							}
-						}
+			// Now, see if there's a function named Input<Name of Input> in this entity's script file. 
+			// If so, execute it and let it decide whether to allow the default behavior to also execute.
+			bool bCallInputFunc = true; // Always assume default behavior (do call the input function)
 
-						if( bCallInputFunc )
-						{
-							(this->*pfnInput)( data );
-						}
+			if ( m_ScriptScope.IsInitialized() )
+			{
+				ScriptVariant_t functionReturn;
+				if ( ScriptInputHook( szInputName, pActivator, pCaller, Value, functionReturn ) )
+				{
+					bCallInputFunc = functionReturn.m_bool;
+				}
+			}
 
-						if ( m_ScriptScope.IsInitialized() )
-						{
-							ScriptInputHookClearParams();
-						}
-					}
-					else if ( dmap->dataDesc[i].flags & FTYPEDESC_KEY )
-					{
-						// set the value directly
-						Value.SetOther( ((char*)this) + dmap->dataDesc[i].fieldOffset[ TD_OFFSET_NORMAL ]);
-					
-						// TODO: if this becomes evil and causes too many full entity updates, then we should make
-						// a macro like this:
-						//
-						// define MAKE_INPUTVAR(x) void Note##x##Modified() { x.GetForModify(); }
-						//
-						// Then the datadesc points at that function and we call it here. The only pain is to add
-						// that function for all the DEFINE_INPUT calls.
-						NetworkStateChanged();
-					}
+			if( bCallInputFunc )
+			{
+				(this->*pfnInput)( data );
+			}
 
-					return true;
-				}
+			if ( m_ScriptScope.IsInitialized() )
+			{
+				ScriptInputHookClearParams();
 			}
 		}
+		else if ( pDesc->flags & FTYPEDESC_KEY )
+		{
+			// set the value directly
+			Value.SetOther( ((char*)this) + pDesc->fieldOffset[ TD_OFFSET_NORMAL ]);
+		
+			// TODO: if this becomes evil and causes too many full entity updates, then we should make
+			// a macro like this:
+			//
+			// define MAKE_INPUTVAR(x) void Note##x##Modified() { x.GetForModify(); }
+			//
+			// Then the datadesc points at that function and we call it here. The only pain is to add
+			// that function for all the DEFINE_INPUT calls.
+			NetworkStateChanged();
+		}
+
+		return true;
 	}
 
 #ifdef MAPBASE_VSCRIPT
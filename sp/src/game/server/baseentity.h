@@ -821,6 +821,7 @@ public:
 
 	// classname access
 	void		SetClassname( const char *className );
+	void		SetClassname( string_t iszClassName );
 	const char* GetClassname();
 
 	// Debug Overlays
@@ -904,6 +905,10 @@ public:
 	void (CBaseEntity::*m_pfnThink)(void);
 	virtual void Think( void ) { if (m_pfnThink) (this->*m_pfnThink)();};
 
+	// Return true if the current thinks only change this entity, so they can
+	// run on the thread pool (see parallelthink.h)
+	virtual bool IsParallelThinkSafe( void ) { return false; }
+
 	// Think functions with contexts
 	int		RegisterThinkContext( const char *szContext );
 	BASEPTR	ThinkSet( BASEPTR func, float flNextThinkTime = 0, const char *szContext = NULL );
@@ -1043,6 +1048,16 @@ private:
 	// list handling
 	friend class CGlobalEntityList;
 	friend class CThinkSyncTester;
+	friend class CEntityStringIndex;
+
+	// Links in gEntList's classname and targetname chains, which are kept in entity list order
+	int				m_nEntListOrder;			// 0 while not in the list
+	string_t		m_iszIndexedClassname;
+	string_t		m_iszIndexedName;
+	CBaseEntity		*m_pPrevByClass;
+	CBaseEntity		*m_pNextByClass;
+	CBaseEntity		*m_pPrevByName;
+	CBaseEntity		*m_pNextByName;
 
 	// was pev->nextthink
 	CNetworkVarForDerived( int, m_nNextThinkTick );
@@ -2337,18 +2352,6 @@ inline const char *CBaseEntity::GetPreTemplateName()
 	return szStrippedName;
 }
 
-inline void CBaseEntity::SetName( string_t newName )
-{
-	m_iName = newName;
-}
-
-#ifdef MAPBASE_VSCRIPT
-inline void CBaseEntity::SetNameAsCStr( const char *newName )
-{
-	m_iName = AllocPooledString(newName);
-}
-#endif
-
 inline bool CBaseEntity::NameMatches( const char *pszNameOrWildcard )
 {
 	if ( IDENT_STRINGS(m_iName, pszNameOrWildcard) )
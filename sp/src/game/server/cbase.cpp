@@ -84,6 +84,12 @@ OUTPUTS:
 #include "tier1/strtools.h"
 #include "datacache/imdlcache.h"
 #include "env_debughistory.h"
+#include "parallelthink.h"
+#include "entityioprofiler.h"
+#include "entityiolog.h"
+#include "igamesystem.h"
+#include "utlhashtable.h"
+#include "tier1/generichash.h"
 #ifdef MAPBASE
 #include "mapbase/variant_tools.h"
 #include "mapbase/matchers.h"
@@ -254,6 +260,12 @@ CBaseEntityOutput::~CBaseEntityOutput()
 //-----------------------------------------------------------------------------
 void CBaseEntityOutput::FireOutput(variant_t Value, CBaseEntity *pActivator, CBaseEntity *pCaller, float fDelay)
 {
+	// Outputs fired from parallel thinks go off once the phase is over
+	if ( g_bParallelThinkActive && ParallelThink_DeferFireOutput( this, Value, pActivator, pCaller, fDelay ) )
+		return;
+
+	CEntityIOProfileScope ioProfile( IOPROFILE_OUTPUT, pCaller, this );
+
 	//
 	// Iterate through all eventactions and fire them off.
 	//
@@ -284,54 +296,8 @@ void CBaseEntityOutput::FireOutput(variant_t Value, CBaseEntity *pActivator, CBa
 #endif
 		}
 
-		if ( ev->m_flDelay )
-		{
-			char szBuffer[256];
-			Q_snprintf( szBuffer,
-						sizeof(szBuffer),
-						"(%0.2f) output: (%s,%s) -> (%s,%s,%.1f)(%s)\n",
-#ifdef TF_DLL
-						engine->GetServerTime(),
-#else
-						gpGlobals->curtime,
-#endif
-						pCaller ? STRING(pCaller->m_iClassname) : "NULL",
-						pCaller ? STRING(pCaller->GetEntityName()) : "NULL",
-						STRING(ev->m_iTarget),
-						STRING(ev->m_iTargetInput),
-						ev->m_flDelay,
-						STRING(ev->m_iParameter) );
-
-#ifdef MAPBASE
-			CGMsg( 2, CON_GROUP_IO_SYSTEM, "%s", szBuffer );
-#else
-			DevMsg( 2, "%s", szBuffer );
-#endif
-			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
-		}
-		else
-		{
-			char szBuffer[256];
-			Q_snprintf( szBuffer,
-						sizeof(szBuffer),
-						"(%0.2f) output: (%s,%s) -> (%s,%s)(%s)\n",
-#ifdef TF_DLL
-						engine->GetServerTime(),
-#else
-						gpGlobals->curtime,
-#endif
-						pCaller ? STRING(pCaller->m_iClassname) : "NULL",
-						pCaller ? STRING(pCaller->GetEntityName()) : "NULL", STRING(ev->m_iTarget),
-						STRING(ev->m_iTargetInput),
-						STRING(ev->m_iParameter) );
-
-#ifdef MAPBASE
-			CGMsg( 2, CON_GROUP_IO_SYSTEM, "%s", szBuffer );
-#else
-			DevMsg( 2, "%s", szBuffer );
-#endif
-			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
-		}
+		// only formatted if someone is reading
+		EntityIOLog_Output( pCaller, ev );
 
 		if ( pCaller && pCaller->m_debugOverlays & OVERLAY_MESSAGE_BIT)
 		{
@@ -348,15 +314,7 @@ void CBaseEntityOutput::FireOutput(variant_t Value, CBaseEntity *pActivator, CBa
 			ev->m_nTimesToFire--;
 			if (ev->m_nTimesToFire == 0)
 			{
-				char szBuffer[256];
-				Q_snprintf( szBuffer, sizeof(szBuffer), "Removing from action list: (%s,%s) -> (%s,%s)\n", pCaller ? STRING(pCaller->m_iClassname) : "NULL", pCaller ? STRING(pCaller->GetEntityName()) : "NULL", STRING(ev->m_iTarget), STRING(ev->m_iTargetInput));
-
-#ifdef MAPBASE
-				CGMsg( 2, CON_GROUP_IO_SYSTEM, "%s", szBuffer );
-#else
-				DevMsg( 2, "%s", szBuffer );
-#endif
-				ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+				EntityIOLog_ActionRemoved( pCaller, ev );
 				bRemove = true;
 			}
 		}
@@ -687,10 +645,12 @@ DEFINE_FIXEDSIZE_ALLOCATOR( EventQueuePrioritizedEvent_t, 128, CUtlMemoryPool::G
 CEventQueue g_EventQueue;
 
 CEventQueue::CEventQueue()
+ :	m_TargetIndex( 0, 0, DefLessFunc( int ) ),
+	m_CallerIndex( 0, 0, DefLessFunc( int ) ),
+	m_TargetSets( 0, 0, DefLessFunc( const void * ) ),
+	m_nNextSerial( 0 ),
+	m_pServicing( NULL )
 {
-	m_Events.m_flFireTime = -FLT_MAX;
-	m_Events.m_pNext = NULL;
-
 	Init();
 }
 
@@ -803,21 +763,29 @@ void CEventQueue::Init( void )
 void CEventQueue::Clear( void )
 {
 	// delete all the events in the queue
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
-	
-	while ( pe != NULL )
+	for ( int i = 0; i < m_Heap.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
-		delete pe;
-		pe = next;
+		EventQueuePrioritizedEvent_t *pe = m_Heap[i];
+
+		// ServiceEvents() deletes the event it is firing
+		if ( pe == m_pServicing )
+			pe->m_iHeapIndex = -1;
+		else
+			delete pe;
 	}
 
-	m_Events.m_pNext = NULL;
+	m_Heap.RemoveAll();
+	m_TargetIndex.RemoveAll();
+	m_CallerIndex.RemoveAll();
+
+	// names are freed with the level
+	m_TargetSets.PurgeAndDeleteElements();
 }
 
 void CEventQueue::Dump( void )
 {
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
+	CUtlVector<EventQueuePrioritizedEvent_t *> events;
+	GetSortedEvents( events );
 
 	Msg("Dumping event queue. Current time is: %.2f\n",
 #ifdef TF_DLL
@@ -827,9 +795,9 @@ void CEventQueue::Dump( void )
 #endif
 		);
 
-	while ( pe != NULL )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
-		EventQueuePrioritizedEvent_t *next = pe->m_pNext;
+		EventQueuePrioritizedEvent_t *pe = events[i];
 
 		Msg("   (%.2f) Target: '%s', Input: '%s', Parameter '%s'. Activator: '%s', Caller '%s'.  \n", 
 			pe->m_flFireTime, 
@@ -838,8 +806,6 @@ void CEventQueue::Dump( void )
 			pe->m_VariantValue.String(),
 			pe->m_pActivator ? pe->m_pActivator->GetDebugName() : "None", 
 			pe->m_pCaller ? pe->m_pCaller->GetDebugName() : "None"  );
-
-		pe = next;
 	}
 
 	Msg("Finished dump.\n");
@@ -921,43 +887,236 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 
 
 //-----------------------------------------------------------------------------
-// Purpose: private function, adds an event into the list
+// Purpose: Orders events by fire time, then by the order they were added in
+//-----------------------------------------------------------------------------
+static bool EventQueueLessThan( const EventQueuePrioritizedEvent_t *pLeft, const EventQueuePrioritizedEvent_t *pRight )
+{
+	if ( pLeft->m_flFireTime != pRight->m_flFireTime )
+		return ( pLeft->m_flFireTime < pRight->m_flFireTime );
+
+	// Wraps safely
+	return ( (int)( pLeft->m_nSerial - pRight->m_nSerial ) < 0 );
+}
+
+static int __cdecl EventQueueCompare( EventQueuePrioritizedEvent_t * const *ppLeft, EventQueuePrioritizedEvent_t * const *ppRight )
+{
+	if ( EventQueueLessThan( *ppLeft, *ppRight ) )
+		return -1;
+	if ( EventQueueLessThan( *ppRight, *ppLeft ) )
+		return 1;
+	return 0;
+}
+
+inline void CEventQueue::HeapSet( int i, EventQueuePrioritizedEvent_t *pe )
+{
+	m_Heap[i] = pe;
+	pe->m_iHeapIndex = i;
+}
+
+void CEventQueue::HeapUp( int i )
+{
+	EventQueuePrioritizedEvent_t *pe = m_Heap[i];
+	while ( i > 0 )
+	{
+		int iParent = ( i - 1 ) / 2;
+		if ( !EventQueueLessThan( pe, m_Heap[iParent] ) )
+			break;
+
+		HeapSet( i, m_Heap[iParent] );
+		i = iParent;
+	}
+	HeapSet( i, pe );
+}
+
+void CEventQueue::HeapDown( int i )
+{
+	EventQueuePrioritizedEvent_t *pe = m_Heap[i];
+	int nCount = m_Heap.Count();
+	for (;;)
+	{
+		int iChild = i * 2 + 1;
+		if ( iChild >= nCount )
+			break;
+
+		if ( iChild + 1 < nCount && EventQueueLessThan( m_Heap[iChild + 1], m_Heap[iChild] ) )
+			iChild++;
+
+		if ( !EventQueueLessThan( m_Heap[iChild], pe ) )
+			break;
+
+		HeapSet( i, m_Heap[iChild] );
+		i = iChild;
+	}
+	HeapSet( i, pe );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Links an event at the head of its entity's list in an index
+//-----------------------------------------------------------------------------
+#define EVENT_INDEX_LINK( index, key, pe, pNext, pPrev ) \
+	{ \
+		unsigned short iIndex = index.Find( key ); \
+		if ( iIndex == index.InvalidIndex() ) \
+		{ \
+			pe->pNext = NULL; \
+			index.Insert( key, pe ); \
+		} \
+		else \
+		{ \
+			pe->pNext = index[iIndex]; \
+			pe->pNext->pPrev = pe; \
+			index[iIndex] = pe; \
+		} \
+		pe->pPrev = NULL; \
+	}
+
+#define EVENT_INDEX_UNLINK( index, key, pe, pNext, pPrev ) \
+	{ \
+		if ( pe->pNext ) \
+			pe->pNext->pPrev = pe->pPrev; \
+		if ( pe->pPrev ) \
+		{ \
+			pe->pPrev->pNext = pe->pNext; \
+		} \
+		else \
+		{ \
+			unsigned short iIndex = index.Find( key ); \
+			Assert( iIndex != index.InvalidIndex() && index[iIndex] == pe ); \
+			if ( pe->pNext ) \
+				index[iIndex] = pe->pNext; \
+			else \
+				index.RemoveAt( iIndex ); \
+		} \
+		pe->pNext = pe->pPrev = NULL; \
+	}
+
+//-----------------------------------------------------------------------------
+// Purpose: private function, adds an event into the queue
 // Input  : *newEvent - the (already built) event to add
 //-----------------------------------------------------------------------------
 void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
 {
-	// loop through the actions looking for a place to insert
-	EventQueuePrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+	if ( g_bEntityIOProfile )
 	{
-		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
-		{
-			break;
-		}
+		EntityIOProfile_EventQueued();
 	}
 
-	Assert( pe );
+	// events with the same fire time go after the ones already queued
+	newEvent->m_nSerial = m_nNextSerial++;
+
+	HeapSet( m_Heap.AddToTail(), newEvent );
+	HeapUp( newEvent->m_iHeapIndex );
+
+	newEvent->m_pNextByTarget = newEvent->m_pPrevByTarget = NULL;
+	if ( newEvent->m_pEntTarget.ToInt() != INVALID_EHANDLE_INDEX )
+	{
+		EVENT_INDEX_LINK( m_TargetIndex, newEvent->m_pEntTarget.ToInt(), newEvent, m_pNextByTarget, m_pPrevByTarget );
+	}
 
-	// insert
-	newEvent->m_pNext = pe->m_pNext;
-	newEvent->m_pPrev = pe;
-	pe->m_pNext = newEvent;
-	if ( newEvent->m_pNext )
+	newEvent->m_pNextByCaller = newEvent->m_pPrevByCaller = NULL;
+	if ( newEvent->m_pCaller.ToInt() != INVALID_EHANDLE_INDEX )
 	{
-		newEvent->m_pNext->m_pPrev = newEvent;
+		EVENT_INDEX_LINK( m_CallerIndex, newEvent->m_pCaller.ToInt(), newEvent, m_pNextByCaller, m_pPrevByCaller );
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Takes an event out of the queue and its indexes without freeing it
+//-----------------------------------------------------------------------------
 void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
 {
-	Assert( pe->m_pPrev );
-	pe->m_pPrev->m_pNext = pe->m_pNext;
-	if ( pe->m_pNext )
+	int i = pe->m_iHeapIndex;
+	Assert( i >= 0 && i < m_Heap.Count() && m_Heap[i] == pe );
+
+	int iLast = m_Heap.Count() - 1;
+	if ( i != iLast )
+	{
+		EventQueuePrioritizedEvent_t *pMoved = m_Heap[iLast];
+		HeapSet( i, pMoved );
+		m_Heap.RemoveMultipleFromTail( 1 );
+		HeapUp( i );
+		HeapDown( pMoved->m_iHeapIndex );
+	}
+	else
+	{
+		m_Heap.RemoveMultipleFromTail( 1 );
+	}
+	pe->m_iHeapIndex = -1;
+
+	if ( pe->m_pEntTarget.ToInt() != INVALID_EHANDLE_INDEX )
+	{
+		EVENT_INDEX_UNLINK( m_TargetIndex, pe->m_pEntTarget.ToInt(), pe, m_pNextByTarget, m_pPrevByTarget );
+	}
+
+	if ( pe->m_pCaller.ToInt() != INVALID_EHANDLE_INDEX )
+	{
+		EVENT_INDEX_UNLINK( m_CallerIndex, pe->m_pCaller.ToInt(), pe, m_pNextByCaller, m_pPrevByCaller );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Removes an event and frees it, unless ServiceEvents() is firing it
+//-----------------------------------------------------------------------------
+void CEventQueue::DeleteEvent( EventQueuePrioritizedEvent_t *pe )
+{
+	RemoveEvent( pe );
+	if ( pe != m_pServicing )
 	{
-		pe->m_pNext->m_pPrev = pe->m_pPrev;
+		delete pe;
 	}
 }
 
+EventQueuePrioritizedEvent_t *CEventQueue::FirstEventOnTarget( CBaseEntity *pTarget )
+{
+	unsigned short i = m_TargetIndex.Find( pTarget->GetRefEHandle().ToInt() );
+	return ( i != m_TargetIndex.InvalidIndex() ) ? m_TargetIndex[i] : NULL;
+}
+
+EventQueuePrioritizedEvent_t *CEventQueue::FirstEventFromCaller( CBaseEntity *pCaller )
+{
+	unsigned short i = m_CallerIndex.Find( pCaller->GetRefEHandle().ToInt() );
+	return ( i != m_CallerIndex.InvalidIndex() ) ? m_CallerIndex[i] : NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lists the queued events in the order they will fire
+//-----------------------------------------------------------------------------
+void CEventQueue::GetSortedEvents( CUtlVector<EventQueuePrioritizedEvent_t *> &events )
+{
+	events.CopyArray( m_Heap.Base(), m_Heap.Count() );
+	events.Sort( EventQueueCompare );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the entities an event targeted by name goes to. The set is
+//			kept until any entity's name changes.
+//-----------------------------------------------------------------------------
+const CUtlVector<EHANDLE> &CEventQueue::ResolveTargetName( string_t iszTarget )
+{
+	unsigned short i = m_TargetSets.Find( STRING( iszTarget ) );
+	if ( i == m_TargetSets.InvalidIndex() )
+	{
+		TargetSet_t *pNewSet = new TargetSet_t;
+		pNewSet->iNameSerial = gEntList.GetEntityNameSerial() - 1;
+		i = m_TargetSets.Insert( STRING( iszTarget ), pNewSet );
+	}
+
+	TargetSet_t *pSet = m_TargetSets[i];
+	if ( pSet->iNameSerial != gEntList.GetEntityNameSerial() )
+	{
+		pSet->targets.RemoveAll();
+
+		CBaseEntity *pTarget = NULL;
+		while ( ( pTarget = gEntList.FindEntityByName( pTarget, iszTarget ) ) != NULL )
+		{
+			pSet->targets.AddToTail( pTarget );
+		}
+
+		pSet->iNameSerial = gEntList.GetEntityNameSerial();
+	}
+
+	return pSet->targets;
+}
 
 //-----------------------------------------------------------------------------
 // Purpose: fires off any events in the queue who's fire time is (or before) the present time
@@ -969,16 +1128,22 @@ void CEventQueue::ServiceEvents( void )
 		return;
 	}
 
-	EventQueuePrioritizedEvent_t *pe = m_Events.m_pNext;
+	CEntityIOProfileScope ioProfile( IOPROFILE_SERVICE, NULL, NULL );
 
 #ifdef TF_DLL
-	while ( pe != NULL && pe->m_flFireTime <= engine->GetServerTime() )
+	while ( m_Heap.Count() && m_Heap[0]->m_flFireTime <= engine->GetServerTime() )
 #else
-	while ( pe != NULL && pe->m_flFireTime <= gpGlobals->curtime )
+	while ( m_Heap.Count() && m_Heap[0]->m_flFireTime <= gpGlobals->curtime )
 #endif
 	{
 		MDLCACHE_CRITICAL_SECTION();
 
+		// stays queued while it fires, but is only freed here
+		EventQueuePrioritizedEvent_t *pe = m_Heap[0];
+		m_pServicing = pe;
+
+		CEntityIOProfileScope ioProfileEvent( IOPROFILE_EVENT, pe->m_pCaller, pe );
+
 		bool targetFound = false;
 
 		// find the targets
@@ -999,7 +1164,46 @@ void CEventQueue::ServiceEvents( void )
 			}
 			else
 #endif
+			if ( STRING( pe->m_iTarget )[0] != '!' )
 			{
+				// inputs can rename targets and change the cached set, so fire from a copy
+				CUtlVectorFixedGrowable<EHANDLE, 16> targets;
+				CUtlVectorFixedGrowable<EHANDLE, 16> firedTargets;
+				int iNameSerial = gEntList.GetEntityNameSerial();
+				const CUtlVector<EHANDLE> &cachedTargets = ResolveTargetName( pe->m_iTarget );
+				targets.CopyArray( cachedTargets.Base(), cachedTargets.Count() );
+
+				for ( int i = 0; i < targets.Count(); i++ )
+				{
+					CBaseEntity *target = targets[i];
+					if ( !target || !target->NameMatches( pe->m_iTarget ) )
+						continue;
+
+					// pump the action into the target
+					target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+					targetFound = true;
+					firedTargets.AddToTail( targets[i] );
+
+					// the input spawned or renamed something, so entities that now
+					// have the name get the event too, like the old walk of the list
+					if ( iNameSerial != gEntList.GetEntityNameSerial() )
+					{
+						iNameSerial = gEntList.GetEntityNameSerial();
+						const CUtlVector<EHANDLE> &renamedTargets = ResolveTargetName( pe->m_iTarget );
+
+						targets.RemoveAll();
+						for ( int j = 0; j < renamedTargets.Count(); j++ )
+						{
+							if ( !firedTargets.HasElement( renamedTargets[j] ) )
+								targets.AddToTail( renamedTargets[j] );
+						}
+						i = -1;
+					}
+				}
+			}
+			else
+			{
+				// procedural targets depend on the activator and caller, find them every time
 				CBaseEntity *target = NULL;
 				while ( 1 )
 				{
@@ -1061,8 +1265,12 @@ void CEventQueue::ServiceEvents( void )
 			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
 		}
 
-		// remove the event from the list (remembering that the queue may have been added to)
-		RemoveEvent( pe );
+		// remove the event from the queue, unless the inputs already cancelled it
+		m_pServicing = NULL;
+		if ( pe->m_iHeapIndex != -1 )
+		{
+			RemoveEvent( pe );
+		}
 		delete pe;
 
 		//
@@ -1075,9 +1283,6 @@ void CEventQueue::ServiceEvents( void )
 				break;
 			}
 		}
-
-		// restart the list (to catch any new items have probably been added to the queue)
-		pe = m_Events.m_pNext;	
 	}
 }
 
@@ -1105,30 +1310,15 @@ void CEventQueue::CancelEvents( CBaseEntity *pCaller )
 	if (!pCaller)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = FirstEventFromCaller( pCaller );
 
 	while (pCur != NULL)
 	{
-		bool bDelete = false;
-		if (pCur->m_pCaller == pCaller)
-		{
-			// Pointers match; make sure everything else matches.
-			if (!stricmp(STRING(pCur->m_pCaller->GetEntityName()), STRING(pCaller->GetEntityName())) &&
-				!stricmp(pCur->m_pCaller->GetClassname(), pCaller->GetClassname()))
-			{
-				// Found a matching event; delete it from the queue.
-				bDelete = true;
-			}
-		}
-
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pNextByCaller;
 
-		if (bDelete)
-		{
-			RemoveEvent( pCurSave );
-			delete pCurSave;
-		}
+		// Found a matching event; delete it from the queue.
+		DeleteEvent( pCurSave );
 	}
 }
 
@@ -1143,27 +1333,17 @@ void CEventQueue::CancelEventOn( CBaseEntity *pTarget, const char *sInputName )
 	if (!pTarget)
 		return;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = FirstEventOnTarget( pTarget );
 
 	while (pCur != NULL)
 	{
-		bool bDelete = false;
-		if (pCur->m_pEntTarget == pTarget)
-		{
-			if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
-			{
-				// Found a matching event; delete it from the queue.
-				bDelete = true;
-			}
-		}
-
 		EventQueuePrioritizedEvent_t *pCurSave = pCur;
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pNextByTarget;
 
-		if (bDelete)
+		if ( !Q_strncmp( STRING(pCurSave->m_iTargetInput), sInputName, strlen(sInputName) ) )
 		{
-			RemoveEvent( pCurSave );
-			delete pCurSave;
+			// Found a matching event; delete it from the queue.
+			DeleteEvent( pCurSave );
 		}
 	}
 }
@@ -1178,20 +1358,17 @@ bool CEventQueue::HasEventPending( CBaseEntity *pTarget, const char *sInputName
 	if (!pTarget)
 		return false;
 
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = FirstEventOnTarget( pTarget );
 
 	while (pCur != NULL)
 	{
-		if (pCur->m_pEntTarget == pTarget)
-		{
-			if ( !sInputName )
-				return true;
+		if ( !sInputName )
+			return true;
 
-			if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
-				return true;
-		}
+		if ( !Q_strncmp( STRING(pCur->m_iTargetInput), sInputName, strlen(sInputName) ) )
+			return true;
 
-		pCur = pCur->m_pNext;
+		pCur = pCur->m_pNextByTarget;
 	}
 
 	return false;
@@ -1217,44 +1394,48 @@ void CEventQueue::CancelEventsByInput( CBaseEntity *pTarget, const char *szInput
 	if ( !pTarget )
 		return;
 
-	string_t iszDebugName = MAKE_STRING( pTarget->GetDebugName() );
-	EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext;
+	EventQueuePrioritizedEvent_t *pCur = FirstEventOnTarget( pTarget );
 
 	while ( pCur )
 	{
-		bool bRemove = false;
+		EventQueuePrioritizedEvent_t *pPrev = pCur;
+		pCur = pCur->m_pNextByTarget;
 
-		if ( pTarget == pCur->m_pEntTarget || pCur->m_iTarget == iszDebugName )
+		if ( !V_strncmp( STRING(pPrev->m_iTargetInput), szInput, strlen(szInput) ) )
 		{
-			if ( !V_strncmp( STRING(pCur->m_iTargetInput), szInput, strlen(szInput) ) )
-			{
-				bRemove = true;
-			}
+			DeleteEvent(pPrev);
 		}
+	}
 
-		EventQueuePrioritizedEvent_t *pPrev = pCur;
-		pCur = pCur->m_pNext;
+	// Events targeted by name are not indexed
+	string_t iszDebugName = MAKE_STRING( pTarget->GetDebugName() );
 
-		if ( bRemove )
+	CUtlVector<EventQueuePrioritizedEvent_t *> removed;
+	for ( int i = 0; i < m_Heap.Count(); i++ )
+	{
+		EventQueuePrioritizedEvent_t *pe = m_Heap[i];
+		if ( pe->m_iTarget == iszDebugName && !V_strncmp( STRING(pe->m_iTargetInput), szInput, strlen(szInput) ) )
 		{
-			RemoveEvent(pPrev);
-			delete pPrev;
+			removed.AddToTail( pe );
 		}
 	}
+
+	// Removing events reorders the heap
+	for ( int i = 0; i < removed.Count(); i++ )
+	{
+		DeleteEvent( removed[i] );
+	}
 }
 
 bool CEventQueue::RemoveEvent( int event )
 {
 	EventQueuePrioritizedEvent_t *pe = reinterpret_cast<EventQueuePrioritizedEvent_t*>(event); // INT_TO_POINTER
 
-	for ( EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext; pCur; pCur = pCur->m_pNext )
+	// The handle may be stale, only trust it if it is still queued
+	if ( m_Heap.Find( pe ) != m_Heap.InvalidIndex() )
 	{
-		if ( pCur == pe )
-		{
-			RemoveEvent(pCur);
-			delete pCur;
-			return true;
-		}
+		DeleteEvent(pe);
+		return true;
 	}
 
 	return false;
@@ -1264,12 +1445,9 @@ float CEventQueue::GetTimeLeft( int event )
 {
 	EventQueuePrioritizedEvent_t *pe = reinterpret_cast<EventQueuePrioritizedEvent_t*>(event); // INT_TO_POINTER
 
-	for ( EventQueuePrioritizedEvent_t *pCur = m_Events.m_pNext; pCur; pCur = pCur->m_pNext )
+	if ( m_Heap.Find( pe ) != m_Heap.InvalidIndex() )
 	{
-		if ( pCur == pe )
-		{
-			return (pCur->m_flFireTime - gpGlobals->curtime);
-		}
+		return (pe->m_flFireTime - gpGlobals->curtime);
 	}
 
 	return 0.f;
@@ -1280,7 +1458,7 @@ float CEventQueue::GetTimeLeft( int event )
 // save data description for the event queue
 BEGIN_SIMPLE_DATADESC( CEventQueue )
 	// These are saved explicitly in CEventQueue::Save below
-	// DEFINE_FIELD( m_Events, EventQueuePrioritizedEvent_t ),
+	// DEFINE_FIELD( m_Heap, EventQueuePrioritizedEvent_t ),
 
 	DEFINE_FIELD( m_iListCount, FIELD_INTEGER ),	// this value is only used during save/restore
 END_DATADESC()
@@ -1297,29 +1475,28 @@ BEGIN_SIMPLE_DATADESC( EventQueuePrioritizedEvent_t )
 	DEFINE_FIELD( m_iOutputID, FIELD_INTEGER ),
 	DEFINE_CUSTOM_FIELD( m_VariantValue, variantFuncs ),
 
-//	DEFINE_FIELD( m_pNext, FIELD_??? ),
-//	DEFINE_FIELD( m_pPrev, FIELD_??? ),
+	// Rebuilt when the events are added back on restore
+//	DEFINE_FIELD( m_nSerial, FIELD_INTEGER ),
+//	DEFINE_FIELD( m_iHeapIndex, FIELD_INTEGER ),
 END_DATADESC()
 
 
 int CEventQueue::Save( ISave &save )
 {
-	// count the number of items in the queue
-	EventQueuePrioritizedEvent_t *pe;
+	// saved in firing order, so restoring them keeps the order of events with the same fire time
+	CUtlVector<EventQueuePrioritizedEvent_t *> events;
+	GetSortedEvents( events );
 
-	m_iListCount = 0;
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
-	{
-		m_iListCount++;
-	}
+	m_iListCount = events.Count();
 
 	// save that value out to disk, so we know how many to restore
 	if ( !save.WriteFields( "EventQueue", this, NULL, m_DataMap.dataDesc, m_DataMap.dataNumFields ) )
 		return 0;
 	
 	// cycle through all the events, saving them all
-	for ( pe = m_Events.m_pNext; pe != NULL; pe = pe->m_pNext )
+	for ( int i = 0; i < events.Count(); i++ )
 	{
+		EventQueuePrioritizedEvent_t *pe = events[i];
 		if ( !save.WriteFields( "PEvent", pe, NULL, pe->m_DataMap.dataDesc, pe->m_DataMap.dataNumFields ) )
 			return 0;
 	}
@@ -1466,6 +1643,109 @@ void variant_t::SetOther( void *data )
 #ifdef MAPBASE
 // This way we don't have to use string comparisons when reading failed conversions
 static const char *g_szNoConversion = "No conversion to string";
+
+#define VARIANT_CONVERSION_CACHE_SIZE	4096
+
+//-----------------------------------------------------------------------------
+// Purpose: Remembers what numbers, vectors and colors became as pooled strings,
+//			so outputs passing the same values around don't format and pool
+//			them every time they fire.
+//-----------------------------------------------------------------------------
+class CVariantConversionCache : public CAutoGameSystem
+{
+public:
+	CVariantConversionCache() : CAutoGameSystem( "CVariantConversionCache" ), m_nHits( 0 ), m_nMisses( 0 ) {}
+
+	// Pooled strings don't survive the level
+	virtual void LevelShutdownPostEntity() { m_Results.Purge(); }
+
+	bool Find( const variant_t &value, fieldtype_t newType, variant_t &result )
+	{
+		ConversionKey_t key;
+		if ( !MakeKey( value, newType, key ) )
+			return false;
+
+		UtlHashHandle_t h = m_Results.Find( key );
+		if ( h == m_Results.InvalidHandle() )
+		{
+			m_nMisses++;
+			return false;
+		}
+
+		m_nHits++;
+		result = m_Results[h];
+		return true;
+	}
+
+	void Add( const variant_t &value, fieldtype_t newType, const variant_t &result )
+	{
+		ConversionKey_t key;
+		if ( !MakeKey( value, newType, key ) )
+			return;
+
+		if ( m_Results.Count() >= VARIANT_CONVERSION_CACHE_SIZE )
+		{
+			m_Results.RemoveAll();
+		}
+
+		m_Results.Insert( key, result );
+	}
+
+	void Report()
+	{
+		Msg( "Variant conversion cache: %d entries, %d hits, %d misses\n", m_Results.Count(), m_nHits, m_nMisses );
+	}
+
+private:
+	struct ConversionKey_t
+	{
+		int		nTypes;		// Source type in the high word, target type in the low word
+		int		nValue[3];
+	};
+
+	struct ConversionKeyHash
+	{
+		unsigned operator()( const ConversionKey_t &key ) const { return Hash16( &key ); }
+	};
+
+	struct ConversionKeyEqual
+	{
+		bool operator()( const ConversionKey_t &left, const ConversionKey_t &right ) const { return !memcmp( &left, &right, sizeof( ConversionKey_t ) ); }
+	};
+
+	// Only values whose conversion never changes can be cached
+	static bool MakeKey( const variant_t &value, fieldtype_t newType, ConversionKey_t &key )
+	{
+		memset( &key, 0, sizeof( key ) );
+		key.nTypes = ( value.fieldType << 16 ) | newType;
+
+		switch ( value.fieldType )
+		{
+		case FIELD_BOOLEAN:		key.nValue[0] = value.bVal ? 1 : 0;					return true;
+		case FIELD_INTEGER:		key.nValue[0] = value.iVal;							return true;
+		case FIELD_FLOAT:		memcpy( key.nValue, &value.flVal, sizeof( float ) );	return true;
+		case FIELD_COLOR32:		memcpy( key.nValue, &value.rgbaVal, sizeof( color32 ) );	return true;
+		case FIELD_VECTOR:		memcpy( key.nValue, value.vecVal, sizeof( value.vecVal ) );	return true;
+		}
+
+		return false;
+	}
+
+	CUtlHashtable<ConversionKey_t, variant_t, ConversionKeyHash, ConversionKeyEqual> m_Results;
+
+	int		m_nHits;
+	int		m_nMisses;
+};
+
+static CVariantConversionCache g_VariantConversionCache;
+
+CON_COMMAND( variant_conversion_cache_stats, "Print how often I/O value conversions were served from the cache" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_VariantConversionCache.Report();
+}
 #endif
 
 //-----------------------------------------------------------------------------
@@ -1502,6 +1782,9 @@ bool variant_t::Convert( fieldtype_t newType )
 #ifdef MAPBASE
 	if (newType == FIELD_STRING)
 	{
+		if ( g_VariantConversionCache.Find( *this, newType, *this ) )
+			return true;
+
 		// I got a conversion error when I tried to convert int to string. I'm actually quite baffled.
 		// Was that case really not handled before? Did I do something that overrode something that already did this?
 		const char *szString = ToString();
@@ -1510,7 +1793,9 @@ bool variant_t::Convert( fieldtype_t newType )
 		// so this is safe and it lets us get away with a pointer comparison.
 		if (szString != g_szNoConversion)
 		{
+			variant_t original = *this;
 			SetString(AllocPooledString(szString));
+			g_VariantConversionCache.Add( original, newType, *this );
 			return true;
 		}
 		return false;
@@ -1534,6 +1819,21 @@ bool variant_t::Convert( fieldtype_t newType )
 					SetBool( iVal != 0 );
 					return true;
 				}
+
+#ifdef MAPBASE
+				// These used to go through a string, which parsed the number as the first component
+				case FIELD_VECTOR:
+				{
+					SetVector3D( Vector( (float) iVal, 0, 0 ) );
+					return true;
+				}
+
+				case FIELD_COLOR32:
+				{
+					SetColor32( iVal, 0, 0, 255 );
+					return true;
+				}
+#endif
 			}
 			break;
 		}
@@ -1553,10 +1853,72 @@ bool variant_t::Convert( fieldtype_t newType )
 					SetBool( flVal != 0 );
 					return true;
 				}
+
+#ifdef MAPBASE
+				case FIELD_VECTOR:
+				{
+					SetVector3D( Vector( flVal, 0, 0 ) );
+					return true;
+				}
+
+				case FIELD_COLOR32:
+				{
+					SetColor32( (int) flVal, 0, 0, 255 );
+					return true;
+				}
+#endif
 			}
 			break;
 		}
 
+#ifdef MAPBASE
+		case FIELD_BOOLEAN:
+		{
+			switch ( newType )
+			{
+				// Going through "true" and "false" always gave 0
+				case FIELD_INTEGER:
+				{
+					SetInt( bVal ? 1 : 0 );
+					return true;
+				}
+
+				case FIELD_FLOAT:
+				{
+					SetFloat( bVal ? 1.0f : 0.0f );
+					return true;
+				}
+			}
+			break;
+		}
+
+		case FIELD_VECTOR:
+		{
+			switch ( newType )
+			{
+				case FIELD_COLOR32:
+				{
+					SetColor32( (int) vecVal[0], (int) vecVal[1], (int) vecVal[2], 255 );
+					return true;
+				}
+			}
+			break;
+		}
+
+		case FIELD_COLOR32:
+		{
+			switch ( newType )
+			{
+				case FIELD_VECTOR:
+				{
+					SetVector3D( Vector( rgbaVal.r, rgbaVal.g, rgbaVal.b ) );
+					return true;
+				}
+			}
+			break;
+		}
+#endif
+
 		//
 		// Everyone must convert from FIELD_STRING if possible, since
 		// parameter overrides are always passed as strings.
@@ -0,0 +1,276 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Records entity I/O traffic without formatting it (ent_io_log)
+//
+//=============================================================================//
+
+#include "cbase.h"
+
+#include "entityiolog.h"
+
+#include "entityoutput.h"
+#include "env_debughistory.h"
+#include "igamesystem.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar ent_io_log( "ent_io_log", "1", FCVAR_NONE, "Keep the most recent entity I/O traffic for ent_io_log_dump" );
+
+#define IOLOG_SIZE			1024	// Must be a power of two
+#define IOLOG_VALUE_LENGTH	64
+
+enum EntityIOLogKind_t
+{
+	IOLOG_OUTPUT = 0,
+	IOLOG_ACTION_REMOVED,
+	IOLOG_INPUT,
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Everything needed to format a line later. Strings are pooled and
+//			live until the level ends, except string values, which are copied
+//			since they may not be pooled.
+//-----------------------------------------------------------------------------
+struct EntityIOLogEntry_t
+{
+	EntityIOLogKind_t	kind;
+	float				flTime;
+
+	bool				bHasCaller;
+	string_t			iszCallerClassname;
+	string_t			iszCallerName;
+
+	// Outputs
+	string_t			iszTarget;
+	string_t			iszTargetInput;
+	string_t			iszParameter;
+	float				flDelay;
+
+	// Inputs
+	string_t			iszTargetClassname;
+	string_t			iszTargetName;
+	string_t			iszInput;			// As the caller spelled it
+	variant_t			value;
+	char				szValue[IOLOG_VALUE_LENGTH];
+	const char			*pszLiveValue;		// The whole string value, only while the entry is being printed
+};
+
+//-----------------------------------------------------------------------------
+// CEntityIOLog
+//-----------------------------------------------------------------------------
+
+class CEntityIOLog : public CAutoGameSystem
+{
+public:
+	CEntityIOLog() : CAutoGameSystem( "CEntityIOLog" ), m_nWritten( 0 ) {}
+
+	// The strings in the entries go with the level
+	virtual void LevelShutdownPostEntity() { m_nWritten = 0; }
+
+	EntityIOLogEntry_t *BeginEntry( EntityIOLogKind_t kind, CBaseEntity *pCaller );
+	void	EndEntry( EntityIOLogEntry_t *pEntry );
+
+	void	Dump( int nCount );
+
+private:
+	void	FormatEntry( const EntityIOLogEntry_t &entry, char *pszBuffer, int nBufferLength );
+
+	EntityIOLogEntry_t	m_Entries[IOLOG_SIZE];
+
+	// Slots are claimed by incrementing this, so writers never wait on each other
+	CInterlockedInt		m_nWritten;
+};
+
+static CEntityIOLog g_EntityIOLog;
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether anyone reads the lines as they happen
+//-----------------------------------------------------------------------------
+static bool IsLiveConsumerActive()
+{
+#if !defined( DISABLE_DEBUG_HISTORY )
+	return true;
+#elif defined( MAPBASE )
+	return CGMsgActive( 2, CON_GROUP_IO_SYSTEM );
+#else
+	return IsSpewActive( "developer", 2 );
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the entry to fill in, or NULL if nobody would read it
+//-----------------------------------------------------------------------------
+EntityIOLogEntry_t *CEntityIOLog::BeginEntry( EntityIOLogKind_t kind, CBaseEntity *pCaller )
+{
+	bool bLive = IsLiveConsumerActive();
+	if ( !bLive && !ent_io_log.GetBool() )
+		return NULL;
+
+	int iEntry = ( ++m_nWritten - 1 ) & ( IOLOG_SIZE - 1 );
+	EntityIOLogEntry_t *pEntry = &m_Entries[iEntry];
+
+	pEntry->kind = kind;
+#ifdef TF_DLL
+	pEntry->flTime = engine->GetServerTime();
+#else
+	pEntry->flTime = gpGlobals->curtime;
+#endif
+	pEntry->bHasCaller = ( pCaller != NULL );
+	pEntry->iszCallerClassname = pCaller ? pCaller->m_iClassname : NULL_STRING;
+	pEntry->iszCallerName = pCaller ? pCaller->GetEntityName() : NULL_STRING;
+	return pEntry;
+}
+
+//-----------------------------------------------------------------------------
+
+void CEntityIOLog::EndEntry( EntityIOLogEntry_t *pEntry )
+{
+	if ( !IsLiveConsumerActive() )
+		return;
+
+	char szBuffer[512];
+	FormatEntry( *pEntry, szBuffer, sizeof( szBuffer ) );
+
+#ifdef MAPBASE
+	CGMsg( 2, CON_GROUP_IO_SYSTEM, "%s", szBuffer );
+#else
+	DevMsg( 2, "%s", szBuffer );
+#endif
+	ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds the same lines the I/O system used to print
+//-----------------------------------------------------------------------------
+void CEntityIOLog::FormatEntry( const EntityIOLogEntry_t &entry, char *pszBuffer, int nBufferLength )
+{
+	switch ( entry.kind )
+	{
+	case IOLOG_OUTPUT:
+		{
+			const char *pszCallerClassname = entry.bHasCaller ? STRING( entry.iszCallerClassname ) : "NULL";
+			const char *pszCallerName = entry.bHasCaller ? STRING( entry.iszCallerName ) : "NULL";
+
+			if ( entry.flDelay )
+			{
+				Q_snprintf( pszBuffer, nBufferLength, "(%0.2f) output: (%s,%s) -> (%s,%s,%.1f)(%s)\n",
+					entry.flTime, pszCallerClassname, pszCallerName,
+					STRING( entry.iszTarget ), STRING( entry.iszTargetInput ), entry.flDelay, STRING( entry.iszParameter ) );
+			}
+			else
+			{
+				Q_snprintf( pszBuffer, nBufferLength, "(%0.2f) output: (%s,%s) -> (%s,%s)(%s)\n",
+					entry.flTime, pszCallerClassname, pszCallerName,
+					STRING( entry.iszTarget ), STRING( entry.iszTargetInput ), STRING( entry.iszParameter ) );
+			}
+		}
+		break;
+
+	case IOLOG_ACTION_REMOVED:
+		{
+			Q_snprintf( pszBuffer, nBufferLength, "Removing from action list: (%s,%s) -> (%s,%s)\n",
+				entry.bHasCaller ? STRING( entry.iszCallerClassname ) : "NULL",
+				entry.bHasCaller ? STRING( entry.iszCallerName ) : "NULL",
+				STRING( entry.iszTarget ), STRING( entry.iszTargetInput ) );
+		}
+		break;
+
+	case IOLOG_INPUT:
+		{
+			// Same as CBaseEntity::GetDebugName()
+			const char *pszTargetName = ( entry.iszTargetName != NULL_STRING ) ? STRING( entry.iszTargetName ) : STRING( entry.iszTargetClassname );
+
+			variant_t value = entry.value;
+			const char *pszValue = ( value.FieldType() == FIELD_STRING ) ? entry.szValue : value.String();
+			if ( entry.pszLiveValue )
+			{
+				pszValue = entry.pszLiveValue;
+			}
+
+			Q_snprintf( pszBuffer, nBufferLength, "(%0.2f) input %s: %s.%s(%s)\n",
+				entry.flTime, entry.bHasCaller ? STRING( entry.iszCallerName ) : "<NULL>",
+				pszTargetName, STRING( entry.iszInput ), pszValue );
+		}
+		break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CEntityIOLog::Dump( int nCount )
+{
+	int nWritten = m_nWritten;
+	nCount = MIN( nCount, MIN( nWritten, IOLOG_SIZE ) );
+
+	Msg( "Last %d of %d entity I/O log entries:\n", nCount, nWritten );
+
+	char szBuffer[512];
+	for ( int i = nWritten - nCount; i < nWritten; i++ )
+	{
+		FormatEntry( m_Entries[i & ( IOLOG_SIZE - 1 )], szBuffer, sizeof( szBuffer ) );
+		Msg( "%s", szBuffer );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void EntityIOLog_Output( CBaseEntity *pCaller, const CEventAction *pAction )
+{
+	EntityIOLogEntry_t *pEntry = g_EntityIOLog.BeginEntry( IOLOG_OUTPUT, pCaller );
+	if ( !pEntry )
+		return;
+
+	pEntry->iszTarget = pAction->m_iTarget;
+	pEntry->iszTargetInput = pAction->m_iTargetInput;
+	pEntry->iszParameter = pAction->m_iParameter;
+	pEntry->flDelay = pAction->m_flDelay;
+
+	g_EntityIOLog.EndEntry( pEntry );
+}
+
+void EntityIOLog_ActionRemoved( CBaseEntity *pCaller, const CEventAction *pAction )
+{
+	EntityIOLogEntry_t *pEntry = g_EntityIOLog.BeginEntry( IOLOG_ACTION_REMOVED, pCaller );
+	if ( !pEntry )
+		return;
+
+	pEntry->iszTarget = pAction->m_iTarget;
+	pEntry->iszTargetInput = pAction->m_iTargetInput;
+
+	g_EntityIOLog.EndEntry( pEntry );
+}
+
+void EntityIOLog_Input( CBaseEntity *pTarget, CBaseEntity *pCaller, const char *pszInput, const variant_t &Value )
+{
+	EntityIOLogEntry_t *pEntry = g_EntityIOLog.BeginEntry( IOLOG_INPUT, pCaller );
+	if ( !pEntry )
+		return;
+
+	pEntry->iszTargetClassname = pTarget->m_iClassname;
+	pEntry->iszTargetName = pTarget->GetEntityName();
+	pEntry->iszInput = AllocPooledString( pszInput );
+	pEntry->value = Value;
+
+	pEntry->pszLiveValue = NULL;
+
+	if ( pEntry->value.FieldType() == FIELD_STRING )
+	{
+		Q_strncpy( pEntry->szValue, STRING( pEntry->value.StringID() ), sizeof( pEntry->szValue ) );
+		pEntry->pszLiveValue = STRING( pEntry->value.StringID() );
+	}
+
+	g_EntityIOLog.EndEntry( pEntry );
+
+	pEntry->pszLiveValue = NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+CON_COMMAND( ent_io_log_dump, "Print the most recent entity I/O traffic. Optional argument: number of entries (default 64)" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_EntityIOLog.Dump( args.ArgC() > 1 ? atoi( args[1] ) : 64 );
+}
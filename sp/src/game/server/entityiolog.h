@@ -0,0 +1,34 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Records entity I/O traffic without formatting it (ent_io_log)
+//
+//=============================================================================//
+
+#ifndef ENTITYIOLOG_H
+#define ENTITYIOLOG_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+class CBaseEntity;
+class CEventAction;
+class variant_t;
+
+//-----------------------------------------------------------------------------
+// The I/O system used to build a debug line for every output and input, even
+// with nobody reading them. These record the arguments into a ring buffer
+// instead, and only format them when the developer 2 I/O messages are on or
+// the buffer is dumped with ent_io_log_dump.
+//-----------------------------------------------------------------------------
+
+// An output posting one of its actions to the event queue
+void EntityIOLog_Output( CBaseEntity *pCaller, const CEventAction *pAction );
+
+// An action that ran out of times to fire
+void EntityIOLog_ActionRemoved( CBaseEntity *pCaller, const CEventAction *pAction );
+
+// An entity receiving an input
+void EntityIOLog_Input( CBaseEntity *pTarget, CBaseEntity *pCaller, const char *pszInput, const variant_t &Value );
+
+#endif // ENTITYIOLOG_H
@@ -0,0 +1,369 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Times entity outputs, queued events and inputs (ent_io_profile)
+//
+//=============================================================================//
+
+#include "cbase.h"
+
+#include "entityioprofiler.h"
+
+#include "entityoutput.h"
+#include "eventqueue.h"
+#include "filesystem.h"
+#include "utldict.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+bool g_bEntityIOProfile = false;
+
+static void EntityIOProfileChanged( IConVar *var, const char *pOldValue, float flOldValue )
+{
+	g_bEntityIOProfile = ((ConVar *)var)->GetBool();
+}
+
+ConVar ent_io_profile( "ent_io_profile", "0", FCVAR_NONE, "Time entity outputs, queued events and inputs. See ent_io_profile_report and ent_io_profile_dump.", EntityIOProfileChanged );
+
+// Handler times go in buckets growing by 25%, enough to tell the 99th percentile
+// apart from the average without keeping every sample
+#define IOPROFILE_BUCKETS		64
+#define IOPROFILE_BUCKET_BASE	0.5f	// Microseconds, upper bound of the first bucket
+#define IOPROFILE_BUCKET_GROWTH	1.25f
+
+static const char *g_pszIOProfileKinds[NUM_IOPROFILE_KINDS] =
+{
+	"service",
+	"event",
+	"output",
+	"input",
+};
+
+//-----------------------------------------------------------------------------
+
+struct EntityIOProfileRecord_t
+{
+	EntityIOProfileKind_t	kind;
+	CUtlString				strClassname;
+	CUtlString				strName;
+
+	int						nCount;
+	double					flTotalTime;	// Microseconds, including nested scopes
+	float					flMaxTime;
+	int						nTotalFanOut;
+	int						nMaxFanOut;
+	int						histogram[IOPROFILE_BUCKETS];
+
+	float	AverageTime() const		{ return nCount ? flTotalTime / nCount : 0.0f; }
+	float	AverageFanOut() const	{ return nCount ? (float)nTotalFanOut / nCount : 0.0f; }
+	float	Percentile( float flFraction ) const;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the upper bound of the bucket the given fraction of samples
+//			fall under, capped by the slowest sample
+//-----------------------------------------------------------------------------
+float EntityIOProfileRecord_t::Percentile( float flFraction ) const
+{
+	int nTarget = (int)ceilf( nCount * flFraction );
+	int nSeen = 0;
+	float flBound = IOPROFILE_BUCKET_BASE;
+	for ( int i = 0; i < IOPROFILE_BUCKETS; i++, flBound *= IOPROFILE_BUCKET_GROWTH )
+	{
+		nSeen += histogram[i];
+		if ( nSeen >= nTarget )
+			return MIN( flBound, flMaxTime );
+	}
+
+	return flMaxTime;
+}
+
+//-----------------------------------------------------------------------------
+// CEntityIOProfiler
+//-----------------------------------------------------------------------------
+
+class CEntityIOProfiler
+{
+public:
+	CEntityIOProfiler() : m_pCurrentScope( NULL ), m_RecordIndex( k_eDictCompareTypeCaseSensitive ) {}
+	~CEntityIOProfiler() { m_Records.PurgeAndDeleteElements(); }
+
+	EntityIOProfileRecord_t *FindOrAddRecord( EntityIOProfileKind_t kind, const char *pszClassname, const char *pszName );
+	void	Record( EntityIOProfileRecord_t *pRecord, float flTime, int nFanOut );
+
+	void	Report( int nCount );
+	void	Dump( const char *pszFile );
+	void	Clear();
+
+	CEntityIOProfileScope	*m_pCurrentScope;
+
+private:
+	void	GetSortedRecords( CUtlVector<EntityIOProfileRecord_t *> &records );
+
+	// Records are never freed while the game runs, scopes hold on to them
+	CUtlVector<EntityIOProfileRecord_t *>	m_Records;
+	CUtlDict<EntityIOProfileRecord_t *, int>	m_RecordIndex;
+};
+
+static CEntityIOProfiler g_EntityIOProfiler;
+
+//-----------------------------------------------------------------------------
+
+EntityIOProfileRecord_t *CEntityIOProfiler::FindOrAddRecord( EntityIOProfileKind_t kind, const char *pszClassname, const char *pszName )
+{
+	char szKey[256];
+	Q_snprintf( szKey, sizeof( szKey ), "%d|%s|%s", kind, pszClassname, pszName );
+
+	int i = m_RecordIndex.Find( szKey );
+	if ( i != m_RecordIndex.InvalidIndex() )
+		return m_RecordIndex[i];
+
+	EntityIOProfileRecord_t *pRecord = new EntityIOProfileRecord_t;
+	pRecord->kind = kind;
+	pRecord->strClassname = pszClassname;
+	pRecord->strName = pszName;
+	pRecord->nCount = 0;
+	pRecord->flTotalTime = 0;
+	pRecord->flMaxTime = 0;
+	pRecord->nTotalFanOut = 0;
+	pRecord->nMaxFanOut = 0;
+	memset( pRecord->histogram, 0, sizeof( pRecord->histogram ) );
+
+	m_Records.AddToTail( pRecord );
+	m_RecordIndex.Insert( szKey, pRecord );
+	return pRecord;
+}
+
+//-----------------------------------------------------------------------------
+
+void CEntityIOProfiler::Record( EntityIOProfileRecord_t *pRecord, float flTime, int nFanOut )
+{
+	int iBucket = 0;
+	if ( flTime > IOPROFILE_BUCKET_BASE )
+	{
+		iBucket = MIN( (int)ceilf( logf( flTime / IOPROFILE_BUCKET_BASE ) / logf( IOPROFILE_BUCKET_GROWTH ) ), IOPROFILE_BUCKETS - 1 );
+	}
+
+	pRecord->nCount++;
+	pRecord->flTotalTime += flTime;
+	pRecord->flMaxTime = MAX( pRecord->flMaxTime, flTime );
+	pRecord->nTotalFanOut += nFanOut;
+	pRecord->nMaxFanOut = MAX( pRecord->nMaxFanOut, nFanOut );
+	pRecord->histogram[iBucket]++;
+}
+
+//-----------------------------------------------------------------------------
+
+static int __cdecl CompareRecordTimes( EntityIOProfileRecord_t * const *ppLeft, EntityIOProfileRecord_t * const *ppRight )
+{
+	if ( (*ppLeft)->flTotalTime != (*ppRight)->flTotalTime )
+		return ( (*ppLeft)->flTotalTime > (*ppRight)->flTotalTime ) ? -1 : 1;
+
+	return 0;
+}
+
+void CEntityIOProfiler::GetSortedRecords( CUtlVector<EntityIOProfileRecord_t *> &records )
+{
+	for ( int i = 0; i < m_Records.Count(); i++ )
+	{
+		if ( m_Records[i]->nCount )
+		{
+			records.AddToTail( m_Records[i] );
+		}
+	}
+
+	records.Sort( CompareRecordTimes );
+}
+
+//-----------------------------------------------------------------------------
+
+void CEntityIOProfiler::Report( int nCount )
+{
+	CUtlVector<EntityIOProfileRecord_t *> records;
+	GetSortedRecords( records );
+
+	Msg( "Entity I/O profile: %d records%s. Times in microseconds and inclusive of nested I/O.\n", records.Count(), g_bEntityIOProfile ? "" : " (ent_io_profile is off)" );
+	Msg( "%-8s %-32s %-32s %8s %10s %8s %8s %8s %8s %6s\n", "kind", "classname", "name", "count", "total ms", "avg", "p99", "max", "fan-out", "max" );
+
+	for ( int i = 0; i < MIN( nCount, records.Count() ); i++ )
+	{
+		const EntityIOProfileRecord_t *pRecord = records[i];
+		Msg( "%-8s %-32s %-32s %8d %10.2f %8.1f %8.1f %8.1f %8.2f %6d\n",
+			g_pszIOProfileKinds[pRecord->kind], pRecord->strClassname.Get(), pRecord->strName.Get(),
+			pRecord->nCount, pRecord->flTotalTime / 1000.0, pRecord->AverageTime(), pRecord->Percentile( 0.99f ), pRecord->flMaxTime,
+			pRecord->AverageFanOut(), pRecord->nMaxFanOut );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CEntityIOProfiler::Dump( const char *pszFile )
+{
+	FileHandle_t fh = filesystem->Open( pszFile, "wt", "DEFAULT_WRITE_PATH" );
+	if ( fh == FILESYSTEM_INVALID_HANDLE )
+	{
+		Warning( "Couldn't open %s for writing\n", pszFile );
+		return;
+	}
+
+	CUtlVector<EntityIOProfileRecord_t *> records;
+	GetSortedRecords( records );
+
+	filesystem->FPrintf( fh, "kind,classname,name,count,total_us,avg_us,p99_us,max_us,fanout_total,fanout_avg,fanout_max\n" );
+	for ( int i = 0; i < records.Count(); i++ )
+	{
+		const EntityIOProfileRecord_t *pRecord = records[i];
+		filesystem->FPrintf( fh, "%s,%s,%s,%d,%.1f,%.2f,%.2f,%.2f,%d,%.3f,%d\n",
+			g_pszIOProfileKinds[pRecord->kind], pRecord->strClassname.Get(), pRecord->strName.Get(),
+			pRecord->nCount, pRecord->flTotalTime, pRecord->AverageTime(), pRecord->Percentile( 0.99f ), pRecord->flMaxTime,
+			pRecord->nTotalFanOut, pRecord->AverageFanOut(), pRecord->nMaxFanOut );
+	}
+
+	filesystem->Close( fh );
+	Msg( "Wrote %d entity I/O profile records to %s\n", records.Count(), pszFile );
+}
+
+//-----------------------------------------------------------------------------
+
+void CEntityIOProfiler::Clear()
+{
+	for ( int i = 0; i < m_Records.Count(); i++ )
+	{
+		EntityIOProfileRecord_t *pRecord = m_Records[i];
+		pRecord->nCount = 0;
+		pRecord->flTotalTime = 0;
+		pRecord->flMaxTime = 0;
+		pRecord->nTotalFanOut = 0;
+		pRecord->nMaxFanOut = 0;
+		memset( pRecord->histogram, 0, sizeof( pRecord->histogram ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Outputs don't know their own names, find this one in its owner's
+//			datadesc
+//-----------------------------------------------------------------------------
+static const char *GetOutputName( CBaseEntity *pCaller, const CBaseEntityOutput *pOutput )
+{
+	if ( !pCaller )
+		return "<unknown output>";
+
+	int nOffset = (const char *)pOutput - (const char *)pCaller;
+	for ( datamap_t *dmap = pCaller->GetDataDescMap(); dmap; dmap = dmap->baseMap )
+	{
+		for ( int i = 0; i < dmap->dataNumFields; i++ )
+		{
+			const typedescription_t *pDesc = &dmap->dataDesc[i];
+			if ( pDesc->fieldType == FIELD_CUSTOM && ( pDesc->flags & FTYPEDESC_OUTPUT ) && pDesc->fieldOffset[0] == nOffset )
+				return pDesc->externalName;
+		}
+	}
+
+	return "<unknown output>";
+}
+
+//-----------------------------------------------------------------------------
+
+void CEntityIOProfileScope::Begin( EntityIOProfileKind_t kind, CBaseEntity *pEntity, const void *pWhat )
+{
+	// Not from parallel thinks
+	if ( !ThreadInMainThread() )
+		return;
+
+	const char *pszClassname = pEntity ? pEntity->GetClassname() : "<null>";
+	const char *pszName = "";
+	switch ( kind )
+	{
+	case IOPROFILE_SERVICE:
+		pszClassname = "CEventQueue";
+		pszName = "ServiceEvents";
+		break;
+
+	case IOPROFILE_EVENT:
+		pszName = STRING( ((const EventQueuePrioritizedEvent_t *)pWhat)->m_iTargetInput );
+		break;
+
+	case IOPROFILE_OUTPUT:
+		pszName = GetOutputName( pEntity, (const CBaseEntityOutput *)pWhat );
+		break;
+
+	case IOPROFILE_INPUT:
+		pszName = ((const typedescription_t *)pWhat)->externalName;
+		break;
+	}
+
+	m_pRecord = g_EntityIOProfiler.FindOrAddRecord( kind, pszClassname, pszName );
+	m_Kind = kind;
+	m_nFanOut = 0;
+
+	m_pParent = g_EntityIOProfiler.m_pCurrentScope;
+	g_EntityIOProfiler.m_pCurrentScope = this;
+
+	if ( m_pParent )
+	{
+		if ( ( m_pParent->m_Kind == IOPROFILE_SERVICE && kind == IOPROFILE_EVENT ) ||
+			( m_pParent->m_Kind == IOPROFILE_EVENT && kind == IOPROFILE_INPUT ) )
+		{
+			m_pParent->m_nFanOut++;
+		}
+	}
+
+	m_Timer.Start();
+}
+
+//-----------------------------------------------------------------------------
+
+void CEntityIOProfileScope::End()
+{
+	m_Timer.End();
+
+	g_EntityIOProfiler.m_pCurrentScope = m_pParent;
+
+	// Events queued by outputs count towards the input that fired them
+	if ( m_Kind == IOPROFILE_OUTPUT && m_pParent && m_pParent->m_Kind == IOPROFILE_INPUT )
+	{
+		m_pParent->m_nFanOut += m_nFanOut;
+	}
+
+	g_EntityIOProfiler.Record( m_pRecord, m_Timer.GetDuration().GetMicrosecondsF(), m_nFanOut );
+}
+
+//-----------------------------------------------------------------------------
+
+void EntityIOProfile_EventQueued()
+{
+	if ( !ThreadInMainThread() )
+		return;
+
+	CEntityIOProfileScope *pScope = g_EntityIOProfiler.m_pCurrentScope;
+	if ( pScope && ( pScope->m_Kind == IOPROFILE_OUTPUT || pScope->m_Kind == IOPROFILE_INPUT ) )
+	{
+		pScope->m_nFanOut++;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+CON_COMMAND( ent_io_profile_report, "Print the entity I/O records that took the most time. Optional argument: number of records (default 25)" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_EntityIOProfiler.Report( args.ArgC() > 1 ? atoi( args[1] ) : 25 );
+}
+
+CON_COMMAND( ent_io_profile_dump, "Write every entity I/O record to a CSV file. Optional argument: file name (default entity_io_profile.csv)" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_EntityIOProfiler.Dump( args.ArgC() > 1 ? args[1] : "entity_io_profile.csv" );
+}
+
+CON_COMMAND( ent_io_profile_clear, "Reset the entity I/O profile" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_EntityIOProfiler.Clear();
+}
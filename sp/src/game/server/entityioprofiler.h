@@ -0,0 +1,77 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Times entity outputs, queued events and inputs (ent_io_profile)
+//
+//=============================================================================//
+
+#ifndef ENTITYIOPROFILER_H
+#define ENTITYIOPROFILER_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+#include "tier0/fasttimer.h"
+
+class CBaseEntity;
+struct EntityIOProfileRecord_t;
+
+enum EntityIOProfileKind_t
+{
+	IOPROFILE_SERVICE = 0,	// CEventQueue::ServiceEvents(), fans out to the events it fires
+	IOPROFILE_EVENT,		// A queued event being delivered, fans out to the inputs it reaches
+	IOPROFILE_OUTPUT,		// CBaseEntityOutput::FireOutput(), fans out to the events it queues
+	IOPROFILE_INPUT,		// CBaseEntity::AcceptInput(), fans out to the events it queues
+
+	NUM_IOPROFILE_KINDS
+};
+
+// ent_io_profile, checked inline so the scopes cost nothing while it's off
+extern bool g_bEntityIOProfile;
+
+//-----------------------------------------------------------------------------
+// Purpose: Times whatever happens while it's in scope and charges it to a
+//			(classname, output/input) record. Scopes nest; each one counts its
+//			fan-out as described above.
+//
+//			pWhat is the CBaseEntityOutput for outputs, the input's
+//			typedescription_t for inputs and the EventQueuePrioritizedEvent_t
+//			for events.
+//-----------------------------------------------------------------------------
+class CEntityIOProfileScope
+{
+public:
+	CEntityIOProfileScope( EntityIOProfileKind_t kind, CBaseEntity *pEntity, const void *pWhat )
+	{
+		m_pRecord = NULL;
+		if ( g_bEntityIOProfile )
+		{
+			Begin( kind, pEntity, pWhat );
+		}
+	}
+
+	~CEntityIOProfileScope()
+	{
+		if ( m_pRecord )
+		{
+			End();
+		}
+	}
+
+private:
+	void Begin( EntityIOProfileKind_t kind, CBaseEntity *pEntity, const void *pWhat );
+	void End();
+
+	EntityIOProfileRecord_t	*m_pRecord;
+	CEntityIOProfileScope	*m_pParent;
+	EntityIOProfileKind_t	m_Kind;
+	int						m_nFanOut;
+	CFastTimer				m_Timer;
+
+	friend void EntityIOProfile_EventQueued();
+};
+
+// Called by CEventQueue for every event added while profiling
+void EntityIOProfile_EventQueued();
+
+#endif // ENTITYIOPROFILER_H
@@ -12,11 +12,14 @@
 #include "collisionutils.h"
 #include "UtlSortVector.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
+#include "tier1/fmtstr.h"
 #include "mapentities.h"
 #include "client.h"
 #include "ai_initutils.h"
 #include "globalstate.h"
 #include "datacache/imdlcache.h"
+#include "parallelthink.h"
 
 #ifdef HL2_DLL
 #include "npc_playercompanion.h"
@@ -37,6 +40,242 @@ static CUtlVector<IServerNetworkable*> g_DeleteList;
 CGlobalEntityList gEntList;
 CBaseEntityList *g_pEntityList = &gEntList;
 
+ConVar ent_find_index( "ent_find_index", "1", FCVAR_NONE, "Find entities by classname and targetname through the entity list's indexes instead of walking the list" );
+ConVar sv_think_wheel( "sv_think_wheel", "1", FCVAR_NONE, "Only visit thinking entities whose next think is due, using a tick-bucketed schedule, instead of scanning the whole think list every tick" );
+
+//-----------------------------------------------------------------------------
+// Purpose: Chains the entities that share a string (classname or targetname),
+//			compared without case like NamesMatch(). Each chain is kept in
+//			entity list order so searches find entities in the same order as
+//			a walk of the list. The distinct strings are also kept sorted, so
+//			"prefix*" searches only visit the chains that match.
+//-----------------------------------------------------------------------------
+struct EntsByStringList_t
+{
+	CBaseEntity *pHead;
+	CBaseEntity *pTail;
+};
+
+class CEntityStringIndexLess
+{
+public:
+	bool Less( const char * const &lhs, const char * const &rhs, void * )
+	{
+		return ( Q_stricmp( lhs, rhs ) < 0 );
+	}
+};
+
+class CEntityStringIndex
+{
+public:
+	enum IndexedString_t
+	{
+		INDEX_CLASSNAME,
+		INDEX_TARGETNAME,
+	};
+
+	CEntityStringIndex( IndexedString_t indexed )
+	{
+		// The links are private to CBaseEntity, so they're picked here
+		if ( indexed == INDEX_CLASSNAME )
+		{
+			m_pIndexed = &CBaseEntity::m_iszIndexedClassname;
+			m_pPrev = &CBaseEntity::m_pPrevByClass;
+			m_pNext = &CBaseEntity::m_pNextByClass;
+		}
+		else
+		{
+			m_pIndexed = &CBaseEntity::m_iszIndexedName;
+			m_pPrev = &CBaseEntity::m_pPrevByName;
+			m_pNext = &CBaseEntity::m_pNextByName;
+		}
+	}
+
+	void Link( CBaseEntity *pEntity, string_t iszString );
+	void Unlink( CBaseEntity *pEntity );
+
+	CBaseEntity *Next( CBaseEntity *pStartEntity, const char *pszString );
+	CBaseEntity *NextWithPrefix( CBaseEntity *pStartEntity, const char *pszPrefix, int nPrefixLen );
+
+	int Count() const { return m_Chains.Count(); }
+
+private:
+	typedef CBaseEntity *CBaseEntity::*EntityLink_t;
+	typedef string_t CBaseEntity::*EntityString_t;
+
+	CBaseEntity *FirstAfter( CBaseEntity *pHead, int nEntListOrder );
+
+	EntityString_t	m_pIndexed;
+	EntityLink_t	m_pPrev;
+	EntityLink_t	m_pNext;
+
+	CUtlHashtable< const char *, EntsByStringList_t, CaselessStringHashFunctor, CaselessStringEqualFunctor > m_Chains;
+	CUtlSortVector< const char *, CEntityStringIndexLess > m_Sorted;
+};
+
+static CEntityStringIndex g_EntsByClassname( CEntityStringIndex::INDEX_CLASSNAME );
+static CEntityStringIndex g_EntsByName( CEntityStringIndex::INDEX_TARGETNAME );
+
+void CEntityStringIndex::Link( CBaseEntity *pEntity, string_t iszString )
+{
+	Unlink( pEntity );
+
+	if ( iszString == NULL_STRING || !pEntity->m_nEntListOrder )
+		return;
+
+	UtlHashHandle_t hChain = m_Chains.Find( STRING(iszString) );
+	if ( hChain == m_Chains.InvalidHandle() )
+	{
+		EntsByStringList_t emptyList = { NULL, NULL };
+		hChain = m_Chains.Insert( STRING(iszString), emptyList );
+		m_Sorted.Insert( m_Chains.Key( hChain ) );
+	}
+
+	EntsByStringList_t &chain = m_Chains[hChain];
+
+	// Usually the newest entity in the list, so search from the tail
+	CBaseEntity *pAfter = chain.pTail;
+	while ( pAfter && pAfter->m_nEntListOrder > pEntity->m_nEntListOrder )
+	{
+		pAfter = pAfter->*m_pPrev;
+	}
+
+	pEntity->*m_pPrev = pAfter;
+	pEntity->*m_pNext = ( pAfter ) ? pAfter->*m_pNext : chain.pHead;
+
+	if ( pEntity->*m_pNext )
+		(pEntity->*m_pNext)->*m_pPrev = pEntity;
+	else
+		chain.pTail = pEntity;
+
+	if ( pAfter )
+		pAfter->*m_pNext = pEntity;
+	else
+		chain.pHead = pEntity;
+
+	pEntity->*m_pIndexed = iszString;
+}
+
+void CEntityStringIndex::Unlink( CBaseEntity *pEntity )
+{
+	if ( pEntity->*m_pIndexed == NULL_STRING )
+		return;
+
+	UtlHashHandle_t hChain = m_Chains.Find( STRING(pEntity->*m_pIndexed) );
+	Assert( hChain != m_Chains.InvalidHandle() );
+
+	EntsByStringList_t &chain = m_Chains[hChain];
+
+	if ( pEntity->*m_pPrev )
+		(pEntity->*m_pPrev)->*m_pNext = pEntity->*m_pNext;
+	else
+		chain.pHead = pEntity->*m_pNext;
+
+	if ( pEntity->*m_pNext )
+		(pEntity->*m_pNext)->*m_pPrev = pEntity->*m_pPrev;
+	else
+		chain.pTail = pEntity->*m_pPrev;
+
+	if ( !chain.pHead )
+	{
+		const char *pszKey = m_Chains.Key( hChain );
+		m_Sorted.Remove( pszKey );
+		m_Chains.Remove( pszKey );
+	}
+
+	pEntity->*m_pPrev = pEntity->*m_pNext = NULL;
+	pEntity->*m_pIndexed = NULL_STRING;
+}
+
+CBaseEntity *CEntityStringIndex::FirstAfter( CBaseEntity *pHead, int nEntListOrder )
+{
+	CBaseEntity *pEntity = pHead;
+	while ( pEntity && pEntity->m_nEntListOrder <= nEntListOrder )
+	{
+		pEntity = pEntity->*m_pNext;
+	}
+	return pEntity;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the next entity in list order after pStartEntity that has
+//			the string, or the first one if pStartEntity is NULL
+//-----------------------------------------------------------------------------
+CBaseEntity *CEntityStringIndex::Next( CBaseEntity *pStartEntity, const char *pszString )
+{
+	// Continuing down the same chain, the usual case
+	if ( pStartEntity && pStartEntity->*m_pIndexed != NULL_STRING && !Q_stricmp( STRING(pStartEntity->*m_pIndexed), pszString ) )
+		return pStartEntity->*m_pNext;
+
+	UtlHashHandle_t hChain = m_Chains.Find( pszString );
+	if ( hChain == m_Chains.InvalidHandle() )
+		return NULL;
+
+	return FirstAfter( m_Chains[hChain].pHead, ( pStartEntity ) ? pStartEntity->m_nEntListOrder : 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Like Next(), for all the strings starting with pszPrefix
+//-----------------------------------------------------------------------------
+CBaseEntity *CEntityStringIndex::NextWithPrefix( CBaseEntity *pStartEntity, const char *pszPrefix, int nPrefixLen )
+{
+	int nStartOrder = ( pStartEntity ) ? pStartEntity->m_nEntListOrder : 0;
+	CBaseEntity *pBest = NULL;
+
+	// Search with the bare prefix, the strings that start with it (including
+	// the prefix itself) all sort after the last string that's less than it
+	char *pszBare = (char *)stackalloc( nPrefixLen + 1 );
+	V_strncpy( pszBare, pszPrefix, nPrefixLen + 1 );
+
+	for ( int i = m_Sorted.FindLess( pszBare ) + 1; i < m_Sorted.Count(); i++ )
+	{
+		const char *pszString = m_Sorted[i];
+		if ( Q_strnicmp( pszString, pszPrefix, nPrefixLen ) )
+			break;
+
+		CBaseEntity *pEntity = FirstAfter( m_Chains[m_Chains.Find( pszString )].pHead, nStartOrder );
+		if ( pEntity && ( !pBest || pEntity->m_nEntListOrder < pBest->m_nEntListOrder ) )
+		{
+			pBest = pEntity;
+		}
+	}
+
+	return pBest;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Checks whether a search string can use the indexes. Returns the
+//			number of characters that must match, or -1 if the search needs
+//			the full matcher (wildcards inside the string, '?', regex).
+//			*pbPrefix is set for "prefix*" searches.
+//-----------------------------------------------------------------------------
+static int GetIndexedSearchLength( const char *pszSearch, bool *pbPrefix )
+{
+	*pbPrefix = false;
+
+	if ( !ent_find_index.GetBool() || pszSearch[0] == '@' )
+		return -1;
+
+	const char *pszChar;
+	for ( pszChar = pszSearch; *pszChar; pszChar++ )
+	{
+		if ( *pszChar == '?' )
+			return -1;
+
+		if ( *pszChar == '*' )
+		{
+			// "*" alone matches everything, walk the list
+			if ( pszChar[1] != 0 || pszChar == pszSearch )
+				return -1;
+
+			*pbPrefix = true;
+			break;
+		}
+	}
+
+	return pszChar - pszSearch;
+}
+
 class CAimTargetManager : public IEntityListener
 {
 public:
@@ -148,6 +387,11 @@ void AimTarget_ForceRepopulateList()
 // NOTE: This is usually a small subset of the global entity list, so it's
 // an optimization to maintain this list incrementally rather than polling each
 // frame.
+//
+// Entities that only think are also kept in a timing wheel bucketed by their next
+// think tick, so entities that won't think for a while aren't visited every tick.
+// Entities that simulate (or are overdue) live in the "due" group and are visited
+// every tick. Either way, the list handed out is in think list order, same as before.
 struct simthinkentry_t
 {
 	unsigned short	entEntry;
@@ -167,7 +411,16 @@ public:
 		for ( int i = 0; i < ARRAYSIZE(m_entinfoIndex); i++ )
 		{
 			m_entinfoIndex[i] = 0xFFFF;
+			m_thinkGroup[i] = THINK_GROUP_NONE;
+			m_nextInGroup[i] = 0xFFFF;
+			m_prevInGroup[i] = 0xFFFF;
 		}
+		for ( int i = 0; i < ARRAYSIZE(m_groupHead); i++ )
+		{
+			m_groupHead[i] = 0xFFFF;
+		}
+		m_nLastScheduledTick = 0;
+		m_dueHandles.Purge();
 	}
 	void LevelInitPreEntity()
 	{
@@ -196,6 +449,7 @@ public:
 		if ( listHandle != 0xFFFF )
 		{
 			Assert(m_simThinkList[listHandle].entEntry == index);
+			UnlinkFromGroup( index );
 			m_simThinkList.FastRemove( listHandle );
 			m_entinfoIndex[index] = 0xFFFF;
 			
@@ -213,24 +467,50 @@ public:
 
 	int ListCopy( CBaseEntity *pList[], int listMax )
 	{
-		int count = MIN(listMax, ListCount());
-		int out = 0;
-		for ( int i = 0; i < count; i++ )
+		if ( !sv_think_wheel.GetBool() )
+			return ListCopyLinear( pList, listMax );
+
+		int tick = gpGlobals->tickcount;
+		if ( tick < m_nLastScheduledTick )
 		{
-			// only copy out entities that will simulate or think this frame
-			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+			// Time went backwards (e.g. a restore); anything still in the wheel is in the future
+			m_nLastScheduledTick = tick;
+		}
+		else if ( tick > m_nLastScheduledTick )
+		{
+			// Promote every bucket we passed since last time. If we skipped a whole
+			// revolution, that's every bucket once.
+			int nBuckets = MIN( tick - m_nLastScheduledTick, (int)THINK_WHEEL_SIZE );
+			for ( int i = 1; i <= nBuckets; i++ )
 			{
-				Assert(m_simThinkList[i].nextThinkTick>=0);
-				int entinfoIndex = m_simThinkList[i].entEntry;
-				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
-				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
-				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
-				Assert( gEntList.IsEntityPtr( pList[out] ) );
-				out++;
+				PromoteBucket( (m_nLastScheduledTick + i) & (THINK_WHEEL_SIZE - 1), tick );
 			}
+			m_nLastScheduledTick = tick;
 		}
 
-		return out;
+		// Hand out the due entities in think list order
+		m_dueHandles.RemoveAll();
+		for ( unsigned short i = m_groupHead[THINK_GROUP_DUE]; i != 0xFFFF; i = m_nextInGroup[i] )
+		{
+			int listHandle = m_entinfoIndex[i];
+			if ( m_simThinkList[listHandle].nextThinkTick <= tick )
+			{
+				m_dueHandles.AddToTail( listHandle );
+			}
+		}
+		m_dueHandles.Sort( CompareListHandles );
+
+		int count = MIN( listMax, m_dueHandles.Count() );
+		for ( int i = 0; i < count; i++ )
+		{
+			const simthinkentry_t &entry = m_simThinkList[m_dueHandles[i]];
+			const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entry.entEntry );
+			pList[i] = (CBaseEntity *)pInfo->m_pEntity;
+			Assert(entry.nextThinkTick==0 || pList[i]->GetFirstThinkTick()==entry.nextThinkTick);
+			Assert( gEntList.IsEntityPtr( pList[i] ) );
+		}
+
+		return count;
 	}
 
 	void EntityChanged( CBaseEntity *pEntity )
@@ -276,12 +556,119 @@ public:
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
 				}
 			}
+
+			UnlinkFromGroup( index );
+			LinkToGroup( index, m_simThinkList[m_entinfoIndex[index]].nextThinkTick );
 		}
 	}
 
 private:
+	enum
+	{
+		THINK_WHEEL_SIZE = 512,	// ticks per revolution, must be a power of two
+		THINK_GROUP_DUE = THINK_WHEEL_SIZE,
+		THINK_GROUP_NONE = 0xFFFF,
+	};
+
+	// The original behavior, used when sv_think_wheel is off
+	int ListCopyLinear( CBaseEntity *pList[], int listMax )
+	{
+		int count = MIN(listMax, ListCount());
+		int out = 0;
+		for ( int i = 0; i < count; i++ )
+		{
+			// only copy out entities that will simulate or think this frame
+			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+			{
+				Assert(m_simThinkList[i].nextThinkTick>=0);
+				int entinfoIndex = m_simThinkList[i].entEntry;
+				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
+				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
+				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
+				Assert( gEntList.IsEntityPtr( pList[out] ) );
+				out++;
+			}
+		}
+
+		return out;
+	}
+
+	static int CompareListHandles( const unsigned short *a, const unsigned short *b )
+	{
+		return (int)*a - (int)*b;
+	}
+
+	void LinkToGroup( int index, int nextThinkTick )
+	{
+		// Simulating entities (tick 0) and anything already due go straight to the due group,
+		// everything else waits in the bucket for its tick.
+		int group = THINK_GROUP_DUE;
+		if ( nextThinkTick > 0 && nextThinkTick > m_nLastScheduledTick )
+		{
+			group = nextThinkTick & (THINK_WHEEL_SIZE - 1);
+		}
+
+		m_thinkGroup[index] = group;
+		m_prevInGroup[index] = 0xFFFF;
+		m_nextInGroup[index] = m_groupHead[group];
+		if ( m_groupHead[group] != 0xFFFF )
+		{
+			m_prevInGroup[m_groupHead[group]] = index;
+		}
+		m_groupHead[group] = index;
+	}
+
+	void UnlinkFromGroup( int index )
+	{
+		int group = m_thinkGroup[index];
+		if ( group == THINK_GROUP_NONE )
+			return;
+
+		if ( m_prevInGroup[index] != 0xFFFF )
+		{
+			m_nextInGroup[m_prevInGroup[index]] = m_nextInGroup[index];
+		}
+		else
+		{
+			m_groupHead[group] = m_nextInGroup[index];
+		}
+
+		if ( m_nextInGroup[index] != 0xFFFF )
+		{
+			m_prevInGroup[m_nextInGroup[index]] = m_prevInGroup[index];
+		}
+
+		m_thinkGroup[index] = THINK_GROUP_NONE;
+		m_nextInGroup[index] = 0xFFFF;
+		m_prevInGroup[index] = 0xFFFF;
+	}
+
+	// Moves everything in a bucket that's due by now into the due group.
+	// Entities more than a revolution out stay where they are.
+	void PromoteBucket( int bucket, int tick )
+	{
+		unsigned short next;
+		for ( unsigned short i = m_groupHead[bucket]; i != 0xFFFF; i = next )
+		{
+			next = m_nextInGroup[i];
+			if ( m_simThinkList[m_entinfoIndex[i]].nextThinkTick <= tick )
+			{
+				UnlinkFromGroup( i );
+				LinkToGroup( i, 0 );
+			}
+		}
+	}
+
 	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
 	CUtlVector<simthinkentry_t>	m_simThinkList;
+
+	// Timing wheel, linked by entinfo index
+	unsigned short m_groupHead[THINK_WHEEL_SIZE + 1];
+	unsigned short m_thinkGroup[NUM_ENT_ENTRIES];
+	unsigned short m_nextInGroup[NUM_ENT_ENTRIES];
+	unsigned short m_prevInGroup[NUM_ENT_ENTRIES];
+	int m_nLastScheduledTick;
+	CUtlVector<unsigned short> m_dueHandles;
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -298,6 +685,10 @@ int SimThink_ListCopy( CBaseEntity *pList[], int listMax )
 
 void SimThink_EntityChanged( CBaseEntity *pEntity )
 {
+	// Parallel thinks re-sync their entity once the phase is over
+	if ( g_bParallelThinkActive && ParallelThink_DeferSimThinkChanged( pEntity ) )
+		return;
+
 	g_SimThinkManager.EntityChanged( pEntity );
 }
 
@@ -319,6 +710,8 @@ CGlobalEntityList::CGlobalEntityList()
 {
 	m_iHighestEnt = m_iNumEnts = m_iNumEdicts = 0;
 	m_bClearingEntities = false;
+	m_iEntityNameSerial = 0;
+	m_nNextEntListOrder = 1;
 }
 
 
@@ -514,6 +907,23 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName )
 #endif
 {
+	bool bPrefix;
+	int nSearchLen = GetIndexedSearchLength( szName, &bPrefix );
+	if ( nSearchLen != -1 )
+	{
+		CBaseEntity *pEntity = pStartEntity;
+		while ( ( pEntity = ( bPrefix ) ? g_EntsByClassname.NextWithPrefix( pEntity, szName, nSearchLen ) : g_EntsByClassname.Next( pEntity, szName ) ) != NULL )
+		{
+#ifdef MAPBASE
+			if ( pFilter && !pFilter->ShouldFindEntity(pEntity) )
+				continue;
+#endif
+			return pEntity;
+		}
+
+		return NULL;
+	}
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -545,19 +955,21 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity
 // From Alien Swarm SDK
 CBaseEntity *CGlobalEntityList::FindEntityByClassnameFast( CBaseEntity *pStartEntity, string_t iszClassname )
 {
-	/*
-	if ( pStartEntity )
-	{
-		return pStartEntity->m_pNextByClass;
-	}
+	if ( iszClassname == NULL_STRING )
+		return NULL;
 
-	EntsByStringList_t key = { iszClassname };
-	UtlHashHandle_t hEntry = g_EntsByClassname.Find( key );
-	if ( hEntry != g_EntsByClassname.InvalidHandle() )
+	if ( ent_find_index.GetBool() )
 	{
-		return g_EntsByClassname[hEntry].pHead;
+		// The chain holds every spelling of the classname, this only wants the identical string
+		CBaseEntity *pEntity = pStartEntity;
+		while ( ( pEntity = g_EntsByClassname.Next( pEntity, STRING(iszClassname) ) ) != NULL )
+		{
+			if ( pEntity->m_iClassname == iszClassname )
+				return pEntity;
+		}
+
+		return NULL;
 	}
-	*/
 
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -821,6 +1233,22 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 
 		return NULL;
 	}
+
+	bool bPrefix;
+	int nSearchLen = GetIndexedSearchLength( szName, &bPrefix );
+	if ( nSearchLen != -1 )
+	{
+		CBaseEntity *ent = pStartEntity;
+		while ( ( ent = ( bPrefix ) ? g_EntsByName.NextWithPrefix( ent, szName, nSearchLen ) : g_EntsByName.Next( ent, szName ) ) != NULL )
+		{
+			if ( pFilter && !pFilter->ShouldFindEntity(ent) )
+				continue;
+
+			return ent;
+		}
+
+		return NULL;
+	}
 	
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -854,6 +1282,18 @@ CBaseEntity *CGlobalEntityList::FindEntityByNameFast( CBaseEntity *pStartEntity,
 	if ( iszName == NULL_STRING || STRING(iszName)[0] == 0 )
 		return NULL;
 
+	if ( ent_find_index.GetBool() )
+	{
+		CBaseEntity *ent = pStartEntity;
+		while ( ( ent = g_EntsByName.Next( ent, STRING(iszName) ) ) != NULL )
+		{
+			if ( ent->m_iName.Get() == iszName )
+				return ent;
+		}
+
+		return NULL;
+	}
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -1432,6 +1872,12 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 {
 	int i = handle.GetEntryIndex();
 
+	if ( g_bParallelThinkActive )
+	{
+		// Should have been deferred through ParallelThink_GetCallQueue()
+		ParallelThink_ReportUnsafe( "entity creation" );
+	}
+
 	// record current list details
 	m_iNumEnts++;
 	if ( i > m_iHighestEnt )
@@ -1444,6 +1890,11 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	
 	// NOTE: Must be a CBaseEntity on server
 	Assert( pBaseEnt );
+
+	// Entities are added at the tail of the list
+	pBaseEnt->m_nEntListOrder = m_nNextEntListOrder++;
+	g_EntsByClassname.Link( pBaseEnt, pBaseEnt->m_iClassname );
+	g_EntsByName.Link( pBaseEnt, pBaseEnt->m_iName );
 	//DevMsg(2,"Created %s\n", pBaseEnt->GetClassname() );
 	for ( i = m_entityListeners.Count()-1; i >= 0; i-- )
 	{
@@ -1474,6 +1925,10 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 	if ( pBaseEnt->edict() )
 		m_iNumEdicts--;
 
+	g_EntsByClassname.Unlink( pBaseEnt );
+	g_EntsByName.Unlink( pBaseEnt );
+	pBaseEnt->m_nEntListOrder = 0;
+
 	m_iNumEnts--;
 }
 
@@ -1517,6 +1972,25 @@ void CGlobalEntityList::NotifyRemoveEntity( CBaseHandle hEnt )
 	}
 }
 
+void CGlobalEntityList::NotifyEntityNameChanged( CBaseEntity *pEnt )
+{
+	m_iEntityNameSerial++;
+
+	// Entities are indexed when they're added to the list
+	if ( pEnt->m_nEntListOrder )
+	{
+		g_EntsByName.Link( pEnt, pEnt->m_iName );
+	}
+}
+
+void CGlobalEntityList::NotifyEntityClassnameChanged( CBaseEntity *pEnt )
+{
+	if ( pEnt->m_nEntListOrder )
+	{
+		g_EntsByClassname.Link( pEnt, pEnt->m_iClassname );
+	}
+}
+
 
 //-----------------------------------------------------------------------------
 // NOTIFY LIST
@@ -1983,3 +2457,82 @@ CON_COMMAND(report_simthinklist, "Lists all simulating/thinking entities")
 	list.ReportEntityList();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Times targetname lookups with and without the entity list indexes
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( ent_find_benchmark, "Times targetname lookups with and without ent_find_index. Arguments: [entities (4000)] [lookups (10000)]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nEntities = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 4000;
+	int nLookups = ( args.ArgC() > 2 ) ? atoi( args[2] ) : 10000;
+
+	// Logical entities, so the benchmark isn't limited by edicts
+	CUtlVector<CBaseEntity *> entities;
+	for ( int i = 0; i < nEntities; i++ )
+	{
+		CBaseEntity *pEntity = CreateEntityByName( "logic_relay" );
+		if ( !pEntity )
+			break;
+
+		pEntity->SetName( AllocPooledString( CFmtStr( "ent_find_benchmark_%d", i ) ) );
+		entities.AddToTail( pEntity );
+	}
+
+	if ( entities.Count() && nLookups > 0 )
+	{
+		// Every fourth lookup is a "prefix*" search, cut somewhere in the
+		// number so it can also match the entity named exactly the prefix
+		int nBaseLen = V_strlen( "ent_find_benchmark_" );
+		CUtlVector<const char *> queries;
+		queries.EnsureCapacity( nLookups );
+		for ( int i = 0; i < nLookups; i++ )
+		{
+			const char *pszName = STRING( entities[ random->RandomInt( 0, entities.Count() - 1 ) ]->GetEntityName() );
+			if ( i % 4 == 3 )
+			{
+				int nLen = random->RandomInt( nBaseLen + 1, V_strlen( pszName ) );
+				pszName = STRING( AllocPooledString( CFmtStr( "%.*s*", nLen, pszName ) ) );
+			}
+			queries.AddToTail( pszName );
+		}
+
+		bool bWasIndexed = ent_find_index.GetBool();
+		float flTime[2];
+		CUtlVector<CBaseEntity *> found[2];
+
+		for ( int iRun = 0; iRun < 2; iRun++ )
+		{
+			ent_find_index.SetValue( iRun == 0 );
+			found[iRun].EnsureCapacity( nLookups );
+
+			CFastTimer timer;
+			timer.Start();
+			for ( int i = 0; i < nLookups; i++ )
+			{
+				found[iRun].AddToTail( gEntList.FindEntityByName( NULL, queries[i] ) );
+			}
+			timer.End();
+
+			flTime[iRun] = timer.GetDuration().GetMillisecondsF();
+		}
+
+		ent_find_index.SetValue( bWasIndexed );
+
+		int nMismatches = 0;
+		for ( int i = 0; i < nLookups; i++ )
+		{
+			if ( found[0][i] != found[1][i] )
+				nMismatches++;
+		}
+
+		Msg( "%d lookups (%d prefix) among %d named entities (%d entities): indexed %.2fms, list walk %.2fms, %d mismatches\n",
+			nLookups, nLookups / 4, entities.Count(), gEntList.NumberOfEntities(), flTime[0], flTime[1], nMismatches );
+	}
+
+	for ( int i = 0; i < entities.Count(); i++ )
+	{
+		UTIL_RemoveImmediate( entities[i] );
+	}
+}
@@ -111,6 +111,9 @@ private:
 	bool m_bClearingEntities;
 	CUtlVector<IEntityListener *>	m_entityListeners;
 
+	int m_iEntityNameSerial;
+	int m_nNextEntListOrder;
+
 public:
 	IServerNetworkable* GetServerNetworkable( CBaseHandle hEnt ) const;
 	CBaseNetworkable* GetBaseNetworkable( CBaseHandle hEnt ) const;
@@ -142,6 +145,12 @@ public:
 	void NotifyCreateEntity( CBaseEntity *pEnt );
 	void NotifySpawn( CBaseEntity *pEnt );
 	void NotifyRemoveEntity( CBaseHandle hEnt );
+
+	// an entity's targetname changed. Lookups cached by name are stale when the serial changes.
+	void NotifyEntityNameChanged( CBaseEntity *pEnt );
+	void NotifyEntityClassnameChanged( CBaseEntity *pEnt );
+	int GetEntityNameSerial() const { return m_iEntityNameSerial; }
+
 	// iteration functions
 
 	// returns the next entity after pCurrentEnt;  if pCurrentEnt is NULL, return the first entity
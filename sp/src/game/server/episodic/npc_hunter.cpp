@@ -1263,6 +1263,7 @@ public:
 
 	bool			WeaponLOSCondition(const Vector &ownerPos, const Vector &targetPos, bool bSetConditions);
 	bool			TestShootPosition(const Vector &vecShootPos, const Vector &targetPos );
+	bool			IsShootPositionCacheable( void ) { return false; } // Depends on where the hunter can plant
 
 	Vector			Weapon_ShootPosition();
 
@@ -6,6 +6,11 @@
 //
 //			The queue is serviced once per server frame.
 //
+//			Pending events are kept in a binary heap ordered by fire time, with
+//			events that share a fire time fired in the order they were added.
+//			Events are also linked per target and per caller entity, so the
+//			cancel and lookup functions only visit the events they affect.
+//
 //=============================================================================//
 
 #ifndef EVENTQUEUE_H
@@ -15,6 +20,8 @@
 #endif
 
 #include "mempool.h"
+#include "utlvector.h"
+#include "utlmap.h"
 
 struct EventQueuePrioritizedEvent_t
 {
@@ -28,8 +35,15 @@ struct EventQueuePrioritizedEvent_t
 
 	variant_t m_VariantValue;	// variable-type parameter
 
-	EventQueuePrioritizedEvent_t *m_pNext;
-	EventQueuePrioritizedEvent_t *m_pPrev;
+	// Order of events with the same fire time
+	unsigned int m_nSerial;
+	int m_iHeapIndex;
+
+	// Links in the target and caller indexes
+	EventQueuePrioritizedEvent_t *m_pNextByTarget;
+	EventQueuePrioritizedEvent_t *m_pPrevByTarget;
+	EventQueuePrioritizedEvent_t *m_pNextByCaller;
+	EventQueuePrioritizedEvent_t *m_pPrevByCaller;
 
 	DECLARE_SIMPLE_DATADESC();
 
@@ -79,11 +93,35 @@ public:
 
 private:
 
+	typedef CUtlMap<int, EventQueuePrioritizedEvent_t *> CEventIndex;
+
+	// Entities with a target name, in entity list order
+	struct TargetSet_t
+	{
+		int iNameSerial;	// gEntList's name serial when the set was found
+		CUtlVector<EHANDLE> targets;
+	};
+
 	void AddEvent( EventQueuePrioritizedEvent_t *event );
 	void RemoveEvent( EventQueuePrioritizedEvent_t *pe );
+	void DeleteEvent( EventQueuePrioritizedEvent_t *pe );
+
+	EventQueuePrioritizedEvent_t *FirstEventOnTarget( CBaseEntity *pTarget );
+	EventQueuePrioritizedEvent_t *FirstEventFromCaller( CBaseEntity *pCaller );
+	void GetSortedEvents( CUtlVector<EventQueuePrioritizedEvent_t *> &events );
+	const CUtlVector<EHANDLE> &ResolveTargetName( string_t iszTarget );
+
+	void HeapUp( int i );
+	void HeapDown( int i );
+	void HeapSet( int i, EventQueuePrioritizedEvent_t *pe );
 
 	DECLARE_SIMPLE_DATADESC();
-	EventQueuePrioritizedEvent_t m_Events;
+	CUtlVector<EventQueuePrioritizedEvent_t *> m_Heap;
+	CEventIndex m_TargetIndex;	// First event on each target handle
+	CEventIndex m_CallerIndex;	// First event from each caller handle
+	CUtlMap<const void *, TargetSet_t *> m_TargetSets;	// Keyed by pooled target name
+	unsigned int m_nNextSerial;
+	EventQueuePrioritizedEvent_t *m_pServicing;	// Event being fired by ServiceEvents()
 	int m_iListCount;
 };
 
@@ -89,6 +89,7 @@
 #include "tier3/tier3.h"
 #include "serverbenchmark_base.h"
 #include "querycache.h"
+#include "triggerbroadphase.h"
 #ifdef MAPBASE
 #include "world.h"
 #endif
@@ -112,6 +113,7 @@ extern ConVar tf_mm_servermode;
 
 #ifdef USE_NAV_MESH
 #include "nav_mesh.h"
+#include "tactical_mission.h"
 #endif
 
 #ifdef NEXT_BOT
@@ -1152,6 +1154,7 @@ void CServerGameDLL::ServerActivate( edict_t *pEdictList, int edictCount, int cl
 	// load the Navigation Mesh for this map
 	TheNavMesh->Load();
 	TheNavMesh->OnServerActivate();
+	TheTacticalMissions().OnServerActivate();
 #endif
 #endif
 
@@ -1245,6 +1248,7 @@ void CServerGameDLL::GameFrame( bool simulating )
 #ifndef _XBOX
 #ifdef USE_NAV_MESH
 	TheNavMesh->Update();
+	TheTacticalMissions().Update();
 #endif
 
 #ifdef NEXT_BOT
@@ -2504,6 +2508,8 @@ void CServerGameEnts::MarkEntitiesAsTouching( edict_t *e1, edict_t *e2 )
 		UTIL_ClearTrace( tr );
 		tr.endpos = (entity->GetAbsOrigin() + entityTouched->GetAbsOrigin()) * 0.5;
 		entity->PhysicsMarkEntitiesAsTouching( entityTouched, tr );
+
+		TriggerBroadphase_EngineMarkedTouching( entity, entityTouched );
 	}
 }
 
@@ -298,6 +298,7 @@ public:
 	bool			FindCoverPos( CSound *pSound, Vector *pResult );
 	bool			FindMortarCoverPos( CSound *pSound, Vector *pResult );
 	bool 			IsCoverPosition( const Vector &vecThreat, const Vector &vecPosition );
+	bool			IsCoverPositionCacheable( void ) { return false; } // Depends on the cover search mode and the enemy list
 
 	bool			IsEnemyTurret() { return ( GetEnemy() && IsTurret(GetEnemy()) ); }
 	
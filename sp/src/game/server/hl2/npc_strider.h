@@ -203,6 +203,7 @@ public:
 	bool			CurrentWeaponLOSCondition(const Vector &targetPos, bool bSetConditions);
 	bool			IsValidShootPosition ( const Vector &vecCoverLocation, CAI_Node *pNode, CAI_Hint const *pHint );
 	bool			TestShootPosition(const Vector &vecShootPos, const Vector &targetPos );
+	bool			IsShootPositionCacheable( void ) { return false; } // Depends on the current height range
 
 	Vector			Weapon_ShootPosition();
 
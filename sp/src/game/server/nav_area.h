@@ -22,6 +22,25 @@ enum { MAX_NAV_TEAMS = 2 };
 class CFuncElevator;
 class CFuncNavPrerequisite;
 class CFuncNavCost;
+class CNavArea;
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * One area's A* bookkeeping inside a CNavSearchContext (see nav_pathfind.h)
+ */
+struct NavSearchState_t
+{
+	unsigned int marker;										// the rest is only valid if this matches the context's marker
+	int openIndex;												// position in the context's open list, or -1
+	bool isClosed;
+	NavTraverseType parentHow;
+	CNavArea *parent;
+	float totalCost;
+	float costSoFar;
+	float pathLengthSoFar;
+};
+
+extern CInterlockedInt g_nActiveNavSearchContexts;				// number of CNavSearchContextScopes alive, on any thread
 
 class CNavVectorNoEditAllocator
 {
@@ -290,6 +309,7 @@ public:
 	void Disconnect( CNavLadder *ladder );						// disconnect this area from given ladder
 
 	unsigned int GetID( void ) const	{ return m_id; }		// return this area's unique ID
+	static unsigned int GetNextID( void )	{ return m_nextID; }	// all area IDs are less than this
 	static void CompressIDs( void );							// re-orders area ID's so they are continuous
 	unsigned int GetDebugID( void ) const { return m_debugid; }
 
@@ -428,8 +448,8 @@ public:
 	BOOL IsMarked( void ) const			{ return (m_marker == m_masterMarker) ? true : false; }
 	
 	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ m_parent = parent; m_parentHow = how; }
-	CNavArea *GetParent( void ) const	{ return m_parent; }
-	NavTraverseType GetParentHow( void ) const	{ return m_parentHow; }
+	CNavArea *GetParent( void ) const	{ const NavSearchState_t *state = GetActiveSearchState(); return state ? state->parent : m_parent; }
+	NavTraverseType GetParentHow( void ) const	{ const NavSearchState_t *state = GetActiveSearchState(); return state ? state->parentHow : m_parentHow; }
 
 	bool IsOpen( void ) const;									// true if on "open list"
 	void AddToOpenList( void );									// add to open list in decreasing value order
@@ -446,13 +466,16 @@ public:
 	static void ClearSearchLists( void );						// clears the open and closed lists for a new search
 
 	void SetTotalCost( float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); m_totalCost = value; }
-	float GetTotalCost( void ) const	{ return m_totalCost; }
+	float GetTotalCost( void ) const	{ const NavSearchState_t *state = GetActiveSearchState(); return state ? state->totalCost : m_totalCost; }
 
 	void SetCostSoFar( float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); m_costSoFar = value; }
-	float GetCostSoFar( void ) const	{ return m_costSoFar; }
+	float GetCostSoFar( void ) const	{ const NavSearchState_t *state = GetActiveSearchState(); return state ? state->costSoFar : m_costSoFar; }
 
 	void SetPathLengthSoFar( float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); m_pathLengthSoFar = value; }
-	float GetPathLengthSoFar( void ) const	{ return m_pathLengthSoFar; }
+	float GetPathLengthSoFar( void ) const	{ const NavSearchState_t *state = GetActiveSearchState(); return state ? state->pathLengthSoFar : m_pathLengthSoFar; }
+
+	// while a CNavSearchContext search runs on this thread, the getters above read its state instead of the area's
+	const NavSearchState_t *GetActiveSearchState( void ) const	{ return g_nActiveNavSearchContexts ? FindActiveSearchState() : NULL; }
 
 	//- editing -----------------------------------------------------------------------------------------
 	virtual void Draw( void ) const;							// draw area for debugging & editing
@@ -707,6 +730,8 @@ private:
 	static CNavArea *m_openList;
 	static CNavArea *m_openListTail;
 
+	const NavSearchState_t *FindActiveSearchState( void ) const;
+
 	//- connections to adjacent areas -------------------------------------------------------------------
 	NavConnectVector m_incomingConnect[ NUM_DIRECTIONS ];		// a list of adjacent areas for each direction that connect TO us, but we have no connection back to them
 
@@ -0,0 +1,296 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Fine grained spatial index used to find the nav area under a position
+//
+//=============================================================================//
+// nav_arealookup.cpp
+
+#include "cbase.h"
+#include "nav_mesh.h"
+#include "nav_arealookup.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+ConVar nav_area_lookup( "nav_area_lookup", "1", FCVAR_GAMEDLL | FCVAR_CHEAT, "Find the nav area under a position with the fine grained area index instead of scanning the mesh grid." );
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * GetZ() interpolates between the corners, but allow for a little rounding
+ */
+static const float NavAreaLookupZTolerance = 1.0f;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * One area's place in one cell while the index is being built
+ */
+struct NavAreaLookupSpan_t
+{
+	float maxZ;
+	unsigned int id;
+	int area;
+};
+
+static int __cdecl CompareNavAreaLookupSpans( const void *pLeft, const void *pRight )
+{
+	const NavAreaLookupSpan_t *lhs = (const NavAreaLookupSpan_t *)pLeft;
+	const NavAreaLookupSpan_t *rhs = (const NavAreaLookupSpan_t *)pRight;
+
+	// highest first, with ties in ID order so the index is the same every time
+	if ( lhs->maxZ != rhs->maxZ )
+		return ( lhs->maxZ > rhs->maxZ ) ? -1 : 1;
+
+	if ( lhs->id != rhs->id )
+		return ( lhs->id < rhs->id ) ? -1 : 1;
+
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavAreaLookup::CNavAreaLookup( void )
+{
+	m_minX = 0.0f;
+	m_minY = 0.0f;
+	m_sizeX = 0;
+	m_sizeY = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaLookup::Clear( void )
+{
+	m_cells.Purge();
+	m_blocks.Purge();
+	m_sizeX = 0;
+	m_sizeY = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Sort every area into each cell it overlaps, then pack the cells into blocks of four
+ */
+void CNavAreaLookup::Build( const CUtlVector< CNavArea * > &areas )
+{
+	Clear();
+
+	if ( areas.Count() == 0 )
+		return;
+
+	Extent extent;
+	areas[0]->GetExtent( &extent );
+
+	CUtlVector< Extent > areaExtent;
+	areaExtent.SetCount( areas.Count() );
+
+	FOR_EACH_VEC( areas, it )
+	{
+		const CNavArea *area = areas[ it ];
+		Extent &areaBounds = areaExtent[ it ];
+
+		areaBounds.lo = area->GetCorner( NORTH_WEST );
+		areaBounds.hi = area->GetCorner( SOUTH_EAST );
+		areaBounds.lo.z = areaBounds.hi.z = area->GetCorner( NORTH_WEST ).z;
+
+		for( int c=1; c<NUM_CORNERS; ++c )
+		{
+			float z = area->GetCorner( (NavCornerType)c ).z;
+			areaBounds.lo.z = MIN( areaBounds.lo.z, z );
+			areaBounds.hi.z = MAX( areaBounds.hi.z, z );
+		}
+
+		areaBounds.lo.z -= NavAreaLookupZTolerance;
+		areaBounds.hi.z += NavAreaLookupZTolerance;
+
+		extent.lo.x = MIN( extent.lo.x, areaBounds.lo.x );
+		extent.lo.y = MIN( extent.lo.y, areaBounds.lo.y );
+		extent.hi.x = MAX( extent.hi.x, areaBounds.hi.x );
+		extent.hi.y = MAX( extent.hi.y, areaBounds.hi.y );
+	}
+
+	m_minX = extent.lo.x;
+	m_minY = extent.lo.y;
+	m_sizeX = (int)( extent.SizeX() / CELL_SIZE ) + 1;
+	m_sizeY = (int)( extent.SizeY() / CELL_SIZE ) + 1;
+
+	// count the areas in each cell
+	CUtlVector< int > cellStart;
+	cellStart.SetCount( m_sizeX * m_sizeY + 1 );
+	V_memset( cellStart.Base(), 0, cellStart.Count() * sizeof( int ) );
+
+	FOR_EACH_VEC( areas, it )
+	{
+		const Extent &areaBounds = areaExtent[ it ];
+
+		for( int y = WorldToCellY( areaBounds.lo.y ); y <= WorldToCellY( areaBounds.hi.y ); ++y )
+		{
+			for( int x = WorldToCellX( areaBounds.lo.x ); x <= WorldToCellX( areaBounds.hi.x ); ++x )
+			{
+				++cellStart[ x + y*m_sizeX + 1 ];
+			}
+		}
+	}
+
+	for( int i=1; i<cellStart.Count(); ++i )
+	{
+		cellStart[i] += cellStart[i-1];
+	}
+
+	// drop each area into its cells
+	CUtlVector< NavAreaLookupSpan_t > spans;
+	spans.SetCount( cellStart.Tail() );
+
+	CUtlVector< int > cellFill;
+	cellFill.SetCount( m_sizeX * m_sizeY );
+	V_memset( cellFill.Base(), 0, cellFill.Count() * sizeof( int ) );
+
+	FOR_EACH_VEC( areas, it )
+	{
+		const Extent &areaBounds = areaExtent[ it ];
+
+		for( int y = WorldToCellY( areaBounds.lo.y ); y <= WorldToCellY( areaBounds.hi.y ); ++y )
+		{
+			for( int x = WorldToCellX( areaBounds.lo.x ); x <= WorldToCellX( areaBounds.hi.x ); ++x )
+			{
+				int cell = x + y*m_sizeX;
+				NavAreaLookupSpan_t &span = spans[ cellStart[ cell ] + cellFill[ cell ]++ ];
+				span.maxZ = areaBounds.hi.z;
+				span.id = areas[ it ]->GetID();
+				span.area = it;
+			}
+		}
+	}
+
+	// sort each cell and pack it into blocks
+	m_cells.SetCount( m_sizeX * m_sizeY );
+
+	int blockCount = 0;
+	for( int c=0; c<m_cells.Count(); ++c )
+	{
+		blockCount += ( cellStart[ c+1 ] - cellStart[ c ] + 3 ) / 4;
+	}
+	m_blocks.EnsureCapacity( blockCount );
+
+	FOR_EACH_VEC( m_cells, c )
+	{
+		NavAreaLookupCell_t &cell = m_cells[ c ];
+		int count = cellStart[ c+1 ] - cellStart[ c ];
+
+		cell.firstBlock = m_blocks.Count();
+		cell.blockCount = ( count + 3 ) / 4;
+
+		if ( count == 0 )
+			continue;
+
+		NavAreaLookupSpan_t *cellSpans = &spans[ cellStart[ c ] ];
+		qsort( cellSpans, count, sizeof( NavAreaLookupSpan_t ), CompareNavAreaLookupSpans );
+
+		m_blocks.AddMultipleToTail( cell.blockCount );
+
+		for( int b=0; b<cell.blockCount; ++b )
+		{
+			NavAreaLookupBlock_t &block = m_blocks[ cell.firstBlock + b ];
+
+			for( int i=0; i<4; ++i )
+			{
+				int s = b*4 + i;
+				if ( s < count )
+				{
+					const Extent &areaBounds = areaExtent[ cellSpans[ s ].area ];
+
+					SubFloat( block.loX, i ) = areaBounds.lo.x;
+					SubFloat( block.loY, i ) = areaBounds.lo.y;
+					SubFloat( block.hiX, i ) = areaBounds.hi.x;
+					SubFloat( block.hiY, i ) = areaBounds.hi.y;
+					SubFloat( block.minZ, i ) = areaBounds.lo.z;
+					SubFloat( block.maxZ, i ) = areaBounds.hi.z;
+					block.area[i] = areas[ cellSpans[ s ].area ];
+				}
+				else
+				{
+					// an empty lane that no position can be inside of
+					SubFloat( block.loX, i ) = FLT_MAX;
+					SubFloat( block.loY, i ) = FLT_MAX;
+					SubFloat( block.hiX, i ) = -FLT_MAX;
+					SubFloat( block.hiY, i ) = -FLT_MAX;
+					SubFloat( block.minZ, i ) = FLT_MAX;
+					SubFloat( block.maxZ, i ) = -FLT_MAX;
+					block.area[i] = NULL;
+				}
+			}
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Test the areas of a cell four at a time, highest first, and stop once the rest are too low to matter
+ */
+CNavArea *CNavAreaLookup::GetNavArea( const Vector &pos, float minZ, float maxZ, bool skipBlocked, int team, float *areaZ ) const
+{
+	if ( !IsBuilt() )
+		return NULL;
+
+	const NavAreaLookupCell_t &cell = m_cells[ WorldToCellX( pos.x ) + WorldToCellY( pos.y )*m_sizeX ];
+
+	CNavArea *use = NULL;
+	float useZ = -99999999.9f;
+
+	const fltx4 posX = ReplicateX4( pos.x );
+	const fltx4 posY = ReplicateX4( pos.y );
+	const fltx4 ceiling = ReplicateX4( maxZ );
+
+	for( int b=0; b<cell.blockCount; ++b )
+	{
+		const NavAreaLookupBlock_t &block = m_blocks[ cell.firstBlock + b ];
+
+		// the first lane is the highest area left in the cell
+		float floorZ = MAX( minZ, useZ );
+		if ( SubFloat( block.maxZ, 0 ) < floorZ )
+			break;
+
+		fltx4 inside = AndSIMD( AndSIMD( CmpGeSIMD( posX, block.loX ), CmpLeSIMD( posX, block.hiX ) ),
+								AndSIMD( CmpGeSIMD( posY, block.loY ), CmpLeSIMD( posY, block.hiY ) ) );
+
+		fltx4 inRange = AndSIMD( CmpLeSIMD( block.minZ, ceiling ), CmpGeSIMD( block.maxZ, ReplicateX4( floorZ ) ) );
+
+		int candidates = TestSignSIMD( AndSIMD( inside, inRange ) );
+
+		for( int i=0; candidates; ++i, candidates >>= 1 )
+		{
+			if ( !( candidates & 1 ) )
+				continue;
+
+			CNavArea *area = block.area[i];
+
+			// project position onto area to get Z
+			float z = area->GetZ( pos );
+
+			if ( z > maxZ || z < minZ )
+				continue;
+
+			// if area is not higher than the one we have, skip it
+			if ( z <= useZ )
+				continue;
+
+			// don't consider blocked areas
+			if ( skipBlocked && area->IsBlocked( team ) )
+				continue;
+
+			use = area;
+			useZ = z;
+		}
+	}
+
+	if ( areaZ )
+	{
+		*areaZ = useZ;
+	}
+
+	return use;
+}
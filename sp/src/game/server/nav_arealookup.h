@@ -0,0 +1,224 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Fine grained spatial index used to find the nav area under a position
+//
+//=============================================================================//
+// nav_arealookup.h
+
+#ifndef _NAV_AREALOOKUP_H_
+#define _NAV_AREALOOKUP_H_
+
+#include "mathlib/ssemath.h"
+#include "utlvector.h"
+#include "nav_area.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Four areas from one cell, laid out so they can be tested against a position together.
+ * Unused lanes have inverted extents and can never overlap anything.
+ */
+struct NavAreaLookupBlock_t
+{
+	fltx4 loX, loY;						// 2D extent of each area
+	fltx4 hiX, hiY;
+	fltx4 minZ, maxZ;					// lowest and highest corner of each area
+	CNavArea *area[4];
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The run of blocks overlapping one cell. Areas are sorted highest first by maxZ,
+ * so a search from above can stop as soon as the remaining areas are too low.
+ */
+struct NavAreaLookupCell_t
+{
+	int firstBlock;
+	int blockCount;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A finer grid than CNavMesh's own, rebuilt from scratch whenever the set of areas changes.
+ * It holds raw area pointers, so the mesh must Clear() it before any area is moved or destroyed.
+ */
+class CNavAreaLookup
+{
+public:
+	CNavAreaLookup( void );
+
+	void Build( const CUtlVector< CNavArea * > &areas );		// index the given areas
+	void Clear( void );											// forget everything, IsBuilt() returns false until the next Build()
+	bool IsBuilt( void ) const		{ return m_cells.Count() > 0; }
+
+	/**
+	 * Return the highest area whose 2D extent contains 'pos' and whose Z at 'pos' is within [minZ, maxZ].
+	 * If 'skipBlocked' is set, areas blocked for 'team' are not considered.
+	 */
+	CNavArea *GetNavArea( const Vector &pos, float minZ, float maxZ, bool skipBlocked = false, int team = TEAM_ANY, float *areaZ = NULL ) const;
+
+	/**
+	 * Return the area closest to 'pos' that passes 'filter', searching no farther than 'maxDist'.
+	 * Distance is measured from 'pos' to the point on the area under 'source', as GetNearestNavArea() does.
+	 */
+	template < typename Filter >
+	CNavArea *GetNearestNavArea( const Vector &pos, const Vector &source, float maxDist, Filter &filter ) const;
+
+	int GetCellCount( void ) const	{ return m_cells.Count(); }
+	int GetBlockCount( void ) const	{ return m_blocks.Count(); }
+
+	enum { CELL_SIZE = 128 };
+
+private:
+	int WorldToCellX( float wx ) const;
+	int WorldToCellY( float wy ) const;
+
+	template < typename Filter >
+	void SearchCellForNearest( int x, int y, const Vector &pos, const Vector &source, float *closeDistSq, CNavArea **close, Filter &filter ) const;
+
+	CUtlVector< NavAreaLookupCell_t > m_cells;
+	CUtlVector< NavAreaLookupBlock_t, CUtlMemoryAligned< NavAreaLookupBlock_t, 16 > > m_blocks;
+	float m_minX;
+	float m_minY;
+	int m_sizeX;
+	int m_sizeY;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+inline int CNavAreaLookup::WorldToCellX( float wx ) const
+{
+	int x = (int)( ( wx - m_minX ) / CELL_SIZE );
+	return clamp( x, 0, m_sizeX-1 );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline int CNavAreaLookup::WorldToCellY( float wy ) const
+{
+	int y = (int)( ( wy - m_minY ) / CELL_SIZE );
+	return clamp( y, 0, m_sizeY-1 );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Test the areas in one cell for being closest to 'pos'.
+ * Each area is considered only from the cell holding its closest point to 'pos', so no area is
+ * tested twice and no search marker is needed.
+ */
+template < typename Filter >
+void CNavAreaLookup::SearchCellForNearest( int x, int y, const Vector &pos, const Vector &source, float *closeDistSq, CNavArea **close, Filter &filter ) const
+{
+	const NavAreaLookupCell_t &cell = m_cells[ x + y*m_sizeX ];
+
+	const fltx4 posX = ReplicateX4( pos.x );
+	const fltx4 posY = ReplicateX4( pos.y );
+
+	for( int b=0; b<cell.blockCount; ++b )
+	{
+		const NavAreaLookupBlock_t &block = m_blocks[ cell.firstBlock + b ];
+
+		// 2D distance from 'pos' to each area is a lower bound on the real distance
+		fltx4 dx = MaxSIMD( SubSIMD( block.loX, posX ), SubSIMD( posX, block.hiX ) );
+		fltx4 dy = MaxSIMD( SubSIMD( block.loY, posY ), SubSIMD( posY, block.hiY ) );
+		dx = MaxSIMD( dx, Four_Zeros );
+		dy = MaxSIMD( dy, Four_Zeros );
+		fltx4 distSq2D = AddSIMD( MulSIMD( dx, dx ), MulSIMD( dy, dy ) );
+
+		int candidates = TestSignSIMD( CmpLtSIMD( distSq2D, ReplicateX4( *closeDistSq ) ) );
+
+		for( int i=0; candidates; ++i, candidates >>= 1 )
+		{
+			if ( !( candidates & 1 ) )
+				continue;
+
+			CNavArea *area = block.area[i];
+
+			Vector areaPos;
+			area->GetClosestPointOnArea( source, &areaPos );
+
+			// only consider the area from the cell holding its closest point
+			if ( WorldToCellX( areaPos.x ) != x || WorldToCellY( areaPos.y ) != y )
+				continue;
+
+			float distSq = ( areaPos - pos ).LengthSqr();
+			if ( distSq >= *closeDistSq )
+				continue;
+
+			if ( !filter( area, areaPos ) )
+				continue;
+
+			*closeDistSq = distSq;
+			*close = area;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Search in increasing rings of cells out from 'pos', stopping once no cell left can hold anything closer
+ */
+template < typename Filter >
+CNavArea *CNavAreaLookup::GetNearestNavArea( const Vector &pos, const Vector &source, float maxDist, Filter &filter ) const
+{
+	if ( !IsBuilt() )
+		return NULL;
+
+	CNavArea *close = NULL;
+	float closeDistSq = maxDist * maxDist;
+
+	int originX = WorldToCellX( pos.x );
+	int originY = WorldToCellY( pos.y );
+
+	// distance from 'pos' to the edges of its own cell
+	float cellLoX = m_minX + originX * CELL_SIZE;
+	float cellLoY = m_minY + originY * CELL_SIZE;
+	float edgeDist = MIN( MIN( pos.x - cellLoX, cellLoX + CELL_SIZE - pos.x ), MIN( pos.y - cellLoY, cellLoY + CELL_SIZE - pos.y ) );
+	edgeDist = MAX( edgeDist, 0.0f );
+
+	int shiftLimit = MAX( MAX( originX, m_sizeX-1 - originX ), MAX( originY, m_sizeY-1 - originY ) );
+
+	for( int shift=0; shift <= shiftLimit; ++shift )
+	{
+		// every cell in this ring is at least this far away in 2D
+		if ( shift > 0 )
+		{
+			float ringDist = edgeDist + ( shift-1 ) * CELL_SIZE;
+			if ( ringDist * ringDist >= closeDistSq )
+				break;
+		}
+
+		int loX = originX - shift;
+		int hiX = originX + shift;
+		int loY = originY - shift;
+		int hiY = originY + shift;
+
+		// top and bottom rows
+		for( int x = MAX( loX, 0 ); x <= MIN( hiX, m_sizeX-1 ); ++x )
+		{
+			if ( loY >= 0 )
+				SearchCellForNearest( x, loY, pos, source, &closeDistSq, &close, filter );
+
+			if ( hiY < m_sizeY && hiY != loY )
+				SearchCellForNearest( x, hiY, pos, source, &closeDistSq, &close, filter );
+		}
+
+		// left and right columns, without the corners
+		for( int y = MAX( loY+1, 0 ); y <= MIN( hiY-1, m_sizeY-1 ); ++y )
+		{
+			if ( loX >= 0 )
+				SearchCellForNearest( loX, y, pos, source, &closeDistSq, &close, filter );
+
+			if ( hiX < m_sizeX && hiX != loX )
+				SearchCellForNearest( hiX, y, pos, source, &closeDistSq, &close, filter );
+		}
+	}
+
+	return close;
+}
+
+
+#endif // _NAV_AREALOOKUP_H_
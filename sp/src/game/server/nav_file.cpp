@@ -11,6 +11,7 @@
 
 #include "cbase.h"
 #include "nav_mesh.h"
+#include "nav_flatfile.h"
 #include "gamerules.h"
 #include "datacache/imdlcache.h"
 
@@ -176,11 +177,16 @@ PlaceDirectory placeDirectory;
 #if defined( _X360 )
 	#define FORMAT_BSPFILE "maps\\%s.360.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.360.nav"
+	#define FORMAT_NAVFLATFILE "maps\\%s.360.navflat"
 #else
 	#define FORMAT_BSPFILE "maps\\%s.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.nav"
+	#define FORMAT_NAVFLATFILE "maps\\%s.navflat"
 #endif
 
+ConVar nav_flat_file( "nav_flat_file", "1", FCVAR_GAMEDLL, "Load the navigation mesh from a memory mapped companion of the .nav file when it is up to date, and write one whenever the .nav file is saved." );
+ConVar nav_flat_file_write_on_load( "nav_flat_file_write_on_load", "0", FCVAR_GAMEDLL, "Also write the flat companion when a .nav file without an up to date one is loaded. Off by default, since the game directory may not be writable." );
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Replace extension with "bsp"
@@ -1194,6 +1200,12 @@ bool CNavMesh::Save( void ) const
 	unsigned int navSize = filesystem->Size( filename );
 	DevMsg( "Size of nav file '%s' is %u bytes.\n", filename, navSize );
 
+	// keep the flat file in step with the .nav file
+	if ( nav_flat_file.GetBool() && !IsX360() && IsFlatFileSupported() )
+	{
+		SaveFlatFile( filename );
+	}
+
 	return true;
 }
 
@@ -1376,6 +1388,21 @@ const CUtlVector< Place > *CNavMesh::GetPlacesFromNavFile( bool *hasUnnamedPlace
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+static void WarnMeshOutOfDate( void )
+{
+	if ( engine->IsDedicatedServer() )
+	{
+		// Warning doesn't print to the dedicated server console, so we'll use Msg instead
+		DevMsg( "The Navigation Mesh was built using a different version of this map.\n" );
+	}
+	else
+	{
+		DevWarning( "The Navigation Mesh was built using a different version of this map.\n" );
+	}
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Load AI navigation data from a file
@@ -1397,6 +1424,13 @@ NavErrorType CNavMesh::Load( void )
 	char filename[256];
 	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
 
+	// an up to date flat file skips parsing the .nav file entirely
+	bool useFlatFile = nav_flat_file.GetBool() && !IsX360() && IsFlatFileSupported();
+	if ( useFlatFile && LoadFlatFile( filename ) == NAV_OK )
+	{
+		return NAV_OK;
+	}
+
 	bool navIsInBsp = false;
 	CUtlBuffer fileBuffer( 4096, 1024*1024, CUtlBuffer::READ_ONLY );
 	if ( !filesystem->ReadFile( filename, "MOD", fileBuffer ) )	// this ignores .nav files embedded in the .bsp ...
@@ -1464,15 +1498,7 @@ NavErrorType CNavMesh::Load( void )
 
 		if ( bspSize != saveBspSize && !navIsInBsp )
 		{
-			if ( engine->IsDedicatedServer() )
-			{
-				// Warning doesn't print to the dedicated server console, so we'll use Msg instead
-				DevMsg( "The Navigation Mesh was built using a different version of this map.\n" );
-			}
-			else
-			{
-				DevWarning( "The Navigation Mesh was built using a different version of this map.\n" );
-			}
+			WarnMeshOutOfDate();
 			m_isOutOfDate = true;
 		}
 	}
@@ -1575,10 +1601,746 @@ NavErrorType CNavMesh::Load( void )
 
 	WarnIfMeshNeedsAnalysis( version );
 
+	// write the flat file so the next load of this map can use it
+	if ( useFlatFile && nav_flat_file_write_on_load.GetBool() && loadResult == NAV_OK && !navIsInBsp && version == NavCurrentVersion && subVersion == GetSubVersionNumber() )
+	{
+		SaveFlatFile( filename );
+	}
+
 	return loadResult;
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+static bool IsFlatRangeValid( const NavFlatRange_t &range, unsigned int count )
+{
+	return range.first <= count && range.count <= count - range.first;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the mesh from the flat companion of the .nav file.
+ * Areas and hiding spots are built straight from the arrays in the mapped file, and everything
+ * they refer to is bound by index instead of being looked up by ID in PostLoad().
+ * Nothing is created until the whole file has been checked, so on failure the caller can
+ * still load the .nav file.
+ */
+NavErrorType CNavMesh::LoadFlatFile( const char *navFilename )
+{
+	// the flat file can only be checked against a .nav file outside the bsp
+	if ( !filesystem->FileExists( navFilename, "MOD" ) )
+		return NAV_CANT_ACCESS_FILE;
+
+	char flatFilename[256];
+	Q_snprintf( flatFilename, sizeof( flatFilename ), FORMAT_NAVFLATFILE, STRING( gpGlobals->mapname ) );
+
+	CNavFlatFile file;
+	if ( !file.Open( flatFilename, "MOD" ) )
+		return NAV_CANT_ACCESS_FILE;
+
+	const NavFlatHeader_t &header = file.GetHeader();
+	if ( header.navVersion != (unsigned int)NavCurrentVersion || header.navSubVersion != GetSubVersionNumber() )
+		return NAV_BAD_FILE_VERSION;
+
+	// don't use a flat file made from some other .nav file
+	if ( header.navSize != filesystem->Size( navFilename, "MOD" ) || header.navFileTime != (unsigned int)filesystem->GetFileTime( navFilename, "MOD" ) )
+		return NAV_FILE_OUT_OF_DATE;
+
+	char *bspFilename = GetBspFilename( navFilename );
+	if ( bspFilename == NULL )
+		return NAV_INVALID_FILE;
+
+	const unsigned int areaCount = header.areaCount;
+	if ( areaCount == 0 )
+		return NAV_INVALID_FILE;
+
+	// per-area arrays
+	const unsigned int *areaID = file.GetArray< unsigned int >( NAV_FLAT_AREA_ID, areaCount );
+	const int *attributes = file.GetArray< int >( NAV_FLAT_AREA_ATTRIBUTES, areaCount );
+	const Vector *nwCorner = file.GetArray< Vector >( NAV_FLAT_AREA_NW_CORNER, areaCount );
+	const Vector *seCorner = file.GetArray< Vector >( NAV_FLAT_AREA_SE_CORNER, areaCount );
+	const float *neZ = file.GetArray< float >( NAV_FLAT_AREA_NE_Z, areaCount );
+	const float *swZ = file.GetArray< float >( NAV_FLAT_AREA_SW_Z, areaCount );
+	const PlaceDirectory::IndexType *placeEntry = file.GetArray< PlaceDirectory::IndexType >( NAV_FLAT_AREA_PLACE, areaCount );
+	const float *occupyTime = file.GetArray< float >( NAV_FLAT_AREA_OCCUPY_TIME, areaCount * MAX_NAV_TEAMS );
+	const float *light = file.GetArray< float >( NAV_FLAT_AREA_LIGHT, areaCount * NUM_CORNERS );
+	const unsigned int *inheritVisibility = file.GetArray< unsigned int >( NAV_FLAT_AREA_INHERIT_VISIBILITY, areaCount );
+	const NavFlatRange_t *connectRange = file.GetArray< NavFlatRange_t >( NAV_FLAT_AREA_CONNECT, areaCount * NUM_DIRECTIONS );
+	const NavFlatRange_t *ladderRange = file.GetArray< NavFlatRange_t >( NAV_FLAT_AREA_LADDER, areaCount * CNavLadder::NUM_LADDER_DIRECTIONS );
+	const NavFlatRange_t *spotRange = file.GetArray< NavFlatRange_t >( NAV_FLAT_AREA_HIDING_SPOT, areaCount );
+	const NavFlatRange_t *encounterRange = file.GetArray< NavFlatRange_t >( NAV_FLAT_AREA_ENCOUNTER, areaCount );
+	const NavFlatRange_t *visibilityRange = file.GetArray< NavFlatRange_t >( NAV_FLAT_AREA_VISIBILITY, areaCount );
+
+	// arrays shared by all areas
+	const unsigned int connectCount = file.GetCount< NavFlatConnect_t >( NAV_FLAT_CONNECT );
+	const unsigned int ladderConnectCount = file.GetCount< unsigned int >( NAV_FLAT_LADDER_CONNECT );
+	const unsigned int spotCount = file.GetCount< NavFlatHidingSpot_t >( NAV_FLAT_HIDING_SPOT );
+	const unsigned int encounterCount = file.GetCount< NavFlatEncounter_t >( NAV_FLAT_ENCOUNTER );
+	const unsigned int encounterSpotCount = file.GetCount< NavFlatSpotOrder_t >( NAV_FLAT_ENCOUNTER_SPOT );
+	const unsigned int visibilityCount = file.GetCount< NavFlatVisibility_t >( NAV_FLAT_VISIBILITY );
+
+	const NavFlatConnect_t *connect = file.GetArray< NavFlatConnect_t >( NAV_FLAT_CONNECT, connectCount );
+	const unsigned int *ladderConnect = file.GetArray< unsigned int >( NAV_FLAT_LADDER_CONNECT, ladderConnectCount );
+	const NavFlatHidingSpot_t *spot = file.GetArray< NavFlatHidingSpot_t >( NAV_FLAT_HIDING_SPOT, spotCount );
+	const NavFlatEncounter_t *encounter = file.GetArray< NavFlatEncounter_t >( NAV_FLAT_ENCOUNTER, encounterCount );
+	const NavFlatSpotOrder_t *encounterSpot = file.GetArray< NavFlatSpotOrder_t >( NAV_FLAT_ENCOUNTER_SPOT, encounterSpotCount );
+	const NavFlatVisibility_t *visibility = file.GetArray< NavFlatVisibility_t >( NAV_FLAT_VISIBILITY, visibilityCount );
+
+	if ( !areaID || !attributes || !nwCorner || !seCorner || !neZ || !swZ || !placeEntry || !occupyTime || !light || !inheritVisibility ||
+		 !connectRange || !ladderRange || !spotRange || !encounterRange || !visibilityRange ||
+		 !connect || !ladderConnect || !spot || !encounter || !encounterSpot || !visibility )
+	{
+		Msg( "Corrupt flat navigation file '%s'.\n", flatFilename );
+		return NAV_CORRUPT_DATA;
+	}
+
+	//
+	// Check every index before anything is created
+	//
+	// areas refer to places by their index in the directory
+	CUtlBuffer blob;
+	file.GetBlob( NAV_FLAT_PLACES, &blob );
+	placeDirectory.Load( blob, NavCurrentVersion );
+
+	const unsigned int placeCount = placeDirectory.GetPlaces()->Count();
+
+	bool isValid = blob.IsValid();
+
+	// every ladder is stored in the same number of bytes
+	file.GetBlob( NAV_FLAT_LADDERS, &blob );
+	isValid &= ( (uint64)blob.TellMaxPut() == (uint64)header.ladderCount * NavFlatLadderSize );
+
+	for( unsigned int i=0; i<areaCount && isValid; ++i )
+	{
+		for( int d=0; d<NUM_DIRECTIONS; ++d )
+		{
+			isValid &= IsFlatRangeValid( connectRange[ i*NUM_DIRECTIONS + d ], connectCount );
+		}
+
+		for( int d=0; d<CNavLadder::NUM_LADDER_DIRECTIONS; ++d )
+		{
+			isValid &= IsFlatRangeValid( ladderRange[ i*CNavLadder::NUM_LADDER_DIRECTIONS + d ], ladderConnectCount );
+		}
+
+		isValid &= IsFlatRangeValid( spotRange[i], spotCount );
+		isValid &= IsFlatRangeValid( encounterRange[i], encounterCount );
+		isValid &= IsFlatRangeValid( visibilityRange[i], visibilityCount );
+		isValid &= ( inheritVisibility[i] == NAV_FLAT_NONE || inheritVisibility[i] < areaCount );
+		isValid &= ( placeEntry[i] <= placeCount );
+	}
+
+	for( unsigned int i=0; i<connectCount && isValid; ++i )
+	{
+		isValid &= ( connect[i].area < areaCount );
+	}
+
+	for( unsigned int i=0; i<ladderConnectCount && isValid; ++i )
+	{
+		isValid &= ( ladderConnect[i] < header.ladderCount );
+	}
+
+	for( unsigned int i=0; i<encounterCount && isValid; ++i )
+	{
+		const NavFlatEncounter_t &e = encounter[i];
+		isValid &= ( e.from == NAV_FLAT_NONE || e.from < areaCount );
+		isValid &= ( e.to == NAV_FLAT_NONE || e.to < areaCount );
+		isValid &= ( e.fromDir < NUM_DIRECTIONS && e.toDir < NUM_DIRECTIONS );
+		isValid &= IsFlatRangeValid( e.spots, encounterSpotCount );
+	}
+
+	for( unsigned int i=0; i<encounterSpotCount && isValid; ++i )
+	{
+		isValid &= ( encounterSpot[i].spot == NAV_FLAT_NONE || encounterSpot[i].spot < spotCount );
+	}
+
+	for( unsigned int i=0; i<visibilityCount && isValid; ++i )
+	{
+		isValid &= ( visibility[i].area < areaCount );
+	}
+
+	if ( !isValid )
+	{
+		Msg( "Corrupt flat navigation file '%s'.\n", flatFilename );
+		placeDirectory.Reset();
+		return NAV_CORRUPT_DATA;
+	}
+
+	//
+	// The file is good, build the mesh from it
+	//
+	m_isFlatFileLoaded = true;
+	m_isAnalyzed = ( header.isAnalyzed != 0 );
+
+	if ( header.bspSize != filesystem->Size( bspFilename ) )
+	{
+		WarnMeshOutOfDate();
+		m_isOutOfDate = true;
+	}
+
+	file.GetBlob( NAV_FLAT_CUSTOM_PRE_AREA, &blob );
+	LoadCustomDataPreArea( blob, header.navSubVersion );
+
+	Extent extent;
+	extent.lo.x = 9999999999.9f;
+	extent.lo.y = 9999999999.9f;
+	extent.hi.x = -9999999999.9f;
+	extent.hi.y = -9999999999.9f;
+
+	CUtlVector< HidingSpot * > hidingSpots;
+	hidingSpots.SetCount( spotCount );
+	V_memset( hidingSpots.Base(), 0, spotCount * sizeof( HidingSpot * ) );
+
+	// create the areas and their hiding spots
+	PreLoadAreas( areaCount );
+	TheNavAreas.EnsureCapacity( areaCount );
+
+	Extent areaExtent;
+	for( unsigned int i=0; i<areaCount; ++i )
+	{
+		CNavArea *area = CreateArea();
+
+		area->m_id = areaID[i];
+
+		// update nextID to avoid collisions
+		if ( area->m_id >= CNavArea::m_nextID )
+			CNavArea::m_nextID = area->m_id+1;
+
+		area->m_attributeFlags = attributes[i];
+		area->m_nwCorner = nwCorner[i];
+		area->m_seCorner = seCorner[i];
+		area->m_neZ = neZ[i];
+		area->m_swZ = swZ[i];
+
+		area->m_center.x = (area->m_nwCorner.x + area->m_seCorner.x)/2.0f;
+		area->m_center.y = (area->m_nwCorner.y + area->m_seCorner.y)/2.0f;
+		area->m_center.z = (area->m_nwCorner.z + area->m_seCorner.z)/2.0f;
+
+		if ( ( area->m_seCorner.x - area->m_nwCorner.x ) > 0.0f && ( area->m_seCorner.y - area->m_nwCorner.y ) > 0.0f )
+		{
+			area->m_invDxCorners = 1.0f / ( area->m_seCorner.x - area->m_nwCorner.x );
+			area->m_invDyCorners = 1.0f / ( area->m_seCorner.y - area->m_nwCorner.y );
+		}
+		else
+		{
+			area->m_invDxCorners = area->m_invDyCorners = 0;
+
+			DevWarning( "Degenerate Navigation Area #%d at setpos %g %g %g\n", 
+				area->m_id, area->m_center.x, area->m_center.y, area->m_center.z );
+		}
+
+		area->CheckWaterLevel();
+
+		area->SetPlace( placeDirectory.IndexToPlace( placeEntry[i] ) );
+
+		V_memcpy( area->m_earliestOccupyTime, &occupyTime[ i*MAX_NAV_TEAMS ], sizeof( area->m_earliestOccupyTime ) );
+		V_memcpy( area->m_lightIntensity, &light[ i*NUM_CORNERS ], sizeof( area->m_lightIntensity ) );
+
+		const NavFlatRange_t &spots = spotRange[i];
+		area->m_hidingSpots.EnsureCapacity( spots.count );
+		for( unsigned int s=spots.first; s<spots.first + spots.count; ++s )
+		{
+			// create new hiding spot and put on master list
+			HidingSpot *hidingSpot = CreateHidingSpot();
+
+			hidingSpot->m_id = spot[s].id;
+			hidingSpot->m_pos = spot[s].pos;
+			hidingSpot->m_flags = (unsigned char)spot[s].flags;
+
+			// update next ID to avoid ID collisions by later spots
+			if ( hidingSpot->m_id >= HidingSpot::m_nextID )
+				HidingSpot::m_nextID = hidingSpot->m_id+1;
+
+			area->m_hidingSpots.AddToTail( hidingSpot );
+			hidingSpots[s] = hidingSpot;
+		}
+
+		TheNavAreas.AddToTail( area );
+
+		area->GetExtent( &areaExtent );
+
+		if (areaExtent.lo.x < extent.lo.x)
+			extent.lo.x = areaExtent.lo.x;
+		if (areaExtent.lo.y < extent.lo.y)
+			extent.lo.y = areaExtent.lo.y;
+		if (areaExtent.hi.x > extent.hi.x)
+			extent.hi.x = areaExtent.hi.x;
+		if (areaExtent.hi.y > extent.hi.y)
+			extent.hi.y = areaExtent.hi.y;
+	}
+
+	// add the areas to the grid
+	AllocateGrid( extent.lo.x, extent.hi.x, extent.lo.y, extent.hi.y );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		AddNavArea( TheNavAreas[ it ] );
+	}
+
+	// ladders find their areas by ID, so they come after the areas are in the mesh
+	file.GetBlob( NAV_FLAT_LADDERS, &blob );
+	m_ladders.EnsureCapacity( header.ladderCount );
+	for( unsigned int i=0; i<header.ladderCount; ++i )
+	{
+		CNavLadder *ladder = new CNavLadder;
+		ladder->Load( blob, NavCurrentVersion );
+		m_ladders.AddToTail( ladder );
+	}
+
+	// bind everything the areas refer to
+	for( unsigned int i=0; i<areaCount; ++i )
+	{
+		CNavArea *area = TheNavAreas[i];
+
+		for( int d=0; d<NUM_DIRECTIONS; ++d )
+		{
+			const NavFlatRange_t &range = connectRange[ i*NUM_DIRECTIONS + d ];
+			area->m_connect[d].EnsureCapacity( range.count );
+
+			for( unsigned int c=range.first; c<range.first + range.count; ++c )
+			{
+				NavConnect navConnect;
+				navConnect.area = TheNavAreas[ connect[c].area ];
+				navConnect.length = connect[c].length;
+				area->m_connect[d].AddToTail( navConnect );
+			}
+		}
+
+		for( int d=0; d<CNavLadder::NUM_LADDER_DIRECTIONS; ++d )
+		{
+			const NavFlatRange_t &range = ladderRange[ i*CNavLadder::NUM_LADDER_DIRECTIONS + d ];
+			area->m_ladder[d].EnsureCapacity( range.count );
+
+			for( unsigned int c=range.first; c<range.first + range.count; ++c )
+			{
+				NavLadderConnect navConnect;
+				navConnect.ladder = m_ladders[ ladderConnect[c] ];
+				area->m_ladder[d].AddToTail( navConnect );
+			}
+		}
+
+		const NavFlatRange_t &encounters = encounterRange[i];
+		area->m_spotEncounters.EnsureCapacity( encounters.count );
+		for( unsigned int e=encounters.first; e<encounters.first + encounters.count; ++e )
+		{
+			const NavFlatEncounter_t &info = encounter[e];
+
+			SpotEncounter *spotEncounter = new SpotEncounter;
+			spotEncounter->from.area = ( info.from == NAV_FLAT_NONE ) ? NULL : TheNavAreas[ info.from ];
+			spotEncounter->fromDir = (NavDirType)info.fromDir;
+			spotEncounter->to.area = ( info.to == NAV_FLAT_NONE ) ? NULL : TheNavAreas[ info.to ];
+			spotEncounter->toDir = (NavDirType)info.toDir;
+			spotEncounter->path.from = info.pathFrom;
+			spotEncounter->path.to = info.pathTo;
+
+			spotEncounter->spots.EnsureCapacity( info.spots.count );
+			for( unsigned int s=info.spots.first; s<info.spots.first + info.spots.count; ++s )
+			{
+				SpotOrder order;
+				order.spot = ( encounterSpot[s].spot == NAV_FLAT_NONE ) ? NULL : hidingSpots[ encounterSpot[s].spot ];
+				order.t = encounterSpot[s].t;
+				spotEncounter->spots.AddToTail( order );
+			}
+
+			area->m_spotEncounters.AddToTail( spotEncounter );
+		}
+
+		const NavFlatRange_t &visible = visibilityRange[i];
+		area->m_potentiallyVisibleAreas.EnsureCapacity( visible.count );
+		for( unsigned int v=visible.first; v<visible.first + visible.count; ++v )
+		{
+			CNavArea::AreaBindInfo info;
+			info.area = TheNavAreas[ visibility[v].area ];
+			info.attributes = (unsigned char)visibility[v].attributes;
+			area->m_potentiallyVisibleAreas.AddToTail( info );
+		}
+
+		area->m_inheritVisibilityFrom.area = ( inheritVisibility[i] == NAV_FLAT_NONE ) ? NULL : TheNavAreas[ inheritVisibility[i] ];
+
+		// func avoid/prefer attributes are controlled by func_nav_cost entities
+		area->ClearAllNavCostEntities();
+	}
+
+	// stairways were marked before the flat file was written, and only need tracing again if the map changed
+	if ( m_isOutOfDate )
+	{
+		MarkStairAreas();
+	}
+
+	//
+	// Load derived class mesh info
+	//
+	file.GetBlob( NAV_FLAT_CUSTOM, &blob );
+	LoadCustomData( blob, header.navSubVersion );
+
+	NavErrorType loadResult = PostLoad( NavCurrentVersion );
+
+	WarnIfMeshNeedsAnalysis( NavCurrentVersion );
+
+	DevMsg( "Loaded navigation mesh from '%s'.\n", flatFilename );
+
+	return loadResult;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Write the mesh as a flat file next to the given .nav file. Everything an area refers to is
+ * stored as an index into the arrays of the flat file, so loading it needs no ID lookups.
+ */
+bool CNavMesh::SaveFlatFile( const char *navFilename ) const
+{
+	char flatFilename[256];
+	Q_snprintf( flatFilename, sizeof( flatFilename ), FORMAT_NAVFLATFILE, STRING( gpGlobals->mapname ) );
+
+	char *bspFilename = GetBspFilename( navFilename );
+	if ( bspFilename == NULL )
+		return false;
+
+	// map IDs to indices, so references can be stored as indices
+	CUtlVector< unsigned int > areaIndex;
+	areaIndex.SetCount( CNavArea::m_nextID );
+	V_memset( areaIndex.Base(), 0xFF, areaIndex.Count() * sizeof( unsigned int ) );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		unsigned int id = TheNavAreas[ it ]->GetID();
+		if ( id >= (unsigned int)areaIndex.Count() )
+			return false;
+
+		areaIndex[ id ] = it;
+	}
+
+	CUtlVector< unsigned int > spotIndex;
+	spotIndex.SetCount( HidingSpot::m_nextID );
+	V_memset( spotIndex.Base(), 0xFF, spotIndex.Count() * sizeof( unsigned int ) );
+
+	unsigned int spotCount = 0;
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const HidingSpotVector &spots = TheNavAreas[ it ]->m_hidingSpots;
+		FOR_EACH_VEC( spots, sit )
+		{
+			unsigned int id = spots[ sit ]->GetID();
+			if ( id >= (unsigned int)spotIndex.Count() )
+				return false;
+
+			spotIndex[ id ] = spotCount++;
+		}
+	}
+
+	CNavFlatFileWriter writer;
+
+	//
+	// Places and custom data that precede the areas
+	//
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		placeDirectory.AddPlace( TheNavAreas[ it ]->GetPlace() );
+	}
+
+	writer.BeginSection( NAV_FLAT_PLACES );
+	placeDirectory.Save( writer.GetBuffer() );
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_CUSTOM_PRE_AREA );
+	SaveCustomDataPreArea( writer.GetBuffer() );
+	writer.EndSection();
+
+	//
+	// Per-area arrays
+	//
+	writer.BeginSection( NAV_FLAT_AREA_ID );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		writer.Put( TheNavAreas[ it ]->m_id );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_ATTRIBUTES );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		writer.Put( TheNavAreas[ it ]->m_attributeFlags );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_NW_CORNER );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		writer.Put( TheNavAreas[ it ]->m_nwCorner );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_SE_CORNER );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		writer.Put( TheNavAreas[ it ]->m_seCorner );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_NE_Z );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		writer.Put( TheNavAreas[ it ]->m_neZ );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_SW_Z );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		writer.Put( TheNavAreas[ it ]->m_swZ );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_PLACE );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		PlaceDirectory::IndexType entry = placeDirectory.GetIndex( TheNavAreas[ it ]->GetPlace() );
+		writer.Put( entry );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_OCCUPY_TIME );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		writer.Put( TheNavAreas[ it ]->m_earliestOccupyTime );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_LIGHT );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		writer.Put( TheNavAreas[ it ]->m_lightIntensity );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_INHERIT_VISIBILITY );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea *inherit = TheNavAreas[ it ]->m_inheritVisibilityFrom.area;
+		unsigned int index = ( inherit ) ? areaIndex[ inherit->GetID() ] : NAV_FLAT_NONE;
+		writer.Put( index );
+	}
+	writer.EndSection();
+
+	//
+	// Where each area's part of the shared arrays begins and ends
+	//
+	writer.BeginSection( NAV_FLAT_AREA_CONNECT );
+	{
+		NavFlatRange_t range = { 0, 0 };
+		FOR_EACH_VEC( TheNavAreas, it )
+		{
+			for( int d=0; d<NUM_DIRECTIONS; ++d )
+			{
+				range.first += range.count;
+				range.count = TheNavAreas[ it ]->m_connect[d].Count();
+				writer.Put( range );
+			}
+		}
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_LADDER );
+	{
+		NavFlatRange_t range = { 0, 0 };
+		FOR_EACH_VEC( TheNavAreas, it )
+		{
+			for( int d=0; d<CNavLadder::NUM_LADDER_DIRECTIONS; ++d )
+			{
+				range.first += range.count;
+				range.count = TheNavAreas[ it ]->m_ladder[d].Count();
+				writer.Put( range );
+			}
+		}
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_HIDING_SPOT );
+	{
+		NavFlatRange_t range = { 0, 0 };
+		FOR_EACH_VEC( TheNavAreas, it )
+		{
+			range.first += range.count;
+			range.count = TheNavAreas[ it ]->m_hidingSpots.Count();
+			writer.Put( range );
+		}
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_ENCOUNTER );
+	{
+		NavFlatRange_t range = { 0, 0 };
+		FOR_EACH_VEC( TheNavAreas, it )
+		{
+			range.first += range.count;
+			range.count = TheNavAreas[ it ]->m_spotEncounters.Count();
+			writer.Put( range );
+		}
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_AREA_VISIBILITY );
+	{
+		NavFlatRange_t range = { 0, 0 };
+		FOR_EACH_VEC( TheNavAreas, it )
+		{
+			range.first += range.count;
+			range.count = TheNavAreas[ it ]->m_potentiallyVisibleAreas.Count();
+			writer.Put( range );
+		}
+	}
+	writer.EndSection();
+
+	//
+	// The shared arrays, in the same order as the ranges above
+	//
+	writer.BeginSection( NAV_FLAT_CONNECT );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		for( int d=0; d<NUM_DIRECTIONS; ++d )
+		{
+			const NavConnectVector &connectList = TheNavAreas[ it ]->m_connect[d];
+			FOR_EACH_VEC( connectList, cit )
+			{
+				NavFlatConnect_t connect;
+				connect.area = areaIndex[ connectList[ cit ].area->GetID() ];
+				connect.length = connectList[ cit ].length;
+				writer.Put( connect );
+			}
+		}
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_LADDER_CONNECT );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		for( int d=0; d<CNavLadder::NUM_LADDER_DIRECTIONS; ++d )
+		{
+			const NavLadderConnectVector &ladderList = TheNavAreas[ it ]->m_ladder[d];
+			FOR_EACH_VEC( ladderList, lit )
+			{
+				// a ladder that isn't in the mesh is stored as an invalid index, so the flat file won't be used
+				unsigned int index = (unsigned int)m_ladders.Find( ladderList[ lit ].ladder );
+				writer.Put( index );
+			}
+		}
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_HIDING_SPOT );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const HidingSpotVector &spots = TheNavAreas[ it ]->m_hidingSpots;
+		FOR_EACH_VEC( spots, sit )
+		{
+			const HidingSpot *hidingSpot = spots[ sit ];
+
+			NavFlatHidingSpot_t info;
+			info.id = hidingSpot->m_id;
+			info.pos = hidingSpot->m_pos;
+			info.flags = hidingSpot->m_flags;
+			writer.Put( info );
+		}
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_ENCOUNTER );
+	{
+		NavFlatRange_t spots = { 0, 0 };
+		FOR_EACH_VEC( TheNavAreas, it )
+		{
+			const SpotEncounterVector &encounters = TheNavAreas[ it ]->m_spotEncounters;
+			FOR_EACH_VEC( encounters, eit )
+			{
+				const SpotEncounter *e = encounters[ eit ];
+
+				spots.first += spots.count;
+				spots.count = e->spots.Count();
+
+				NavFlatEncounter_t info;
+				info.from = ( e->from.area ) ? areaIndex[ e->from.area->GetID() ] : NAV_FLAT_NONE;
+				info.to = ( e->to.area ) ? areaIndex[ e->to.area->GetID() ] : NAV_FLAT_NONE;
+				info.fromDir = e->fromDir;
+				info.toDir = e->toDir;
+				info.pathFrom = e->path.from;
+				info.pathTo = e->path.to;
+				info.spots = spots;
+				writer.Put( info );
+			}
+		}
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_ENCOUNTER_SPOT );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const SpotEncounterVector &encounters = TheNavAreas[ it ]->m_spotEncounters;
+		FOR_EACH_VEC( encounters, eit )
+		{
+			const SpotOrderVector &spots = encounters[ eit ]->spots;
+			FOR_EACH_VEC( spots, sit )
+			{
+				NavFlatSpotOrder_t order;
+				order.spot = ( spots[ sit ].spot ) ? spotIndex[ spots[ sit ].spot->GetID() ] : NAV_FLAT_NONE;
+				order.t = spots[ sit ].t;
+				writer.Put( order );
+			}
+		}
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_VISIBILITY );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea::CAreaBindInfoArray &visibleList = TheNavAreas[ it ]->m_potentiallyVisibleAreas;
+		for( int v=0; v<visibleList.Count(); ++v )
+		{
+			NavFlatVisibility_t info;
+			info.area = areaIndex[ visibleList[v].area->GetID() ];
+			info.attributes = visibleList[v].attributes;
+			writer.Put( info );
+		}
+	}
+	writer.EndSection();
+
+	//
+	// Ladders and derived class mesh info, in the .nav encoding
+	//
+	writer.BeginSection( NAV_FLAT_LADDERS );
+	FOR_EACH_VEC( m_ladders, it )
+	{
+		m_ladders[ it ]->Save( writer.GetBuffer(), NavCurrentVersion );
+	}
+	writer.EndSection();
+
+	writer.BeginSection( NAV_FLAT_CUSTOM );
+	SaveCustomData( writer.GetBuffer() );
+	writer.EndSection();
+
+	NavFlatHeader_t header;
+	V_memset( &header, 0, sizeof( header ) );
+	header.magic = NAV_FLAT_MAGIC_NUMBER;
+	header.version = NavFlatCurrentVersion;
+	header.navVersion = NavCurrentVersion;
+	header.navSubVersion = GetSubVersionNumber();
+	header.navSize = filesystem->Size( navFilename, "MOD" );
+	header.navFileTime = (unsigned int)filesystem->GetFileTime( navFilename, "MOD" );
+	header.bspSize = ( m_isOutOfDate ) ? 0 : filesystem->Size( bspFilename );
+	header.isAnalyzed = m_isAnalyzed;
+	header.areaCount = TheNavAreas.Count();
+	header.ladderCount = m_ladders.Count();
+
+	if ( !writer.Write( flatFilename, "MOD", header ) )
+	{
+		Warning( "Unable to save %d bytes to %s\n", writer.GetBuffer().TellPut(), flatFilename );
+		return false;
+	}
+
+	return true;
+}
+
+
 struct OneWayLink_t
 {
 	CNavArea *destArea;
@@ -1603,10 +2365,14 @@ struct OneWayLink_t
 NavErrorType CNavMesh::PostLoad( unsigned int version )
 {
 	// allow areas to connect to each other, etc
-	FOR_EACH_VEC( TheNavAreas, pit )
+	// (areas from a flat file were bound as they were created)
+	if ( !m_isFlatFileLoaded )
 	{
-		CNavArea *area = TheNavAreas[ pit ];
-		area->PostLoad();
+		FOR_EACH_VEC( TheNavAreas, pit )
+		{
+			CNavArea *area = TheNavAreas[ pit ];
+			area->PostLoad();
+		}
 	}
 
 	// allow hiding spots to compute information
@@ -0,0 +1,230 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Memory mapped "flat" companion to the .nav file
+//
+//=============================================================================//
+// nav_flatfile.cpp
+
+#include "cbase.h"
+#include "filesystem.h"
+#include "nav_flatfile.h"
+
+#if defined( _WIN32 )
+#include "winlite.h"
+#elif defined( POSIX )
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavFlatFile::CNavFlatFile( void )
+{
+	m_data = NULL;
+	m_size = 0;
+	m_mapping = NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavFlatFile::~CNavFlatFile()
+{
+	Close();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Map the file if it is loose on disk, otherwise read it
+ */
+bool CNavFlatFile::Open( const char *filename, const char *pathID )
+{
+	Close();
+
+	char fullPath[ MAX_PATH ];
+	if ( filesystem->RelativePathToFullPath( filename, pathID, fullPath, sizeof( fullPath ), FILTER_CULLPACK ) && fullPath[0] )
+	{
+		Map( fullPath );
+	}
+
+	if ( !m_mapping )
+	{
+		if ( !filesystem->ReadFile( filename, pathID, m_fileBuffer ) )
+			return false;
+
+		m_data = (const unsigned char *)m_fileBuffer.Base();
+		m_size = m_fileBuffer.TellPut();
+	}
+
+	if ( !IsValid() )
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavFlatFile::Map( const char *fullPath )
+{
+#if defined( _WIN32 )
+	HANDLE hFile = CreateFile( fullPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return;
+
+	DWORD size = GetFileSize( hFile, NULL );
+	if ( size != INVALID_FILE_SIZE && size > 0 )
+	{
+		HANDLE hMapping = CreateFileMapping( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+		if ( hMapping )
+		{
+			// the view keeps the mapping alive after its handle is closed
+			void *view = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+			if ( view )
+			{
+				m_mapping = view;
+				m_data = (const unsigned char *)view;
+				m_size = size;
+			}
+
+			CloseHandle( hMapping );
+		}
+	}
+
+	CloseHandle( hFile );
+#elif defined( POSIX )
+	int fd = open( fullPath, O_RDONLY );
+	if ( fd < 0 )
+		return;
+
+	struct stat fileInfo;
+	if ( fstat( fd, &fileInfo ) == 0 && fileInfo.st_size > 0 )
+	{
+		void *view = mmap( NULL, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( view != MAP_FAILED )
+		{
+			m_mapping = view;
+			m_data = (const unsigned char *)view;
+			m_size = fileInfo.st_size;
+		}
+	}
+
+	close( fd );
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavFlatFile::Close( void )
+{
+	if ( m_mapping )
+	{
+#if defined( _WIN32 )
+		UnmapViewOfFile( m_mapping );
+#elif defined( POSIX )
+		munmap( m_mapping, m_size );
+#endif
+		m_mapping = NULL;
+	}
+
+	m_fileBuffer.Purge();
+	m_data = NULL;
+	m_size = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if the header is ours and every section lies inside the file.
+ * The contents of the sections are checked by the loader.
+ */
+bool CNavFlatFile::IsValid( void ) const
+{
+	if ( !m_data || m_size < sizeof( NavFlatHeader_t ) )
+		return false;
+
+	const NavFlatHeader_t &header = GetHeader();
+	if ( header.magic != NAV_FLAT_MAGIC_NUMBER || header.version != NavFlatCurrentVersion )
+		return false;
+
+	for( int s=0; s<NAV_FLAT_SECTION_COUNT; ++s )
+	{
+		const NavFlatSection_t &info = header.section[s];
+
+		// sections are aligned so the arrays in them can be used in place
+		if ( info.offset % 4 || info.offset < sizeof( NavFlatHeader_t ) )
+			return false;
+
+		if ( info.offset > m_size || info.size > m_size - info.offset )
+			return false;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavFlatFile::GetBlob( NavFlatSectionType section, CUtlBuffer *buffer ) const
+{
+	const NavFlatSection_t &info = GetHeader().section[ section ];
+	buffer->SetExternalBuffer( const_cast< unsigned char * >( m_data + info.offset ), info.size, info.size, CUtlBuffer::READ_ONLY );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------------
+CNavFlatFileWriter::CNavFlatFileWriter( void ) : m_buffer( 4096, 1024*1024 )
+{
+	V_memset( m_section, 0, sizeof( m_section ) );
+	m_currentSection = -1;
+
+	// leave room for the header
+	NavFlatHeader_t header;
+	V_memset( &header, 0, sizeof( header ) );
+	m_buffer.Put( &header, sizeof( header ) );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavFlatFileWriter::BeginSection( NavFlatSectionType section )
+{
+	Assert( section > m_currentSection );
+
+	while( m_buffer.TellPut() % 16 )
+	{
+		m_buffer.PutUnsignedChar( 0 );
+	}
+
+	m_currentSection = section;
+	m_section[ section ].offset = m_buffer.TellPut();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavFlatFileWriter::EndSection( void )
+{
+	Assert( m_currentSection >= 0 );
+
+	NavFlatSection_t &info = m_section[ m_currentSection ];
+	info.size = m_buffer.TellPut() - info.offset;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavFlatFileWriter::Write( const char *filename, const char *pathID, const NavFlatHeader_t &header )
+{
+	Assert( m_currentSection == NAV_FLAT_SECTION_COUNT-1 );
+
+	NavFlatHeader_t finalHeader = header;
+	V_memcpy( finalHeader.section, m_section, sizeof( m_section ) );
+	V_memcpy( m_buffer.Base(), &finalHeader, sizeof( finalHeader ) );
+
+	return filesystem->WriteFile( filename, pathID, m_buffer );
+}
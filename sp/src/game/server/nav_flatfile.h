@@ -0,0 +1,222 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Memory mapped "flat" companion to the .nav file
+//
+//=============================================================================//
+// nav_flatfile.h
+
+#ifndef _NAV_FLATFILE_H_
+#define _NAV_FLATFILE_H_
+
+#include "utlbuffer.h"
+#include "nav.h"
+
+
+#define NAV_FLAT_MAGIC_NUMBER 0xFEEDF1A7				// to help identify flat nav files
+
+/// The current version of the flat file layout. Bump it whenever any structure below changes.
+const unsigned int NavFlatCurrentVersion = 1;
+
+/// The number of bytes CNavLadder::Save() writes at NavCurrentVersion
+const unsigned int NavFlatLadderSize = 15 * sizeof( unsigned int );
+
+/// Marks an index that refers to nothing
+const unsigned int NAV_FLAT_NONE = 0xFFFFFFFF;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The sections of a flat file, in the order they are stored.
+ * Per-area sections hold one entry (or a fixed number of entries) for every area, in area order.
+ * The "blob" sections hold data in the regular .nav encoding.
+ */
+enum NavFlatSectionType
+{
+	NAV_FLAT_PLACES,					// blob: place directory
+	NAV_FLAT_CUSTOM_PRE_AREA,			// blob: SaveCustomDataPreArea()
+
+	NAV_FLAT_AREA_ID,					// unsigned int per area
+	NAV_FLAT_AREA_ATTRIBUTES,			// int per area
+	NAV_FLAT_AREA_NW_CORNER,			// Vector per area
+	NAV_FLAT_AREA_SE_CORNER,			// Vector per area
+	NAV_FLAT_AREA_NE_Z,					// float per area
+	NAV_FLAT_AREA_SW_Z,					// float per area
+	NAV_FLAT_AREA_PLACE,				// PlaceDirectory::IndexType per area
+	NAV_FLAT_AREA_OCCUPY_TIME,			// MAX_NAV_TEAMS floats per area
+	NAV_FLAT_AREA_LIGHT,				// NUM_CORNERS floats per area
+	NAV_FLAT_AREA_INHERIT_VISIBILITY,	// area index per area
+	NAV_FLAT_AREA_CONNECT,				// NUM_DIRECTIONS NavFlatRange_t's per area, into NAV_FLAT_CONNECT
+	NAV_FLAT_AREA_LADDER,				// NUM_LADDER_DIRECTIONS NavFlatRange_t's per area, into NAV_FLAT_LADDER_CONNECT
+	NAV_FLAT_AREA_HIDING_SPOT,			// NavFlatRange_t per area, into NAV_FLAT_HIDING_SPOT
+	NAV_FLAT_AREA_ENCOUNTER,			// NavFlatRange_t per area, into NAV_FLAT_ENCOUNTER
+	NAV_FLAT_AREA_VISIBILITY,			// NavFlatRange_t per area, into NAV_FLAT_VISIBILITY
+
+	NAV_FLAT_CONNECT,					// NavFlatConnect_t
+	NAV_FLAT_LADDER_CONNECT,			// ladder index
+	NAV_FLAT_HIDING_SPOT,				// NavFlatHidingSpot_t
+	NAV_FLAT_ENCOUNTER,					// NavFlatEncounter_t
+	NAV_FLAT_ENCOUNTER_SPOT,			// NavFlatSpotOrder_t
+	NAV_FLAT_VISIBILITY,				// NavFlatVisibility_t
+
+	NAV_FLAT_LADDERS,					// blob: every CNavLadder
+	NAV_FLAT_CUSTOM,					// blob: SaveCustomData()
+
+	NAV_FLAT_SECTION_COUNT
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+struct NavFlatSection_t
+{
+	unsigned int offset;				// from the start of the file
+	unsigned int size;					// in bytes
+};
+
+/**
+ * The start of every flat file. It records which .nav file it was made from, so a stale
+ * flat file is never used.
+ */
+struct NavFlatHeader_t
+{
+	unsigned int magic;
+	unsigned int version;				// NavFlatCurrentVersion
+	unsigned int navVersion;			// version and sub-version of the mesh data
+	unsigned int navSubVersion;
+	unsigned int navSize;				// size and modification time of the .nav file this was made from
+	unsigned int navFileTime;
+	unsigned int bspSize;				// size of the bsp the mesh matched, zero if it was already out of date
+	unsigned int isAnalyzed;
+	unsigned int areaCount;
+	unsigned int ladderCount;
+	NavFlatSection_t section[ NAV_FLAT_SECTION_COUNT ];
+};
+
+/**
+ * A run of entries in one of the shared arrays
+ */
+struct NavFlatRange_t
+{
+	unsigned int first;
+	unsigned int count;
+};
+
+struct NavFlatConnect_t
+{
+	unsigned int area;					// area index
+	float length;
+};
+
+struct NavFlatHidingSpot_t
+{
+	unsigned int id;
+	Vector pos;
+	unsigned int flags;
+};
+
+struct NavFlatEncounter_t
+{
+	unsigned int from;					// area indices
+	unsigned int to;
+	unsigned int fromDir;
+	unsigned int toDir;
+	Vector pathFrom;
+	Vector pathTo;
+	NavFlatRange_t spots;				// into NAV_FLAT_ENCOUNTER_SPOT
+};
+
+struct NavFlatSpotOrder_t
+{
+	unsigned int spot;					// hiding spot index
+	float t;
+};
+
+struct NavFlatVisibility_t
+{
+	unsigned int area;					// area index
+	unsigned int attributes;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A flat file mapped read-only into memory. Falls back to reading the whole file when it
+ * can't be mapped, such as when it lives inside a pack file.
+ */
+class CNavFlatFile
+{
+public:
+	CNavFlatFile( void );
+	~CNavFlatFile();
+
+	bool Open( const char *filename, const char *pathID );	// map the file and check its header and section table
+	void Close( void );
+
+	const NavFlatHeader_t &GetHeader( void ) const	{ return *(const NavFlatHeader_t *)m_data; }
+
+	/**
+	 * Return the section as an array of 'count' T's, or NULL if it isn't exactly that big
+	 */
+	template < typename T >
+	const T *GetArray( NavFlatSectionType section, unsigned int count ) const
+	{
+		const NavFlatSection_t &info = GetHeader().section[ section ];
+		if ( (uint64)info.size != (uint64)count * sizeof( T ) )
+			return NULL;
+
+		return (const T *)( m_data + info.offset );
+	}
+
+	/**
+	 * Return the number of T's the section holds
+	 */
+	template < typename T >
+	unsigned int GetCount( NavFlatSectionType section ) const
+	{
+		return GetHeader().section[ section ].size / sizeof( T );
+	}
+
+	void GetBlob( NavFlatSectionType section, CUtlBuffer *buffer ) const;	// point a read-only buffer at a blob section
+
+	bool IsMapped( void ) const		{ return m_mapping != NULL; }
+
+private:
+	void Map( const char *fullPath );
+	bool IsValid( void ) const;
+
+	const unsigned char *m_data;
+	unsigned int m_size;
+
+	void *m_mapping;						// the mapped view, or NULL if the file was read into m_fileBuffer
+	CUtlBuffer m_fileBuffer;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Collects sections in order and writes them out behind a header
+ */
+class CNavFlatFileWriter
+{
+public:
+	CNavFlatFileWriter( void );
+
+	void BeginSection( NavFlatSectionType section );	// sections must be written in order
+	void EndSection( void );
+
+	void Put( const void *data, int size )	{ m_buffer.Put( data, size ); }
+
+	template < typename T >
+	void Put( const T &value )				{ m_buffer.Put( &value, sizeof( T ) ); }
+
+	CUtlBuffer &GetBuffer( void )			{ return m_buffer; }	// for writing blob sections
+
+	bool Write( const char *filename, const char *pathID, const NavFlatHeader_t &header );	// fill in the section table and write the file
+
+private:
+	CUtlBuffer m_buffer;
+	NavFlatSection_t m_section[ NAV_FLAT_SECTION_COUNT ];
+	int m_currentSection;
+};
+
+
+#endif // _NAV_FLATFILE_H_
@@ -11,6 +11,7 @@
 
 #include "cbase.h"
 #include "util_shared.h"
+#include "vstdlib/jobthread.h"
 #include "nav_mesh.h"
 #include "nav_node.h"
 #include "nav_pathfind.h"
@@ -42,6 +43,8 @@ ConVar nav_generate_fixup_jump_areas( "nav_generate_fixup_jump_areas", "1", FCVA
 ConVar nav_generate_incremental_range( "nav_generate_incremental_range", "2000", FCVAR_CHEAT );
 ConVar nav_generate_incremental_tolerance( "nav_generate_incremental_tolerance", "0", FCVAR_CHEAT, "Z tolerance for adding new nav areas." );
 ConVar nav_area_max_size( "nav_area_max_size", "50", FCVAR_CHEAT, "Max area size created in nav generation" );
+ConVar nav_generate_parallel( "nav_generate_parallel", "1", FCVAR_CHEAT, "Sample walkable space on the job threads, a wavefront of nodes at a time" );
+ConVar nav_generate_parallel_region_size( "nav_generate_parallel_region_size", "16", FCVAR_CHEAT, "Width in generation steps of the square regions parallel sampling hands to each job" );
 
 // Common bounding box for traces
 Vector NavTraceMins( -0.45, -0.45, 0 );
@@ -3262,6 +3265,24 @@ int CNavMesh::BuildArea( CNavNode *node, int width, int height )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Reports how long one step of area creation took
+ */
+class CNavGenerateStepTimer
+{
+public:
+	CNavGenerateStepTimer( const char *name ) : m_name( name ), m_startTime( Plat_FloatTime() ) { }
+	~CNavGenerateStepTimer()	{ Msg( "  %s: %0.2f seconds\n", m_name, Plat_FloatTime() - m_startTime ); }
+
+private:
+	const char *m_name;
+	double m_startTime;
+};
+
+#define NAV_GENERATE_STEP( step )	{ CNavGenerateStepTimer stepTimer( #step ); step; }
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * This function uses the CNavNodes that have been sampled from the map to
@@ -3279,6 +3300,7 @@ void CNavMesh::CreateNavAreasFromNodes( void )
 	int tryHeight = tryWidth;
 	int uncoveredNodes = CNavNode::GetListLength();
 
+	double coverStartTime = Plat_FloatTime();
 	while( uncoveredNodes > 0 )
 	{
 		for( CNavNode *node = CNavNode::GetFirst(); node; node = node->GetNext() )
@@ -3307,6 +3329,7 @@ void CNavMesh::CreateNavAreasFromNodes( void )
 		if (tryWidth <= 0 || tryHeight <= 0)
 			break;
 	}
+	Msg( "  Covering nodes with areas: %0.2f seconds\n", Plat_FloatTime() - coverStartTime );
 
 	if ( !TheNavAreas.Count() )
 	{
@@ -3347,16 +3370,16 @@ void CNavMesh::CreateNavAreasFromNodes( void )
 	}
 
 	
-	ConnectGeneratedAreas();
-	MarkPlayerClipAreas();
-	MarkJumpAreas();	// mark jump areas before we merge generated areas, so we don't merge jump and non-jump areas
-	MergeGeneratedAreas();
-	SplitAreasUnderOverhangs();
-	SquareUpAreas();
-	MarkStairAreas();
-	StichAndRemoveJumpAreas();
-	HandleObstacleTopAreas();
-	FixUpGeneratedAreas();
+	NAV_GENERATE_STEP( ConnectGeneratedAreas() );
+	NAV_GENERATE_STEP( MarkPlayerClipAreas() );
+	NAV_GENERATE_STEP( MarkJumpAreas() );	// mark jump areas before we merge generated areas, so we don't merge jump and non-jump areas
+	NAV_GENERATE_STEP( MergeGeneratedAreas() );
+	NAV_GENERATE_STEP( SplitAreasUnderOverhangs() );
+	NAV_GENERATE_STEP( SquareUpAreas() );
+	NAV_GENERATE_STEP( MarkStairAreas() );
+	NAV_GENERATE_STEP( StichAndRemoveJumpAreas() );
+	NAV_GENERATE_STEP( HandleObstacleTopAreas() );
+	NAV_GENERATE_STEP( FixUpGeneratedAreas() );
 
 	/// @TODO: incremental generation doesn't create ladders yet
 	if ( m_generationMode != GENERATE_INCREMENTAL )
@@ -3396,7 +3419,7 @@ void CNavMesh::AddWalkableSeeds( void )
 /**
  * Initiate the generation process
  */
-void CNavMesh::BeginGeneration( bool incremental )
+void CNavMesh::BeginGeneration( bool incremental, bool headless )
 {
 	IGameEvent *event = gameeventmanager->CreateEvent( "nav_generate" );
 	if ( event )
@@ -3428,6 +3451,9 @@ void CNavMesh::BeginGeneration( bool incremental )
 	m_generationState = SAMPLE_WALKABLE_SPACE;
 	m_sampleTick = 0;
 	m_generationMode = (incremental) ? GENERATE_INCREMENTAL : GENERATE_FULL;
+	m_isHeadlessGeneration = headless;
+	m_bQuitWhenFinished = headless;
+	V_memset( m_generationPhaseTime, 0, sizeof( m_generationPhaseTime ) );
 	lastMsgTime = 0.0f;
 
 	// clear any previous mesh
@@ -3449,12 +3475,18 @@ void CNavMesh::BeginGeneration( bool incremental )
 
 	// the system will see this NULL and select the next walkable seed
 	m_currentNode = NULL;
+	m_sampleFrontier.RemoveAll();
 
 	// if there are no seed points, we can't generate
 	if (m_walkableSeeds.Count() == 0)
 	{
 		m_generationMode = GENERATE_NONE;
 		Msg( "No valid walkable seed positions.  Cannot generate Navigation Mesh.\n" );
+
+		if ( m_bQuitWhenFinished )
+		{
+			engine->ServerCommand( "quit\n" );
+		}
 		return;
 	}
 
@@ -3528,6 +3560,8 @@ void CNavMesh::BeginAnalysis( bool quitWhenFinished )
 	m_generationIndex = 0;
 	m_generationMode = GENERATE_ANALYSIS_ONLY;
 	m_bQuitWhenFinished = quitWhenFinished;
+	m_isHeadlessGeneration = false;
+	V_memset( m_generationPhaseTime, 0, sizeof( m_generationPhaseTime ) );
 	lastMsgTime = 0.0f;
 	m_generationStartTime = Plat_FloatTime();
 }
@@ -3609,11 +3643,61 @@ static void HideAnalysisProgress( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+static const char *s_generationPhaseName[] =
+{
+	"Sampling walkable space",
+	"Creating areas from samples",
+	"Finding hiding spots",
+	"Finding encounter spots",
+	"Finding sniper spots",
+	"Finding earliest occupy times",
+	"Finding light intensity",
+	"Computing mesh visibility",
+	"Custom game-specific analysis",
+	"Saving",
+};
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Process the auto-generation for 'maxTime' seconds. return false if generation is complete.
+ * Keeps track of the time spent in each phase, and reports it as each one finishes.
  */
 bool CNavMesh::UpdateGeneration( float maxTime )
+{
+	COMPILE_TIME_ASSERT( ARRAYSIZE( s_generationPhaseName ) == NUM_GENERATION_STATES );
+
+	GenerationStateType phase = m_generationState;
+	double startTime = Plat_FloatTime();
+
+	bool isGenerating = UpdateGenerationPhase( maxTime );
+
+	m_generationPhaseTime[ phase ] += Plat_FloatTime() - startTime;
+
+	if ( m_generationState != phase || !isGenerating )
+	{
+		Msg( "%s took %0.2f seconds.\n", s_generationPhaseName[ phase ], m_generationPhaseTime[ phase ] );
+	}
+
+	if ( !isGenerating )
+	{
+		Msg( "Generation phase times:\n" );
+		for( int i=0; i<NUM_GENERATION_STATES; ++i )
+		{
+			if ( m_generationPhaseTime[i] > 0.0f )
+			{
+				Msg( "  %-32s %8.2f seconds\n", s_generationPhaseName[i], m_generationPhaseTime[i] );
+			}
+		}
+	}
+
+	return isGenerating;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavMesh::UpdateGenerationPhase( float maxTime )
 {
 	double startTime = Plat_FloatTime();
 	static unsigned int s_movedPlayerToArea = 0;	// Last area we moved a player to for lighting calcs
@@ -3631,11 +3715,24 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			AnalysisProgress( "Sampling walkable space...", 100, m_sampleTick / 10, false );
 			m_sampleTick = ( m_sampleTick + 1 ) % 1000;
 
-			while ( SampleStep() )
+			if ( nav_generate_parallel.GetBool() )
 			{
-				if ( Plat_FloatTime() - startTime > maxTime )
+				while ( SampleWavefront() )
 				{
-					return true;
+					if ( Plat_FloatTime() - startTime > maxTime )
+					{
+						return true;
+					}
+				}
+			}
+			else
+			{
+				while ( SampleStep() )
+				{
+					if ( Plat_FloatTime() - startTime > maxTime )
+					{
+						return true;
+					}
 				}
 			}
 
@@ -4065,6 +4162,27 @@ const char *CNavMesh::GetPlayerSpawnName( void ) const
 	return "info_player_start";
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Classify a node from the space around it. Only touches the node, so
+ * nodes can be classified on several threads at once.
+ */
+void CNavMesh::ClassifyNode( CNavNode *node )
+{
+	node->CheckCrouch();
+
+	// determine if there's a cliff nearby and set an attribute on this node
+	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
+	{
+		NavDirType dir = (NavDirType) i;
+		if ( CheckCliff( node->GetPosition(), dir ) )
+		{
+			node->SetAttributes( node->GetAttributes() | NAV_MESH_CLIFF );
+			break;
+		}
+	}
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Add a nav node and connect it.
@@ -4072,6 +4190,27 @@ const char *CNavMesh::GetPlayerSpawnName( void ) const
  */
 CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDirType dir, CNavNode *source, bool isOnDisplacement, 
 							float obstacleHeight, float obstacleStartDist, float obstacleEndDist )
+{
+	bool useNew;
+	CNavNode *node = ConnectNode( destPos, normal, dir, source, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist, &useNew );
+
+	if (useNew)
+	{
+		// new node becomes current node
+		m_currentNode = node;
+	}
+
+	ClassifyNode( node );
+
+	return node;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find or create the node at 'destPos' and connect 'source' to it, without tracing anything.
+ */
+CNavNode *CNavMesh::ConnectNode( const Vector &destPos, const Vector &normal, NavDirType dir, CNavNode *source, bool isOnDisplacement, 
+								float obstacleHeight, float obstacleStartDist, float obstacleEndDist, bool *isNew )
 {
 	// check if a node exists at this location
 	CNavNode *node = CNavNode::GetNode( destPos );
@@ -4102,25 +4241,7 @@ CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDir
 		node->MarkAsVisited( OppositeDirection( dir ) );
 	}
 
-	if (useNew)
-	{
-		// new node becomes current node
-		m_currentNode = node;
-	}
-
-	node->CheckCrouch();
-
-	// determine if there's a cliff nearby and set an attribute on this node
-	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
-	{
-		NavDirType dir = (NavDirType) i;
-		if ( CheckCliff( node->GetPosition(), dir ) )
-		{
-			node->SetAttributes( node->GetAttributes() | NAV_MESH_CLIFF );
-			break;
-		}
-	}
-
+	*isNew = useNew;
 	return node;
 }
 
@@ -4331,6 +4452,233 @@ static bool IsNodeOverlapped( const Vector& pos, const Vector& offset )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Test taking one sampling step from 'from' in the given direction.
+ * Returns true if we can move there, and fills in 'step' with where we ended up.
+ * Only reads the world and the mesh, so many steps can be tested at once.
+ */
+bool CNavMesh::TestSampleStep( const Vector &from, NavDirType dir, SampledStep *step ) const
+{
+	// start at the node position
+	Vector pos = from;
+
+	// snap to grid
+	int cx = SnapToGrid( pos.x );
+	int cy = SnapToGrid( pos.y );
+
+	// attempt to move to adjacent node
+	switch( dir )
+	{
+		case NORTH:		cy -= GenerationStepSize; break;
+		case SOUTH:		cy += GenerationStepSize; break;
+		case EAST:		cx += GenerationStepSize; break;
+		case WEST:		cx -= GenerationStepSize; break;
+	}
+
+	pos.x = cx;
+	pos.y = cy;
+
+	// sanity check to not generate across the world for incremental generation
+	const float incrementalRange = nav_generate_incremental_range.GetFloat();
+	if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
+	{
+		bool inRange = false;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
+			{
+				inRange = true;
+				break;
+			}
+		}
+
+		if ( !inRange )
+		{
+			return false;
+		}
+	}
+
+	if ( m_generationMode == GENERATE_SIMPLIFY )
+	{
+		if ( !m_simplifyGenerationExtent.Contains( pos ) )
+		{
+			return false;
+		}
+	}
+
+	// test if we can move to new position
+	trace_t result;
+	CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
+	Vector to, toNormal;
+	float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
+	if ( TraceAdjacentNode( 0, from, pos, &result ) )
+	{
+		to = result.endpos;
+		toNormal = result.plane.normal;
+	}
+	else
+	{
+		// test going up ClimbUpHeight
+		bool success = false;
+		for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
+		{						
+			trace_t tr;
+			Vector start( from );
+			Vector end( pos );
+			start.z += height;
+			end.z += height;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+			if ( !tr.startsolid && tr.fraction == 1.0f )
+			{
+				if ( !StayOnFloor( &tr ) )
+				{
+					break;
+				}
+
+				to = tr.endpos;
+				toNormal = tr.plane.normal;
+
+				start = end = from;
+				end.z += height;
+				UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+				if ( tr.fraction < 1.0f )
+				{
+					break;
+				}
+
+				// keep track of far up we had to go to find a path to the next node
+				obstacleHeight = height;
+				success = true;
+				break;
+			}
+			else
+			{
+				// Could not trace from node to node at this height, something is in the way.
+				// Trace in the other direction to see if we hit something
+				Vector vecToObstacleStart = tr.endpos - start;
+				Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
+				if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
+				{
+					UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+					if ( !tr.startsolid && tr.fraction < 1.0 )
+					{
+						// We hit something going the other direction.  There is some obstacle between the two nodes.
+						Vector vecToObstacleEnd = tr.endpos - start;
+						Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
+						if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
+						{
+							// Remember the distances to start and end of the obstacle (with respect to the "from" node).
+							// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
+							// If we do eventually clear the obstacle, these values will be the start and end distance to the
+							// very tip of the obstacle.
+							obstacleStartDist = vecToObstacleStart.Length();
+							obstacleEndDist = vecToObstacleEnd.Length();
+							if ( obstacleEndDist == 0 )
+							{
+								obstacleEndDist = GenerationStepSize;
+							}
+						}								
+					}
+				}
+			}
+		}
+
+		if ( !success )
+		{
+			return false;
+		}
+	}
+
+	// Don't generate nodes if we spill off the end of the world onto skybox
+	if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
+	{
+		return false;
+	}
+
+	// If we're incrementally generating, don't overlap existing nav areas.
+	Vector testPos( to );
+	bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
+	bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
+	bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
+	bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
+	if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+	{
+		return false;
+	}
+
+	int nTolerance = nav_generate_incremental_tolerance.GetInt();
+	if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
+	{
+		bool bValid = false;
+		int zPos = to.z;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			int zMin = seedPos.z - nTolerance;
+			int zMax = seedPos.z + nTolerance;
+
+			if ( zPos >= zMin && zPos <= zMax )
+			{
+				bValid = true;
+				break;
+			}
+		}
+
+		if ( !bValid )
+			return false;
+	}
+
+
+	bool isOnDisplacement = result.IsDispSurface();
+
+	if ( nav_displacement_test.GetInt() > 0 )
+	{
+		// Test for nodes under displacement surfaces.
+		// This happens during development, and is a pain because the space underneath a displacement
+		// is not 'solid'.
+		Vector start = to + Vector( 0, 0, 0 );
+		Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
+		UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+
+		if ( result.fraction > 0 )
+		{
+			end = start;
+			start = result.endpos;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+			if ( result.fraction < 1 )
+			{
+				// if we made it down to within StepHeight, maybe we're on a static prop
+				if ( result.endpos.z > to.z + StepHeight )
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	float deltaZ = to.z - from.z;
+	// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
+	// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
+	// and distances
+	if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+	{
+		obstacleHeight = 0;
+		obstacleStartDist = 0;
+		obstacleEndDist = GenerationStepSize;
+	}
+
+	step->to = to;
+	step->toNormal = toNormal;
+	step->isOnDisplacement = isOnDisplacement;
+	step->obstacleHeight = obstacleHeight;
+	step->obstacleStartDist = obstacleStartDist;
+	step->obstacleEndDist = obstacleEndDist;
+	return true;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Search the world and build a map of possible movements.
@@ -4349,34 +4697,12 @@ bool CNavMesh::SampleStep( void )
 		if (m_currentNode == NULL)
 		{
 			// sampling is complete from current seed, try next one
-			m_currentNode = GetNextWalkableSeedNode();
+			m_currentNode = GetNextSampleStartNode();
 
 			if (m_currentNode == NULL)
 			{
-				if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
-				{
-					return false;
-				}
-
-				// search is exhausted - continue search from ends of ladders
-				for ( int i=0; i<m_ladders.Count(); ++i )
-				{
-					CNavLadder *ladder = m_ladders[i];
-
-					// check ladder bottom
-					if ((m_currentNode = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
-						break;
-
-					// check ladder top
-					if ((m_currentNode = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
-						break;
-				}
-
-				if (m_currentNode == NULL)
-				{
-					// all seeds exhausted, sampling complete
-					return false;
-				}
+				// all seeds exhausted, sampling complete
+				return false;
 			}
 		}
 
@@ -4388,233 +4714,275 @@ bool CNavMesh::SampleStep( void )
 			if (!m_currentNode->HasVisited( (NavDirType)dir ))
 			{
 				// have not searched in this direction yet
+				m_generationDir = (NavDirType)dir;
 
-				// start at current node position
-				Vector pos = *m_currentNode->GetPosition();
-
-				// snap to grid
-				int cx = SnapToGrid( pos.x );
-				int cy = SnapToGrid( pos.y );
+				// mark direction as visited
+				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// attempt to move to adjacent node
-				switch( dir )
+				// test if we can move to new position
+				SampledStep step;
+				if ( TestSampleStep( *m_currentNode->GetPosition(), m_generationDir, &step ) )
 				{
-					case NORTH:		cy -= GenerationStepSize; break;
-					case SOUTH:		cy += GenerationStepSize; break;
-					case EAST:		cx += GenerationStepSize; break;
-					case WEST:		cx -= GenerationStepSize; break;
+					// we can move here
+					// create a new navigation node, and update current node pointer
+					AddNode( step.to, step.toNormal, m_generationDir, m_currentNode, step.isOnDisplacement, step.obstacleHeight, step.obstacleStartDist, step.obstacleEndDist );
 				}
 
-				pos.x = cx;
-				pos.y = cy;
+				return true;
+			}
+		}
 
-				m_generationDir = (NavDirType)dir;
+		// all directions have been searched from this node - pop back to its parent and continue
+		m_currentNode = m_currentNode->GetParent();
+	}
+}
 
-				// mark direction as visited
-				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// sanity check to not generate across the world for incremental generation
-				const float incrementalRange = nav_generate_incremental_range.GetFloat();
-				if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
-				{
-					bool inRange = false;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
-						{
-							inRange = true;
-							break;
-						}
-					}
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the node to start sampling from once the last one has been exhausted,
+ * or NULL if sampling is complete.
+ */
+CNavNode *CNavMesh::GetNextSampleStartNode( void )
+{
+	CNavNode *node = GetNextWalkableSeedNode();
 
-					if ( !inRange )
-					{
-						return true;
-					}
-				}
+	if (node == NULL)
+	{
+		if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
+		{
+			return NULL;
+		}
 
-				if ( m_generationMode == GENERATE_SIMPLIFY )
-				{
-					if ( !m_simplifyGenerationExtent.Contains( pos ) )
-					{
-						return true;
-					}
-				}
+		// search is exhausted - continue search from ends of ladders
+		for ( int i=0; i<m_ladders.Count(); ++i )
+		{
+			CNavLadder *ladder = m_ladders[i];
 
-				// test if we can move to new position
-				trace_t result;
-				Vector from( *m_currentNode->GetPosition() );
-				CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
-				Vector to, toNormal;
-				float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
-				if ( TraceAdjacentNode( 0, from, pos, &result ) )
-				{
-					to = result.endpos;
-					toNormal = result.plane.normal;
-				}
-				else
-				{
-					// test going up ClimbUpHeight
-					bool success = false;
-					for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
-					{						
-						trace_t tr;
-						Vector start( from );
-						Vector end( pos );
-						start.z += height;
-						end.z += height;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-						if ( !tr.startsolid && tr.fraction == 1.0f )
-						{
-							if ( !StayOnFloor( &tr ) )
-							{
-								break;
-							}
+			// check ladder bottom
+			if ((node = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
+				break;
 
-							to = tr.endpos;
-							toNormal = tr.plane.normal;
+			// check ladder top
+			if ((node = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
+				break;
+		}
+	}
 
-							start = end = from;
-							end.z += height;
-							UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-							if ( tr.fraction < 1.0f )
-							{
-								break;
-							}
+	return node;
+}
 
-							// keep track of far up we had to go to find a path to the next node
-							obstacleHeight = height;
-							success = true;
-							break;
-						}
-						else
-						{
-							// Could not trace from node to node at this height, something is in the way.
-							// Trace in the other direction to see if we hit something
-							Vector vecToObstacleStart = tr.endpos - start;
-							Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
-							if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
-							{
-								UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-								if ( !tr.startsolid && tr.fraction < 1.0 )
-								{
-									// We hit something going the other direction.  There is some obstacle between the two nodes.
-									Vector vecToObstacleEnd = tr.endpos - start;
-									Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
-									if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
-									{
-										// Remember the distances to start and end of the obstacle (with respect to the "from" node).
-										// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
-										// If we do eventually clear the obstacle, these values will be the start and end distance to the
-										// very tip of the obstacle.
-										obstacleStartDist = vecToObstacleStart.Length();
-										obstacleEndDist = vecToObstacleEnd.Length();
-										if ( obstacleEndDist == 0 )
-										{
-											obstacleEndDist = GenerationStepSize;
-										}
-									}								
-								}
-							}
-						}
-					}
 
-					if ( !success )
-					{
-						return true;
-					}
-				}
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * One wavefront of parallel sampling: a step in every unsearched direction from
+ * each frontier node. Steps are grouped into square regions of the map, and each
+ * region is traced by one job, so neighboring traces stay on the same thread.
+ */
+class CNavSampleWavefront
+{
+public:
+	CNavSampleWavefront( CNavMesh *mesh, const CUtlVector< CNavNode * > &frontier );
 
-				// Don't generate nodes if we spill off the end of the world onto skybox
-				if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
-				{
-					return true;
-				}
+	void Run( void );											// trace all of the steps on the job threads
+	void Merge( CUtlVector< CNavNode * > *newNodes );			// add the results to the graph, in frontier order
 
-				// If we're incrementally generating, don't overlap existing nav areas.
-				Vector testPos( to );
-				bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
-				bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
-				bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
-				bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
-				if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
-				{
-					return true;
-				}
+private:
+	struct Step
+	{
+		CNavNode *from;
+		NavDirType dir;
+		bool canMove;
+		CNavMesh::SampledStep result;
+	};
 
-				int nTolerance = nav_generate_incremental_tolerance.GetInt();
-				if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
-				{
-					bool bValid = false;
-					int zPos = to.z;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						int zMin = seedPos.z - nTolerance;
-						int zMax = seedPos.z + nTolerance;
+	struct Region
+	{
+		int first;												// into m_regionSteps
+		int count;
+	};
 
-						if ( zPos >= zMin && zPos <= zMax )
-						{
-							bValid = true;
-							break;
-						}
-					}
+	void SampleRegion( Region &region );
 
-					if ( !bValid )
-						return true;
-				}
+	CNavMesh *m_mesh;
+	CUtlVector< Step > m_steps;
+	CUtlVector< int > m_regionSteps;							// indices into m_steps, sorted by region
+	CUtlVector< Region > m_regions;
+};
 
+//--------------------------------------------------------------------------------------------------------------
+struct NavSampleRegionKey
+{
+	int64 region;
+	int step;
+};
 
-				bool isOnDisplacement = result.IsDispSurface();
+static int __cdecl CompareNavSampleRegionKeys( const NavSampleRegionKey *lhs, const NavSampleRegionKey *rhs )
+{
+	if ( lhs->region != rhs->region )
+		return ( lhs->region < rhs->region ) ? -1 : 1;
 
-				if ( nav_displacement_test.GetInt() > 0 )
-				{
-					// Test for nodes under displacement surfaces.
-					// This happens during development, and is a pain because the space underneath a displacement
-					// is not 'solid'.
-					Vector start = to + Vector( 0, 0, 0 );
-					Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
-					UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-
-					if ( result.fraction > 0 )
-					{
-						end = start;
-						start = result.endpos;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-						if ( result.fraction < 1 )
-						{
-							// if we made it down to within StepHeight, maybe we're on a static prop
-							if ( result.endpos.z > to.z + StepHeight )
-							{
-								return true;
-							}
-						}
-					}
-				}
+	return lhs->step - rhs->step;
+}
 
-				float deltaZ = to.z - m_currentNode->GetPosition()->z;
-				// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
-				// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
-				// and distances
-				if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
-				{
-					obstacleHeight = 0;
-					obstacleStartDist = 0;
-					obstacleEndDist = GenerationStepSize;
-				}
+//--------------------------------------------------------------------------------------------------------------
+CNavSampleWavefront::CNavSampleWavefront( CNavMesh *mesh, const CUtlVector< CNavNode * > &frontier )
+{
+	m_mesh = mesh;
 
-				// we can move here
-				// create a new navigation node, and update current node pointer
-				AddNode( to, toNormal, m_generationDir, m_currentNode, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist );
+	const float regionSize = MAX( nav_generate_parallel_region_size.GetInt(), 1 ) * GenerationStepSize;
 
-				return true;
-			}
+	CUtlVector< NavSampleRegionKey > keys;
+
+	FOR_EACH_VEC( frontier, it )
+	{
+		CNavNode *node = frontier[ it ];
+
+		int64 regionX = (int64)floor( node->GetPosition()->x / regionSize );
+		int64 regionY = (int64)floor( node->GetPosition()->y / regionSize );
+
+		for( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
+		{
+			if ( node->HasVisited( (NavDirType)dir ) )
+				continue;
+
+			// mark direction as visited
+			node->MarkAsVisited( (NavDirType)dir );
+
+			Step &step = m_steps[ m_steps.AddToTail() ];
+			step.from = node;
+			step.dir = (NavDirType)dir;
+			step.canMove = false;
+
+			NavSampleRegionKey &key = keys[ keys.AddToTail() ];
+			key.region = ( regionX << 32 ) ^ ( regionY & 0xffffffff );
+			key.step = m_steps.Count() - 1;
 		}
+	}
 
-		// all directions have been searched from this node - pop back to its parent and continue
-		m_currentNode = m_currentNode->GetParent();
+	keys.Sort( CompareNavSampleRegionKeys );
+
+	m_regionSteps.EnsureCapacity( keys.Count() );
+	FOR_EACH_VEC( keys, kit )
+	{
+		if ( kit == 0 || keys[ kit ].region != keys[ kit-1 ].region )
+		{
+			Region &region = m_regions[ m_regions.AddToTail() ];
+			region.first = kit;
+			region.count = 0;
+		}
+
+		m_regionSteps.AddToTail( keys[ kit ].step );
+		++m_regions.Tail().count;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSampleWavefront::SampleRegion( Region &region )
+{
+	for( int i=0; i<region.count; ++i )
+	{
+		Step &step = m_steps[ m_regionSteps[ region.first + i ] ];
+		step.canMove = m_mesh->TestSampleStep( *step.from->GetPosition(), step.dir, &step.result );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSampleWavefront::Run( void )
+{
+	if ( m_regions.Count() == 1 )
+	{
+		// not worth waking the thread pool
+		SampleRegion( m_regions[0] );
+		return;
+	}
+
+	ParallelProcess( "CNavMesh::SampleWavefront", m_regions.Base(), m_regions.Count(), this, &CNavSampleWavefront::SampleRegion );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+static int __cdecl CompareNavNodePointers( CNavNode * const *lhs, CNavNode * const *rhs )
+{
+	if ( *lhs == *rhs )
+		return 0;
+
+	return ( *lhs < *rhs ) ? -1 : 1;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Connect the nodes we stepped to, in the order the steps were taken, so the graph
+ * doesn't depend on which job finished first. Then classify every node reached,
+ * which only touches the node itself and can go wide again.
+ */
+void CNavSampleWavefront::Merge( CUtlVector< CNavNode * > *newNodes )
+{
+	CUtlVector< CNavNode * > reached;
+
+	FOR_EACH_VEC( m_steps, it )
+	{
+		const Step &step = m_steps[ it ];
+		if ( !step.canMove )
+			continue;
+
+		bool isNew;
+		CNavNode *node = m_mesh->ConnectNode( step.result.to, step.result.toNormal, step.dir, step.from, step.result.isOnDisplacement,
+											  step.result.obstacleHeight, step.result.obstacleStartDist, step.result.obstacleEndDist, &isNew );
+		if ( isNew )
+		{
+			newNodes->AddToTail( node );
+		}
+
+		reached.AddToTail( node );
+	}
+
+	// a node can be reached from several sides, but must only be classified by one job
+	reached.Sort( CompareNavNodePointers );
+
+	int uniqueCount = 0;
+	FOR_EACH_VEC( reached, rit )
+	{
+		if ( uniqueCount == 0 || reached[ uniqueCount-1 ] != reached[ rit ] )
+		{
+			reached[ uniqueCount++ ] = reached[ rit ];
+		}
 	}
+	reached.SetCountNonDestructively( uniqueCount );
+
+	ParallelProcess( "CNavMesh::ClassifyNode", reached.Base(), reached.Count(), &CNavMesh::ClassifyNodeJob );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Parallel version of SampleStep(). Instead of a depth-first walk, the search
+ * proceeds in wavefronts: every node found by the last wavefront steps in each
+ * direction it hasn't searched, with the traces run on the job threads.
+ *
+ * Returns true if sampling needs to continue, or false if done.
+ */
+bool CNavMesh::SampleWavefront( void )
+{
+	if ( m_sampleFrontier.Count() == 0 )
+	{
+		// sampling is complete from current seed, try next one
+		CNavNode *node = GetNextSampleStartNode();
+		if ( node == NULL )
+		{
+			// all seeds exhausted, sampling complete
+			return false;
+		}
+
+		m_sampleFrontier.AddToTail( node );
+	}
+
+	CNavSampleWavefront wavefront( this, m_sampleFrontier );
+	m_sampleFrontier.RemoveAll();
+
+	wavefront.Run();
+	wavefront.Merge( &m_sampleFrontier );
+
+	return true;
 }
 
 
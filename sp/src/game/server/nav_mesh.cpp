@@ -62,6 +62,7 @@ CNavMesh::CNavMesh( void )
 	m_gridCellSize = 300.0f;
 	m_editMode = NORMAL;
 	m_bQuitWhenFinished = false;
+	m_isHeadlessGeneration = false;
 	m_hostThreadModeRestoreValue = 0;
 	m_placeCount = 0;
 	m_placeName = NULL;
@@ -105,6 +106,7 @@ void CNavMesh::Reset( void )
 
 	m_isAnalyzed = false;
 	m_isOutOfDate = false;
+	m_isFlatFileLoaded = false;
 	m_isEditing = false;
 	m_navPlace = UNDEFINED_PLACE;
 	m_markedArea = NULL;
@@ -156,6 +158,8 @@ CNavArea *CNavMesh::GetMarkedArea( void ) const
  */
 void CNavMesh::DestroyNavigationMesh( bool incremental )
 {
+	m_areaLookup.Clear();
+
 	m_blockedAreas.RemoveAll();
 	m_avoidanceObstacleAreas.RemoveAll();
 	m_transientAreas.RemoveAll();
@@ -252,7 +256,8 @@ void CNavMesh::Update( void )
 
 	if (IsGenerating())
 	{
-		UpdateGeneration( 0.03 );
+		// headless generation has nobody to stay responsive for
+		UpdateGeneration( m_isHeadlessGeneration ? FLT_MAX : 0.03 );
 		return; // don't bother trying to draw stuff while we're generating
 	}
 
@@ -285,6 +290,8 @@ void CNavMesh::Update( void )
 		}
 	}
 
+	UpdateAreaLookup();
+
 	if (nav_show_danger.GetBool())
 	{
 		DrawDanger();
@@ -353,6 +360,26 @@ void CNavMesh::Update( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Build the area index if it is out of date and the mesh is holding still
+ */
+void CNavMesh::UpdateAreaLookup( void )
+{
+	// areas can be reshaped at any moment while editing, so scan the grid until we're done
+	if ( m_isEditing || IsGenerating() )
+	{
+		m_areaLookup.Clear();
+		return;
+	}
+
+	if ( !m_areaLookup.IsBuilt() && TheNavAreas.Count() )
+	{
+		m_areaLookup.Build( TheNavAreas );
+	}
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Check all nav areas inside the breakable's extent to see if players would now fall through
@@ -470,6 +497,9 @@ void CNavMesh::AddNavArea( CNavArea *area )
 		AllocateGrid( 0, 0, 0, 0 );
 	}
 
+	// the area index is rebuilt once the mesh settles down
+	m_areaLookup.Clear();
+
 	// add to grid
 	int loX = WorldToGridX( area->GetCorner( NORTH_WEST ).x );
 	int loY = WorldToGridY( area->GetCorner( NORTH_WEST ).y );
@@ -517,6 +547,9 @@ void CNavMesh::AddNavArea( CNavArea *area )
  */
 void CNavMesh::RemoveNavArea( CNavArea *area )
 {
+	// the area index must not hold on to areas that are going away
+	m_areaLookup.Clear();
+
 	// add to grid
 	int loX = WorldToGridX( area->GetCorner( NORTH_WEST ).x );
 	int loY = WorldToGridY( area->GetCorner( NORTH_WEST ).y );
@@ -692,6 +725,24 @@ CNavArea *CNavMesh::GetNavArea( const Vector &pos, float beneathLimit ) const
 	if ( !m_grid.Count() )
 		return NULL;
 
+	// skip areas above us, or too far below us
+	float maxZ = pos.z + 5.0f;
+	float minZ = pos.z - beneathLimit;
+
+	if ( IsAreaLookupActive() )
+		return m_areaLookup.GetNavArea( pos, minZ, maxZ );
+
+	return ScanGridForNavArea( pos, minZ, maxZ, false, TEAM_ANY, NULL );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the highest area in the grid cell holding 'pos' whose Z at 'pos' is within [minZ, maxZ].
+ * This is the slow way to get what the area index gives us, for when the index is out of date.
+ */
+CNavArea *CNavMesh::ScanGridForNavArea( const Vector &pos, float minZ, float maxZ, bool skipBlocked, int team, float *areaZ ) const
+{
 	// get list in cell that contains position
 	int x = WorldToGridX( pos.x );
 	int y = WorldToGridY( pos.y );
@@ -700,39 +751,60 @@ CNavArea *CNavMesh::GetNavArea( const Vector &pos, float beneathLimit ) const
 	// search cell list to find correct area
 	CNavArea *use = NULL;
 	float useZ = -99999999.9f;
-	Vector testPos = pos + Vector( 0, 0, 5 );
 
 	FOR_EACH_VEC( (*areaVector), it )
 	{
 		CNavArea *area = (*areaVector)[ it ];
 
 		// check if position is within 2D boundaries of this area
-		if (area->IsOverlapping( testPos ))
-		{
-			// project position onto area to get Z
-			float z = area->GetZ( testPos );
+		if ( !area->IsOverlapping( pos ) )
+			continue;
 
-			// if area is above us, skip it
-			if (z > testPos.z)
-				continue;
+		// don't consider blocked areas
+		if ( skipBlocked && area->IsBlocked( team ) )
+			continue;
 
-			// if area is too far below us, skip it
-			if (z < pos.z - beneathLimit)
-				continue;
+		// project position onto area to get Z
+		float z = area->GetZ( pos );
 
-			// if area is higher than the one we have, use this instead
-			if (z > useZ)
-			{
-				use = area;
-				useZ = z;
-			}
-		}
+		// if area is above us, skip it
+		if ( z > maxZ )
+			continue;
+
+		// if area is too far below us, skip it
+		if ( z < minZ )
+			continue;
+
+		// if area is lower than the one we have, skip it
+		if ( z <= useZ )
+			continue;
+
+		use = area;
+		useZ = z;
+	}
+
+	if ( areaZ )
+	{
+		*areaZ = useZ;
 	}
 
 	return use;
 }
 
 
+//----------------------------------------------------------------------------
+// Return true if 'pos' is on 'area', give or take a step
+//----------------------------------------------------------------------------
+static bool IsStandingOnNavArea( const CNavArea *pArea, const Vector &pos )
+{
+	if ( !pArea->IsOverlapping( pos ) )
+		return false;
+
+	float flZ = pArea->GetZ( pos );
+	return ( flZ <= pos.z + StepHeight ) && ( flZ >= pos.z - StepHeight );
+}
+
+
 //----------------------------------------------------------------------------
 // Given a position, return the nav area that IsOverlapping and is *immediately* beneath it
 //----------------------------------------------------------------------------
@@ -744,61 +816,48 @@ CNavArea *CNavMesh::GetNavArea( CBaseEntity *pEntity, int nFlags, float flBeneat
 		return NULL;
 
 	Vector testPos = pEntity->GetAbsOrigin();
+	bool bSkipBlockedAreas = ( ( nFlags & GETNAVAREA_ALLOW_BLOCKED_AREAS ) == 0 );
 
 	float flStepHeight = 1e-3;
 	CBaseCombatCharacter *pBCC = pEntity->MyCombatCharacterPointer();
 	if ( pBCC )
 	{
-		// Check if we're still in the last area
 		CNavArea *pLastNavArea = pBCC->GetLastKnownArea();
-		if ( pLastNavArea && pLastNavArea->IsOverlapping( testPos ) )
+		if ( pLastNavArea )
 		{
-			float flZ = pLastNavArea->GetZ( testPos );
-			if ( ( flZ <= testPos.z + StepHeight ) && ( flZ >= testPos.z - StepHeight ) )
+			// Check if we're still in the last area
+			if ( IsStandingOnNavArea( pLastNavArea, testPos ) )
 				return pLastNavArea;
+
+			// If not, we've most likely walked into one next to it
+			for ( int dir = 0; dir < NUM_DIRECTIONS; dir++ )
+			{
+				const NavConnectVector *pAdjacent = pLastNavArea->GetAdjacentAreas( (NavDirType)dir );
+				FOR_EACH_VEC( (*pAdjacent), it )
+				{
+					CNavArea *pAdjacentArea = (*pAdjacent)[ it ].area;
+
+					if ( bSkipBlockedAreas && pAdjacentArea->IsBlocked( pEntity->GetTeamNumber() ) )
+						continue;
+
+					if ( IsStandingOnNavArea( pAdjacentArea, testPos ) )
+						return pAdjacentArea;
+				}
+			}
 		}
 		flStepHeight = StepHeight;
 	}
 
-	// get list in cell that contains position
-	int x = WorldToGridX( testPos.x );
-	int y = WorldToGridY( testPos.y );
-	NavAreaVector *areaVector = &m_grid[ x + y*m_gridSizeX ];
-
-	// search cell list to find correct area
-	CNavArea *use = NULL;
-	float useZ = -99999999.9f;
-
-	bool bSkipBlockedAreas = ( ( nFlags & GETNAVAREA_ALLOW_BLOCKED_AREAS ) == 0 );
-	FOR_EACH_VEC( (*areaVector), it )
+	// find the highest area that isn't above us or too far below us
+	CNavArea *use;
+	float useZ;
+	if ( IsAreaLookupActive() )
 	{
-		CNavArea *pArea = (*areaVector)[ it ];
-
-		// check if position is within 2D boundaries of this area
-		if ( !pArea->IsOverlapping( testPos ) )
-			continue;
-
-		// don't consider blocked areas
-		if ( bSkipBlockedAreas && pArea->IsBlocked( pEntity->GetTeamNumber() ) )
-			continue;
-
-		// project position onto area to get Z
-		float z = pArea->GetZ( testPos );
-
-		// if area is above us, skip it
-		if ( z > testPos.z + flStepHeight )
-			continue;
-
-		// if area is too far below us, skip it
-		if ( z < testPos.z - flBeneathLimit )
-			continue;
-
-		// if area is lower than the one we have, skip it
-		if ( z <= useZ )
-			continue;
-
-		use = pArea;
-		useZ = z;
+		use = m_areaLookup.GetNavArea( testPos, testPos.z - flBeneathLimit, testPos.z + flStepHeight, bSkipBlockedAreas, pEntity->GetTeamNumber(), &useZ );
+	}
+	else
+	{
+		use = ScanGridForNavArea( testPos, testPos.z - flBeneathLimit, testPos.z + flStepHeight, bSkipBlockedAreas, pEntity->GetTeamNumber(), &useZ );
 	}
 
 	// Check LOS if necessary
@@ -814,6 +873,90 @@ CNavArea *CNavMesh::GetNavArea( CBaseEntity *pEntity, int nFlags, float flBeneat
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Decides which of the areas GetNearestNavArea() comes across it may return
+ */
+class NearestNavAreaFilter
+{
+public:
+	NearestNavAreaFilter( const Vector &pos, bool checkLOS, int team ) : m_pos( pos ), m_checkLOS( checkLOS ), m_team( team )
+	{
+		m_hasSafePos = false;
+	}
+
+	bool operator() ( CNavArea *area, const Vector &areaPos )
+	{
+		// don't consider blocked areas
+		if ( area->IsBlocked( m_team ) )
+			return false;
+
+		// check LOS to area
+		// REMOVED: If we do this for !anyZ, it's likely we wont have LOS and will enumerate every area in the mesh
+		// It is still good to do this in some isolated cases, however
+		if ( m_checkLOS )
+		{
+			trace_t result;
+			const Vector &safePos = GetSafePos();
+
+			// Don't bother tracing from the nav area up to safePos.z if it's within StepHeight of the area, since areas can be embedded in the ground a bit
+			float heightDelta = fabs(areaPos.z - safePos.z);
+			if ( heightDelta > StepHeight )
+			{
+				// trace to the height of the original point
+				UTIL_TraceLine( areaPos + Vector( 0, 0, StepHeight ), Vector( areaPos.x, areaPos.y, safePos.z ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
+				
+				if ( result.fraction != 1.0f )
+				{
+					return false;
+				}
+			}
+
+			// trace to the original point's height above the area
+			UTIL_TraceLine( safePos, Vector( areaPos.x, areaPos.y, safePos.z + StepHeight ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
+
+			if ( result.fraction != 1.0f )
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+private:
+	// 'pos', moved out of the world if it is embedded in it
+	const Vector &GetSafePos( void )
+	{
+		if ( !m_hasSafePos )
+		{
+			trace_t result;
+			UTIL_TraceLine( m_pos, m_pos + Vector( 0, 0, StepHeight ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
+			if ( result.startsolid )
+			{
+				// it was embedded - move it out
+				m_safePos = result.endpos + Vector( 0, 0, 1.0f );
+			}
+			else
+			{
+				m_safePos = m_pos;
+			}
+
+			m_hasSafePos = true;
+		}
+
+		return m_safePos;
+	}
+
+	const Vector &m_pos;
+	bool m_checkLOS;
+	int m_team;
+
+	bool m_hasSafePos;
+	Vector m_safePos;
+};
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Given a position in the world, return the nav area that is closest
@@ -828,13 +971,10 @@ CNavArea *CNavMesh::GetNearestNavArea( const Vector &pos, bool anyZ, float maxDi
 	if ( !m_grid.Count() )
 		return NULL;	
 
-	CNavArea *close = NULL;
-	float closeDistSq = maxDist * maxDist;
-
 	// quick check
 	if ( !checkLOS && !checkGround )
 	{
-		close = GetNavArea( pos );
+		CNavArea *close = GetNavArea( pos );
 		if ( close )
 		{
 			return close;
@@ -859,6 +999,27 @@ CNavArea *CNavMesh::GetNearestNavArea( const Vector &pos, bool anyZ, float maxDi
 
 	source.z += HalfHumanHeight;
 
+	NearestNavAreaFilter filter( pos, checkLOS, team );
+
+	// the area index finds the true closest area, and without touching the areas' search markers
+	if ( IsAreaLookupActive() )
+	{
+		return m_areaLookup.GetNearestNavArea( pos, source, maxDist, filter );
+	}
+
+	return ScanGridForNearestNavArea( pos, source, maxDist, filter );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * GetNearestNavArea() without the area index
+ */
+CNavArea *CNavMesh::ScanGridForNearestNavArea( const Vector &pos, const Vector &source, float maxDist, NearestNavAreaFilter &filter ) const
+{
+	CNavArea *close = NULL;
+	float closeDistSq = maxDist * maxDist;
+
 	// find closest nav area
 
 	// use a unique marker for this method, so it can be used within a SearchSurroundingArea() call
@@ -915,10 +1076,6 @@ CNavArea *CNavMesh::GetNearestNavArea( const Vector &pos, bool anyZ, float maxDi
 					if ( area->m_nearNavSearchMarker == searchMarker )
 						continue;
 
-					// don't consider blocked areas
-					if ( area->IsBlocked( team ) )
-						continue;
-
 					// mark as visited
 					area->m_nearNavSearchMarker = searchMarker;
 
@@ -934,48 +1091,8 @@ CNavArea *CNavMesh::GetNearestNavArea( const Vector &pos, bool anyZ, float maxDi
 					if ( distSq >= closeDistSq )
 						continue;
 
-					// check LOS to area
-					// REMOVED: If we do this for !anyZ, it's likely we wont have LOS and will enumerate every area in the mesh
-					// It is still good to do this in some isolated cases, however
-					if ( checkLOS )
-					{
-						trace_t result;
-
-						// make sure 'pos' is not embedded in the world
-						Vector safePos;
-
-						UTIL_TraceLine( pos, pos + Vector( 0, 0, StepHeight ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
-						if ( result.startsolid )
-						{
-							// it was embedded - move it out
-							safePos = result.endpos + Vector( 0, 0, 1.0f );
-						}
-						else
-						{
-							safePos = pos;
-						}
-
-						// Don't bother tracing from the nav area up to safePos.z if it's within StepHeight of the area, since areas can be embedded in the ground a bit
-						float heightDelta = fabs(areaPos.z - safePos.z);
-						if ( heightDelta > StepHeight )
-						{
-							// trace to the height of the original point
-							UTIL_TraceLine( areaPos + Vector( 0, 0, StepHeight ), Vector( areaPos.x, areaPos.y, safePos.z ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
-							
-							if ( result.fraction != 1.0f )
-							{
-								continue;
-							}
-						}
-
-						// trace to the original point's height above the area
-						UTIL_TraceLine( safePos, Vector( areaPos.x, areaPos.y, safePos.z + StepHeight ), MASK_NPCSOLID_BRUSHONLY, NULL, COLLISION_GROUP_NONE, &result );
-
-						if ( result.fraction != 1.0f )
-						{
-							continue;
-						}
-					}
+					if ( !filter( area, areaPos ) )
+						continue;
 
 					closeDistSq = distSq;
 					close = area;
@@ -2605,6 +2722,179 @@ void CommandNavGenerateIncremental( void )
 static ConCommand nav_generate_incremental( "nav_generate_incremental", CommandNavGenerateIncremental, "Generate a Navigation Mesh for the current map and save it to disk.", FCVAR_GAMEDLL | FCVAR_CHEAT );
 
 
+//--------------------------------------------------------------------------------------------------------------
+void CommandNavGenerateHeadless( void )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNavMesh->BeginGeneration( false, true );
+}
+static ConCommand nav_generate_headless( "nav_generate_headless", CommandNavGenerateHeadless, "Generate a Navigation Mesh for the current map as fast as possible, save it to disk, and quit. For batch builds on a dedicated server.", FCVAR_GAMEDLL | FCVAR_CHEAT );
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Time area lookups over a sweep of positions with and without the area index, and check they agree
+ */
+void CNavMesh::CommandNavBenchAreaLookup( const CCommand &args )
+{
+	if ( TheNavAreas.Count() == 0 )
+	{
+		Msg( "No Navigation Mesh loaded.\n" );
+		return;
+	}
+
+	if ( m_isEditing || IsGenerating() )
+	{
+		Msg( "The area index is not used while editing or generating.\n" );
+		return;
+	}
+
+	UpdateAreaLookup();
+
+	int sweepSize = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 64;
+	sweepSize = clamp( sweepSize, 1, 1024 );
+
+	// positions on a regular grid over the whole mesh at a few heights, plus just above every area
+	Extent extent;
+	TheNavAreas[0]->GetExtent( &extent );
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		Extent areaExtent;
+		TheNavAreas[ it ]->GetExtent( &areaExtent );
+		extent.Encompass( areaExtent );
+	}
+
+	const int heightCount = 4;
+	CUtlVector< Vector > positions;
+	positions.EnsureCapacity( sweepSize * sweepSize * heightCount + TheNavAreas.Count() );
+
+	for( int y=0; y<sweepSize; ++y )
+	{
+		for( int x=0; x<sweepSize; ++x )
+		{
+			for( int h=0; h<heightCount; ++h )
+			{
+				Vector pos;
+				pos.x = extent.lo.x + extent.SizeX() * ( x + 0.5f ) / sweepSize;
+				pos.y = extent.lo.y + extent.SizeY() * ( y + 0.5f ) / sweepSize;
+				pos.z = extent.lo.z + extent.SizeZ() * ( h + 0.5f ) / heightCount;
+				positions.AddToTail( pos );
+			}
+		}
+	}
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		positions.AddToTail( TheNavAreas[ it ]->GetCenter() + Vector( 0, 0, HalfHumanHeight ) );
+	}
+
+	CUtlVector< CNavArea * > gridResult;
+	CUtlVector< CNavArea * > lookupResult;
+	gridResult.SetCount( positions.Count() );
+	lookupResult.SetCount( positions.Count() );
+
+	// GetNavArea()
+	double startTime = Plat_FloatTime();
+	FOR_EACH_VEC( positions, it )
+	{
+		const Vector &pos = positions[ it ];
+		gridResult[ it ] = ScanGridForNavArea( pos, pos.z - 120.0f, pos.z + 5.0f, false, TEAM_ANY, NULL );
+	}
+	double gridTime = Plat_FloatTime() - startTime;
+
+	startTime = Plat_FloatTime();
+	FOR_EACH_VEC( positions, it )
+	{
+		const Vector &pos = positions[ it ];
+		lookupResult[ it ] = m_areaLookup.GetNavArea( pos, pos.z - 120.0f, pos.z + 5.0f );
+	}
+	double lookupTime = Plat_FloatTime() - startTime;
+
+	int differ = 0;
+	FOR_EACH_VEC( positions, it )
+	{
+		if ( gridResult[ it ] != lookupResult[ it ] )
+		{
+			++differ;
+		}
+	}
+
+	Msg( "GetNavArea: %d positions, grid %.3f ms, index %.3f ms (%.1fx), %d differ\n",
+		positions.Count(), gridTime * 1000.0, lookupTime * 1000.0, ( lookupTime > 0.0 ) ? gridTime / lookupTime : 0.0, differ );
+
+	// GetNearestNavArea(), just the search, since the ground trace before it costs the same either way
+	CUtlVector< Vector > sources;
+	sources.SetCount( positions.Count() );
+	FOR_EACH_VEC( positions, it )
+	{
+		sources[ it ] = positions[ it ];
+		if ( !GetGroundHeight( positions[ it ], &sources[ it ].z ) )
+		{
+			sources[ it ].z = positions[ it ].z;
+		}
+		sources[ it ].z += HalfHumanHeight;
+	}
+
+	startTime = Plat_FloatTime();
+	FOR_EACH_VEC( positions, it )
+	{
+		NearestNavAreaFilter filter( positions[ it ], false, TEAM_ANY );
+		gridResult[ it ] = ScanGridForNearestNavArea( positions[ it ], sources[ it ], 10000.0f, filter );
+	}
+	gridTime = Plat_FloatTime() - startTime;
+
+	startTime = Plat_FloatTime();
+	FOR_EACH_VEC( positions, it )
+	{
+		NearestNavAreaFilter filter( positions[ it ], false, TEAM_ANY );
+		lookupResult[ it ] = m_areaLookup.GetNearestNavArea( positions[ it ], sources[ it ], 10000.0f, filter );
+	}
+	lookupTime = Plat_FloatTime() - startTime;
+
+	// the grid search gives up one ring after its first hit, so it can miss a closer area the index finds
+	differ = 0;
+	int closer = 0;
+	FOR_EACH_VEC( positions, it )
+	{
+		if ( gridResult[ it ] == lookupResult[ it ] )
+			continue;
+
+		++differ;
+
+		if ( gridResult[ it ] && lookupResult[ it ] )
+		{
+			Vector gridPos, lookupPos;
+			gridResult[ it ]->GetClosestPointOnArea( positions[ it ], &gridPos );
+			lookupResult[ it ]->GetClosestPointOnArea( positions[ it ], &lookupPos );
+
+			if ( ( lookupPos - positions[ it ] ).LengthSqr() < ( gridPos - positions[ it ] ).LengthSqr() )
+			{
+				++closer;
+			}
+		}
+	}
+
+	Msg( "GetNearestNavArea: %d positions, grid %.3f ms, index %.3f ms (%.1fx), %d differ (%d closer with the index)\n",
+		positions.Count(), gridTime * 1000.0, lookupTime * 1000.0, ( lookupTime > 0.0 ) ? gridTime / lookupTime : 0.0, differ, closer );
+
+	Msg( "Area index: %d cells of %d units, %d blocks (%d KB)\n",
+		m_areaLookup.GetCellCount(), (int)CNavAreaLookup::CELL_SIZE, m_areaLookup.GetBlockCount(),
+		(int)( ( m_areaLookup.GetCellCount() * sizeof( NavAreaLookupCell_t ) + m_areaLookup.GetBlockCount() * sizeof( NavAreaLookupBlock_t ) ) / 1024 ) );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_bench_area_lookup, "Time nav area lookups over a sweep of positions with and without the area index. Optional argument: positions along each side of the sweep (default 64).", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNavMesh->CommandNavBenchAreaLookup( args );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 void CommandNavAnalyze( void )
 {
@@ -25,17 +25,20 @@
 
 #include "nav.h"
 #include "nav_area.h"
+#include "nav_arealookup.h"
 #include "nav_colors.h"
 
 
 class CNavArea;
 class CBaseEntity; 
 class CBreakable;
+class NearestNavAreaFilter;
 
 extern ConVar nav_edit;
 extern ConVar nav_quicksave;
 extern ConVar nav_show_approach_points;
 extern ConVar nav_show_danger;
+extern ConVar nav_area_lookup;
 
 //--------------------------------------------------------------------------------------------------------
 class NavAreaCollector
@@ -292,6 +295,8 @@ public:
 	virtual void LoadCustomData( CUtlBuffer &fileBuffer, unsigned int subVersion ) { }			// load custom mesh data for derived classes
 	virtual void SaveCustomDataPreArea( CUtlBuffer &fileBuffer ) const { }						// store custom mesh data for derived classes that needs to be loaded before areas are read in
 	virtual void LoadCustomDataPreArea( CUtlBuffer &fileBuffer, unsigned int subVersion ) { }	// load custom mesh data for derived classes that needs to be loaded before areas are read in
+	virtual bool IsFlatFileSupported( void ) const { return true; }							// return false if derived areas store more than CNavArea does, so they must load from the .nav file
+	bool IsFlatFileLoaded( void ) const	{ return m_isFlatFileLoaded; }							// return true if the current mesh was loaded from the flat nav file
 
 	// events
 	virtual void OnServerActivate( void );								// (EXTEND) invoked when server loads a new map
@@ -347,7 +352,7 @@ public:
 	// Auto-generation
 	//
 	#define INCREMENTAL_GENERATION true
-	void BeginGeneration( bool incremental = false );					// initiate the generation process
+	void BeginGeneration( bool incremental = false, bool headless = false );	// initiate the generation process. 'headless' runs it without time slicing, then quits
 	void BeginAnalysis( bool quitWhenFinished = false );						// re-analyze an existing Mesh.  Determine Hiding Spots, Encounter Spots, etc.
 
 	bool IsGenerating( void ) const		{ return m_generationMode != GENERATE_NONE; }	// return true while a Navigation Mesh is being generated
@@ -439,6 +444,7 @@ public:
 	void CommandNavSaveSelected( const CCommand &args );				// Save selected set to disk
 	void CommandNavMergeMesh( const CCommand &args );					// Merge a saved selected set into the current mesh
 	void CommandNavMarkWalkable( void );
+	void CommandNavBenchAreaLookup( const CCommand &args );				// time area lookups with and without the area index
 
 	void AddToDragSelectionSet( CNavArea *pArea );
 	void RemoveFromDragSelectionSet( CNavArea *pArea );
@@ -1063,6 +1069,7 @@ private:
 	friend class CNavArea;
 	friend class CNavNode;
 	friend class CNavUIBasePanel;
+	friend class CNavSampleWavefront;
 
 	mutable CUtlVector<NavAreaVector> m_grid;
 	float m_gridCellSize;										// the width/height of a grid cell for spatially partitioning nav areas for fast access
@@ -1075,6 +1082,10 @@ private:
 	bool m_isLoaded;											// true if a Navigation Mesh has been loaded
 	bool m_isOutOfDate;											// true if the Navigation Mesh is older than the actual BSP
 	bool m_isAnalyzed;											// true if the Navigation Mesh needs analysis
+	bool m_isFlatFileLoaded;									// true if the Navigation Mesh was loaded from the flat nav file
+
+	NavErrorType LoadFlatFile( const char *navFilename );		// load the mesh from the flat companion of the given .nav file, if it is up to date
+	bool SaveFlatFile( const char *navFilename ) const;			// write the flat companion of the given .nav file
 
 	enum { HASH_TABLE_SIZE = 256 };
 	CNavArea *m_hashTable[ HASH_TABLE_SIZE ];					// hash table to optimize lookup by ID
@@ -1087,6 +1098,12 @@ private:
 
 	void AddNavArea( CNavArea *area );							// add an area to the grid
 
+	CNavAreaLookup m_areaLookup;								// finer index of the areas, built only while the mesh holds still
+	bool IsAreaLookupActive( void ) const;						// true if queries can use m_areaLookup
+	void UpdateAreaLookup( void );								// rebuild m_areaLookup if the mesh has changed
+	CNavArea *ScanGridForNavArea( const Vector &pos, float minZ, float maxZ, bool skipBlocked, int team, float *areaZ ) const;	// GetNavArea() without the area index
+	CNavArea *ScanGridForNearestNavArea( const Vector &pos, const Vector &source, float maxDist, NearestNavAreaFilter &filter ) const;	// GetNearestNavArea() without the area index
+
 	void DestroyNavigationMesh( bool incremental = false );		// free all resources of the mesh and reset it to empty state
 	void DestroyHidingSpots( void );
 
@@ -1150,6 +1167,7 @@ private:
 	// Auto-generation
 	//
 	bool UpdateGeneration( float maxTime = 0.25f );				// process the auto-generation for 'maxTime' seconds. return false if generation is complete.
+	bool UpdateGenerationPhase( float maxTime );				// UpdateGeneration() without the phase timing
 
 	virtual void BeginCustomAnalysis( bool bIncremental ) {}
 	virtual void EndCustomAnalysis() {}
@@ -1163,6 +1181,22 @@ private:
 	void DestroyLadders( void );
 
 	bool SampleStep( void );									// sample the walkable areas of the map
+	bool SampleWavefront( void );								// sample one step from every node found by the previous call, on the job threads
+	CUtlVector< CNavNode * > m_sampleFrontier;					// nodes SampleWavefront() will step from next
+
+	struct SampledStep
+	{
+		Vector to;
+		Vector toNormal;
+		bool isOnDisplacement;
+		float obstacleHeight;
+		float obstacleStartDist;
+		float obstacleEndDist;
+	};
+	bool TestSampleStep( const Vector &from, NavDirType dir, SampledStep *step ) const;	// can we step from 'from' to the adjacent grid point in 'dir'? Safe to call from any thread
+	CNavNode *ConnectNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist, bool *isNew );	// the graph half of AddNode()
+	static void ClassifyNode( CNavNode *node );					// set crouch and cliff attributes from the space around the node. Only touches the node, so safe to call from any thread
+	static void ClassifyNodeJob( CNavNode *&node )				{ ClassifyNode( node ); }
 	void CreateNavAreasFromNodes( void );						// cover all of the sampled nodes with nav areas
 
 	bool TestArea( CNavNode *node, int width, int height );		// check if an area of size (width, height) can fit, starting from node as upper left corner
@@ -1218,7 +1252,9 @@ private:
 	int m_generationIndex;										// used for iterating nav areas during generation process
 	int m_sampleTick;											// counter for displaying pseudo-progress while sampling walkable space
 	bool m_bQuitWhenFinished;
+	bool m_isHeadlessGeneration;								// run each phase to completion without yielding to the frame
 	float m_generationStartTime;
+	float m_generationPhaseTime[ NUM_GENERATION_STATES ];		// seconds spent working on each phase
 	Extent m_simplifyGenerationExtent;
 
 	char *m_spawnName;											// name of player spawn entity, used to initiate sampling
@@ -1231,6 +1267,7 @@ private:
 	CUtlVector< WalkableSeedSpot > m_walkableSeeds;				// list of walkable seed spots for sampling
 
 	CNavNode *GetNextWalkableSeedNode( void );					// return the next walkable seed as a node
+	CNavNode *GetNextSampleStartNode( void );					// return the next seed, or a node at the end of a ladder, to sample from
 	int m_seedIdx;
 	int m_hostThreadModeRestoreValue;							// stores the value of host_threadmode before we changed it
 
@@ -1300,6 +1337,12 @@ inline int CNavMesh::ComputeHashKey( unsigned int id ) const
 	return id & 0xFF;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+inline bool CNavMesh::IsAreaLookupActive( void ) const
+{
+	return m_areaLookup.IsBuilt() && nav_area_lookup.GetBool();
+}
+
 //--------------------------------------------------------------------------------------------------------------
 inline int CNavMesh::WorldToGridX( float wx ) const
 { 
@@ -0,0 +1,257 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Path search state kept outside the navigation areas
+//
+//=============================================================================//
+// nav_pathfind.cpp
+
+#include "cbase.h"
+#include "nav_mesh.h"
+#include "nav_pathfind.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+CInterlockedInt g_nActiveNavSearchContexts;
+
+static CThreadLocalPtr< CNavSearchContext > s_activeSearchContext;
+
+const NavSearchState_t CNavSearchContext::s_emptyState = { 0, -1, false, NUM_TRAVERSE_TYPES, NULL, 0.0f, 0.0f, 0.0f };
+
+static CThreadFastMutex s_searchContextPoolMutex;
+static CUtlVector< CNavSearchContext * > s_searchContextPool;
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchContext::CNavSearchContext( void )
+{
+	m_marker = 1;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Start a new search. Everything the last one touched becomes stale by changing the marker.
+ */
+void CNavSearchContext::Clear( void )
+{
+	m_openList.RemoveAll();
+
+	if ( (unsigned int)m_state.Count() < CNavArea::GetNextID() )
+	{
+		Grow( CNavArea::GetNextID() );
+	}
+
+	++m_marker;
+	if ( m_marker == 0 )
+	{
+		// wrapped around, forget every old marker so none of them can match again
+		for( int i=0; i<m_state.Count(); ++i )
+		{
+			m_state[i].marker = 0;
+		}
+
+		m_marker = 1;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchContext::Grow( unsigned int count )
+{
+	int oldCount = m_state.Count();
+	m_state.EnsureCount( count );
+
+	for( int i=oldCount; i<m_state.Count(); ++i )
+	{
+		m_state[i] = s_emptyState;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchContext::AddToOpenList( CNavArea *area )
+{
+	NavSearchState_t &state = Touch( area );
+	if ( state.openIndex >= 0 )
+	{
+		// already on list
+		return;
+	}
+
+	state.openIndex = m_openList.AddToTail( area );
+	HeapUp( state.openIndex );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchContext::UpdateOnOpenList( CNavArea *area )
+{
+	// costs only ever go down while on the open list
+	const NavSearchState_t *state = GetState( area );
+	if ( state->openIndex >= 0 )
+	{
+		HeapUp( state->openIndex );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavArea *CNavSearchContext::PopOpenList( void )
+{
+	if ( m_openList.Count() == 0 )
+		return NULL;
+
+	CNavArea *area = m_openList[0];
+	m_state[ area->GetID() ].openIndex = -1;
+
+	CNavArea *last = m_openList.Tail();
+	m_openList.FastRemove( m_openList.Count()-1 );
+
+	if ( m_openList.Count() )
+	{
+		m_openList[0] = last;
+		m_state[ last->GetID() ].openIndex = 0;
+		HeapDown( 0 );
+	}
+
+	return area;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchContext::HeapUp( int index )
+{
+	CNavArea *area = m_openList[ index ];
+	float cost = m_state[ area->GetID() ].totalCost;
+
+	while( index > 0 )
+	{
+		int parent = ( index - 1 ) / 2;
+		CNavArea *parentArea = m_openList[ parent ];
+		if ( m_state[ parentArea->GetID() ].totalCost <= cost )
+			break;
+
+		m_openList[ index ] = parentArea;
+		m_state[ parentArea->GetID() ].openIndex = index;
+		index = parent;
+	}
+
+	m_openList[ index ] = area;
+	m_state[ area->GetID() ].openIndex = index;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchContext::HeapDown( int index )
+{
+	CNavArea *area = m_openList[ index ];
+	float cost = m_state[ area->GetID() ].totalCost;
+	int count = m_openList.Count();
+
+	while( true )
+	{
+		int child = 2 * index + 1;
+		if ( child >= count )
+			break;
+
+		if ( child + 1 < count && m_state[ m_openList[ child+1 ]->GetID() ].totalCost < m_state[ m_openList[ child ]->GetID() ].totalCost )
+		{
+			++child;
+		}
+
+		CNavArea *childArea = m_openList[ child ];
+		if ( m_state[ childArea->GetID() ].totalCost >= cost )
+			break;
+
+		m_openList[ index ] = childArea;
+		m_state[ childArea->GetID() ].openIndex = index;
+		index = child;
+	}
+
+	m_openList[ index ] = area;
+	m_state[ area->GetID() ].openIndex = index;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchContext *CNavSearchContext::GetActive( void )
+{
+	return s_activeSearchContext;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchContext *CNavSearchContext::Alloc( void )
+{
+	AUTO_LOCK( s_searchContextPoolMutex );
+
+	if ( s_searchContextPool.Count() )
+	{
+		CNavSearchContext *context = s_searchContextPool.Tail();
+		s_searchContextPool.FastRemove( s_searchContextPool.Count()-1 );
+		return context;
+	}
+
+	return new CNavSearchContext;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchContext::Free( CNavSearchContext *context )
+{
+	AUTO_LOCK( s_searchContextPoolMutex );
+
+	s_searchContextPool.AddToTail( context );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchContextScope::CNavSearchContextScope( CNavSearchContext *context )
+{
+	m_prevContext = s_activeSearchContext;
+	s_activeSearchContext = context;
+
+	++g_nActiveNavSearchContexts;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchContextScope::~CNavSearchContextScope()
+{
+	s_activeSearchContext = m_prevContext;
+
+	--g_nActiveNavSearchContexts;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The A* state CNavArea's getters should report on this thread, if a context is bound to it
+ */
+const NavSearchState_t *CNavArea::FindActiveSearchState( void ) const
+{
+	CNavSearchContext *context = s_activeSearchContext;
+	return ( context ) ? context->GetState( this ) : NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+int NavSearchBuildPath( const CNavSearchContext &context, CNavArea *endArea, CUtlVector< NavPathStep_t > *path )
+{
+	path->RemoveAll();
+
+	// collect the steps back to the start, then put them in order
+	for( CNavArea *area = endArea; area; area = context.GetParent( area ) )
+	{
+		NavPathStep_t &step = path->Element( path->AddToTail() );
+		step.area = area;
+		step.how = context.GetParentHow( area );
+
+		if ( (unsigned int)path->Count() > TheNavMesh->GetNavAreaCount() )
+		{
+			// bogus parent loop
+			Assert( false );
+			break;
+		}
+	}
+
+	for( int i=0, j=path->Count()-1; i<j; ++i, --j )
+	{
+		NavPathStep_t step = path->Element( i );
+		path->Element( i ) = path->Element( j );
+		path->Element( j ) = step;
+	}
+
+	return path->Count();
+}
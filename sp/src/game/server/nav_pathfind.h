@@ -14,6 +14,7 @@
 
 #include "tier0/vprof.h"
 #include "mathlib/ssemath.h"
+#include "vstdlib/jobthread.h"
 #include "nav_area.h"
 
 extern int g_DebugPathfindCounter;
@@ -85,6 +86,143 @@ public:
 	}
 };
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A* bookkeeping kept in the areas themselves, via CNavArea::ClearSearchLists() etc.
+ * Only one search can use it at a time, on the main thread.
+ */
+class CNavAreaSearchLists
+{
+public:
+	void Clear( void )															{ CNavArea::ClearSearchLists(); }
+
+	void SetParent( CNavArea *area, CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ area->SetParent( parent, how ); }
+	CNavArea *GetParent( const CNavArea *area ) const							{ return area->GetParent(); }
+	NavTraverseType GetParentHow( const CNavArea *area ) const					{ return area->GetParentHow(); }
+
+	bool IsOpen( const CNavArea *area ) const									{ return area->IsOpen(); }
+	void AddToOpenList( CNavArea *area )										{ area->AddToOpenList(); }
+	void UpdateOnOpenList( CNavArea *area )										{ area->UpdateOnOpenList(); }
+	bool IsOpenListEmpty( void ) const											{ return CNavArea::IsOpenListEmpty(); }
+	CNavArea *PopOpenList( void )												{ return CNavArea::PopOpenList(); }
+
+	bool IsClosed( const CNavArea *area ) const									{ return area->IsClosed(); }
+	void AddToClosedList( CNavArea *area )										{ area->AddToClosedList(); }
+	void RemoveFromClosedList( CNavArea *area )									{ area->RemoveFromClosedList(); }
+
+	void SetTotalCost( CNavArea *area, float value )							{ area->SetTotalCost( value ); }
+	float GetTotalCost( const CNavArea *area ) const							{ return area->GetTotalCost(); }
+	void SetCostSoFar( CNavArea *area, float value )							{ area->SetCostSoFar( value ); }
+	float GetCostSoFar( const CNavArea *area ) const							{ return area->GetCostSoFar(); }
+	void SetPathLengthSoFar( CNavArea *area, float value )						{ area->SetPathLengthSoFar( value ); }
+	float GetPathLengthSoFar( const CNavArea *area ) const						{ return area->GetPathLengthSoFar(); }
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A* bookkeeping for one search at a time, kept outside the areas in an array indexed by area ID,
+ * with a binary heap for the open list. Any number of contexts can search the mesh at once, from
+ * any thread, as long as nobody edits the mesh meanwhile.
+ * Has the same interface as CNavAreaSearchLists, with the results left in the context until the
+ * next search.
+ */
+class CNavSearchContext
+{
+public:
+	CNavSearchContext( void );
+
+	void Clear( void );															// start a new search
+
+	void SetParent( CNavArea *area, CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ NavSearchState_t &state = Touch( area ); state.parent = parent; state.parentHow = how; }
+	CNavArea *GetParent( const CNavArea *area ) const							{ return GetState( area )->parent; }
+	NavTraverseType GetParentHow( const CNavArea *area ) const					{ return GetState( area )->parentHow; }
+
+	bool IsOpen( const CNavArea *area ) const									{ return GetState( area )->openIndex >= 0; }
+	void AddToOpenList( CNavArea *area );
+	void UpdateOnOpenList( CNavArea *area );									// a smaller cost has been found
+	bool IsOpenListEmpty( void ) const											{ return m_openList.Count() == 0; }
+	CNavArea *PopOpenList( void );
+
+	bool IsClosed( const CNavArea *area ) const									{ return GetState( area )->isClosed; }
+	void AddToClosedList( CNavArea *area )										{ Touch( area ).isClosed = true; }
+	void RemoveFromClosedList( CNavArea *area )									{ Touch( area ).isClosed = false; }
+
+	void SetTotalCost( CNavArea *area, float value )							{ Assert( value >= 0.0 && !IS_NAN(value) ); Touch( area ).totalCost = value; }
+	float GetTotalCost( const CNavArea *area ) const							{ return GetState( area )->totalCost; }
+	void SetCostSoFar( CNavArea *area, float value )							{ Assert( value >= 0.0 && !IS_NAN(value) ); Touch( area ).costSoFar = value; }
+	float GetCostSoFar( const CNavArea *area ) const							{ return GetState( area )->costSoFar; }
+	void SetPathLengthSoFar( CNavArea *area, float value )						{ Assert( value >= 0.0 && !IS_NAN(value) ); Touch( area ).pathLengthSoFar = value; }
+	float GetPathLengthSoFar( const CNavArea *area ) const						{ return GetState( area )->pathLengthSoFar; }
+
+	const NavSearchState_t *GetState( const CNavArea *area ) const;			// areas this search hasn't reached read as empty
+
+	static CNavSearchContext *GetActive( void );								// the context bound to the calling thread, if any
+
+	static CNavSearchContext *Alloc( void );									// borrow a context from a shared pool, from any thread
+	static void Free( CNavSearchContext *context );
+
+private:
+	NavSearchState_t &Touch( const CNavArea *area );
+	void Grow( unsigned int count );
+	void HeapUp( int index );
+	void HeapDown( int index );
+
+	CUtlVector< NavSearchState_t > m_state;										// indexed by area ID
+	CUtlVector< CNavArea * > m_openList;										// binary heap, lowest total cost first
+	unsigned int m_marker;
+
+	static const NavSearchState_t s_emptyState;
+};
+
+//--------------------------------------------------------------------------------------------------------------
+inline const NavSearchState_t *CNavSearchContext::GetState( const CNavArea *area ) const
+{
+	unsigned int id = area->GetID();
+	if ( id < (unsigned int)m_state.Count() && m_state[ id ].marker == m_marker )
+		return &m_state[ id ];
+
+	return &s_emptyState;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline NavSearchState_t &CNavSearchContext::Touch( const CNavArea *area )
+{
+	unsigned int id = area->GetID();
+	if ( id >= (unsigned int)m_state.Count() )
+	{
+		// area was created after the context was sized
+		Grow( id + 1 );
+	}
+
+	NavSearchState_t &state = m_state[ id ];
+	if ( state.marker != m_marker )
+	{
+		state = s_emptyState;
+		state.marker = m_marker;
+	}
+
+	return state;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Binds a context to the calling thread for as long as this is in scope, so that CNavArea::GetCostSoFar(),
+ * GetParent() etc. read that context's search. This is how cost functors written against the areas keep
+ * working with a CNavSearchContext.
+ */
+class CNavSearchContextScope
+{
+public:
+	CNavSearchContextScope( CNavSearchContext *context );
+	~CNavSearchContextScope();
+
+private:
+	CNavSearchContext *m_prevContext;
+};
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Find path from startArea to goalArea via an A* search, using supplied cost heuristic.
@@ -98,8 +236,8 @@ public:
  * Returns true if a path exists.
  */
 #define IGNORE_NAV_BLOCKERS true
-template< typename CostFunctor >
-bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false )
+template< typename CostFunctor, typename SearchLists >
+bool NavAreaBuildPathInternal( SearchLists &search, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea, float maxPathLength, int teamID, bool ignoreNavBlockers )
 {
 	VPROF_BUDGET( "NavAreaBuildPath", "NextBotSpiky" );
 
@@ -108,12 +246,12 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 		*closestArea = startArea;
 	}
 
-	bool isDebug = ( g_DebugPathfindCounter-- > 0 );
+	bool isDebug = ( ThreadInMainThread() && g_DebugPathfindCounter-- > 0 );
 
 	if (startArea == NULL)
 		return false;
 
-	startArea->SetParent( NULL );
+	search.SetParent( startArea, NULL );
 
 	if (goalArea != NULL && goalArea->IsBlocked( teamID, ignoreNavBlockers ))
 		goalArea = NULL;
@@ -131,28 +269,28 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 	Vector actualGoalPos = (goalPos) ? *goalPos : goalArea->GetCenter();
 
 	// start search
-	CNavArea::ClearSearchLists();
+	search.Clear();
 
 	// compute estimate of path length
 	/// @todo Cost might work as "manhattan distance"
-	startArea->SetTotalCost( (startArea->GetCenter() - actualGoalPos).Length() );
+	search.SetTotalCost( startArea, (startArea->GetCenter() - actualGoalPos).Length() );
 
 	float initCost = costFunc( startArea, NULL, NULL, NULL, -1.0f );	
 	if (initCost < 0.0f)
 		return false;
-	startArea->SetCostSoFar( initCost );
-	startArea->SetPathLengthSoFar( 0.0 );
+	search.SetCostSoFar( startArea, initCost );
+	search.SetPathLengthSoFar( startArea, 0.0 );
 
-	startArea->AddToOpenList();
+	search.AddToOpenList( startArea );
 
 	// keep track of the area we visit that is closest to the goal
-	float closestAreaDist = startArea->GetTotalCost();
+	float closestAreaDist = search.GetTotalCost( startArea );
 
 	// do A* search
-	while( !CNavArea::IsOpenListEmpty() )
+	while( !search.IsOpenListEmpty() )
 	{
 		// get next area to check
-		CNavArea *area = CNavArea::PopOpenList();
+		CNavArea *area = search.PopOpenList();
 
 		if ( isDebug )
 		{
@@ -329,7 +467,7 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 
 			// don't backtrack
 			Assert( newArea );
-			if ( newArea == area->GetParent() )
+			if ( newArea == search.GetParent( area ) )
 				continue;
 			if ( newArea == area ) // self neighbor?
 				continue;
@@ -346,13 +484,13 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 
 			// Safety check against a bogus functor.  The cost of the path
 			// A...B, C should always be at least as big as the path A...B.
-			Assert( newCostSoFar >= area->GetCostSoFar() );
+			Assert( newCostSoFar >= search.GetCostSoFar( area ) );
 
 			// And now that we've asserted, let's be a bit more defensive.
 			// Make sure that any jump to a new area incurs some pathfinsing
 			// cost, to avoid us spinning our wheels over insignificant cost
 			// benefit, floating point precision bug, or busted cost functor.
-			float minNewCostSoFar = area->GetCostSoFar() * 1.00001 + 0.00001;
+			float minNewCostSoFar = search.GetCostSoFar( area ) * 1.00001 + 0.00001;
 			newCostSoFar = Max( newCostSoFar, minNewCostSoFar );
 				
 			// stop if path length limit reached
@@ -360,14 +498,14 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 			{
 				// keep track of path length so far
 				float deltaLength = ( newArea->GetCenter() - area->GetCenter() ).Length();
-				float newLengthSoFar = area->GetPathLengthSoFar() + deltaLength;
+				float newLengthSoFar = search.GetPathLengthSoFar( area ) + deltaLength;
 				if ( newLengthSoFar > maxPathLength )
 					continue;
 				
-				newArea->SetPathLengthSoFar( newLengthSoFar );
+				search.SetPathLengthSoFar( newArea, newLengthSoFar );
 			}
 
-			if ( ( newArea->IsOpen() || newArea->IsClosed() ) && newArea->GetCostSoFar() <= newCostSoFar )
+			if ( ( search.IsOpen( newArea ) || search.IsClosed( newArea ) ) && search.GetCostSoFar( newArea ) <= newCostSoFar )
 			{
 				// this is a worse path - skip it
 				continue;
@@ -385,35 +523,153 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 					closestAreaDist = newCostRemaining;
 				}
 				
-				newArea->SetCostSoFar( newCostSoFar );
-				newArea->SetTotalCost( newCostSoFar + newCostRemaining );
+				search.SetCostSoFar( newArea, newCostSoFar );
+				search.SetTotalCost( newArea, newCostSoFar + newCostRemaining );
 
-				if ( newArea->IsClosed() )
+				if ( search.IsClosed( newArea ) )
 				{
-					newArea->RemoveFromClosedList();
+					search.RemoveFromClosedList( newArea );
 				}
 
-				if ( newArea->IsOpen() )
+				if ( search.IsOpen( newArea ) )
 				{
 					// area already on open list, update the list order to keep costs sorted
-					newArea->UpdateOnOpenList();
+					search.UpdateOnOpenList( newArea );
 				}
 				else
 				{
-					newArea->AddToOpenList();
+					search.AddToOpenList( newArea );
 				}
 
-				newArea->SetParent( area, how );
+				search.SetParent( newArea, area, how );
 			}
 		}
 
 		// we have searched this area
-		area->AddToClosedList();
+		search.AddToClosedList( area );
 	}
 
 	return false;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Search using the bookkeeping in the areas - see NavAreaBuildPathInternal() above. Main thread only.
+ */
+template< typename CostFunctor >
+bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false )
+{
+	CNavAreaSearchLists search;
+	return NavAreaBuildPathInternal( search, startArea, goalArea, goalPos, costFunc, closestArea, maxPathLength, teamID, ignoreNavBlockers );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Search using the given context, which may be done on any thread. The path is defined by following
+ * context.GetParent() back from the goal area, or by NavSearchBuildPath() below.
+ * While the search runs, the cost functor sees the context through CNavArea::GetCostSoFar() etc, so
+ * the same functors work with both versions - but they must be safe to call from the searching thread.
+ */
+template< typename CostFunctor >
+bool NavAreaBuildPath( CNavSearchContext &context, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false )
+{
+	CNavSearchContextScope scope( &context );
+	return NavAreaBuildPathInternal( context, startArea, goalArea, goalPos, costFunc, closestArea, maxPathLength, teamID, ignoreNavBlockers );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * One step of a path found with a CNavSearchContext
+ */
+struct NavPathStep_t
+{
+	CNavArea *area;
+	NavTraverseType how;										// how we got to 'area' from the previous step
+};
+
+/**
+ * Collect the path to 'endArea' found by the last search of 'context', starting at the start area.
+ * Returns the number of steps.
+ */
+extern int NavSearchBuildPath( const CNavSearchContext &context, CNavArea *endArea, CUtlVector< NavPathStep_t > *path );
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A path request for NavAreaBuildPaths()
+ */
+struct NavPathQuery_t
+{
+	NavPathQuery_t( void )
+	{
+		startArea = NULL;
+		goalArea = NULL;
+		goalPos = vec3_origin;
+		hasGoalPos = false;
+		maxPathLength = 0.0f;
+		teamID = TEAM_ANY;
+		ignoreNavBlockers = false;
+		pathFound = false;
+		closestArea = NULL;
+	}
+
+	// request, as for NavAreaBuildPath()
+	CNavArea *startArea;
+	CNavArea *goalArea;
+	Vector goalPos;												// only used if 'hasGoalPos' is set
+	bool hasGoalPos;
+	float maxPathLength;
+	int teamID;
+	bool ignoreNavBlockers;
+
+	// result
+	bool pathFound;
+	CNavArea *closestArea;
+	CUtlVector< NavPathStep_t > path;							// from the start area to the goal area, or to the closest area if no path was found
+};
+
+template< typename CostFunctor >
+class CNavPathQueryProcessor
+{
+public:
+	CNavPathQueryProcessor( CostFunctor &costFunc ) : m_costFunc( costFunc ) { }
+
+	void Process( NavPathQuery_t &query )
+	{
+		CNavSearchContext *context = CNavSearchContext::Alloc();
+
+		query.pathFound = NavAreaBuildPath( *context, query.startArea, query.goalArea, query.hasGoalPos ? &query.goalPos : NULL, m_costFunc, &query.closestArea, query.maxPathLength, query.teamID, query.ignoreNavBlockers );
+
+		CNavArea *endArea = query.pathFound ? ( query.goalArea ? query.goalArea : query.closestArea ) : query.closestArea;
+		query.path.RemoveAll();
+		if ( endArea )
+		{
+			NavSearchBuildPath( *context, endArea, &query.path );
+		}
+
+		CNavSearchContext::Free( context );
+	}
+
+private:
+	CostFunctor &m_costFunc;
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Run many path searches at once, spread over the job threads. The cost functor is shared by all
+ * of them and must be safe to call from several threads at the same time.
+ * The mesh must not change until this returns.
+ */
+template< typename CostFunctor >
+void NavAreaBuildPaths( NavPathQuery_t *queries, int count, CostFunctor &costFunc )
+{
+	VPROF_BUDGET( "NavAreaBuildPaths", "NextBotSpiky" );
+
+	CNavPathQueryProcessor< CostFunctor > processor( costFunc );
+	ParallelProcess( "NavAreaBuildPaths", queries, count, &processor, &CNavPathQueryProcessor< CostFunctor >::Process );
+}
+
 
 //--------------------------------------------------------------------------------------------------------------
 /**
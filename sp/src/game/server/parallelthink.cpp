@@ -0,0 +1,324 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Runs the thinks of parallel-safe entities across the thread pool
+//
+//=============================================================================//
+
+#include "cbase.h"
+
+#include "parallelthink.h"
+
+#include "entityoutput.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar sv_parallel_think( "sv_parallel_think", "0", FCVAR_NONE, "Run the thinks of entities flagged as parallel-safe across the thread pool" );
+ConVar sv_parallel_think_min( "sv_parallel_think_min", "16", FCVAR_NONE, "Parallel-safe thinks due in a tick before the thread pool is used for them" );
+ConVar sv_parallel_think_debug( "sv_parallel_think_debug", "0", FCVAR_NONE, "Report parallel thinks that write to entities other than their own or do work that can't be deferred" );
+
+extern ConVar sv_thinktimecheck;
+
+bool g_bParallelThinkActive = false;
+
+//-----------------------------------------------------------------------------
+
+struct ParallelThinkJob_t
+{
+	CBaseEntity	*pEntity;
+	CCallQueue	*pCallQueue;		// Deferred work, applied after the phase
+	bool		bStateChanged;		// Own network state changed
+};
+
+static CThreadLocalPtr<ParallelThinkJob_t> g_pCurrentParallelThink;
+
+//-----------------------------------------------------------------------------
+// CParallelThinkManager
+//-----------------------------------------------------------------------------
+
+class CParallelThinkManager
+{
+public:
+	CParallelThinkManager()
+	 :	m_nLastThinks( 0 ),
+		m_nLastDeferred( 0 )
+	{
+	}
+
+	~CParallelThinkManager()
+	{
+		m_CallQueues.PurgeAndDeleteElements();
+	}
+
+	void Run( CBaseEntity **pList, int count );
+	void ReportUnsafe( ParallelThinkJob_t *pJob, CBaseEntity *pOther, const char *pszWhat );
+	void Report();
+
+private:
+	void ProcessJob( ParallelThinkJob_t &job );
+
+	CUtlVector<ParallelThinkJob_t>	m_Jobs;
+	CUtlVector<CCallQueue *>		m_CallQueues;
+
+	int								m_nLastThinks;
+	int								m_nLastDeferred;
+	CInterlockedInt					m_nUnsafe;
+};
+
+static CParallelThinkManager g_ParallelThinkManager;
+
+//-----------------------------------------------------------------------------
+
+void CParallelThinkManager::Run( CBaseEntity **pList, int count )
+{
+	m_Jobs.RemoveAll();
+
+	for ( int i = 0; i < count; i++ )
+	{
+		CBaseEntity *pEntity = pList[i];
+
+		// Only entities that just think; simulation moves them through shared state
+		if ( !pEntity || pEntity->IsPlayer() || !pEntity->IsEFlagSet( EFL_NO_GAME_PHYSICS_SIMULATION ) )
+			continue;
+
+		if ( !pEntity->IsParallelThinkSafe() )
+			continue;
+
+		int iJob = m_Jobs.AddToTail();
+		m_Jobs[iJob].pEntity = pEntity;
+		m_Jobs[iJob].bStateChanged = false;
+	}
+
+	if ( m_Jobs.Count() < MAX( sv_parallel_think_min.GetInt(), 1 ) )
+	{
+		// Not worth waking the pool, let them think in order with everyone else
+		m_Jobs.RemoveAll();
+		return;
+	}
+
+	while ( m_CallQueues.Count() < m_Jobs.Count() )
+	{
+		m_CallQueues.AddToTail( new CCallQueue );
+	}
+
+	for ( int i = 0, iJob = 0; i < count && iJob < m_Jobs.Count(); i++ )
+	{
+		if ( pList[i] == m_Jobs[iJob].pEntity )
+		{
+			m_Jobs[iJob].pCallQueue = m_CallQueues[iJob];
+			pList[i] = NULL;
+			iJob++;
+		}
+	}
+
+	g_bParallelThinkActive = true;
+	ParallelProcess( "ParallelThink", m_Jobs.Base(), m_Jobs.Count(), this, &CParallelThinkManager::ProcessJob );
+	g_bParallelThinkActive = false;
+
+	// Apply what the thinks deferred, in think list order
+	m_nLastThinks = m_Jobs.Count();
+	m_nLastDeferred = 0;
+	for ( int i = 0; i < m_Jobs.Count(); i++ )
+	{
+		ParallelThinkJob_t &job = m_Jobs[i];
+
+		if ( job.bStateChanged )
+		{
+			job.pEntity->NetworkStateChanged();
+		}
+
+		SimThink_EntityChanged( job.pEntity );
+
+		m_nLastDeferred += job.pCallQueue->Count();
+		job.pCallQueue->CallQueued();
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CParallelThinkManager::ProcessJob( ParallelThinkJob_t &job )
+{
+	g_pCurrentParallelThink = &job;
+	job.pEntity->PhysicsRunThink();
+	g_pCurrentParallelThink = NULL;
+}
+
+//-----------------------------------------------------------------------------
+
+void CParallelThinkManager::ReportUnsafe( ParallelThinkJob_t *pJob, CBaseEntity *pOther, const char *pszWhat )
+{
+	++m_nUnsafe;
+
+	if ( !sv_parallel_think_debug.GetBool() )
+		return;
+
+	if ( pOther )
+	{
+		Warning( "Parallel think of %s (%s) touched %s of %s (%s)\n", pJob->pEntity->GetClassname(), pJob->pEntity->GetDebugName(),
+			pszWhat, pOther->GetClassname(), pOther->GetDebugName() );
+	}
+	else
+	{
+		Warning( "Parallel think of %s (%s) did unsafe work: %s\n", pJob->pEntity->GetClassname(), pJob->pEntity->GetDebugName(), pszWhat );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CParallelThinkManager::Report()
+{
+	Msg( "Parallel think: %s, last phase ran %d thinks and deferred %d calls, %d unsafe accesses since last report\n",
+		sv_parallel_think.GetBool() ? "on" : "off", m_nLastThinks, m_nLastDeferred, (int)m_nUnsafe );
+	m_nUnsafe = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Deferred versions of the hooked calls. Entities are held by handle since
+// an earlier deferred call may have removed them.
+//-----------------------------------------------------------------------------
+
+static void DeferredStateChanged( EHANDLE hEntity )
+{
+	if ( hEntity )
+	{
+		hEntity->NetworkStateChanged();
+	}
+}
+
+static void DeferredSimThinkChanged( EHANDLE hEntity )
+{
+	if ( hEntity )
+	{
+		SimThink_EntityChanged( hEntity );
+	}
+}
+
+static void DeferredRemove( EHANDLE hEntity )
+{
+	UTIL_Remove( hEntity.Get() );
+}
+
+static void DeferredEmitSound( EHANDLE hEntity, CUtlString soundname, float soundtime )
+{
+	if ( hEntity )
+	{
+		hEntity->EmitSound( soundname.Get(), soundtime );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void ParallelThink_Run( CBaseEntity **pList, int count )
+{
+	if ( !sv_parallel_think.GetBool() || !g_pThreadPool )
+		return;
+
+	// The think sync tester isn't thread safe
+	if ( sv_thinktimecheck.GetBool() )
+		return;
+
+	g_ParallelThinkManager.Run( pList, count );
+}
+
+CCallQueue *ParallelThink_GetCallQueue()
+{
+	if ( !g_bParallelThinkActive )
+		return NULL;
+
+	ParallelThinkJob_t *pJob = g_pCurrentParallelThink;
+	return pJob ? pJob->pCallQueue : NULL;
+}
+
+bool ParallelThink_DeferStateChanged( CServerNetworkProperty *pProp )
+{
+	ParallelThinkJob_t *pJob = g_pCurrentParallelThink;
+	if ( !pJob )
+		return false;
+
+	CBaseEntity *pEntity = pProp->GetBaseEntity();
+	if ( pEntity == pJob->pEntity )
+	{
+		pJob->bStateChanged = true;
+		return true;
+	}
+
+	g_ParallelThinkManager.ReportUnsafe( pJob, pEntity, "network state" );
+	pJob->pCallQueue->QueueCall( &DeferredStateChanged, EHANDLE( pEntity ) );
+	return true;
+}
+
+bool ParallelThink_DeferSimThinkChanged( CBaseEntity *pEntity )
+{
+	ParallelThinkJob_t *pJob = g_pCurrentParallelThink;
+	if ( !pJob )
+		return false;
+
+	// Our own entity is re-synced once the phase is over
+	if ( pEntity == pJob->pEntity )
+		return true;
+
+	g_ParallelThinkManager.ReportUnsafe( pJob, pEntity, "think time" );
+	pJob->pCallQueue->QueueCall( &DeferredSimThinkChanged, EHANDLE( pEntity ) );
+	return true;
+}
+
+bool ParallelThink_DeferRemove( CBaseEntity *pEntity )
+{
+	ParallelThinkJob_t *pJob = g_pCurrentParallelThink;
+	if ( !pJob )
+		return false;
+
+	if ( pEntity != pJob->pEntity )
+	{
+		g_ParallelThinkManager.ReportUnsafe( pJob, pEntity, "removal" );
+	}
+
+	pJob->pCallQueue->QueueCall( &DeferredRemove, EHANDLE( pEntity ) );
+	return true;
+}
+
+bool ParallelThink_DeferFireOutput( CBaseEntityOutput *pOutput, const variant_t &Value, CBaseEntity *pActivator, CBaseEntity *pCaller, float fDelay )
+{
+	ParallelThinkJob_t *pJob = g_pCurrentParallelThink;
+	if ( !pJob )
+		return false;
+
+	pJob->pCallQueue->QueueCall( pOutput, &CBaseEntityOutput::FireOutput, Value, pActivator, pCaller, fDelay );
+	return true;
+}
+
+bool ParallelThink_DeferEmitSound( CBaseEntity *pEntity, const char *soundname, float soundtime )
+{
+	ParallelThinkJob_t *pJob = g_pCurrentParallelThink;
+	if ( !pJob )
+		return false;
+
+	if ( pEntity != pJob->pEntity )
+	{
+		g_ParallelThinkManager.ReportUnsafe( pJob, pEntity, "sound" );
+	}
+
+	pJob->pCallQueue->QueueCall( &DeferredEmitSound, EHANDLE( pEntity ), CUtlString( soundname ), soundtime );
+	return true;
+}
+
+void ParallelThink_ReportUnsafe( const char *pszWhat )
+{
+	ParallelThinkJob_t *pJob = g_pCurrentParallelThink;
+	if ( !pJob )
+		return;
+
+	g_ParallelThinkManager.ReportUnsafe( pJob, NULL, pszWhat );
+	Assert( 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+CON_COMMAND( sv_parallel_think_stats, "Print what the last parallel think phase did" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_ParallelThinkManager.Report();
+}
@@ -0,0 +1,56 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Runs the thinks of parallel-safe entities across the thread pool
+//
+//=============================================================================//
+
+#ifndef PARALLELTHINK_H
+#define PARALLELTHINK_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+#include "tier1/callqueue.h"
+
+class CBaseEntity;
+class CBaseEntityOutput;
+class CServerNetworkProperty;
+class variant_t;
+
+//-----------------------------------------------------------------------------
+// An entity opts in by returning true from CBaseEntity::IsParallelThinkSafe()
+// for its current think. Such a think may only read shared state and write its
+// own entity. While the parallel phase runs:
+//
+//	- Network state changes, think rescheduling, UTIL_Remove(), FireOutput()
+//	  and CBaseEntity::EmitSound( soundname ) are deferred automatically.
+//	- Anything else with global side effects (creating entities, temp ents,
+//	  the event queue, ...) must go through ParallelThink_GetCallQueue().
+//
+// Deferred work is applied on the main thread right after the phase, entity
+// by entity in think list order, so the result doesn't depend on which
+// thread ran what. Parallel-safe entities think before the rest of the list.
+//-----------------------------------------------------------------------------
+
+// True while the parallel phase is running. Checked inline by hot paths.
+extern bool g_bParallelThinkActive;
+
+// Runs the parallel-safe entities in pList and clears their slots.
+void ParallelThink_Run( CBaseEntity **pList, int count );
+
+// Returns the queue for deferred work of the think running on this thread,
+// or NULL outside of a parallel think.
+CCallQueue *ParallelThink_GetCallQueue();
+
+// Deferral hooks, return true if the call was deferred.
+bool ParallelThink_DeferStateChanged( CServerNetworkProperty *pProp );
+bool ParallelThink_DeferSimThinkChanged( CBaseEntity *pEntity );
+bool ParallelThink_DeferRemove( CBaseEntity *pEntity );
+bool ParallelThink_DeferFireOutput( CBaseEntityOutput *pOutput, const variant_t &Value, CBaseEntity *pActivator, CBaseEntity *pCaller, float fDelay );
+bool ParallelThink_DeferEmitSound( CBaseEntity *pEntity, const char *soundname, float soundtime );
+
+// Reports work that can't be made safe, like creating an entity.
+void ParallelThink_ReportUnsafe( const char *pszWhat );
+
+#endif // PARALLELTHINK_H
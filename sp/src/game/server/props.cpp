@@ -3083,7 +3083,7 @@ void CPhysicsProp::Spawn( )
 	if ( FClassnameIs( this, "physics_prop" ) )
 	{
 #ifdef MAPBASE
-		m_iClassname = gm_isz_class_PropPhysics;
+		SetClassname( gm_isz_class_PropPhysics );
 #else
 		SetClassname( "prop_physics" );
 #endif
@@ -3098,7 +3098,7 @@ void CPhysicsProp::Spawn( )
 #ifdef MAPBASE
 	if ( EntIsClass( this, gm_isz_class_PropPhysicsOverride ) )
 	{
-		m_iClassname = gm_isz_class_PropPhysics;
+		SetClassname( gm_isz_class_PropPhysics );
 	}
 #else
 	if ( FClassnameIs( this, "prop_physics_override") )
@@ -0,0 +1,439 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+// tactical_influence.cpp
+// Per-team influence fields over the navigation mesh, for tactical missions
+
+#include "cbase.h"
+#include "ai_basenpc.h"
+#include "nav_mesh.h"
+#include "tactical_mission.h"
+#include "tactical_influence.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+ConVar tactical_influence( "tactical_influence", "1", FCVAR_GAMEDLL, "Keep influence fields over the nav mesh for tactical missions to read." );
+ConVar tactical_influence_interval( "tactical_influence_interval", "0.2", FCVAR_GAMEDLL, "Seconds between updates of the tactical influence fields.", true, 0.0f, false, 0.0f );
+ConVar tactical_influence_draw( "tactical_influence_draw", "-1", FCVAR_GAMEDLL | FCVAR_CHEAT, "Draw one kind of tactical influence near the local player (0 = threat, 1 = deaths, 2 = coverage, 3 = objective)." );
+ConVar tactical_influence_draw_team( "tactical_influence_draw_team", "0", FCVAR_GAMEDLL | FCVAR_CHEAT, "Which team's tactical influence tactical_influence_draw shows." );
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * How each kind of influence behaves
+ */
+struct TacticalInfluenceInfo_t
+{
+	const char *name;
+	float halfLife;					// seconds for influence to fade by half once its source is gone
+	float spreadRange;				// distance along the mesh influence spreads over, zero if it stays where it was stamped
+	float weight;					// contribution to GetTacticalValue()
+};
+
+static const TacticalInfluenceInfo_t s_influenceInfo[ NUM_INFLUENCE_TYPES ] =
+{
+	{ "threat",		4.0f,	1000.0f,	-1.0f },
+	{ "deaths",		30.0f,	300.0f,		-0.5f },
+	{ "coverage",	1.0f,	0.0f,		0.25f },
+	{ "objective",	2.0f,	750.0f,		1.0f },
+};
+
+/// Areas handed to each job when propagating
+static const int InfluenceSpanSize = 256;
+
+
+//---------------------------------------------------------------------------------------------
+const char *TacticalInfluenceTypeName( TacticalInfluenceType type )
+{
+	if ( type < 0 || type >= NUM_INFLUENCE_TYPES )
+		return "unknown";
+
+	return s_influenceInfo[ type ].name;
+}
+
+
+//---------------------------------------------------------------------------------------------
+CTacticalInfluenceMap::CTacticalInfluenceMap( void )
+{
+	m_current = 0;
+
+	for( int i=0; i<NUM_INFLUENCE_TYPES; ++i )
+	{
+		m_decay[i] = 0.0f;
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTacticalInfluenceMap::Reset( void )
+{
+	m_field[0].Purge();
+	m_field[1].Purge();
+	m_source.Purge();
+	m_spans.Purge();
+	m_deaths.Purge();
+	m_current = 0;
+	m_updateTimer.Invalidate();
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Make room for areas with IDs below 'count'. New areas start with no influence.
+ */
+void CTacticalInfluenceMap::Grow( unsigned int count )
+{
+	int oldCount = m_source.Count();
+	if ( (unsigned int)oldCount >= count )
+		return;
+
+	m_field[0].EnsureCount( count );
+	m_field[1].EnsureCount( count );
+	m_source.EnsureCount( count );
+
+	int added = count - oldCount;
+	V_memset( &m_field[0][ oldCount ], 0, added * sizeof( Influence_t ) );
+	V_memset( &m_field[1][ oldCount ], 0, added * sizeof( Influence_t ) );
+}
+
+
+//---------------------------------------------------------------------------------------------
+inline void CTacticalInfluenceMap::Stamp( const CNavArea *area, int team, TacticalInfluenceType type )
+{
+	m_source[ area->GetID() ].value[ team ][ type ] = 1.0f;
+}
+
+
+//---------------------------------------------------------------------------------------------
+class CCollectVisibleAreas
+{
+public:
+	CCollectVisibleAreas( CUtlVector< const CNavArea * > *visible ) : m_visible( visible ) { }
+
+	bool operator() ( CNavArea *area )
+	{
+		m_visible->AddToTail( area );
+		return true;
+	}
+
+	CUtlVector< const CNavArea * > *m_visible;
+};
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Stamp the character's threat to every other team, and its own team's coverage of what it can see
+ */
+void CTacticalInfluenceMap::StampCharacter( CTacticalMissionManager &manager, CBaseCombatCharacter *who )
+{
+	if ( !who || !who->IsAlive() )
+		return;
+
+	CNavArea *area = who->GetLastKnownArea();
+	if ( !area )
+	{
+		area = TheNavMesh->GetNavArea( who, GETNAVAREA_CHECK_GROUND );
+		if ( !area )
+			return;
+	}
+
+	int team = manager.GetInfluenceTeam( who ) % MAX_NAV_TEAMS;
+
+	for( int t=0; t<MAX_NAV_TEAMS; ++t )
+	{
+		if ( t != team )
+		{
+			Stamp( area, t, INFLUENCE_THREAT );
+		}
+	}
+
+	// coverage comes from the visibility computed by nav_analyze, instead of tracing
+	Stamp( area, team, INFLUENCE_COVERAGE );
+
+	CUtlVector< const CNavArea * > visible;
+	CCollectVisibleAreas collect( &visible );
+	area->ForAllPotentiallyVisibleAreas( collect );
+
+	FOR_EACH_VEC( visible, it )
+	{
+		Stamp( visible[ it ], team, INFLUENCE_COVERAGE );
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Collect the areas of every mission's objective zone
+ */
+class CCollectObjectiveAreas : public CTacticalMissionManager::IForEachMission, public IForEachNavArea
+{
+public:
+	virtual bool Inspect( const CTacticalMission &mission )
+	{
+		const CTacticalMissionZone *zone = mission.GetObjectiveZone();
+		if ( zone )
+		{
+			zone->ForEachArea( *this );
+		}
+
+		return true;
+	}
+
+	virtual bool Inspect( const CNavArea *area )
+	{
+		m_areas.AddToTail( area );
+		return true;
+	}
+
+	CUtlVector< const CNavArea * > m_areas;
+};
+
+void CTacticalInfluenceMap::StampObjectives( CTacticalMissionManager &manager )
+{
+	CCollectObjectiveAreas collect;
+	manager.ForEachMission( collect );
+
+	FOR_EACH_VEC( collect.m_areas, it )
+	{
+		// objectives matter to every team
+		for( int t=0; t<MAX_NAV_TEAMS; ++t )
+		{
+			Stamp( collect.m_areas[ it ], t, INFLUENCE_OBJECTIVE );
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTacticalInfluenceMap::OnCharacterKilled( CBaseCombatCharacter *victim, int team )
+{
+	if ( !IsActive() || !victim )
+		return;
+
+	CNavArea *area = victim->GetLastKnownArea();
+	if ( !area )
+	{
+		area = TheNavMesh->GetNavArea( victim, GETNAVAREA_CHECK_GROUND );
+		if ( !area )
+			return;
+	}
+
+	Death_t death;
+	death.areaID = area->GetID();
+	death.team = team % MAX_NAV_TEAMS;
+	m_deaths.AddToTail( death );
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * One step of spreading and decay for a run of areas. Each area only reads the current field
+ * and writes its own entry in the other, so spans can run on any thread.
+ */
+void CTacticalInfluenceMap::PropagateSpan( Span_t &span )
+{
+	const CUtlVector< Influence_t > &from = m_field[ m_current ];
+	CUtlVector< Influence_t > &to = m_field[ !m_current ];
+
+	for( int i = span.first; i < span.first + span.count; ++i )
+	{
+		const CNavArea *area = TheNavAreas[i];
+
+		// strongest influence reaching this area, starting with its own
+		Influence_t reach = from[ area->GetID() ];
+
+		for( int d=0; d<NUM_DIRECTIONS; ++d )
+		{
+			const NavConnectVector *adjacent = area->GetAdjacentAreas( (NavDirType)d );
+			FOR_EACH_VEC( (*adjacent), it )
+			{
+				const NavConnect &connect = (*adjacent)[ it ];
+				const Influence_t &neighbor = from[ connect.area->GetID() ];
+
+				float length = connect.length;
+				if ( length < 0.0f )
+				{
+					length = ( connect.area->GetCenter() - area->GetCenter() ).Length();
+				}
+
+				for( int type=0; type<NUM_INFLUENCE_TYPES; ++type )
+				{
+					float range = s_influenceInfo[ type ].spreadRange;
+					if ( length >= range )
+						continue;
+
+					float falloff = 1.0f - length / range;
+					for( int t=0; t<MAX_NAV_TEAMS; ++t )
+					{
+						reach.value[t][type] = MAX( reach.value[t][type], neighbor.value[t][type] * falloff );
+					}
+				}
+			}
+		}
+
+		const Influence_t &source = m_source[ area->GetID() ];
+		Influence_t &result = to[ area->GetID() ];
+
+		for( int t=0; t<MAX_NAV_TEAMS; ++t )
+		{
+			for( int type=0; type<NUM_INFLUENCE_TYPES; ++type )
+			{
+				result.value[t][type] = MAX( source.value[t][type], reach.value[t][type] * m_decay[ type ] );
+			}
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Stamp this update's sources, then spread and decay the whole field by one step
+ */
+void CTacticalInfluenceMap::Update( CTacticalMissionManager &manager )
+{
+	if ( !tactical_influence.GetBool() || !TheNavMesh->IsLoaded() || TheNavMesh->IsGenerating() || TheNavAreas.Count() == 0 )
+	{
+		if ( IsActive() )
+		{
+			Reset();
+		}
+		return;
+	}
+
+	if ( m_updateTimer.HasStarted() && !m_updateTimer.IsElapsed() )
+		return;
+
+	VPROF_BUDGET( "CTacticalInfluenceMap::Update", "NextBot" );
+
+	float interval = MAX( tactical_influence_interval.GetFloat(), gpGlobals->interval_per_tick );
+	m_updateTimer.Start( interval );
+
+	Grow( CNavArea::GetNextID() );
+	V_memset( m_source.Base(), 0, m_source.Count() * sizeof( Influence_t ) );
+
+	//
+	// Stamp the sources
+	//
+	for( int i=1; i<=gpGlobals->maxClients; ++i )
+	{
+		StampCharacter( manager, UTIL_PlayerByIndex( i ) );
+	}
+
+	CAI_BaseNPC **npcs = g_AI_Manager.AccessAIs();
+	for( int i=0; i<g_AI_Manager.NumAIs(); ++i )
+	{
+		StampCharacter( manager, npcs[i] );
+	}
+
+	FOR_EACH_VEC( m_deaths, it )
+	{
+		const Death_t &death = m_deaths[ it ];
+		if ( death.areaID < (unsigned int)m_source.Count() )
+		{
+			m_source[ death.areaID ].value[ death.team ][ INFLUENCE_DEATHS ] = 1.0f;
+		}
+	}
+	m_deaths.RemoveAll();
+
+	StampObjectives( manager );
+
+	//
+	// Spread and decay
+	//
+	for( int type=0; type<NUM_INFLUENCE_TYPES; ++type )
+	{
+		m_decay[ type ] = powf( 0.5f, interval / s_influenceInfo[ type ].halfLife );
+	}
+
+	m_spans.RemoveAll();
+	for( int first=0; first<TheNavAreas.Count(); first += InfluenceSpanSize )
+	{
+		Span_t span;
+		span.first = first;
+		span.count = MIN( InfluenceSpanSize, TheNavAreas.Count() - first );
+		m_spans.AddToTail( span );
+	}
+
+	if ( m_spans.Count() == 1 )
+	{
+		// not worth waking the thread pool
+		PropagateSpan( m_spans[0] );
+	}
+	else
+	{
+		ParallelProcess( "CTacticalInfluenceMap::Propagate", m_spans.Base(), m_spans.Count(), this, &CTacticalInfluenceMap::PropagateSpan );
+	}
+
+	m_current = !m_current;
+
+	if ( tactical_influence_draw.GetInt() >= 0 )
+	{
+		Draw( tactical_influence_draw_team.GetInt(), (TacticalInfluenceType)tactical_influence_draw.GetInt() );
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+float CTacticalInfluenceMap::GetInfluence( const CNavArea *area, int team, TacticalInfluenceType type ) const
+{
+	const CUtlVector< Influence_t > &field = m_field[ m_current ];
+
+	if ( !area || area->GetID() >= (unsigned int)field.Count() )
+		return 0.0f;
+
+	return field[ area->GetID() ].value[ team % MAX_NAV_TEAMS ][ type ];
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Return how desirable the area is for the team: near objectives and watched over by
+ * teammates is good, near enemies or where teammates died is bad
+ */
+float CTacticalInfluenceMap::GetTacticalValue( const CNavArea *area, int team ) const
+{
+	const CUtlVector< Influence_t > &field = m_field[ m_current ];
+
+	if ( !area || area->GetID() >= (unsigned int)field.Count() )
+		return 0.0f;
+
+	const float *value = field[ area->GetID() ].value[ team % MAX_NAV_TEAMS ];
+
+	float result = 0.0f;
+	for( int type=0; type<NUM_INFLUENCE_TYPES; ++type )
+	{
+		result += s_influenceInfo[ type ].weight * value[ type ];
+	}
+
+	return result;
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTacticalInfluenceMap::Draw( int team, TacticalInfluenceType type ) const
+{
+	if ( type < 0 || type >= NUM_INFLUENCE_TYPES )
+		return;
+
+	CBasePlayer *player = UTIL_GetListenServerHost();
+	if ( !player )
+		return;
+
+	const float drawRange = 2000.0f;
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea *area = TheNavAreas[ it ];
+
+		float value = GetInfluence( area, team, type );
+		if ( value < 0.01f )
+			continue;
+
+		if ( ( area->GetCenter() - player->GetAbsOrigin() ).IsLengthGreaterThan( drawRange ) )
+			continue;
+
+		int red = (int)( 255.0f * MIN( value, 1.0f ) );
+		area->DrawFilled( red, 0, 255 - red, 100, m_updateTimer.GetCountdownDuration(), false );
+	}
+}
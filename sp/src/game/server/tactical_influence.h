@@ -0,0 +1,91 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+// tactical_influence.h
+// Per-team influence fields over the navigation mesh, for tactical missions
+
+#ifndef TACTICAL_INFLUENCE_H
+#define TACTICAL_INFLUENCE_H
+
+#include "nav_area.h"
+
+class CBaseCombatCharacter;
+class CTacticalMissionManager;
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * The kinds of influence kept for each team
+ */
+enum TacticalInfluenceType
+{
+	INFLUENCE_THREAT,				// how close the team's enemies are
+	INFLUENCE_DEATHS,				// where members of the team have recently died
+	INFLUENCE_COVERAGE,				// what members of the team can see
+	INFLUENCE_OBJECTIVE,			// how close the objectives of the missions are
+
+	NUM_INFLUENCE_TYPES
+};
+
+extern const char *TacticalInfluenceTypeName( TacticalInfluenceType type );
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Influence values for every nav area, for every team, kept up to date as the game runs.
+ * Each update stamps the current sources (characters, deaths, mission objectives), then
+ * spreads and decays the field by one step on the job threads. Queries read the field
+ * from the last update, so asking about an area never traces or searches.
+ *
+ * Teams are indexed modulo MAX_NAV_TEAMS, as elsewhere in the nav mesh.
+ */
+class CTacticalInfluenceMap
+{
+public:
+	CTacticalInfluenceMap( void );
+
+	void Reset( void );														// forget all influence
+	void Update( CTacticalMissionManager &manager );						// invoked on each game frame, updates at tactical_influence_interval
+	bool IsActive( void ) const		{ return m_field[ m_current ].Count() > 0; }	// return true if there is a field to query
+
+	void OnCharacterKilled( CBaseCombatCharacter *victim, int team );		// remember where a member of 'team' died
+
+	float GetInfluence( const CNavArea *area, int team, TacticalInfluenceType type ) const;	// return influence of the given type in the area, from 0 to 1
+	float GetTacticalValue( const CNavArea *area, int team ) const;		// return how desirable the area is for the team, higher is better
+
+	void Draw( int team, TacticalInfluenceType type ) const;				// draw areas near the local player, shaded by influence
+
+private:
+	struct Influence_t
+	{
+		float value[ MAX_NAV_TEAMS ][ NUM_INFLUENCE_TYPES ];
+	};
+
+	struct Span_t													// a run of TheNavAreas for one job
+	{
+		int first;
+		int count;
+	};
+
+	struct Death_t
+	{
+		unsigned int areaID;
+		int team;
+	};
+
+	void Grow( unsigned int count );
+	void Stamp( const CNavArea *area, int team, TacticalInfluenceType type );
+	void StampCharacter( CTacticalMissionManager &manager, CBaseCombatCharacter *who );
+	void StampObjectives( CTacticalMissionManager &manager );
+	void PropagateSpan( Span_t &span );
+
+	CUtlVector< Influence_t > m_field[2];							// indexed by area ID, the current one is read while the other is written
+	int m_current;
+	CUtlVector< Influence_t > m_source;								// influence stamped by this update, indexed by area ID
+	float m_decay[ NUM_INFLUENCE_TYPES ];							// how much influence is kept by this update
+
+	CUtlVector< Span_t > m_spans;
+	CUtlVector< Death_t > m_deaths;									// deaths since the last update
+	CountdownTimer m_updateTimer;
+};
+
+
+#endif // TACTICAL_INFLUENCE_H
@@ -84,13 +84,56 @@ CON_COMMAND_F( mission_show, "Show the given mission", FCVAR_GAMEDLL )
 
 
 //---------------------------------------------------------------------------------------------
+/**
+ * Return the area of this zone with the best tactical value for the player's team.
+ * Areas that are equally good are chosen between at random, so players don't all pick the same one.
+ */
 CNavArea *CTacticalMissionZone::SelectArea( CBasePlayer *who ) const
 {
 	if ( m_areaVector.Count() == 0 )
 		return NULL;
 
-	int which = RandomInt( 0, m_areaVector.Count()-1 );
-	return m_areaVector[ which ];
+#ifdef USE_NAV_MESH
+	const CTacticalInfluenceMap &influence = TheTacticalMissions().GetInfluenceMap();
+	if ( !influence.IsActive() )
+#endif
+	{
+		int which = RandomInt( 0, m_areaVector.Count()-1 );
+		return m_areaVector[ which ];
+	}
+
+#ifdef USE_NAV_MESH
+	int team = TheTacticalMissions().GetInfluenceTeam( who );
+
+	const float equalValue = 0.01f;
+	CNavArea *best = NULL;
+	float bestValue = -FLT_MAX;
+	int equalCount = 0;
+
+	FOR_EACH_VEC( m_areaVector, it )
+	{
+		CNavArea *area = m_areaVector[ it ];
+		float value = influence.GetTacticalValue( area, team );
+
+		if ( value > bestValue + equalValue )
+		{
+			best = area;
+			bestValue = value;
+			equalCount = 1;
+		}
+		else if ( value >= bestValue - equalValue )
+		{
+			// pick uniformly among the equally good areas
+			++equalCount;
+			if ( RandomInt( 1, equalCount ) == 1 )
+			{
+				best = area;
+			}
+		}
+	}
+
+	return best;
+#endif
 }
 
 
@@ -123,6 +166,9 @@ CTacticalMissionManager::CTacticalMissionManager( void )
 {
 	ListenForGameEvent( "round_start" );
 	ListenForGameEvent( "teamplay_round_start" );
+#ifdef USE_NAV_MESH
+	ListenForGameEvent( "entity_killed" );
+#endif
 }
 
 
@@ -133,6 +179,74 @@ void CTacticalMissionManager::FireGameEvent( IGameEvent *gameEvent )
 	{
 		OnRoundRestart();
 	}
+#ifdef USE_NAV_MESH
+	else if ( FStrEq( gameEvent->GetName(), "entity_killed" ) )
+	{
+		CBaseEntity *victim = UTIL_EntityByIndex( gameEvent->GetInt( "entindex_killed" ) );
+		CBaseCombatCharacter *character = ( victim ) ? victim->MyCombatCharacterPointer() : NULL;
+		if ( character )
+		{
+			m_influenceMap.OnCharacterKilled( character, GetInfluenceTeam( character ) );
+		}
+	}
+#endif
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTacticalMissionManager::OnServerActivate( void )
+{
+#ifdef USE_NAV_MESH
+	m_influenceMap.Reset();
+#endif
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTacticalMissionManager::OnRoundRestart( void )
+{
+#ifdef USE_NAV_MESH
+	m_influenceMap.Reset();
+#endif
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTacticalMissionManager::Update( void )
+{
+#ifdef USE_NAV_MESH
+	m_influenceMap.Update( *this );
+#endif
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Return which team's influence the character counts toward.
+ * Without real teams, as in single player, players and the characters that like them are
+ * one team and everyone else is the other.
+ */
+int CTacticalMissionManager::GetInfluenceTeam( CBaseCombatCharacter *who ) const
+{
+	if ( !who )
+		return 0;
+
+	if ( who->GetTeamNumber() >= FIRST_GAME_TEAM )
+		return who->GetTeamNumber() % MAX_NAV_TEAMS;
+
+	if ( who->IsPlayer() )
+		return 0;
+
+	for( int i=1; i<=gpGlobals->maxClients; ++i )
+	{
+		CBasePlayer *player = UTIL_PlayerByIndex( i );
+		if ( player && player->IsConnected() )
+		{
+			return ( who->IRelationType( player ) == D_LI ) ? 0 : 1;
+		}
+	}
+
+	return 1;
 }
 
 
@@ -8,8 +8,12 @@
 
 #include "nav_area.h"
 #include "GameEventListener.h"
+#ifdef USE_NAV_MESH
+#include "tactical_influence.h"
+#endif
 
 class CBasePlayer;
+class CBaseCombatCharacter;
 
 //---------------------------------------------------------------------------------------------
 /**
@@ -18,7 +22,7 @@ class CBasePlayer;
 class CTacticalMissionZone
 {
 public:
-	virtual CNavArea *SelectArea( CBasePlayer *who ) const;
+	virtual CNavArea *SelectArea( CBasePlayer *who ) const;				// return the area of this zone that is best for the given player right now
 
 	/**
 	 * Iterate each area in this zone.
@@ -75,8 +79,9 @@ public:
 
 	virtual void FireGameEvent( IGameEvent *event );						// incoming event processing
 
-	virtual void OnServerActivate( void ) { }								// invoked when server loads a new map, after everything has been created/spawned
-	virtual void OnRoundRestart( void ) { } 								// invoked when a game round restarts
+	virtual void OnServerActivate( void );									// (EXTEND) invoked when server loads a new map, after everything has been created/spawned
+	virtual void OnRoundRestart( void );									// (EXTEND) invoked when a game round restarts
+	virtual void Update( void );											// (EXTEND) invoked on each game frame
 
 	virtual void Register( CTacticalMission *mission );
 	virtual void Unregister( CTacticalMission *mission );
@@ -94,8 +99,16 @@ public:
 	};
 	virtual bool ForEachMission( IForEachMission &func );
 
+	virtual int GetInfluenceTeam( CBaseCombatCharacter *who ) const;		// return which team's influence the character counts toward, from 0 to MAX_NAV_TEAMS-1
+#ifdef USE_NAV_MESH
+	const CTacticalInfluenceMap &GetInfluenceMap( void ) const	{ return m_influenceMap; }
+#endif
+
 protected:
 	CUtlVector< CTacticalMission * > m_missionVector;
+#ifdef USE_NAV_MESH
+	CTacticalInfluenceMap m_influenceMap;
+#endif
 };
 
 
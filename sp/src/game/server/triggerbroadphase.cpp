@@ -0,0 +1,818 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Finds the triggers a moving solid touches without going through
+//			the engine's spatial partition
+//
+//=============================================================================//
+
+#include "cbase.h"
+
+#include "triggerbroadphase.h"
+
+#include "collisionutils.h"
+#include "igamesystem.h"
+#include "utlhashtable.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar sv_trigger_broadphase( "sv_trigger_broadphase", "0", FCVAR_NONE, "Find the triggers moving solids touch through the game's trigger tree instead of the engine's spatial partition" );
+ConVar sv_trigger_broadphase_verify( "sv_trigger_broadphase_verify", "0", FCVAR_CHEAT, "With sv_trigger_broadphase on, let the engine find trigger touches and report every touch the trigger tree disagrees on" );
+
+#define TRIGGER_STATIC_TIME		1.0f	// Seconds a moving trigger must stay put before it goes back in the tree
+#define TRIGGER_TREE_LEAF_SIZE	4
+#define TRIGGER_TREE_MAX_DEPTH	64
+#define TRIGGER_CANDIDATE_TICKS	4		// Candidate bounds are bloated by this many ticks of movement...
+#define TRIGGER_CANDIDATE_BLOAT	8.0f	// ...plus this many units
+
+typedef CUtlVectorFixedGrowable<EHANDLE, 16> TouchedTriggers_t;
+
+//-----------------------------------------------------------------------------
+
+struct TriggerEntry_t
+{
+	const CBaseEntity	*pKey;			// NULL for a free slot
+	EHANDLE				hTrigger;
+	Vector				vecMins;		// Surrounding bounds, bloated like the partition's
+	Vector				vecMaxs;
+	float				flLastMoveTime;
+	bool				bInTree;
+	bool				bDynamic;		// Moving, tested directly instead of through the tree
+
+	// Profiling
+	int					nTests;
+	int					nTouches;
+};
+
+struct TriggerTreeNode_t
+{
+	Vector				vecMins;
+	Vector				vecMaxs;
+	int					iChild;			// First of two children, -1 for a leaf
+	int					iFirst;			// Leaves: range in m_TreeSlots
+	int					nCount;
+};
+
+// What a solid touched last time, so it doesn't have to be worked out again
+struct SolidTouchCache_t
+{
+	EHANDLE				hEntity;
+	int					nGeneration;
+	int					nCollisionGroup;	// What the hits were filtered with, see ShouldTouchTrigger()
+	bool				bTrigger;
+
+	// Every tree trigger overlapping these bounds
+	Vector				vecCandidateMins;
+	Vector				vecCandidateMaxs;
+	CUtlVector<int>		candidates;
+
+	// The last query and the tree triggers it touched
+	Vector				vecStart;
+	Vector				vecDelta;
+	Vector				vecExtents;
+	CUtlVector<int>		hits;
+};
+
+//-----------------------------------------------------------------------------
+// CTriggerBroadphase
+//
+// Purpose: Triggers that don't move are kept in a bounding volume tree, rebuilt
+//			when one is added or stops moving. Moving triggers are tested
+//			directly. Each solid remembers the tree triggers around its
+//			velocity-bloated bounds, and what it touched. Solids that haven't
+//			moved reuse their last result, ones that moved only a little reuse
+//			the candidates, as long as no tree trigger changed in between.
+//-----------------------------------------------------------------------------
+
+class CTriggerBroadphase : public CAutoGameSystem
+{
+public:
+	CTriggerBroadphase();
+
+	virtual void LevelInitPreEntity()		{ Clear(); }
+	virtual void LevelShutdownPostEntity()	{ Clear(); }
+
+	void	UpdateTrigger( CBaseEntity *pEntity, bool bIsTrigger );
+	void	TriggerMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs );
+	void	RemoveTrigger( const CBaseEntity *pEntity );
+
+	bool	SolidMoved( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin, bool bAccurateBboxTriggerChecks );
+	void	EngineMarkedTouching( CBaseEntity *pEntity, CBaseEntity *pTouched );
+
+	void	Report( bool bClear );
+
+private:
+	void	Clear();
+	void	ClearCounters();
+
+	int		FindTrigger( const CBaseEntity *pEntity );
+	void	SetDynamic( int iSlot, bool bDynamic );
+
+	void	RebuildTree();
+	void	BuildNode( int iNode, int iFirst, int nCount );
+	void	QueryTree( const Vector &vecMins, const Vector &vecMaxs, CUtlVector<int> &slots );
+
+	SolidTouchCache_t *GetCache( CBaseEntity *pEntity );
+	void	FindTouchedTriggers( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin, bool bAccurateBboxTriggerChecks, TouchedTriggers_t &touched );
+	bool	ShouldTouch( CBaseEntity *pTrigger, CBaseEntity *pEntity );
+	bool	TestTrigger( int iSlot, CBaseEntity *pEntity, const Ray_t &ray );
+	void	VerifyAgainstEngine( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin, bool bAccurateBboxTriggerChecks, const TouchedTriggers_t &touched );
+
+	static int __cdecl CompareCentroids( const int *pLeft, const int *pRight );
+
+	CUtlVector<TriggerEntry_t>		m_Triggers;
+	CUtlVector<int>					m_FreeSlots;
+	CUtlVector<int>					m_DynamicSlots;
+	CUtlHashtable<const void *, int, PointerHashFunctor, PointerEqualFunctor> m_SlotsByEntity;
+
+	CUtlVector<TriggerTreeNode_t>	m_TreeNodes;
+	CUtlVector<int>					m_TreeSlots;
+	bool							m_bTreeDirty;
+	float							m_flNextTreeCheck;
+
+	// Bumped whenever a tree trigger is added, moved or removed
+	int								m_nGeneration;
+
+	SolidTouchCache_t				*m_pCaches[NUM_ENT_ENTRIES];
+
+	// sv_trigger_broadphase_verify
+	CBaseEntity						*m_pVerifyEntity;
+	TouchedTriggers_t				*m_pEngineTouched;
+
+	// Profiling
+	int								m_nQueries;
+	int								m_nResultReuses;
+	int								m_nCandidateReuses;
+	int								m_nTreeRebuilds;
+	int								m_nVerifyMismatches;
+
+	static const TriggerEntry_t		*s_pSortTriggers;
+	static int						s_iSortAxis;
+};
+
+const TriggerEntry_t *CTriggerBroadphase::s_pSortTriggers = NULL;
+int CTriggerBroadphase::s_iSortAxis = 0;
+
+static CTriggerBroadphase g_TriggerBroadphase;
+
+//-----------------------------------------------------------------------------
+
+CTriggerBroadphase::CTriggerBroadphase()
+ :	CAutoGameSystem( "CTriggerBroadphase" ),
+	m_bTreeDirty( false ),
+	m_flNextTreeCheck( 0 ),
+	m_nGeneration( 0 ),
+	m_pVerifyEntity( NULL ),
+	m_pEngineTouched( NULL )
+{
+	memset( m_pCaches, 0, sizeof( m_pCaches ) );
+	ClearCounters();
+}
+
+//-----------------------------------------------------------------------------
+
+void CTriggerBroadphase::Clear()
+{
+	m_Triggers.Purge();
+	m_FreeSlots.Purge();
+	m_DynamicSlots.Purge();
+	m_SlotsByEntity.Purge();
+	m_TreeNodes.Purge();
+	m_TreeSlots.Purge();
+	m_bTreeDirty = false;
+	m_flNextTreeCheck = 0;
+	m_nGeneration++;
+
+	for ( int i = 0; i < ARRAYSIZE( m_pCaches ); i++ )
+	{
+		delete m_pCaches[i];
+		m_pCaches[i] = NULL;
+	}
+
+	ClearCounters();
+}
+
+//-----------------------------------------------------------------------------
+
+void CTriggerBroadphase::ClearCounters()
+{
+	m_nQueries = 0;
+	m_nResultReuses = 0;
+	m_nCandidateReuses = 0;
+	m_nTreeRebuilds = 0;
+	m_nVerifyMismatches = 0;
+
+	for ( int i = 0; i < m_Triggers.Count(); i++ )
+	{
+		m_Triggers[i].nTests = 0;
+		m_Triggers[i].nTouches = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+int CTriggerBroadphase::FindTrigger( const CBaseEntity *pEntity )
+{
+	UtlHashHandle_t h = m_SlotsByEntity.Find( pEntity );
+	return ( h != m_SlotsByEntity.InvalidHandle() ) ? m_SlotsByEntity[h] : -1;
+}
+
+//-----------------------------------------------------------------------------
+
+void CTriggerBroadphase::SetDynamic( int iSlot, bool bDynamic )
+{
+	TriggerEntry_t &entry = m_Triggers[iSlot];
+	if ( entry.bDynamic == bDynamic )
+		return;
+
+	entry.bDynamic = bDynamic;
+	if ( bDynamic )
+	{
+		m_DynamicSlots.AddToTail( iSlot );
+	}
+	else
+	{
+		m_DynamicSlots.FindAndFastRemove( iSlot );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called whenever the entity's partition lists are set up again
+//-----------------------------------------------------------------------------
+void CTriggerBroadphase::UpdateTrigger( CBaseEntity *pEntity, bool bIsTrigger )
+{
+	if ( !bIsTrigger )
+	{
+		RemoveTrigger( pEntity );
+		return;
+	}
+
+	// Same bounds CCollisionProperty::UpdatePartition() gives the partition
+	CCollisionProperty *pCollide = pEntity->CollisionProp();
+	Vector vecMins, vecMaxs;
+	if ( pCollide->BoundingRadius() != 0.0f )
+	{
+		pCollide->WorldSpaceSurroundingBounds( &vecMins, &vecMaxs );
+		vecMins -= Vector( 1, 1, 1 );
+		vecMaxs += Vector( 1, 1, 1 );
+	}
+	else
+	{
+		vecMins = vecMaxs = pCollide->GetCollisionOrigin();
+	}
+
+	int iSlot = FindTrigger( pEntity );
+	if ( iSlot != -1 )
+	{
+		TriggerMoved( pEntity, vecMins, vecMaxs );
+		return;
+	}
+
+	if ( m_FreeSlots.Count() )
+	{
+		iSlot = m_FreeSlots.Tail();
+		m_FreeSlots.RemoveMultipleFromTail( 1 );
+	}
+	else
+	{
+		iSlot = m_Triggers.AddToTail();
+	}
+
+	TriggerEntry_t &entry = m_Triggers[iSlot];
+	entry.pKey = pEntity;
+	entry.hTrigger = pEntity;
+	entry.vecMins = vecMins;
+	entry.vecMaxs = vecMaxs;
+	entry.flLastMoveTime = -FLT_MAX;
+	entry.bInTree = false;
+	entry.bDynamic = false;
+	entry.nTests = 0;
+	entry.nTouches = 0;
+
+	m_SlotsByEntity.Insert( pEntity, iSlot );
+
+	// Goes in the tree on the next query
+	m_bTreeDirty = true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called when the partition moves the entity
+//-----------------------------------------------------------------------------
+void CTriggerBroadphase::TriggerMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs )
+{
+	int iSlot = FindTrigger( pEntity );
+	if ( iSlot == -1 )
+		return;
+
+	TriggerEntry_t &entry = m_Triggers[iSlot];
+	if ( VectorsAreEqual( entry.vecMins, vecMins, 0.0f ) && VectorsAreEqual( entry.vecMaxs, vecMaxs, 0.0f ) )
+		return;
+
+	entry.vecMins = vecMins;
+	entry.vecMaxs = vecMaxs;
+
+	// Triggers still waiting for the tree just take their new bounds
+	if ( !entry.bInTree && !entry.bDynamic )
+		return;
+
+	entry.flLastMoveTime = gpGlobals->curtime;
+
+	if ( entry.bInTree )
+	{
+		// Test it directly until it settles down
+		entry.bInTree = false;
+		SetDynamic( iSlot, true );
+		m_nGeneration++;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CTriggerBroadphase::RemoveTrigger( const CBaseEntity *pEntity )
+{
+	UtlHashHandle_t h = m_SlotsByEntity.Find( pEntity );
+	if ( h == m_SlotsByEntity.InvalidHandle() )
+		return;
+
+	int iSlot = m_SlotsByEntity[h];
+	m_SlotsByEntity.Remove( pEntity );
+
+	SetDynamic( iSlot, false );
+
+	TriggerEntry_t &entry = m_Triggers[iSlot];
+	entry.pKey = NULL;
+	entry.hTrigger = NULL;
+	entry.bInTree = false;
+
+	m_FreeSlots.AddToTail( iSlot );
+
+	// Cached results may refer to the slot
+	m_nGeneration++;
+}
+
+//-----------------------------------------------------------------------------
+
+int __cdecl CTriggerBroadphase::CompareCentroids( const int *pLeft, const int *pRight )
+{
+	const TriggerEntry_t &left = s_pSortTriggers[*pLeft];
+	const TriggerEntry_t &right = s_pSortTriggers[*pRight];
+
+	float flLeft = left.vecMins[s_iSortAxis] + left.vecMaxs[s_iSortAxis];
+	float flRight = right.vecMins[s_iSortAxis] + right.vecMaxs[s_iSortAxis];
+
+	if ( flLeft != flRight )
+		return ( flLeft < flRight ) ? -1 : 1;
+
+	return *pLeft - *pRight;
+}
+
+//-----------------------------------------------------------------------------
+
+void CTriggerBroadphase::BuildNode( int iNode, int iFirst, int nCount )
+{
+	Vector vecMins( FLT_MAX, FLT_MAX, FLT_MAX );
+	Vector vecMaxs( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+	for ( int i = iFirst; i < iFirst + nCount; i++ )
+	{
+		const TriggerEntry_t &entry = m_Triggers[m_TreeSlots[i]];
+		VectorMin( vecMins, entry.vecMins, vecMins );
+		VectorMax( vecMaxs, entry.vecMaxs, vecMaxs );
+	}
+
+	m_TreeNodes[iNode].vecMins = vecMins;
+	m_TreeNodes[iNode].vecMaxs = vecMaxs;
+	m_TreeNodes[iNode].iChild = -1;
+	m_TreeNodes[iNode].iFirst = iFirst;
+	m_TreeNodes[iNode].nCount = nCount;
+
+	if ( nCount <= TRIGGER_TREE_LEAF_SIZE )
+		return;
+
+	// Split at the median along the longest axis
+	Vector vecSize = vecMaxs - vecMins;
+	s_iSortAxis = ( vecSize.x >= vecSize.y && vecSize.x >= vecSize.z ) ? 0 : ( ( vecSize.y >= vecSize.z ) ? 1 : 2 );
+	s_pSortTriggers = m_Triggers.Base();
+	qsort( &m_TreeSlots[iFirst], nCount, sizeof( int ), (int (__cdecl *)(const void *, const void *))CompareCentroids );
+
+	int iChild = m_TreeNodes.AddMultipleToTail( 2 );
+	m_TreeNodes[iNode].iChild = iChild;
+
+	int nLeft = nCount / 2;
+	BuildNode( iChild, iFirst, nLeft );
+	BuildNode( iChild + 1, iFirst + nLeft, nCount - nLeft );
+}
+
+//-----------------------------------------------------------------------------
+
+void CTriggerBroadphase::RebuildTree()
+{
+	m_TreeNodes.RemoveAll();
+	m_TreeSlots.RemoveAll();
+
+	for ( int i = 0; i < m_Triggers.Count(); i++ )
+	{
+		TriggerEntry_t &entry = m_Triggers[i];
+		if ( !entry.pKey )
+			continue;
+
+		// Moving triggers that have stayed put for a while go back in the tree
+		if ( entry.bDynamic && gpGlobals->curtime - entry.flLastMoveTime >= TRIGGER_STATIC_TIME )
+		{
+			SetDynamic( i, false );
+		}
+
+		entry.bInTree = !entry.bDynamic;
+		if ( entry.bInTree )
+		{
+			m_TreeSlots.AddToTail( i );
+		}
+	}
+
+	if ( m_TreeSlots.Count() )
+	{
+		m_TreeNodes.AddToTail();
+		BuildNode( 0, 0, m_TreeSlots.Count() );
+	}
+
+	m_bTreeDirty = false;
+	m_flNextTreeCheck = gpGlobals->curtime + TRIGGER_STATIC_TIME;
+	m_nGeneration++;
+	m_nTreeRebuilds++;
+}
+
+//-----------------------------------------------------------------------------
+
+void CTriggerBroadphase::QueryTree( const Vector &vecMins, const Vector &vecMaxs, CUtlVector<int> &slots )
+{
+	if ( !m_TreeNodes.Count() )
+		return;
+
+	int stack[TRIGGER_TREE_MAX_DEPTH];
+	int nStack = 0;
+	stack[nStack++] = 0;
+
+	while ( nStack )
+	{
+		const TriggerTreeNode_t &node = m_TreeNodes[stack[--nStack]];
+		if ( !IsBoxIntersectingBox( node.vecMins, node.vecMaxs, vecMins, vecMaxs ) )
+			continue;
+
+		if ( node.iChild == -1 )
+		{
+			for ( int i = node.iFirst; i < node.iFirst + node.nCount; i++ )
+			{
+				int iSlot = m_TreeSlots[i];
+				const TriggerEntry_t &entry = m_Triggers[iSlot];
+				if ( entry.bInTree && IsBoxIntersectingBox( entry.vecMins, entry.vecMaxs, vecMins, vecMaxs ) )
+				{
+					slots.AddToTail( iSlot );
+				}
+			}
+			continue;
+		}
+
+		Assert( nStack + 2 <= TRIGGER_TREE_MAX_DEPTH );
+		stack[nStack++] = node.iChild;
+		stack[nStack++] = node.iChild + 1;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+SolidTouchCache_t *CTriggerBroadphase::GetCache( CBaseEntity *pEntity )
+{
+	int iEntry = pEntity->GetRefEHandle().GetEntryIndex();
+	SolidTouchCache_t *pCache = m_pCaches[iEntry];
+	if ( !pCache )
+	{
+		pCache = m_pCaches[iEntry] = new SolidTouchCache_t;
+		pCache->nGeneration = m_nGeneration - 1;
+	}
+
+	if ( pCache->hEntity != pEntity )
+	{
+		// Someone else had this slot
+		pCache->hEntity = pEntity;
+		pCache->nGeneration = m_nGeneration - 1;
+	}
+
+	return pCache;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Same test the engine's touch enumerator does. The solid has to
+//			want to touch the trigger (debris only touches some), then the ray
+//			is clipped against the trigger's collision model.
+//-----------------------------------------------------------------------------
+bool CTriggerBroadphase::ShouldTouch( CBaseEntity *pTrigger, CBaseEntity *pEntity )
+{
+	if ( !pTrigger || pTrigger == pEntity || !pTrigger->IsSolidFlagSet( FSOLID_TRIGGER ) )
+		return false;
+
+	return pEntity->CollisionProp()->ShouldTouchTrigger( pTrigger->GetSolidFlags() );
+}
+
+bool CTriggerBroadphase::TestTrigger( int iSlot, CBaseEntity *pEntity, const Ray_t &ray )
+{
+	TriggerEntry_t &entry = m_Triggers[iSlot];
+	CBaseEntity *pTrigger = entry.hTrigger;
+	if ( !ShouldTouch( pTrigger, pEntity ) )
+		return false;
+
+	entry.nTests++;
+
+	if ( !IsBoxIntersectingRay( entry.vecMins, entry.vecMaxs, ray ) )
+		return false;
+
+	trace_t tr;
+	enginetrace->ClipRayToCollideable( ray, MASK_ALL, pTrigger->GetCollideable(), &tr );
+	if ( !tr.startsolid && tr.fraction == 1.0f )
+		return false;
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void CTriggerBroadphase::FindTouchedTriggers( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin, bool bAccurateBboxTriggerChecks, TouchedTriggers_t &touched )
+{
+	// Like the engine, bring the partition (and our trigger bounds) up to date first
+	UpdateDirtySpatialPartitionEntities();
+
+	if ( m_bTreeDirty || ( m_DynamicSlots.Count() && gpGlobals->curtime >= m_flNextTreeCheck ) )
+	{
+		RebuildTree();
+	}
+
+	m_nQueries++;
+
+	// The box the engine tests with
+	CCollisionProperty *pCollide = pEntity->CollisionProp();
+	const Vector &vecOrigin = pCollide->GetCollisionOrigin();
+	Vector vecMins, vecMaxs;
+	if ( bAccurateBboxTriggerChecks && pCollide->GetSolid() == SOLID_BBOX )
+	{
+		vecMins = pCollide->OBBMins();
+		vecMaxs = pCollide->OBBMaxs();
+	}
+	else
+	{
+		pCollide->WorldSpaceSurroundingBounds( &vecMins, &vecMaxs );
+		vecMins -= vecOrigin;
+		vecMaxs -= vecOrigin;
+	}
+
+	Ray_t ray;
+	ray.Init( pPrevAbsOrigin ? *pPrevAbsOrigin : vecOrigin, vecOrigin, vecMins, vecMaxs );
+
+	SolidTouchCache_t *pCache = GetCache( pEntity );
+	bool bCacheValid = ( pCache->nGeneration == m_nGeneration &&
+		pCache->nCollisionGroup == pEntity->GetCollisionGroup() &&
+		pCache->bTrigger == pEntity->IsSolidFlagSet( FSOLID_TRIGGER ) );
+
+	if ( bCacheValid &&
+		VectorsAreEqual( pCache->vecStart, ray.m_Start, 0.0f ) &&
+		VectorsAreEqual( pCache->vecDelta, ray.m_Delta, 0.0f ) &&
+		VectorsAreEqual( pCache->vecExtents, ray.m_Extents, 0.0f ) )
+	{
+		// Nothing moved, same tree triggers as last time
+		m_nResultReuses++;
+	}
+	else
+	{
+		Vector vecEnd = ray.m_Start + ray.m_Delta;
+		Vector vecRayMins, vecRayMaxs;
+		VectorMin( ray.m_Start, vecEnd, vecRayMins );
+		VectorMax( ray.m_Start, vecEnd, vecRayMaxs );
+		vecRayMins -= ray.m_Extents;
+		vecRayMaxs += ray.m_Extents;
+
+		if ( bCacheValid &&
+			IsPointInBox( vecRayMins, pCache->vecCandidateMins, pCache->vecCandidateMaxs ) &&
+			IsPointInBox( vecRayMaxs, pCache->vecCandidateMins, pCache->vecCandidateMaxs ) )
+		{
+			m_nCandidateReuses++;
+		}
+		else
+		{
+			// Leave room for where it's heading
+			Vector vecVelocity = pEntity->GetAbsVelocity();
+			Vector vecBloat( fabs( vecVelocity.x ), fabs( vecVelocity.y ), fabs( vecVelocity.z ) );
+			vecBloat *= TICK_INTERVAL * TRIGGER_CANDIDATE_TICKS;
+			vecBloat += Vector( TRIGGER_CANDIDATE_BLOAT, TRIGGER_CANDIDATE_BLOAT, TRIGGER_CANDIDATE_BLOAT );
+
+			pCache->vecCandidateMins = vecRayMins - vecBloat;
+			pCache->vecCandidateMaxs = vecRayMaxs + vecBloat;
+			pCache->candidates.RemoveAll();
+			QueryTree( pCache->vecCandidateMins, pCache->vecCandidateMaxs, pCache->candidates );
+		}
+
+		pCache->hits.RemoveAll();
+		for ( int i = 0; i < pCache->candidates.Count(); i++ )
+		{
+			if ( TestTrigger( pCache->candidates[i], pEntity, ray ) )
+			{
+				pCache->hits.AddToTail( pCache->candidates[i] );
+			}
+		}
+
+		pCache->nGeneration = m_nGeneration;
+		pCache->nCollisionGroup = pEntity->GetCollisionGroup();
+		pCache->bTrigger = pEntity->IsSolidFlagSet( FSOLID_TRIGGER );
+		pCache->vecStart = ray.m_Start;
+		pCache->vecDelta = ray.m_Delta;
+		pCache->vecExtents = ray.m_Extents;
+	}
+
+	for ( int i = 0; i < pCache->hits.Count(); i++ )
+	{
+		TriggerEntry_t &entry = m_Triggers[pCache->hits[i]];
+		if ( ShouldTouch( entry.hTrigger, pEntity ) )
+		{
+			entry.nTouches++;
+			touched.AddToTail( entry.hTrigger );
+		}
+	}
+
+	// Moving triggers are always tested
+	for ( int i = 0; i < m_DynamicSlots.Count(); i++ )
+	{
+		int iSlot = m_DynamicSlots[i];
+		if ( TestTrigger( iSlot, pEntity, ray ) )
+		{
+			m_Triggers[iSlot].nTouches++;
+			touched.AddToTail( m_Triggers[iSlot].hTrigger );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+bool CTriggerBroadphase::SolidMoved( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin, bool bAccurateBboxTriggerChecks )
+{
+	if ( !sv_trigger_broadphase.GetBool() )
+		return false;
+
+	VPROF( "CTriggerBroadphase::SolidMoved" );
+
+	TouchedTriggers_t touched;
+	FindTouchedTriggers( pEntity, pPrevAbsOrigin, bAccurateBboxTriggerChecks, touched );
+
+	if ( sv_trigger_broadphase_verify.GetBool() )
+	{
+		VerifyAgainstEngine( pEntity, pPrevAbsOrigin, bAccurateBboxTriggerChecks, touched );
+		return true;
+	}
+
+	// Touches may remove things, so they're all found before any are marked
+	for ( int i = 0; i < touched.Count(); i++ )
+	{
+		CBaseEntity *pTrigger = touched[i];
+		if ( !pTrigger )
+			continue;
+
+		// Same as CServerGameEnts::MarkEntitiesAsTouching()
+		trace_t tr;
+		UTIL_ClearTrace( tr );
+		tr.endpos = ( pTrigger->GetAbsOrigin() + pEntity->GetAbsOrigin() ) * 0.5;
+		pTrigger->PhysicsMarkEntitiesAsTouching( pEntity, tr );
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lets the engine do the touching and compares what it found
+//-----------------------------------------------------------------------------
+void CTriggerBroadphase::VerifyAgainstEngine( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin, bool bAccurateBboxTriggerChecks, const TouchedTriggers_t &touched )
+{
+	TouchedTriggers_t engineTouched;
+
+	// Touch callbacks can move other solids, so this nests
+	CBaseEntity *pPrevEntity = m_pVerifyEntity;
+	TouchedTriggers_t *pPrevTouched = m_pEngineTouched;
+	m_pVerifyEntity = pEntity;
+	m_pEngineTouched = &engineTouched;
+
+	engine->SolidMoved( pEntity->edict(), pEntity->CollisionProp(), pPrevAbsOrigin, bAccurateBboxTriggerChecks );
+
+	m_pVerifyEntity = pPrevEntity;
+	m_pEngineTouched = pPrevTouched;
+
+	for ( int i = 0; i < engineTouched.Count(); i++ )
+	{
+		if ( engineTouched[i] && touched.Find( engineTouched[i] ) == -1 )
+		{
+			m_nVerifyMismatches++;
+			Warning( "Trigger broadphase missed %s (%s) touching %s (%s)\n", engineTouched[i]->GetClassname(), engineTouched[i]->GetDebugName(),
+				pEntity->GetClassname(), pEntity->GetDebugName() );
+		}
+	}
+
+	for ( int i = 0; i < touched.Count(); i++ )
+	{
+		if ( touched[i] && engineTouched.Find( touched[i] ) == -1 )
+		{
+			m_nVerifyMismatches++;
+			Warning( "Trigger broadphase found %s (%s) touching %s (%s), the engine didn't\n", touched[i]->GetClassname(), touched[i]->GetDebugName(),
+				pEntity->GetClassname(), pEntity->GetDebugName() );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CTriggerBroadphase::EngineMarkedTouching( CBaseEntity *pEntity, CBaseEntity *pTouched )
+{
+	if ( !m_pEngineTouched )
+		return;
+
+	if ( pTouched == m_pVerifyEntity )
+	{
+		m_pEngineTouched->AddToTail( pEntity );
+	}
+	else if ( pEntity == m_pVerifyEntity )
+	{
+		m_pEngineTouched->AddToTail( pTouched );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+static int __cdecl CompareTriggerTests( const TriggerEntry_t * const *ppLeft, const TriggerEntry_t * const *ppRight )
+{
+	return (*ppRight)->nTests - (*ppLeft)->nTests;
+}
+
+void CTriggerBroadphase::Report( bool bClear )
+{
+	CUtlVector<const TriggerEntry_t *> triggers;
+	for ( int i = 0; i < m_Triggers.Count(); i++ )
+	{
+		if ( m_Triggers[i].pKey )
+		{
+			triggers.AddToTail( &m_Triggers[i] );
+		}
+	}
+
+	Msg( "Trigger broadphase: %s, %d triggers (%d moving), %d tree nodes, %d rebuilds\n",
+		sv_trigger_broadphase.GetBool() ? "on" : "off", triggers.Count(), m_DynamicSlots.Count(), m_TreeNodes.Count(), m_nTreeRebuilds );
+	Msg( "  %d queries, %d reused the last result, %d reused their candidates, %d verify mismatches\n",
+		m_nQueries, m_nResultReuses, m_nCandidateReuses, m_nVerifyMismatches );
+
+	triggers.Sort( CompareTriggerTests );
+
+	Msg( "  Most tested triggers:\n" );
+	for ( int i = 0; i < MIN( triggers.Count(), 20 ); i++ )
+	{
+		CBaseEntity *pTrigger = triggers[i]->hTrigger;
+		if ( !pTrigger || !triggers[i]->nTests )
+			break;
+
+		Msg( "    %5d tests %5d touches  %s (%s)%s\n", triggers[i]->nTests, triggers[i]->nTouches,
+			pTrigger->GetClassname(), pTrigger->GetDebugName(), triggers[i]->bDynamic ? " moving" : "" );
+	}
+
+	if ( bClear )
+	{
+		ClearCounters();
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void TriggerBroadphase_UpdateTrigger( CBaseEntity *pEntity, bool bIsTrigger )
+{
+	g_TriggerBroadphase.UpdateTrigger( pEntity, bIsTrigger );
+}
+
+void TriggerBroadphase_TriggerMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs )
+{
+	g_TriggerBroadphase.TriggerMoved( pEntity, vecMins, vecMaxs );
+}
+
+void TriggerBroadphase_RemoveTrigger( const CBaseEntity *pEntity )
+{
+	g_TriggerBroadphase.RemoveTrigger( pEntity );
+}
+
+bool TriggerBroadphase_SolidMoved( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin, bool bAccurateBboxTriggerChecks )
+{
+	return g_TriggerBroadphase.SolidMoved( pEntity, pPrevAbsOrigin, bAccurateBboxTriggerChecks );
+}
+
+void TriggerBroadphase_EngineMarkedTouching( CBaseEntity *pEntity, CBaseEntity *pTouched )
+{
+	g_TriggerBroadphase.EngineMarkedTouching( pEntity, pTouched );
+}
+
+//-----------------------------------------------------------------------------
+
+CON_COMMAND( sv_trigger_broadphase_stats, "Print the trigger broadphase's counters and the most tested triggers. \"clear\" resets them." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_TriggerBroadphase.Report( args.ArgC() > 1 && !Q_stricmp( args[1], "clear" ) );
+}
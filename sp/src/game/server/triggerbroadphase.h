@@ -0,0 +1,34 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Finds the triggers a moving solid touches without going through
+//			the engine's spatial partition
+//
+//=============================================================================//
+
+#ifndef TRIGGERBROADPHASE_H
+#define TRIGGERBROADPHASE_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+class CBaseEntity;
+
+//-----------------------------------------------------------------------------
+// Mirrors the engine's trigger list. The collision property keeps it up to
+// date as entities gain or lose FSOLID_TRIGGER and move.
+//-----------------------------------------------------------------------------
+void TriggerBroadphase_UpdateTrigger( CBaseEntity *pEntity, bool bIsTrigger );
+void TriggerBroadphase_TriggerMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs );
+void TriggerBroadphase_RemoveTrigger( const CBaseEntity *pEntity );
+
+//-----------------------------------------------------------------------------
+// Replaces engine->SolidMoved(). Returns false if the broadphase is off and
+// the engine should be used instead.
+//-----------------------------------------------------------------------------
+bool TriggerBroadphase_SolidMoved( CBaseEntity *pEntity, const Vector *pPrevAbsOrigin, bool bAccurateBboxTriggerChecks );
+
+// Called for every touch the engine reports, used by sv_trigger_broadphase_verify
+void TriggerBroadphase_EngineMarkedTouching( CBaseEntity *pEntity, CBaseEntity *pTouched );
+
+#endif // TRIGGERBROADPHASE_H
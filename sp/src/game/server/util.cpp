@@ -36,6 +36,7 @@
 #include "datacache/imdlcache.h"
 #include "util.h"
 #include "cdll_int.h"
+#include "parallelthink.h"
 #ifdef MAPBASE
 #include "fmtstr.h"
 #endif
@@ -523,6 +524,10 @@ void UTIL_Remove( IServerNetworkable *oldObj )
 		return;
 	}
 
+	// Parallel thinks remove entities once the phase is over
+	if ( g_bParallelThinkActive && ParallelThink_DeferRemove( oldObj->GetBaseEntity() ) )
+		return;
+
 	// mark it for deletion	
 	pProp->MarkForDeletion( );
 
@@ -108,6 +108,9 @@ protected:
 	const char *ToString( void ) const;
 
 	friend class CVariantSaveDataOps;
+#ifdef MAPBASE
+	friend class CVariantConversionCache;
+#endif
 };
 
 
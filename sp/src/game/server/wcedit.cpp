@@ -21,6 +21,8 @@
 #include "ai_link.h"
 #include "ai_node.h"
 #include "ai_dynamiclink.h"
+#include "ai_clustergraph.h"
+#include "ai_nodevisibility.h"
 #include "ai_networkmanager.h"
 #include "ndebugoverlay.h"
 #include "editor_sendcommand.h"
@@ -347,6 +349,8 @@ void NWCEdit::DestroyAINode( CBasePlayer *pPlayer )
 			// Note that network needs to be rebuild
 			g_pAINetworkManager->GetEditOps()->SetRebuildFlags();
 			g_pAINetworkManager->GetEditOps()->m_pLastDeletedNode	= pAINode;
+			g_pBigAINet->GetClusterGraph()->Purge();
+			g_pBigAINet->GetNodeVisibility()->Purge();
 
 			// Now go through at delete any dynamic links that were attached to this node
 			for (int link = 0; link < pAINode->NumLinks(); link++)
@@ -400,6 +404,7 @@ void NWCEdit::CreateAILink( CBasePlayer* pPlayer )
 		{
 			// Don't actually destroy the dynamic link while editing.  Just mark the link
 			pAILink->m_LinkInfo &= ~bits_LINK_OFF;
+			g_pBigAINet->GetClusterGraph()->Purge();
 
 			CAI_DynamicLink* pDynamicLink = CAI_DynamicLink::GetDynamicLink(pAILink->m_iSrcID, pAILink->m_iDestID);
 			UTIL_Remove(pDynamicLink);
@@ -442,6 +447,7 @@ void NWCEdit::DestroyAILink( CBasePlayer *pPlayer )
 			pNewLink->m_nDestID			= pAILink->m_iDestID;
 			pNewLink->m_nLinkState		= LINK_OFF;
 			pAILink->m_LinkInfo |= bits_LINK_OFF;
+			g_pBigAINet->GetClusterGraph()->Purge();
 		}
 	}
 }
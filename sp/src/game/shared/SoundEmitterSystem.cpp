@@ -27,6 +27,7 @@
 #ifndef CLIENT_DLL
 #include "envmicrophone.h"
 #include "sceneentity.h"
+#include "parallelthink.h"
 #else
 #include <vgui_controls/Controls.h>
 #include <vgui/IVGui.h>
@@ -1199,6 +1200,16 @@ void CBaseEntity::EmitSound( const char *soundname, float soundtime /*= 0.0f*/,
 	//VPROF( "CBaseEntity::EmitSound" );
 	VPROF_BUDGET( "CBaseEntity::EmitSound", _T( "CBaseEntity::EmitSound" ) );
 
+#ifndef CLIENT_DLL
+	// Parallel thinks emit their sounds once the phase is over
+	if ( g_bParallelThinkActive && ParallelThink_DeferEmitSound( this, soundname, soundtime ) )
+	{
+		if ( duration )
+			*duration = 0.0f;
+		return;
+	}
+#endif
+
 	CPASAttenuationFilter filter( this, soundname );
 
 	EmitSound_t params;
@@ -421,6 +421,24 @@ CSprite *CSprite::SpriteCreatePredictable( const char *module, int line, const c
 	return pSprite;
 }
 
+#if !defined( CLIENT_DLL )
+//-----------------------------------------------------------------------------
+// Purpose: Animating and expanding only change the sprite itself, except when
+//			a play-once sprite turns itself off at the end
+//-----------------------------------------------------------------------------
+bool CSprite::IsParallelThinkSafe( void )
+{
+	if ( m_pfnThink == static_cast<BASEPTR>( &CSprite::ExpandThink ) )
+		return true;
+
+	if ( HasSpawnFlags( SF_SPRITE_ONCE ) )
+		return false;
+
+	return ( m_pfnThink == static_cast<BASEPTR>( &CSprite::AnimateThink ) ||
+		m_pfnThink == static_cast<BASEPTR>( &CSprite::AnimateUntilDead ) );
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
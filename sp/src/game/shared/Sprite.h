@@ -120,6 +120,8 @@ public:
 	}
 
 	void OnRestore();
+
+	virtual bool IsParallelThinkSafe( void );
 #endif
 
 	void AnimateThink( void );
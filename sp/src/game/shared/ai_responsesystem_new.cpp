@@ -53,6 +53,9 @@ static void CC_RR_DumpHashInfo( const CCommand &args );
 
 #ifdef MAPBASE
 ConVar rr_enhanced_saverestore( "rr_enhanced_saverestore", "0", FCVAR_NONE, "Enables enhanced save/restore capabilities for the Response System." );
+ConVar rr_matcher_cache_size( "rr_matcher_cache_size", "512", FCVAR_NONE, "How many parsed criterion matchers ResponseSystemCompare() keeps around. The cache is emptied when it fills up." );
+
+static void ClearResponseMatcherCache();
 #endif
 
 extern ISceneFileCache *scenefilecache;
@@ -662,16 +665,31 @@ public:
 		}
 
 #ifdef MAPBASE
+		ClearResponseMatcherCache();
+
 		if (!rr_enhanced_saverestore.GetBool() || gpGlobals->eLoadType != MapLoad_Transition)
 #endif
 		ResetResponseGroups();
 	}
 
+#ifdef MAPBASE
+	virtual void LevelShutdownPostEntity()
+	{
+		// Don't let matchers parsed for this map pile up across level changes
+		ClearResponseMatcherCache();
+	}
+#endif
+
 	void ReloadAllResponseSystems()
 	{
 		Clear();
 		Init();
 
+#ifdef MAPBASE
+		// Cached matchers may have resolved enumerations from the old scripts
+		ClearResponseMatcherCache();
+#endif
+
 		int c = m_InstancedSystems.Count();
 		for ( int i = c - 1 ; i >= 0; i-- )
 		{
@@ -789,14 +807,60 @@ static ConCommand rr_dumphashinfo( "rr_dumphashinfo", CC_RR_DumpHashInfo, "Stati
 #ifdef MAPBASE
 // Designed for extern magic, this gives the <, >, etc. of response system criteria to the outside world.
 // Mostly just used for Matcher_Match in matchers.h.
+//
+// Parsing a criterion (operators, enumerations, wildcards) is much slower than testing it,
+// and filters/contexts pass the same few criteria every frame, so parsed matchers are kept by text.
+static CUtlDict<Matcher, unsigned short> g_ResponseMatcherCache( k_eDictCompareTypeCaseSensitive );
+static CThreadFastMutex g_ResponseMatcherCacheMutex;
+static int g_nResponseMatcherCacheHits = 0;
+static int g_nResponseMatcherCacheMisses = 0;
+
+static void ClearResponseMatcherCache()
+{
+	AUTO_LOCK( g_ResponseMatcherCacheMutex );
+	g_ResponseMatcherCache.RemoveAll();
+}
+
 bool ResponseSystemCompare( const char *criterion, const char *value )
 {
-	Criteria criteria;
-	criteria.value = criterion;
-	defaultresponsesytem.ComputeMatcher( &criteria, criteria.matcher );
-	return defaultresponsesytem.CompareUsingMatcher( value, criteria.matcher, true );
+	Matcher matcher;
+
+	{
+		AUTO_LOCK( g_ResponseMatcherCacheMutex );
 
-	return false;
+		unsigned short i = g_ResponseMatcherCache.Find( criterion );
+		if ( i != g_ResponseMatcherCache.InvalidIndex() )
+		{
+			g_nResponseMatcherCacheHits++;
+			matcher = g_ResponseMatcherCache[i];
+		}
+		else
+		{
+			g_nResponseMatcherCacheMisses++;
+
+			Criteria criteria;
+			criteria.value = criterion;
+			defaultresponsesytem.ComputeMatcher( &criteria, criteria.matcher );
+			matcher = criteria.matcher;
+
+			if ( g_ResponseMatcherCache.Count() >= MAX( rr_matcher_cache_size.GetInt(), 1 ) )
+				g_ResponseMatcherCache.RemoveAll();
+
+			g_ResponseMatcherCache.Insert( criterion, matcher );
+		}
+	}
+
+	return defaultresponsesytem.CompareUsingMatcher( value, matcher, true );
+}
+
+CON_COMMAND( rr_matcher_cache_stats, "Prints how well ResponseSystemCompare()'s parsed matcher cache is doing." )
+{
+	AUTO_LOCK( g_ResponseMatcherCacheMutex );
+
+	int nLookups = g_nResponseMatcherCacheHits + g_nResponseMatcherCacheMisses;
+	Msg( "Response matcher cache: %d/%d entries, %d hits, %d misses (%.1f%% hit rate)\n",
+		g_ResponseMatcherCache.Count(), rr_matcher_cache_size.GetInt(), g_nResponseMatcherCacheHits, g_nResponseMatcherCacheMisses,
+		nLookups > 0 ? 100.0f * (float)g_nResponseMatcherCacheHits / (float)nLookups : 0.0f );
 }
 
 //-----------------------------------------------------------------------------
@@ -1030,6 +1094,9 @@ bool LoadResponseSystemFile(const char *scriptfile)
 	defaultresponsesytem.LoadFromBuffer( scriptfile, (const char *)buf.PeekGet() );
 	defaultresponsesytem.Precache();
 
+	// The file may have changed enumerations cached matchers resolved
+	ClearResponseMatcherCache();
+
 	return true;
 }
 
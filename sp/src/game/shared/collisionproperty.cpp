@@ -24,6 +24,7 @@
 #include "baseanimating.h"
 #include "sendproxy.h"
 #include "hierarchy.h"
+#include "triggerbroadphase.h"
 #endif
 
 #include "predictable_entity.h"
@@ -1299,6 +1300,10 @@ void CCollisionProperty::DestroyPartitionHandle()
 		partition->DestroyHandle( m_Partition );
 		m_Partition = PARTITION_INVALID_HANDLE;
 	}
+
+#ifndef CLIENT_DLL
+	TriggerBroadphase_RemoveTrigger( m_pOuter );
+#endif
 }
 
 
@@ -1318,7 +1323,10 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 
 	// Don't bother with deleted things
 	if ( !m_pOuter->edict() )
+	{
+		TriggerBroadphase_RemoveTrigger( m_pOuter );
 		return;
+	}
 
 	// don't add the world
 	if ( m_pOuter->entindex() == 0 )
@@ -1332,7 +1340,10 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 	}
 
 	if ( !bIsSolid )
+	{
+		TriggerBroadphase_UpdateTrigger( m_pOuter, false );
 		return;
+	}
 
 	// Insert it into the appropriate lists.
 	// We have to continually reinsert it because its solid type may have changed
@@ -1347,6 +1358,8 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 	}
 	Assert( mask != 0 );
 	partition->Insert( mask, handle );
+
+	TriggerBroadphase_UpdateTrigger( m_pOuter, IsSolidFlagSet(FSOLID_TRIGGER) );
 #endif
 }
 
@@ -1410,10 +1423,16 @@ void CCollisionProperty::UpdatePartition( )
 				vecSurroundMins -= Vector( 1, 1, 1 );
 				vecSurroundMaxs += Vector( 1, 1, 1 );
 				partition->ElementMoved( GetPartitionHandle(), vecSurroundMins,  vecSurroundMaxs );
+#ifndef CLIENT_DLL
+				TriggerBroadphase_TriggerMoved( m_pOuter, vecSurroundMins, vecSurroundMaxs );
+#endif
 			}
 			else
 			{
 				partition->ElementMoved( GetPartitionHandle(), GetCollisionOrigin(),  GetCollisionOrigin() );
+#ifndef CLIENT_DLL
+				TriggerBroadphase_TriggerMoved( m_pOuter, GetCollisionOrigin(), GetCollisionOrigin() );
+#endif
 			}
 		}
 	}
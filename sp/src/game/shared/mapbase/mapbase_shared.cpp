@@ -10,6 +10,7 @@
 
 #include "tier0/icommandline.h"
 #include "tier1/mapbase_con_groups.h"
+#include "tier1/mapbase_matchers_base.h"
 #include "igamesystem.h"
 #include "filesystem.h"
 #include <vgui_controls/Controls.h> 
@@ -861,3 +862,8 @@ CON_COMMAND_SHARED( con_group_toggle, "Toggles a console group." )
 {
 	ToggleConsoleGroups( args.Arg( 1 ) );
 }
+
+CON_COMMAND_SHARED( mapbase_regex_cache_stats, "Prints how well Mapbase's compiled regex cache is doing." )
+{
+	Matcher_PrintRegexCacheStats();
+}
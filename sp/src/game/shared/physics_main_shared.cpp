@@ -19,6 +19,10 @@
 #include "utlmultilist.h"
 #include "tier1/callqueue.h"
 
+#ifndef CLIENT_DLL
+#include "parallelthink.h"
+#endif
+
 #ifdef PORTAL
 	#include "portal_util_shared.h"
 #endif
@@ -1969,7 +1973,7 @@ struct ThinkSync
 };
 
 #if !defined( CLIENT_DLL )
-static ConVar sv_thinktimecheck( "sv_thinktimecheck", "0", 0, "Check for thinktimes all on same timestamp." );
+ConVar sv_thinktimecheck( "sv_thinktimecheck", "0", 0, "Check for thinktimes all on same timestamp." );
 #endif
 
 //-----------------------------------------------------------------------------
@@ -2109,7 +2113,10 @@ bool CBaseEntity::PhysicsRunSpecificThink( int nContextIndex, BASEPTR thinkFunc
 	
 	// Only do this on the game server
 #if !defined( CLIENT_DLL )
-	g_ThinkChecker.EntityThinking( gpGlobals->tickcount, this, thinktime, m_nNextThinkTick );
+	if ( !g_bParallelThinkActive )
+	{
+		g_ThinkChecker.EntityThinking( gpGlobals->tickcount, this, thinktime, m_nNextThinkTick );
+	}
 #endif
 
 	SetNextThink( nContextIndex, TICK_NEVER_THINK );
@@ -12,6 +12,12 @@
 #include "datacache/imdlcache.h"
 #include "vstdlib/jobthread.h"
 
+#ifdef CLIENT_DLL
+#include "c_baseplayer.h"
+#else
+#include "player.h"
+#endif
+
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -38,6 +44,12 @@ static int s_nNumCacheQueries = 0;
 static int s_nNumCacheMisses = 0;
 static int s_SuccessfulSpeculatives = 0;
 static int s_WastedSpeculativeUpdates = 0;
+static int s_nNumSyncQueries = 0;									// queries traced on the calling thread
+static int s_nNumCacheHits = 0;
+static float s_flTotalHitAge = 0;
+static float s_flMaxHitAge = 0;
+
+float g_flQueryCacheVisibilityInterval = 0;
 
 void QueryCacheKey_t::ComputeHashIndex( void )
 {
@@ -45,7 +57,7 @@ void QueryCacheKey_t::ComputeHashIndex( void )
 	for( int i = 0 ; i < m_nNumValidPoints; i++ )
 	{
 		ret += ( unsigned int ) m_pEntities[i].ToInt();
-		ret += ( unsigned int ) m_nOffsetMode;
+		ret += ( unsigned int ) m_nOffsetMode[i];
 	}
 	ret += *( ( uint32 *) &m_flMinimumUpdateInterval );
 	ret += m_nTraceMask;
@@ -55,7 +67,9 @@ void QueryCacheKey_t::ComputeHashIndex( void )
 
 ConVar	sv_disable_querycache("sv_disable_querycache", "0", FCVAR_CHEAT, "debug - disable trace query cache" );
 
-static QueryCacheEntry_t *FindOrAllocateCacheEntry( QueryCacheKey_t const &entry )
+// With bDeferQuery, a new entry is left for the next UpdateQueryCache() to
+// trace and an existing one is returned as is.
+static QueryCacheEntry_t *FindOrAllocateCacheEntry( QueryCacheKey_t const &entry, bool bDeferQuery = false )
 {
 	QueryCacheEntry_t *pFound = NULL;
 	// see if we find it
@@ -85,21 +99,35 @@ static QueryCacheEntry_t *FindOrAllocateCacheEntry( QueryCacheKey_t const &entry
 		pFound->m_QueryParams = entry;
 		s_HashChains[pFound->m_QueryParams.m_nHashIdx].AddToHead( pFound );
 		pFound->m_bSpeculativelyDone = false;
-		pFound->IssueQuery();
+		if ( bDeferQuery )
+		{
+			pFound->m_bResult = false;
+			pFound->m_hBlocker = NULL;
+			pFound->m_flLastUpdateTime = -FLT_MAX;
+		}
+		else
+		{
+			s_nNumSyncQueries++;
+			pFound->IssueQuery();
+		}
 	}
-	else
+	else if ( !bDeferQuery )
 	{
+		float flAge = gpGlobals->curtime - pFound->m_flLastUpdateTime;
 		if ( sv_disable_querycache.GetInt() || 
-			 ( gpGlobals->curtime - pFound->m_flLastUpdateTime >= 
-			   pFound->m_QueryParams.m_flMinimumUpdateInterval ) )
+			 ( flAge >= pFound->m_QueryParams.m_flMinimumUpdateInterval ) )
 		{
 			pFound->m_bSpeculativelyDone = false;
+			s_nNumSyncQueries++;
 			pFound->IssueQuery();
 		}
 		else
 		{
 			if ( pFound->m_bSpeculativelyDone )
 				s_SuccessfulSpeculatives++;
+			s_nNumCacheHits++;
+			s_flTotalHitAge += flAge;
+			s_flMaxHitAge = MAX( s_flMaxHitAge, flAge );
 		}
 		
 	}
@@ -274,11 +302,39 @@ void QueryCacheEntry_t::IssueQuery( void )
 			m_QueryParams.m_Type = EQUERY_INVALID;
 			s_HashChains[m_QueryParams.m_nHashIdx].RemoveNode( this );
 			s_VictimList.AddToHead( this );
+			m_bResult = false;
+			m_hBlocker = NULL;
 			return;
 		}
 		CalculateOffsettedPosition( pEntity, m_QueryParams.m_nOffsetMode[i],
 									&( m_QueryParams.m_Points[i] ) );
 	}
+	if ( m_QueryParams.m_Type == EQUERY_ENTITY_VISIBILITY )
+	{
+		CBaseEntity *pDestEntity = m_QueryParams.m_pEntities[1];
+		CTraceFilterLOS filter( m_QueryParams.m_pEntities[0], m_QueryParams.m_nCollisionGroup, pDestEntity );
+		trace_t result;
+		s_nNumCacheMisses++;
+		UTIL_TraceLine( m_QueryParams.m_Points[0], m_QueryParams.m_Points[1],
+						m_QueryParams.m_nTraceMask, &filter, &result );
+
+		// same acceptance rules as CBaseEntity::FVisible()
+		m_bResult = true;
+		m_hBlocker = NULL;
+		if ( result.fraction != 1.0 || result.startsolid )
+		{
+			CBaseEntity *pHit = result.m_pEnt;
+			if ( pHit != pDestEntity &&
+				 !( pDestEntity->IsPlayer() && pHit == ToBasePlayer( pDestEntity )->GetVehicleEntity() ) )
+			{
+				m_bResult = false;
+				m_hBlocker = pHit;
+			}
+		}
+		m_flLastUpdateTime = gpGlobals->curtime;
+		return;
+	}
+
 	CTraceFilterSimple filter( m_QueryParams.m_pEntities[2],
 							   m_QueryParams.m_nCollisionGroup,
 							   m_QueryParams.m_pTraceFilterFunction );
@@ -323,6 +379,65 @@ bool IsLineOfSightBetweenTwoEntitiesClear( CBaseEntity *pSrcEntity,
 }
 
 
+static void InitVisibilityKey( QueryCacheKey_t *pKey,
+							   CBaseEntity *pSrcEntity,
+							   CBaseEntity *pDestEntity,
+							   int nCollisionGroup,
+							   unsigned int nTraceMask,
+							   float flMinimumUpdateInterval )
+{
+	pKey->m_Type = EQUERY_ENTITY_VISIBILITY;
+	pKey->m_pEntities[0] = pSrcEntity;
+	pKey->m_pEntities[1] = pDestEntity;
+	pKey->m_pEntities[2] = NULL;
+	pKey->m_nOffsetMode[0] = EOFFSET_MODE_EYEPOSITION;
+	pKey->m_nOffsetMode[1] = EOFFSET_MODE_EYEPOSITION;
+	pKey->m_nOffsetMode[2] = EOFFSET_MODE_NONE;
+	pKey->m_nTraceMask = nTraceMask;
+	pKey->m_nNumValidPoints = 2;
+	pKey->m_nCollisionGroup = nCollisionGroup;
+	pKey->m_pTraceFilterFunction = NULL;
+	pKey->m_flMinimumUpdateInterval = flMinimumUpdateInterval;
+	pKey->ComputeHashIndex();
+}
+
+bool IsEntityVisibleFromEntity( CBaseEntity *pSrcEntity,
+								CBaseEntity *pDestEntity,
+								int nCollisionGroup,
+								unsigned int nTraceMask,
+								float flMinimumUpdateInterval,
+								CBaseEntity **ppBlocker )
+{
+	QueryCacheKey_t entry;
+	InitVisibilityKey( &entry, pSrcEntity, pDestEntity, nCollisionGroup, nTraceMask, flMinimumUpdateInterval );
+
+	s_nNumCacheQueries++;
+	QueryCacheEntry_t *pNode = FindOrAllocateCacheEntry( entry );
+	pNode->m_bUsedSinceUpdated = true;
+	if ( ppBlocker && !pNode->m_bResult )
+	{
+		*ppBlocker = pNode->m_hBlocker;
+	}
+	return pNode->m_bResult;
+}
+
+void PrefetchEntityVisibility( CBaseEntity *pSrcEntity,
+							   CBaseEntity *pDestEntity,
+							   int nCollisionGroup,
+							   unsigned int nTraceMask,
+							   float flMinimumUpdateInterval )
+{
+	if ( sv_disable_querycache.GetInt() )
+		return;
+
+	QueryCacheKey_t entry;
+	InitVisibilityKey( &entry, pSrcEntity, pDestEntity, nCollisionGroup, nTraceMask, flMinimumUpdateInterval );
+
+	QueryCacheEntry_t *pNode = FindOrAllocateCacheEntry( entry, true );
+	pNode->m_bUsedSinceUpdated = true;
+}
+
+
 #if defined( CLIENT_DLL )
 CON_COMMAND_F( cl_querycache_stats, "Display status of the query cache (client only)", FCVAR_CHEAT )
 #else
@@ -334,9 +449,24 @@ CON_COMMAND( sv_querycache_stats, "Display status of the query cache (client onl
 		return;
 #endif
 
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "clear" ) )
+	{
+		s_nNumCacheQueries = s_nNumCacheMisses = 0;
+		s_SuccessfulSpeculatives = s_WastedSpeculativeUpdates = 0;
+		s_nNumSyncQueries = s_nNumCacheHits = 0;
+		s_flTotalHitAge = s_flMaxHitAge = 0;
+		return;
+	}
+
 	Warning( "%d queries, %d misses (%d free) suc spec = %d wasted spec=%d\n",
 			 s_nNumCacheQueries, s_nNumCacheMisses, s_VictimList.Count(),
 			 s_SuccessfulSpeculatives, s_WastedSpeculativeUpdates );
+
+	// hits are answered without a trace on the calling thread; their age is how stale the answer was
+	Warning( "%d hits (%.1f%%), %d synchronous traces, staleness avg %.3fs max %.3fs\n",
+			 s_nNumCacheHits, ( s_nNumCacheQueries ) ? 100.0f * s_nNumCacheHits / s_nNumCacheQueries : 0.0f,
+			 s_nNumSyncQueries,
+			 ( s_nNumCacheHits ) ? s_flTotalHitAge / s_nNumCacheHits : 0.0f, s_flMaxHitAge );
 }
 
 
@@ -28,6 +28,7 @@ enum EQueryType_t
 	EQUERY_INVALID = 0,									// an invalid or unused entry
 	EQUERY_TRACELINE,
 	EQUERY_ENTITY_LOS_CHECK,
+	EQUERY_ENTITY_VISIBILITY,							// eye to eye, like CBaseEntity::FVisible()
 
 };
 
@@ -70,6 +71,7 @@ struct QueryCacheEntry_t
 	bool m_bUsedSinceUpdated;								// was this cell referenced?
 	bool m_bSpeculativelyDone;
 	bool m_bResult;											// for queries with a boolean result
+	EHANDLE m_hBlocker;										// what blocked a visibility query
 
 	void IssueQuery( void );
 
@@ -90,6 +92,47 @@ bool IsLineOfSightBetweenTwoEntitiesClear( CBaseEntity *pSrcEntity,
 
 
 
+// Eye to eye line of sight with the same trace and result as CBaseEntity::FVisible().
+bool IsEntityVisibleFromEntity( CBaseEntity *pSrcEntity,
+								CBaseEntity *pDestEntity,
+								int nCollisionGroup,
+								unsigned int nTraceMask,
+								float flMinimumUpdateInterval,
+								CBaseEntity **ppBlocker = NULL
+	);
+
+// Adds a visibility query without tracing it. It gets traced by the next
+// UpdateQueryCache(), so a later IsEntityVisibleFromEntity() with the same
+// parameters finds it ready.
+void PrefetchEntityVisibility( CBaseEntity *pSrcEntity,
+							   CBaseEntity *pDestEntity,
+							   int nCollisionGroup,
+							   unsigned int nTraceMask,
+							   float flMinimumUpdateInterval
+	);
+
+// While one of these is in scope, CBaseEntity::FVisible() answers plain line
+// of sight checks from the cache, accepting results up to the given age.
+extern float g_flQueryCacheVisibilityInterval;
+
+class CQueryCacheVisibilityScope
+{
+public:
+	CQueryCacheVisibilityScope( float flMinimumUpdateInterval )
+	{
+		m_flSavedInterval = g_flQueryCacheVisibilityInterval;
+		g_flQueryCacheVisibilityInterval = flMinimumUpdateInterval;
+	}
+
+	~CQueryCacheVisibilityScope()
+	{
+		g_flQueryCacheVisibilityInterval = m_flSavedInterval;
+	}
+
+private:
+	float m_flSavedInterval;
+};
+
 // call during main loop for threaded update of the query cache
 void UpdateQueryCache( void );
 
@@ -50,6 +50,13 @@ void CGMsg( int level, ConGroupID_t nGroup, PRINTF_FORMAT_STRING const tchar* pM
 
 #define CGWarning CGMsg
 
+// Whether a CGMsg() at this level and group would be printed.
+bool CGMsgActive( int level, ConGroupID_t nGroup );
+
+// CGMsg() that only evaluates its arguments when the message would be printed,
+// for hot paths whose arguments are expensive to build.
+#define CGMsgLazy( level, nGroup, ... )		do { if ( CGMsgActive( level, nGroup ) ) CGMsg( level, nGroup, __VA_ARGS__ ); } while ( 0 )
+
 //-----------------------------------------------------------------------------
 
 class IBaseFileSystem;
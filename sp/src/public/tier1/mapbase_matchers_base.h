@@ -20,6 +20,9 @@
 // szValue = The value that should be matched.
 bool Matcher_Regex( const char *pszQuery, const char *szValue );
 
+// Prints how well the compiled regex cache used by Matcher_Regex() is doing.
+void Matcher_PrintRegexCacheStats();
+
 // Compares two strings with support for wildcards or regex. This code is an expanded version of baseentity.cpp's NamesMatch().
 // pszQuery = The value that should have the wildcard.
 // szValue = The value tested against the query.
@@ -161,6 +161,17 @@ void SetConsoleGroupIncludeNames( bool bToggle )
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
+bool CGMsgActive( int level, ConGroupID_t nGroup )
+{
+	if (!IsSpewActive("developer", level))
+		return false;
+
+	Assert( nGroup >= 0 );
+	Assert( nGroup < CON_GROUP_MAX );
+
+	return !g_ConGroups[nGroup].bDisabled;
+}
+
 void CGMsg( int level, ConGroupID_t nGroup, const tchar* pMsg, ... )
 {
 	// Return early if we're not at this level
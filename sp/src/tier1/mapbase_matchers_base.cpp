@@ -7,6 +7,8 @@
 
 #include "mapbase_matchers_base.h"
 #include "convar.h"
+#include "utldict.h"
+#include "tier0/threadtools.h"
 
 // glibc (Linux) uses these tokens when including <regex>, so we must not #define them
 #undef max
@@ -18,6 +20,7 @@
 ConVar mapbase_wildcards_enabled("mapbase_wildcards_enabled", "1", FCVAR_NONE, "Toggles Mapbase's '?' wildcard and true '*' features. Useful for maps that have '?' in their targetnames.");
 ConVar mapbase_wildcards_lazy_hack("mapbase_wildcards_lazy_hack", "1", FCVAR_NONE, "Toggles a hack which prevents Mapbase's lazy '?' wildcards from picking up \"???\", the default instance parameter.");
 ConVar mapbase_regex_enabled("mapbase_regex_enabled", "1", FCVAR_NONE, "Toggles Mapbase's regex matching handover.");
+ConVar mapbase_regex_cache_size("mapbase_regex_cache_size", "256", FCVAR_NONE, "How many compiled regular expressions Mapbase keeps around. The cache is emptied when it fills up.");
 
 //=============================================================================
 // These are the "matchers" that compare with wildcards ("any*" for text starting with "any")
@@ -78,23 +81,68 @@ bool Matcher_RunCharCompare(const char *pszQuery, const char *szValue)
 	return ( ( *pszQuery == 0 && *szValue == 0 ) || *pszQuery == '*' );
 }
 
+//-----------------------------------------------------------------------------
+// Compiling a std::regex is far more expensive than running it, and the same
+// handful of patterns gets matched over and over by filters and triggers, so
+// compiled expressions are kept by query text. Invalid patterns are cached too
+// so they don't get recompiled (and re-reported) on every call.
+//-----------------------------------------------------------------------------
+struct CompiledRegex_t
+{
+	std::regex	regex;
+	bool		bValid;
+};
+
+static CUtlDict<CompiledRegex_t*, unsigned short> g_RegexCache( k_eDictCompareTypeCaseSensitive );
+static CThreadFastMutex g_RegexCacheMutex;
+static int g_nRegexCacheHits = 0;
+static int g_nRegexCacheMisses = 0;
+static int g_nRegexCacheFlushes = 0;
+
 // Regular expressions based off of the std library.
 // The C++ is strong in this one.
 bool Matcher_Regex(const char *pszQuery, const char *szValue)
 {
-	std::regex regex;
-	
-	// Since I can't find any other way to check for valid regex,
-	// use a try-catch here to see if it throws an exception.
-	try { regex = std::regex(pszQuery); }
-	catch (std::regex_error &e)
+	// std::regex_match only reads the expression, but the cache itself can be
+	// flushed by another thread, so hold the lock for the whole match.
+	AUTO_LOCK( g_RegexCacheMutex );
+
+	unsigned short i = g_RegexCache.Find( pszQuery );
+	if (i == g_RegexCache.InvalidIndex())
 	{
-		Msg("Invalid regex \"%s\" (%s)\n", pszQuery, e.what());
-		return false;
+		g_nRegexCacheMisses++;
+
+		if (g_RegexCache.Count() >= MAX( mapbase_regex_cache_size.GetInt(), 1 ))
+		{
+			g_RegexCache.PurgeAndDeleteElements();
+			g_nRegexCacheFlushes++;
+		}
+
+		CompiledRegex_t *pCompiled = new CompiledRegex_t;
+		pCompiled->bValid = true;
+
+		// Since I can't find any other way to check for valid regex,
+		// use a try-catch here to see if it throws an exception.
+		try { pCompiled->regex = std::regex(pszQuery); }
+		catch (std::regex_error &e)
+		{
+			Msg("Invalid regex \"%s\" (%s)\n", pszQuery, e.what());
+			pCompiled->bValid = false;
+		}
+
+		i = g_RegexCache.Insert( pszQuery, pCompiled );
 	}
+	else
+	{
+		g_nRegexCacheHits++;
+	}
+
+	const CompiledRegex_t *pCompiled = g_RegexCache[i];
+	if (!pCompiled->bValid)
+		return false;
 
 	std::match_results<const char*> results;
-	bool bMatch = std::regex_match( szValue, results, regex );
+	bool bMatch = std::regex_match( szValue, results, pCompiled->regex );
 	if (!bMatch)
 		return false;
 
@@ -102,6 +150,18 @@ bool Matcher_Regex(const char *pszQuery, const char *szValue)
 	return Q_strlen(results.str(0).c_str()) == Q_strlen(szValue);
 }
 
+// tier1 is linked into both the client and the server, so the console command
+// for this lives in game code.
+void Matcher_PrintRegexCacheStats()
+{
+	AUTO_LOCK( g_RegexCacheMutex );
+
+	int nLookups = g_nRegexCacheHits + g_nRegexCacheMisses;
+	Msg( "Regex cache: %d/%d entries, %d hits, %d misses (%.1f%% hit rate), %d flushes\n",
+		g_RegexCache.Count(), mapbase_regex_cache_size.GetInt(), g_nRegexCacheHits, g_nRegexCacheMisses,
+		nLookups > 0 ? 100.0f * (float)g_nRegexCacheHits / (float)nLookups : 0.0f, g_nRegexCacheFlushes );
+}
+
 // The entry point for Mapbase's modified version of Valve's NamesMatch().
 bool Matcher_NamesMatch(const char *pszQuery, const char *szValue)
 {